@@ -4,9 +4,12 @@
 #include "worker/storage_tier.h"
 #include <benchmark/benchmark.h>
 
+#include <chrono>
 #include <cstring>
 #include <filesystem>
+#include <memory>
 #include <random>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -50,6 +53,177 @@ static void BM_MemoryTierRead(benchmark::State &state) {
 }
 BENCHMARK(BM_MemoryTierRead)->Arg(4096)->Arg(65536)->Arg(1048576);
 
+// Allocation throughput under a create/remove mix: keep a small window of live
+// blocks and retire the oldest one for every new allocation.
+static void BM_MemoryTierAllocChurn(benchmark::State &state) {
+  anycache::StorageTier tier(anycache::TierType::kMemory, "",
+                             256 * 1024 * 1024);
+  size_t block_size = state.range(0);
+  constexpr uint64_t kLiveBlocks = 3;
+
+  anycache::BlockHandle handle;
+  uint64_t next_id = 1;
+  for (auto _ : state) {
+    tier.AllocateBlock(next_id, block_size, &handle);
+    if (next_id > kLiveBlocks) {
+      tier.RemoveBlock(next_id - kLiveBlocks);
+    }
+    next_id++;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["internal_frag"] =
+      tier.GetArenaStats().InternalFragmentation();
+}
+BENCHMARK(BM_MemoryTierAllocChurn)
+    ->Arg(4096)
+    ->Arg(1048576)
+    ->Arg(48 * 1024 * 1024);
+
+// Random 4 KB reads scattered over 4 x 64 MB blocks: TLB-bound on base
+// pages. Arg: 0 = base pages, 1 = huge pages (hugetlb or THP)
+static void BM_MemoryTierHugePageScan(benchmark::State &state) {
+  constexpr int kBlocks = 4;
+  constexpr size_t kBlockSize = 64 * 1024 * 1024;
+  anycache::TierConfig tc;
+  tc.type = anycache::TierType::kMemory;
+  tc.capacity_bytes = kBlocks * kBlockSize;
+  tc.huge_pages = state.range(0) != 0;
+  anycache::StorageTier tier(tc);
+  state.SetLabel(tier.GetPageMode() == anycache::MemArena::PageMode::kDefault
+                     ? "base"
+                     : "huge");
+
+  std::vector<char> data(kBlockSize, 'x');
+  anycache::BlockHandle handle;
+  for (int i = 1; i <= kBlocks; ++i) {
+    tier.AllocateBlock(i, kBlockSize, &handle);
+    tier.WriteBlock(i, data.data(), kBlockSize, 0);
+  }
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> block_dist(1, kBlocks);
+  std::uniform_int_distribution<size_t> page_dist(0, kBlockSize / 4096 - 1);
+  char buf[256];
+  for (auto _ : state) {
+    tier.ReadBlock(block_dist(rng), buf, sizeof(buf),
+                   static_cast<off_t>(page_dist(rng) * 4096));
+    benchmark::DoNotOptimize(buf);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryTierHugePageScan)->Arg(0)->Arg(1);
+
+// Random 4 KB reads of a shared memory tier from 1..8 threads; read
+// throughput should scale with threads since reads take no tier-wide lock
+static std::unique_ptr<anycache::StorageTier> g_shared_tier;
+
+static void BM_MemoryTierConcurrentRead(benchmark::State &state) {
+  constexpr int kBlocks = 1024;
+  constexpr size_t kBlockSize = 64 * 1024;
+  if (state.thread_index() == 0) {
+    g_shared_tier = std::make_unique<anycache::StorageTier>(
+        anycache::TierType::kMemory, "", kBlocks * kBlockSize);
+    std::vector<char> data(kBlockSize, 'x');
+    anycache::BlockHandle handle;
+    for (int i = 1; i <= kBlocks; ++i) {
+      g_shared_tier->AllocateBlock(i, kBlockSize, &handle);
+      g_shared_tier->WriteBlock(i, data.data(), data.size(), 0);
+    }
+  }
+
+  std::mt19937 rng(42 + state.thread_index());
+  std::uniform_int_distribution<int> block_dist(1, kBlocks);
+  std::uniform_int_distribution<int> page_dist(0, kBlockSize / 4096 - 1);
+  char buf[4096];
+  for (auto _ : state) {
+    g_shared_tier->ReadBlock(block_dist(rng), buf, sizeof(buf),
+                             static_cast<off_t>(page_dist(rng)) * 4096);
+    benchmark::DoNotOptimize(buf);
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    g_shared_tier.reset();
+  }
+}
+BENCHMARK(BM_MemoryTierConcurrentRead)->ThreadRange(1, 8)->UseRealTime();
+
+// Random 4 KB reads across many SSD-tier blocks; exercises the fd cache
+static void BM_DiskTierRandomRead(benchmark::State &state) {
+  fs::path dir = fs::temp_directory_path() / "anycache_bench_disk";
+  fs::remove_all(dir);
+  anycache::TierConfig tc;
+  tc.type = anycache::TierType::kSSD;
+  tc.path = dir.string();
+  tc.capacity_bytes = 256 * 1024 * 1024;
+  tc.max_open_files = state.range(0);
+  {
+    anycache::StorageTier tier(tc);
+    constexpr int kBlocks = 256;
+    constexpr size_t kBlockSize = 256 * 1024;
+    anycache::BlockHandle handle;
+    for (int i = 1; i <= kBlocks; ++i) {
+      tier.AllocateBlock(i, kBlockSize, &handle);
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> block_dist(1, kBlocks);
+    std::uniform_int_distribution<int> page_dist(0, kBlockSize / 4096 - 1);
+    char buf[4096];
+    for (auto _ : state) {
+      tier.ReadBlock(block_dist(rng), buf, sizeof(buf),
+                     static_cast<off_t>(page_dist(rng)) * 4096);
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+  fs::remove_all(dir);
+}
+// 0 = fd cache disabled (open + pread + close per read)
+BENCHMARK(BM_DiskTierRandomRead)->Arg(0)->Arg(1024);
+
+// Batches of 32 random 4 KB reads through ReadBlocks; compares the sync
+// engine (one pread at a time) with io_uring (whole batch in flight)
+static void BM_DiskTierBatchRead(benchmark::State &state) {
+  fs::path dir = fs::temp_directory_path() / "anycache_bench_batch";
+  fs::remove_all(dir);
+  anycache::TierConfig tc;
+  tc.type = anycache::TierType::kSSD;
+  tc.path = dir.string();
+  tc.capacity_bytes = 256 * 1024 * 1024;
+  tc.io_engine = static_cast<anycache::IoEngineType>(state.range(0));
+  tc.io_queue_depth = 64;
+  {
+    anycache::StorageTier tier(tc);
+    state.SetLabel(tier.GetIoEngineName());
+    constexpr int kBlocks = 256;
+    constexpr size_t kBlockSize = 256 * 1024;
+    constexpr size_t kBatch = 32;
+    anycache::BlockHandle handle;
+    for (int i = 1; i <= kBlocks; ++i) {
+      tier.AllocateBlock(i, kBlockSize, &handle);
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> block_dist(1, kBlocks);
+    std::uniform_int_distribution<int> page_dist(0, kBlockSize / 4096 - 1);
+    std::vector<char> bufs(kBatch * 4096);
+    std::vector<anycache::BlockIo> ios(kBatch);
+    for (auto _ : state) {
+      for (size_t i = 0; i < kBatch; ++i) {
+        ios[i].block_id = block_dist(rng);
+        ios[i].buf = bufs.data() + i * 4096;
+        ios[i].size = 4096;
+        ios[i].offset = static_cast<off_t>(page_dist(rng)) * 4096;
+      }
+      tier.ReadBlocks(ios);
+    }
+    state.SetItemsProcessed(state.iterations() * kBatch);
+  }
+  fs::remove_all(dir);
+}
+// 0 = sync, 1 = io_uring
+BENCHMARK(BM_DiskTierBatchRead)->Arg(0)->Arg(1);
+
 // ─── CacheManager LRU benchmarks ────────────────────────────
 
 static void BM_LRU_Insert(benchmark::State &state) {
@@ -89,6 +263,82 @@ static void BM_LRU_Evict(benchmark::State &state) {
 }
 BENCHMARK(BM_LRU_Evict);
 
+// ─── Eviction policy comparison ──────────────────────────────
+// Arg(0) = policy (CacheManager::PolicyType), Arg(1) = cached blocks.
+
+static void SetPolicyLabel(benchmark::State &state) {
+  static const char *kNames[] = {"LRU", "LFU", "ARC", "2Q", "S3FIFO",
+                                 "GDSF"};
+  state.SetLabel(kNames[state.range(0)]);
+}
+
+// Skewed hits: a few hot blocks take most accesses, so most blocks stay at a
+// low frequency (the case that used to make LFU accesses linear)
+static void BM_Policy_Access(benchmark::State &state) {
+  anycache::CacheManager mgr(
+      static_cast<anycache::CacheManager::PolicyType>(state.range(0)));
+  int n = state.range(1);
+  for (int i = 1; i <= n; ++i)
+    mgr.OnBlockInsert(i, 4096);
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> all(1, n);
+  std::uniform_int_distribution<int> hot(1, std::max(1, n / 100));
+  for (auto _ : state) {
+    mgr.OnBlockAccess(rng() % 10 < 8 ? hot(rng) : all(rng));
+  }
+  SetPolicyLabel(state);
+}
+BENCHMARK(BM_Policy_Access)
+    ->ArgsProduct({{0, 1, 2, 3, 4, 5}, {10000, 100000}});
+
+// Full cache: every new block evicts one
+static void BM_Policy_InsertEvict(benchmark::State &state) {
+  anycache::CacheManager mgr(
+      static_cast<anycache::CacheManager::PolicyType>(state.range(0)));
+  int n = state.range(1);
+  for (int i = 1; i <= n; ++i)
+    mgr.OnBlockInsert(i, 4096);
+
+  std::mt19937 rng(42);
+  uint64_t next_id = n + 1;
+  for (auto _ : state) {
+    // Half re-reference recent victims so ghost lists see hits
+    uint64_t id = rng() % 2 ? next_id++ : next_id - 1 - rng() % (n / 2);
+    mgr.OnBlockInsert(id, 4096);
+    mgr.GetEvictionCandidates(4096);
+  }
+  SetPolicyLabel(state);
+}
+BENCHMARK(BM_Policy_InsertEvict)
+    ->ArgsProduct({{0, 1, 2, 3, 4, 5}, {10000, 100000}});
+
+// Readers of one CacheManager on many threads; Arg = lock shards
+static std::unique_ptr<anycache::CacheManager> g_shared_mgr;
+
+static void BM_CacheManager_ConcurrentAccess(benchmark::State &state) {
+  constexpr int kBlocks = 100000;
+  if (state.thread_index() == 0) {
+    g_shared_mgr = std::make_unique<anycache::CacheManager>(
+        anycache::CacheManager::PolicyType::kLRU, anycache::AdmissionOptions{},
+        state.range(0));
+    for (int i = 1; i <= kBlocks; ++i)
+      g_shared_mgr->OnBlockInsert(i, 4096);
+  }
+  std::mt19937 rng(42 + state.thread_index());
+  std::uniform_int_distribution<int> all(1, kBlocks);
+  for (auto _ : state) {
+    g_shared_mgr->OnBlockAccess(all(rng));
+  }
+  if (state.thread_index() == 0)
+    g_shared_mgr.reset();
+}
+BENCHMARK(BM_CacheManager_ConcurrentAccess)
+    ->Arg(1)
+    ->Arg(16)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
 // ─── PageStore benchmarks ────────────────────────────────────
 
 static void BM_PageStoreWrite(benchmark::State &state) {
@@ -126,6 +376,69 @@ static void BM_PageStoreRead(benchmark::State &state) {
 }
 BENCHMARK(BM_PageStoreRead);
 
+// Page hits of one PageStore on many threads; Args = {lock shards, CLOCK}
+static std::unique_ptr<anycache::PageStore> g_shared_pages;
+
+static void BM_PageStore_ConcurrentHit(benchmark::State &state) {
+  constexpr int kPages = 4096;
+  constexpr size_t kPageSize = 4096;
+  if (state.thread_index() == 0) {
+    g_shared_pages = std::make_unique<anycache::PageStore>(
+        kPageSize, kPages, state.range(0),
+        state.range(1) ? anycache::PageEvictionMode::kClock
+                       : anycache::PageEvictionMode::kLRU);
+    std::vector<char> data(kPageSize, 'a');
+    for (int i = 0; i < kPages; ++i)
+      g_shared_pages->WritePage(1, i, data.data(), data.size());
+  }
+  std::mt19937 rng(42 + state.thread_index());
+  std::uniform_int_distribution<int> dist(0, kPages - 1);
+  std::vector<char> buf(kPageSize);
+  size_t bytes_read;
+  for (auto _ : state) {
+    g_shared_pages->ReadPage(1, dist(rng), buf.data(), &bytes_read);
+  }
+  state.SetBytesProcessed(state.iterations() * kPageSize);
+  state.SetLabel(state.range(1) ? "clock" : "lru");
+  if (state.thread_index() == 0)
+    g_shared_pages.reset();
+}
+BENCHMARK(BM_PageStore_ConcurrentHit)
+    ->Args({1, 0})
+    ->Args({16, 0})
+    ->Args({16, 1})
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+// Cold sequential scan against a backing store with a 200us round trip per
+// page; Arg = read-ahead window cap in pages (0 = off)
+static void BM_PageStore_ColdScan(benchmark::State &state) {
+  constexpr size_t kPageSize = 4096;
+  anycache::PageStore::Options opts;
+  opts.page_size = kPageSize;
+  opts.max_pages = 1 << 16;
+  opts.prefetch_threads = 8;
+  opts.prefetch_queue_limit = 1024;
+  opts.readahead_max_pages = state.range(0);
+  anycache::PageStore store(opts);
+  store.SetPageFetcher([](anycache::FileId, uint64_t, void *buf,
+                          size_t *bytes_read) -> anycache::Status {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    std::memset(buf, 'a', kPageSize);
+    *bytes_read = kPageSize;
+    return anycache::Status::OK();
+  });
+
+  std::vector<char> buf(kPageSize);
+  size_t bytes_read;
+  uint64_t page = 0;
+  for (auto _ : state) {
+    store.ReadPage(1, page++, buf.data(), &bytes_read);
+  }
+  state.SetBytesProcessed(state.iterations() * kPageSize);
+}
+BENCHMARK(BM_PageStore_ColdScan)->Arg(0)->Arg(64)->UseRealTime();
+
 // ─── BlockStore benchmarks ───────────────────────────────────
 
 static void BM_BlockStoreCreateWrite(benchmark::State &state) {
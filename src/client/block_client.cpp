@@ -22,10 +22,22 @@ void BlockClient::SetDeadline(grpc::ClientContext &ctx) const {
 
 Status BlockClient::ReadBlock(BlockId id, void *buf, size_t size,
                               off_t offset) {
+  return ReadBlockThrough(id, buf, size, offset, "", 0, 0);
+}
+
+Status BlockClient::ReadBlockThrough(BlockId id, void *buf, size_t size,
+                                     off_t offset, const std::string &ufs_path,
+                                     uint64_t offset_in_ufs,
+                                     uint64_t block_length) {
   proto::ReadBlockRequest req;
   req.set_block_id(id);
   req.set_offset(static_cast<uint64_t>(offset));
   req.set_length(size);
+  if (!ufs_path.empty()) {
+    req.set_ufs_path(ufs_path);
+    req.set_offset_in_ufs(offset_in_ufs);
+    req.set_block_length(block_length);
+  }
 
   proto::ReadBlockResponse resp;
   grpc::ClientContext ctx;
@@ -33,6 +33,11 @@ public:
       std::chrono::milliseconds timeout = std::chrono::milliseconds(30000));
 
   Status ReadBlock(BlockId id, void *buf, size_t size, off_t offset);
+  // Read-through: the worker caches the block partially (block_length bytes
+  // starting at offset_in_ufs of ufs_path) and fetches only missing pages
+  Status ReadBlockThrough(BlockId id, void *buf, size_t size, off_t offset,
+                          const std::string &ufs_path, uint64_t offset_in_ufs,
+                          uint64_t block_length);
   Status WriteBlock(BlockId id, const void *buf, size_t size, off_t offset);
   Status RemoveBlock(BlockId id);
 
@@ -59,6 +59,38 @@ Config Config::LoadFromYAML(const YAML::Node &root) {
       cfg.worker.block_size = worker["block_size"].as<size_t>();
     if (worker["metrics_port"])
       cfg.worker.metrics_port = worker["metrics_port"].as<int>();
+    if (worker["demote_on_evict"])
+      cfg.worker.demote_on_evict = worker["demote_on_evict"].as<bool>();
+    if (worker["demote_bandwidth_bytes_per_sec"])
+      cfg.worker.demote_bandwidth_bytes_per_sec =
+          worker["demote_bandwidth_bytes_per_sec"].as<uint64_t>();
+    if (worker["cache_policy"])
+      cfg.worker.cache_policy = worker["cache_policy"].as<std::string>();
+    if (worker["cache_admission"])
+      cfg.worker.cache_admission = worker["cache_admission"].as<bool>();
+    if (worker["cache_shards"])
+      cfg.worker.cache_shards = worker["cache_shards"].as<size_t>();
+    if (worker["mrc_sample_rate"])
+      cfg.worker.mrc_sample_rate = worker["mrc_sample_rate"].as<double>();
+    if (worker["page_cache_shards"])
+      cfg.worker.page_cache_shards = worker["page_cache_shards"].as<size_t>();
+    if (worker["page_cache_clock"])
+      cfg.worker.page_cache_clock = worker["page_cache_clock"].as<bool>();
+    if (worker["page_prefetch_threads"])
+      cfg.worker.page_prefetch_threads =
+          worker["page_prefetch_threads"].as<size_t>();
+    if (worker["page_prefetch_queue_limit"])
+      cfg.worker.page_prefetch_queue_limit =
+          worker["page_prefetch_queue_limit"].as<size_t>();
+    if (worker["page_readahead_max_pages"])
+      cfg.worker.page_readahead_max_pages =
+          worker["page_readahead_max_pages"].as<size_t>();
+    if (worker["memory_spill_dir"])
+      cfg.worker.memory_spill_dir =
+          worker["memory_spill_dir"].as<std::string>();
+    if (worker["memory_spill_timeout_ms"])
+      cfg.worker.memory_spill_timeout_ms =
+          worker["memory_spill_timeout_ms"].as<uint32_t>();
 
     if (auto tiers = worker["tiers"]) {
       cfg.worker.tiers.clear();
@@ -73,6 +105,30 @@ Config Config::LoadFromYAML(const YAML::Node &root) {
           tc.type = TierType::kHDD;
         tc.path = t["path"].as<std::string>("/tmp/anycache/data");
         tc.capacity_bytes = t["capacity_bytes"].as<size_t>(1073741824ULL);
+        if (t["max_open_files"])
+          tc.max_open_files = t["max_open_files"].as<size_t>();
+        if (t["io_engine"]) {
+          std::string engine = t["io_engine"].as<std::string>();
+          tc.io_engine = engine == "io_uring" ? IoEngineType::kIoUring
+                                              : IoEngineType::kSync;
+        }
+        if (t["io_queue_depth"])
+          tc.io_queue_depth = t["io_queue_depth"].as<uint32_t>();
+        if (t["direct_io"])
+          tc.direct_io = t["direct_io"].as<bool>();
+        if (t["disk_layout"]) {
+          std::string layout = t["disk_layout"].as<std::string>();
+          tc.disk_layout = layout == "segment" ? DiskLayout::kSegment
+                                               : DiskLayout::kFilePerBlock;
+        }
+        if (t["segment_bytes"])
+          tc.segment_bytes = t["segment_bytes"].as<size_t>();
+        if (t["compact_dead_ratio"])
+          tc.compact_dead_ratio = t["compact_dead_ratio"].as<double>();
+        if (t["huge_pages"])
+          tc.huge_pages = t["huge_pages"].as<bool>();
+        if (t["numa_aware"])
+          tc.numa_aware = t["numa_aware"].as<bool>();
         cfg.worker.tiers.push_back(tc);
       }
     }
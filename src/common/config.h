@@ -8,10 +8,37 @@
 
 namespace anycache {
 
+// I/O backend for disk tiers
+enum class IoEngineType : uint8_t {
+  kSync = 0,    // pread/pwrite on the calling thread
+  kIoUring = 1, // batched io_uring submission; falls back to kSync
+};
+
+enum class DiskLayout : uint8_t {
+  kFilePerBlock = 0, // one file per block
+  kSegment = 1,      // blocks appended to large segment files
+};
+
 struct TierConfig {
-  TierType type;
+  TierType type = TierType::kMemory;
   std::string path;
-  size_t capacity_bytes;
+  size_t capacity_bytes = 0;
+  // Disk tiers: max block file descriptors kept open (LRU); 0 = no caching
+  size_t max_open_files = 1024;
+  // Disk tiers: I/O backend and its queue depth (io_uring ring entries)
+  IoEngineType io_engine = IoEngineType::kSync;
+  uint32_t io_queue_depth = 64;
+  // Disk tiers: open block files with O_DIRECT, bypassing the page cache
+  bool direct_io = false;
+  // Disk tiers: block layout; segment size and the dead-space ratio at which
+  // a sealed segment is compacted (segment layout only)
+  DiskLayout disk_layout = DiskLayout::kFilePerBlock;
+  size_t segment_bytes = 1ULL << 30;
+  double compact_dead_ratio = 0.5;
+  // Memory tier: back the arena with 2 MB pages (hugetlb, else THP)
+  bool huge_pages = false;
+  // Memory tier: split capacity per NUMA node, allocate node-local
+  bool numa_aware = false;
 };
 
 struct WorkerConfig {
@@ -22,6 +49,36 @@ struct WorkerConfig {
   size_t page_size = kDefaultPageSize;
   size_t block_size = kDefaultBlockSize;
   int metrics_port = 9202; // Prometheus /metrics HTTP port; 0 = disabled
+  // Evicted blocks move to the next slower tier instead of being dropped;
+  // background demotion is limited to this many bytes/s (0 = unlimited)
+  bool demote_on_evict = false;
+  uint64_t demote_bandwidth_bytes_per_sec = 0;
+  // Per-tier eviction policy: LRU | LFU | ARC | 2Q | S3FIFO | GDSF (weighs
+  // measured UFS refetch time and block size)
+  std::string cache_policy = "LRU";
+  // W-TinyLFU admission: new blocks must out-rank eviction victims by
+  // estimated access frequency to stay cached once a tier is full
+  bool cache_admission = false;
+  // Lock shards per tier's cache bookkeeping (reads of blocks in different
+  // shards never contend)
+  size_t cache_shards = 16;
+  // Share of blocks sampled for each tier's miss-ratio curve (hit ratio at
+  // 0.5x-4x its capacity, in /metrics and GetWorkerStatus); 0 = off
+  double mrc_sample_rate = 0.01;
+  // Lock shards of the page cache, and CLOCK instead of exact LRU so page
+  // hits only take a shard's read lock
+  size_t page_cache_shards = 16;
+  bool page_cache_clock = false;
+  // Background threads for page prefetch hints (0 = on the caller's thread)
+  // and the most pages waiting for them
+  size_t page_prefetch_threads = 2;
+  size_t page_prefetch_queue_limit = 256;
+  // Largest sequential read-ahead window in pages (0 = no read-ahead)
+  size_t page_readahead_max_pages = 64;
+  // Graceful stop spills memory-tier blocks here and startup re-imports them
+  // (empty = the memory tier starts cold); spilling gives up after the timeout
+  std::string memory_spill_dir;
+  uint32_t memory_spill_timeout_ms = 30000;
 };
 
 struct MasterConfig {
@@ -0,0 +1,103 @@
+#include "worker/aligned_buffer_pool.h"
+#include "common/logging.h"
+#include "common/metrics.h"
+
+#include <cstdlib>
+#include <sys/mman.h>
+
+namespace anycache {
+
+// ─── Buffer ──────────────────────────────────────────────────
+AlignedBufferPool::Buffer &
+AlignedBufferPool::Buffer::operator=(Buffer &&other) noexcept {
+  if (this != &other) {
+    Release();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    size_ = other.size_;
+    pooled_ = other.pooled_;
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.pooled_ = false;
+  }
+  return *this;
+}
+
+void AlignedBufferPool::Buffer::Release() {
+  if (!data_)
+    return;
+  if (pooled_)
+    pool_->Return(data_);
+  else
+    std::free(data_);
+  data_ = nullptr;
+}
+
+// ─── Pool ────────────────────────────────────────────────────
+AlignedBufferPool::AlignedBufferPool(size_t buffer_size, size_t count)
+    : buffer_size_(AlignUp(buffer_size)) {
+  if (count == 0 || buffer_size_ == 0)
+    return;
+
+  size_t bytes = buffer_size_ * count;
+  void *p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    LOG_WARN("AlignedBufferPool: mmap of {} bytes failed, using heap only",
+             bytes);
+    return;
+  }
+  region_ = static_cast<char *>(p);
+  region_bytes_ = bytes;
+  free_.reserve(count);
+  for (size_t i = count; i > 0; --i)
+    free_.push_back(region_ + (i - 1) * buffer_size_);
+  stats_.buffers = count;
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+  if (region_)
+    ::munmap(region_, region_bytes_);
+}
+
+AlignedBufferPool::Buffer AlignedBufferPool::Acquire(size_t size) {
+  Buffer buf;
+  buf.pool_ = this;
+  buf.size_ = AlignUp(size);
+  if (buf.size_ <= buffer_size_) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!free_.empty()) {
+      buf.data_ = free_.back();
+      buf.pooled_ = true;
+      free_.pop_back();
+      stats_.in_use++;
+      return buf;
+    }
+  }
+
+  // Oversized request or pool exhausted
+  void *p = nullptr;
+  if (::posix_memalign(&p, kAlignment, buf.size_) != 0)
+    return Buffer{};
+  buf.data_ = static_cast<char *>(p);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stats_.heap_fallbacks++;
+  }
+  Metrics::Instance().IncrCounter("storage_tier.direct_io.pool_fallbacks");
+  return buf;
+}
+
+void AlignedBufferPool::Return(char *data) {
+  std::lock_guard<std::mutex> lock(mu_);
+  free_.push_back(data);
+  stats_.in_use--;
+}
+
+AlignedBufferPool::Stats AlignedBufferPool::GetStats() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return stats_;
+}
+
+} // namespace anycache
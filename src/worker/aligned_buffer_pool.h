@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sys/uio.h>
+#include <vector>
+
+namespace anycache {
+
+// AlignedBufferPool hands out bounce buffers for O_DIRECT I/O. The pool is
+// one mmap'd region split into `count` buffers of `buffer_size` bytes, so the
+// whole pool can be registered with an IoEngine as a single fixed buffer.
+// Requests that do not fit a pooled buffer (or arrive while all are in use)
+// get a one-off aligned heap buffer instead of blocking.
+class AlignedBufferPool {
+public:
+  // O_DIRECT alignment for buffers, offsets and lengths. 4 KB satisfies both
+  // 512-byte and 4K-native devices.
+  static constexpr size_t kAlignment = 4096;
+
+  static size_t AlignDown(size_t v) { return v & ~(kAlignment - 1); }
+  static size_t AlignUp(size_t v) { return AlignDown(v + kAlignment - 1); }
+  static bool IsAligned(uint64_t v) { return (v & (kAlignment - 1)) == 0; }
+
+  // RAII lease on one buffer; returned to the pool (or freed) on destruction.
+  class Buffer {
+  public:
+    Buffer() = default;
+    Buffer(Buffer &&other) noexcept { *this = std::move(other); }
+    Buffer &operator=(Buffer &&other) noexcept;
+    ~Buffer() { Release(); }
+
+    char *data() const { return data_; }
+    size_t size() const { return size_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+  private:
+    friend class AlignedBufferPool;
+    void Release();
+
+    AlignedBufferPool *pool_ = nullptr;
+    char *data_ = nullptr;
+    size_t size_ = 0;
+    bool pooled_ = false;
+  };
+
+  struct Stats {
+    size_t buffers = 0;        // pooled buffers
+    size_t in_use = 0;         // pooled buffers currently leased
+    uint64_t heap_fallbacks = 0; // leases served by a one-off allocation
+  };
+
+  // `buffer_size` is rounded up to kAlignment.
+  AlignedBufferPool(size_t buffer_size, size_t count);
+  ~AlignedBufferPool();
+
+  AlignedBufferPool(const AlignedBufferPool &) = delete;
+  AlignedBufferPool &operator=(const AlignedBufferPool &) = delete;
+
+  // Lease an aligned buffer of at least `size` bytes (rounded up to
+  // kAlignment). Returns an empty Buffer only if allocation fails.
+  Buffer Acquire(size_t size);
+
+  // The pooled region, for IoEngine::RegisterBuffers(). Empty if mmap failed.
+  iovec Region() const { return {region_, region_bytes_}; }
+
+  size_t GetBufferSize() const { return buffer_size_; }
+  Stats GetStats() const;
+
+private:
+  void Return(char *data);
+
+  size_t buffer_size_;
+  char *region_ = nullptr;
+  size_t region_bytes_ = 0;
+
+  mutable std::mutex mu_;
+  std::vector<char *> free_;
+  Stats stats_;
+};
+
+} // namespace anycache
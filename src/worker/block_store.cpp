@@ -1,8 +1,16 @@
 #include "worker/block_store.h"
 #include "common/logging.h"
 #include "common/metrics.h"
+#include "worker/index_snapshot.h"
 
+#include <algorithm>
+#include <bit>
 #include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <thread>
+#include <unordered_set>
 
 namespace anycache {
 
@@ -12,59 +20,132 @@ static int64_t NowMs() {
       .count();
 }
 
+// Blocks copied per mu_ hold while writing an index snapshot
+static constexpr size_t kSnapshotChunk = 4096;
+// Stored blocks a recovery thread reconciles per work item
+static constexpr size_t kRecoverChunk = 1024;
+
+// Snapshot records keep refetch costs in 32 bits (over an hour)
+static uint32_t SaturateCost(uint64_t cost_us) {
+  return static_cast<uint32_t>(
+      std::min<uint64_t>(cost_us, std::numeric_limits<uint32_t>::max()));
+}
+
 BlockStore::BlockStore(const Options &opts) : opts_(opts) {
   // Create storage tiers
   for (auto &tc : opts.tiers) {
-    tiers_.push_back(
-        std::make_unique<StorageTier>(tc.type, tc.path, tc.capacity_bytes));
+    tiers_.push_back(std::make_unique<StorageTier>(tc));
   }
   // Sort tiers: Memory first, then SSD, then HDD
   std::sort(tiers_.begin(), tiers_.end(), [](const auto &a, const auto &b) {
     return static_cast<int>(a->GetType()) < static_cast<int>(b->GetType());
   });
 
-  cache_mgr_ = std::make_unique<CacheManager>(opts.cache_policy);
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    AdmissionOptions admission;
+    admission.enabled = opts.cache_admission;
+    admission.capacity_bytes = static_cast<size_t>(
+        tiers_[i]->GetCapacity() * opts.auto_evict_high_watermark);
+    admission.window_ratio = opts.admission_window_ratio;
+    cache_mgrs_.push_back(
+        std::make_unique<CacheManager>(opts.cache_policy, admission,
+                                       opts.cache_shards));
+    if (opts.mrc_sample_rate > 0)
+      cache_mgrs_.back()->EnableMissRatioCurve(tiers_[i]->GetCapacity(),
+                                               opts.mrc_sample_rate);
+  }
   meta_store_ = MetaStore::Create(opts.meta_db_path);
+
+  reclaimers_.resize(tiers_.size());
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    reclaimers_[i].thread = std::thread([this, i] { ReclaimLoop(i); });
+  }
+  flusher_ = std::thread([this] { FlushLoop(); });
+}
+
+BlockStore::~BlockStore() {
+  {
+    std::lock_guard<std::mutex> lock(reclaim_mu_);
+    stop_reclaim_ = true;
+  }
+  reclaim_cv_.notify_all();
+  for (auto &r : reclaimers_) {
+    if (r.thread.joinable())
+      r.thread.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(flush_mu_);
+    stop_flush_ = true;
+  }
+  flush_cv_.notify_all();
+  if (flusher_.joinable())
+    flusher_.join();
+  FlushAccessStats();
+  auto s = WriteIndexSnapshot();
+  if (!s.ok())
+    LOG_WARN("Final index snapshot failed: {}", s.ToString());
 }
 
 Status BlockStore::CreateBlock(BlockId block_id, size_t size) {
-  // Try to allocate in the fastest tier with space
+  return CreateBlockImpl(block_id, size, /*partial=*/false);
+}
+
+Status BlockStore::CreatePartialBlock(BlockId block_id, size_t size) {
+  return CreateBlockImpl(block_id, size, /*partial=*/true);
+}
+
+Status BlockStore::CreateBlockImpl(BlockId block_id, size_t size,
+                                   bool partial) {
+  if (HasBlock(block_id))
+    return Status::AlreadyExists("block already cached");
+
+  // The reclaimers keep headroom, so normally a tier has space right away
   StorageTier *target = nullptr;
-  for (auto &tier : tiers_) {
-    if (tier->GetAvailableBytes() >= size) {
-      target = tier.get();
-      break;
+  BlockHandle handle;
+  for (int attempt = 0;; ++attempt) {
+    target = FindTierWithSpace(size);
+    if (!target) {
+      RETURN_IF_ERROR(WaitForSpace(size, &target));
     }
+    auto s = target->AllocateBlock(block_id, size, &handle, partial);
+    if (s.ok())
+      break;
+    // A concurrent tier move may take the space between check and allocation
+    if (s.code() != StatusCode::kResourceExhausted || attempt == 3)
+      return s;
   }
 
-  if (!target) {
-    // Try eviction from the fastest tier
-    std::vector<BlockId> evicted;
-    RETURN_IF_ERROR(EvictBlocks(tiers_.front()->GetType(), size, &evicted));
-    target = tiers_.front().get();
-    if (target->GetAvailableBytes() < size) {
-      return Status::ResourceExhausted("no tier has enough space");
-    }
+  auto state = std::make_shared<BlockState>();
+  state->block_id = block_id;
+  state->length = size;
+  state->tier = target->GetType();
+  state->create_time_ms = NowMs();
+  state->last_access_time_ms = state->create_time_ms;
+  if (partial) {
+    size_t pages = (size + opts_.page_size - 1) / opts_.page_size;
+    state->valid_pages =
+        std::make_unique<std::atomic<uint64_t>[]>((pages + 63) / 64);
+  } else {
+    state->cached_bytes = size;
   }
-
-  BlockHandle handle;
-  RETURN_IF_ERROR(target->AllocateBlock(block_id, size, &handle));
-
-  // Update metadata
-  BlockMeta meta;
-  meta.block_id = block_id;
-  meta.length = size;
-  meta.tier = target->GetType();
-  meta.create_time_ms = NowMs();
-  meta.last_access_time_ms = meta.create_time_ms;
-  RETURN_IF_ERROR(meta_store_->PutBlockMeta(block_id, meta));
-
   {
+    // Creators are serialized by meta_mu_, so the check below holds until
+    // the block is indexed
+    std::lock_guard<std::mutex> meta_lock(meta_mu_);
+    Status s;
+    if (HasBlock(block_id))
+      s = Status::AlreadyExists("block already cached");
+    else
+      s = meta_store_->PutBlockMeta(block_id, state->ToMeta(state->tier));
+    if (!s.ok()) {
+      target->RemoveBlock(block_id);
+      return s;
+    }
     std::lock_guard<std::mutex> lock(mu_);
-    block_tier_map_[block_id] = target->GetType();
+    blocks_[block_id] = std::move(state);
   }
 
-  cache_mgr_->OnBlockInsert(block_id, size);
+  CacheFor(target->GetType())->OnBlockInsert(block_id, size);
   Metrics::Instance().IncrCounter("block_store.blocks_created");
 
   // Check if any tier needs proactive eviction
@@ -77,68 +158,396 @@ Status BlockStore::EnsureBlock(BlockId block_id, size_t size) {
   if (HasBlock(block_id)) {
     return Status::OK();
   }
-  return CreateBlock(block_id, size);
+  auto s = CreateBlock(block_id, size);
+  return s.IsAlreadyExists() ? Status::OK() : s; // lost a creation race
+}
+
+Status BlockStore::EnsurePartialBlock(BlockId block_id, size_t size) {
+  if (HasBlock(block_id)) {
+    return Status::OK();
+  }
+  auto s = CreatePartialBlock(block_id, size);
+  return s.IsAlreadyExists() ? Status::OK() : s;
+}
+
+// ─── Leases ──────────────────────────────────────────────────
+
+BlockStore::Lease::Lease(Lease &&other) noexcept
+    : state_(std::move(other.state_)), tier_(other.tier_) {
+  other.tier_ = nullptr;
+}
+
+BlockStore::Lease &BlockStore::Lease::operator=(Lease &&other) noexcept {
+  if (this != &other) {
+    Release();
+    state_ = std::move(other.state_);
+    tier_ = std::exchange(other.tier_, nullptr);
+  }
+  return *this;
+}
+
+BlockId BlockStore::Lease::block_id() const { return state_->block_id; }
+
+uint64_t BlockStore::Lease::length() const { return state_->length; }
+
+TierType BlockStore::Lease::tier() const { return tier_->GetType(); }
+
+Status BlockStore::Lease::Read(void *buf, size_t size, off_t offset) const {
+  return tier_->ReadBlock(state_->block_id, buf, size, offset);
+}
+
+Status BlockStore::Lease::Write(const void *buf, size_t size,
+                                off_t offset) const {
+  auto s = tier_->WriteBlock(state_->block_id, buf, size, offset);
+  // Still pinned here, so a concurrent move sees either the pin or this
+  state_->write_seq.fetch_add(1, std::memory_order_release);
+  return s;
+}
+
+void BlockStore::Lease::Release() {
+  if (state_) {
+    state_->pins.fetch_sub(1, std::memory_order_release);
+    state_.reset();
+    tier_ = nullptr;
+  }
+}
+
+// ─── Partial blocks ──────────────────────────────────────────
+
+std::pair<uint64_t, uint64_t>
+BlockStore::PageSpan(const BlockState &state, uint64_t offset,
+                     size_t size) const {
+  uint64_t end = std::min<uint64_t>(offset + size, state.length);
+  if (offset >= end)
+    return {0, 0};
+  return {offset / opts_.page_size,
+          (end + opts_.page_size - 1) / opts_.page_size};
+}
+
+bool BlockStore::RangeValid(const BlockState &state, uint64_t offset,
+                            size_t size) const {
+  if (!state.valid_pages ||
+      state.cached_bytes.load(std::memory_order_acquire) == state.length)
+    return true;
+  auto [first, last] = PageSpan(state, offset, size);
+  for (uint64_t page = first; page < last; ++page) {
+    uint64_t word = state.valid_pages[page / 64].load(std::memory_order_acquire);
+    if (!((word >> (page % 64)) & 1))
+      return false;
+  }
+  return true;
+}
+
+void BlockStore::MarkValid(const Lease &lease, uint64_t offset, size_t size) {
+  auto &state = *lease.state_;
+  if (!state.valid_pages)
+    return;
+  uint64_t page_size = opts_.page_size;
+  uint64_t end = std::min<uint64_t>(offset + size, state.length);
+  if (offset >= end)
+    return;
+  // Only fully covered pages; the last page ends at the block's end
+  uint64_t first = (offset + page_size - 1) / page_size;
+  uint64_t last =
+      end == state.length ? (end + page_size - 1) / page_size : end / page_size;
+  uint64_t added = 0;
+  for (uint64_t page = first; page < last; ++page) {
+    uint64_t bit = 1ULL << (page % 64);
+    uint64_t prev = state.valid_pages[page / 64].fetch_or(
+        bit, std::memory_order_acq_rel);
+    if (!(prev & bit))
+      added += std::min<uint64_t>(page_size, state.length - page * page_size);
+  }
+  if (added > 0) {
+    uint64_t cached =
+        state.cached_bytes.fetch_add(added, std::memory_order_acq_rel) + added;
+    MarkDirty(state);
+    if (cached == state.length) {
+      // Pinned by the lease, so the block is still in this tier
+      auto s = lease.tier_->CompleteBlock(state.block_id);
+      if (!s.ok())
+        LOG_WARN("Completing partial block {} failed: {}", state.block_id,
+                 s.ToString());
+    }
+  }
+}
+
+void BlockStore::PinLocked(const std::shared_ptr<BlockState> &state,
+                           Lease *lease) {
+  state->pins.fetch_add(1, std::memory_order_acq_rel);
+  lease->Release();
+  lease->state_ = state;
+  lease->tier_ = FindTier(state->tier);
+}
+
+Status BlockStore::AcquireLease(BlockId id, Lease *lease) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = blocks_.find(id);
+  if (it == blocks_.end())
+    return Status::NotFound("block not cached");
+  PinLocked(it->second, lease);
+  return Status::OK();
+}
+
+bool BlockStore::IsPinned(BlockId id) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = blocks_.find(id);
+  return it != blocks_.end() &&
+         it->second->pins.load(std::memory_order_acquire) > 0;
 }
 
 Status BlockStore::ReadBlock(BlockId id, void *buf, size_t size, off_t offset) {
   ScopedLatency lat("block_store.read_latency_ms");
 
-  StorageTier *tier = FindBlockTier(id);
-  if (!tier)
-    return Status::NotFound("block not cached");
+  Lease lease;
+  auto s = AcquireLease(id, &lease);
+  if (s.IsNotFound())
+    RecordReference(id, 0);
+  RETURN_IF_ERROR(s);
+  if (!RangeValid(*lease.state_, offset, size)) {
+    RecordReference(id, lease.length());
+    return Status::NotFound("block range not cached");
+  }
+  RETURN_IF_ERROR(lease.Read(buf, size, offset));
+  RecordRead(std::move(lease));
+  return Status::OK();
+}
 
-  RETURN_IF_ERROR(tier->ReadBlock(id, buf, size, offset));
-  cache_mgr_->OnBlockAccess(id);
+Status BlockStore::ReadBlockThrough(BlockId id, void *buf, size_t size,
+                                    off_t offset, const RangeFetcher &fetch) {
+  ScopedLatency lat("block_store.read_latency_ms");
 
-  // Update access time in meta
-  BlockMeta meta;
-  if (meta_store_->GetBlockMeta(id, &meta).ok()) {
-    meta.last_access_time_ms = NowMs();
-    meta.access_count++;
-    meta_store_->PutBlockMeta(id, meta);
+  Lease lease;
+  RETURN_IF_ERROR(AcquireLease(id, &lease));
+  auto &state = *lease.state_;
+  if (static_cast<uint64_t>(offset) + size > state.length)
+    return Status::InvalidArgument("read past end of block");
 
-    // Auto-promote hot blocks to faster tier
-    MaybeAutoPromote(id, meta);
+  if (!RangeValid(state, offset, size)) {
+    // Fetch each run of missing pages with one backing-store read
+    auto page_valid = [&](uint64_t page) {
+      return (state.valid_pages[page / 64].load(std::memory_order_acquire) >>
+              (page % 64)) &
+             1;
+    };
+    auto [first, last] = PageSpan(state, offset, size);
+    std::vector<char> fill;
+    uint64_t fetched = 0;
+    std::chrono::steady_clock::duration fetch_time{};
+    for (uint64_t page = first; page < last;) {
+      if (page_valid(page)) {
+        ++page;
+        continue;
+      }
+      uint64_t run_end = page + 1;
+      while (run_end < last && !page_valid(run_end))
+        ++run_end;
+      uint64_t begin = page * opts_.page_size;
+      uint64_t end = std::min<uint64_t>(run_end * opts_.page_size,
+                                        state.length);
+      fill.resize(end - begin);
+      auto fetch_start = std::chrono::steady_clock::now();
+      RETURN_IF_ERROR(fetch(begin, fill.size(), fill.data()));
+      fetch_time += std::chrono::steady_clock::now() - fetch_start;
+      fetched += fill.size();
+      RETURN_IF_ERROR(lease.Write(fill.data(), fill.size(), begin));
+      MarkValid(lease, begin, fill.size());
+      Metrics::Instance().IncrCounter("block_store.fill_bytes", fill.size());
+      page = run_end;
+    }
+    RecordFetch(
+        id, fetched,
+        std::chrono::duration_cast<std::chrono::microseconds>(fetch_time)
+            .count());
   }
 
-  Metrics::Instance().IncrCounter("block_store.reads");
+  RETURN_IF_ERROR(lease.Read(buf, size, offset));
+  RecordRead(std::move(lease));
   return Status::OK();
 }
 
+void BlockStore::RecordFetch(BlockId id, uint64_t bytes,
+                             uint64_t elapsed_us) {
+  TierType tier;
+  auto state = LookupBlock(id, &tier);
+  if (!state || bytes == 0)
+    return;
+  // Linear in size: a small first fetch overstates the per-byte cost of a
+  // big block, but only until larger fetches smooth it out
+  uint64_t sample =
+      std::max<uint64_t>(elapsed_us * state->length / bytes, 1);
+  uint64_t old = state->fetch_cost_us.load(std::memory_order_relaxed);
+  uint64_t cost = old == 0 ? sample : (old * 3 + sample) / 4;
+  state->fetch_cost_us.store(cost, std::memory_order_relaxed);
+  MarkDirty(*state);
+  CacheFor(tier)->SetBlockCost(id, cost);
+}
+
+void BlockStore::RecordRead(Lease lease) {
+  auto state = lease.state_;
+  TierType tier = lease.tier();
+  lease.Release();
+
+  CacheFor(tier)->OnBlockAccess(state->block_id);
+  RecordReference(state->block_id, state->length);
+
+  // Statistics stay in memory; FlushLoop persists them in batches
+  state->last_access_time_ms.store(NowMs(), std::memory_order_relaxed);
+  uint64_t count =
+      state->access_count.fetch_add(1, std::memory_order_relaxed) + 1;
+  MarkDirty(*state);
+
+  // Auto-promote hot blocks to faster tier
+  MaybeAutoPromote(state->block_id, tier, count, state->length);
+
+  Metrics::Instance().IncrCounter("block_store.reads");
+}
+
+void BlockStore::RecordReference(BlockId id, size_t size) {
+  for (auto &cache : cache_mgrs_)
+    cache->OnBlockReference(id, size);
+}
+
+void BlockStore::PublishMissRatioCurves() {
+  auto &metrics = Metrics::Instance();
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    std::string prefix = std::string("block_store.mrc.") +
+                         TierTypeName(tiers_[i]->GetType()) + ".";
+    for (auto &p : cache_mgrs_[i]->GetMissRatioCurve()) {
+      // 0.5 -> "hit_ratio_0_5x"
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%g", p.multiple);
+      std::string multiple(buf);
+      std::replace(multiple.begin(), multiple.end(), '.', '_');
+      metrics.SetGauge(prefix + "hit_ratio_" + multiple + "x", p.hit_ratio);
+      metrics.SetGauge(prefix + "references",
+                       static_cast<double>(p.references));
+    }
+  }
+}
+
+void BlockStore::MarkDirty(BlockState &state) {
+  if (state.dirty.exchange(true, std::memory_order_acq_rel))
+    return; // already queued
+  std::lock_guard<std::mutex> lock(dirty_mu_);
+  dirty_ids_.push_back(state.block_id);
+}
+
 Status BlockStore::WriteBlock(BlockId id, const void *buf, size_t size,
                               off_t offset) {
   ScopedLatency lat("block_store.write_latency_ms");
 
-  StorageTier *tier = FindBlockTier(id);
-  if (!tier)
-    return Status::NotFound("block not cached");
-
-  RETURN_IF_ERROR(tier->WriteBlock(id, buf, size, offset));
-  cache_mgr_->OnBlockAccess(id);
+  Lease lease;
+  RETURN_IF_ERROR(AcquireLease(id, &lease));
+  RETURN_IF_ERROR(lease.Write(buf, size, offset));
+  MarkValid(lease, offset, size);
+  CacheFor(lease.tier())->OnBlockAccess(id);
 
   Metrics::Instance().IncrCounter("block_store.writes");
   return Status::OK();
 }
 
-Status BlockStore::RemoveBlock(BlockId id) {
-  StorageTier *tier = FindBlockTier(id);
-  if (tier) {
-    tier->RemoveBlock(id);
+Status BlockStore::DispatchBatch(std::span<BlockIo> ios, bool is_write,
+                                 std::vector<Lease> *leases) {
+  // Pin and resolve tiers up front; unknown blocks fail without reaching a
+  // tier
+  std::unordered_map<StorageTier *, std::vector<size_t>> groups;
+  leases->clear();
+  leases->resize(ios.size());
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (size_t i = 0; i < ios.size(); ++i) {
+      auto it = blocks_.find(ios[i].block_id);
+      if (it == blocks_.end()) {
+        ios[i].status = Status::NotFound("block not cached");
+        continue;
+      }
+      if (!is_write &&
+          !RangeValid(*it->second, ios[i].offset, ios[i].size)) {
+        ios[i].status = Status::NotFound("block range not cached");
+        continue;
+      }
+      PinLocked(it->second, &(*leases)[i]);
+      groups[(*leases)[i].tier_].push_back(i);
+    }
   }
 
-  cache_mgr_->OnBlockRemove(id);
-  meta_store_->DeleteBlockMeta(id);
+  for (auto &[tier, indices] : groups) {
+    std::vector<BlockIo> batch;
+    batch.reserve(indices.size());
+    for (size_t i : indices)
+      batch.push_back(ios[i]);
+    if (is_write)
+      tier->WriteBlocks(batch);
+    else
+      tier->ReadBlocks(batch);
+    for (size_t k = 0; k < indices.size(); ++k)
+      ios[indices[k]].status = std::move(batch[k].status);
+  }
 
+  for (auto &io : ios) {
+    if (!io.status.ok())
+      return io.status;
+  }
+  return Status::OK();
+}
+
+Status BlockStore::ReadBlocks(std::span<BlockIo> ios) {
+  ScopedLatency lat("block_store.read_batch_latency_ms");
+  std::vector<Lease> leases;
+  auto s = DispatchBatch(ios, /*is_write=*/false, &leases);
+  for (size_t i = 0; i < ios.size(); ++i) {
+    if (ios[i].status.ok())
+      RecordRead(std::move(leases[i]));
+    else if (ios[i].status.IsNotFound())
+      RecordReference(ios[i].block_id, 0);
+  }
+  return s;
+}
+
+Status BlockStore::WriteBlocks(std::span<BlockIo> ios) {
+  ScopedLatency lat("block_store.write_batch_latency_ms");
+  std::vector<Lease> leases;
+  auto s = DispatchBatch(ios, /*is_write=*/true, &leases);
+  for (size_t i = 0; i < ios.size(); ++i) {
+    if (ios[i].status.ok()) {
+      MarkValid(leases[i], ios[i].offset, ios[i].size);
+      CacheFor(leases[i].tier())->OnBlockAccess(ios[i].block_id);
+      Metrics::Instance().IncrCounter("block_store.writes");
+    }
+  }
+  return s;
+}
+
+Status BlockStore::RemoveBlock(BlockId id) {
+  // Unmap first so a concurrent tier move sees the removal (see MoveBlock)
+  StorageTier *tier = nullptr;
   {
     std::lock_guard<std::mutex> lock(mu_);
-    block_tier_map_.erase(id);
+    auto it = blocks_.find(id);
+    if (it != blocks_.end()) {
+      tier = FindTier(it->second->tier);
+      blocks_.erase(it);
+    }
+  }
+  if (tier) {
+    tier->RemoveBlock(id);
+    CacheFor(tier->GetType())->OnBlockRemove(id);
   }
+  DeletePersistedMeta(id);
 
   Metrics::Instance().IncrCounter("block_store.blocks_removed");
   return Status::OK();
 }
 
 Status BlockStore::PromoteBlock(BlockId id, TierType target_type) {
+  RETURN_IF_ERROR(MoveBlock(id, target_type));
+  Metrics::Instance().IncrCounter("block_store.promotions");
+  LOG_DEBUG("Promoted block {} to {}", id, TierTypeName(target_type));
+  return Status::OK();
+}
+
+Status BlockStore::MoveBlock(BlockId id, TierType target_type) {
   StorageTier *src_tier = FindBlockTier(id);
   if (!src_tier)
     return Status::NotFound("block not found");
@@ -148,84 +557,855 @@ Status BlockStore::PromoteBlock(BlockId id, TierType target_type) {
   StorageTier *dst_tier = FindTier(target_type);
   if (!dst_tier)
     return Status::NotFound("target tier not found");
+  uint64_t write_seq;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = blocks_.find(id);
+    if (it == blocks_.end())
+      return Status::NotFound("block not found");
+    if (it->second->pins.load(std::memory_order_acquire) > 0)
+      return Status::Unavailable("block is pinned");
+    write_seq = it->second->write_seq.load(std::memory_order_acquire);
+  }
 
-  // Export data from source
-  std::vector<char> data;
-  RETURN_IF_ERROR(src_tier->ExportBlock(id, &data));
-
-  // Import into destination
-  RETURN_IF_ERROR(dst_tier->ImportBlock(id, data));
+  // Copy without a full-block staging buffer; reads keep going to the
+  // source tier meanwhile
+  RETURN_IF_ERROR(src_tier->MigrateBlockTo(id, dst_tier));
 
-  // Remove from source
+  // Switch readers over before the source copy goes away, unless the block
+  // was removed, moved elsewhere or leased while copying
+  uint64_t length, cost;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = blocks_.find(id);
+    if (it == blocks_.end() || it->second->tier != src_tier->GetType()) {
+      dst_tier->RemoveBlock(id);
+      return Status::NotFound("block changed during tier move");
+    }
+    if (it->second->pins.load(std::memory_order_acquire) > 0 ||
+        it->second->write_seq.load(std::memory_order_acquire) != write_seq) {
+      dst_tier->RemoveBlock(id);
+      return Status::Unavailable("block was leased during tier move");
+    }
+    it->second->tier = target_type;
+    length = it->second->length;
+    cost = it->second->fetch_cost_us.load(std::memory_order_relaxed);
+  }
   src_tier->RemoveBlock(id);
 
-  // Update metadata
+  PersistBlockMeta(id);
+  CacheFor(src_tier->GetType())->OnBlockRemove(id);
+  CacheFor(target_type)->OnBlockInsert(id, length, cost);
+
+  if (tier_listener_)
+    tier_listener_(id, target_type);
+  return Status::OK();
+}
+
+Status BlockStore::EvictBlocks(TierType tier, size_t bytes_needed,
+                               std::vector<BlockId> *evicted) {
+  CacheManager *cache = CacheFor(tier);
+  if (!cache)
+    return Status::NotFound("tier not found");
+
+  size_t count = EvictFromTier(tier, bytes_needed, /*throttle=*/false,
+                               evicted);
+  Metrics::Instance().IncrCounter("block_store.evictions", count);
+  return Status::OK();
+}
+
+size_t BlockStore::EvictFromTier(TierType tier, size_t bytes, bool throttle,
+                                 std::vector<BlockId> *evicted) {
+  CacheManager *cache = CacheFor(tier);
+  size_t count = 0, freed = 0;
+  // Pinned victims are requeued, so ask for more until enough is freed or a
+  // round only turns up victims deferred before
+  std::unordered_set<BlockId> deferred;
+  while (freed < bytes) {
+    auto candidates = cache->GetEvictionCandidates(bytes - freed);
+    size_t consumed = 0;
+    for (BlockId bid : candidates) {
+      StorageTier *owner = FindBlockTier(bid);
+      if (!owner || owner->GetType() != tier) {
+        consumed++; // stale entry, already gone from the policy
+        continue;
+      }
+      size_t length = BlockLength(bid);
+      if (throttle)
+        ThrottleDemotion(length);
+      if (!DemoteOrDrop(bid, tier)) {
+        if (deferred.insert(bid).second)
+          consumed++;
+        continue;
+      }
+      consumed++;
+      count++;
+      freed += length;
+      if (evicted)
+        evicted->push_back(bid);
+    }
+    if (consumed == 0)
+      break;
+  }
+  if (count > 0) {
+    LOG_DEBUG("Evicted {} blocks (~{} bytes) from {}", count, freed,
+              TierTypeName(tier));
+  }
+  return count;
+}
+
+bool BlockStore::DemoteOrDrop(BlockId id, TierType tier) {
+  if (IsPinned(id)) {
+    RequeueVictim(id, tier);
+    return false;
+  }
+  StorageTier *next = opts_.demote_on_evict ? NextSlowerTier(tier) : nullptr;
+  if (next) {
+    size_t length = BlockLength(id);
+    // Cascade: make room in the next tier by evicting (demoting) from it
+    if (next->GetAvailableBytes() < length) {
+      EvictBlocks(next->GetType(), length - next->GetAvailableBytes(),
+                  nullptr);
+    }
+    auto s = MoveBlock(id, next->GetType());
+    if (s.ok()) {
+      Metrics::Instance().IncrCounter("block_store.demotions");
+      Metrics::Instance().IncrCounter("block_store.demoted_bytes", length);
+      LOG_DEBUG("Demoted block {} from {} to {}", id, TierTypeName(tier),
+                TierTypeName(next->GetType()));
+      // Keep headroom further down the cascade
+      MaybeAutoEvict(next->GetType());
+      return true;
+    }
+    if (s.IsNotFound() && !FindBlockTier(id))
+      return true; // removed meanwhile
+    if (s.code() == StatusCode::kUnavailable) {
+      RequeueVictim(id, tier);
+      return false;
+    }
+    LOG_DEBUG("Demotion of block {} failed ({}), dropping it", id,
+              s.ToString());
+  }
+  if (!DropBlock(id, tier)) {
+    RequeueVictim(id, tier);
+    return false;
+  }
+  return true;
+}
+
+bool BlockStore::DropBlock(BlockId id, TierType tier) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = blocks_.find(id);
+    if (it == blocks_.end() || it->second->tier != tier ||
+        it->second->pins.load(std::memory_order_acquire) > 0)
+      return false;
+    blocks_.erase(it);
+  }
+  FindTier(tier)->RemoveBlock(id);
+  CacheFor(tier)->OnBlockRemove(id);
+  DeletePersistedMeta(id);
+  Metrics::Instance().IncrCounter("block_store.dropped");
+  return true;
+}
+
+void BlockStore::RequeueVictim(BlockId id, TierType tier) {
+  // The cache manager already forgot the victim; put it back (as most
+  // recently used) so a later pass retries it once the leases are gone
+  uint64_t length, cost;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = blocks_.find(id);
+    if (it == blocks_.end() || it->second->tier != tier)
+      return;
+    length = it->second->length;
+    cost = it->second->fetch_cost_us.load(std::memory_order_relaxed);
+  }
+  CacheFor(tier)->OnBlockInsert(id, length, cost);
+  Metrics::Instance().IncrCounter("block_store.evict_deferred_pinned");
+}
+
+void BlockStore::ReclaimLoop(size_t index) {
+  TierType tier = tiers_[index]->GetType();
+  auto interval = std::chrono::milliseconds(opts_.reclaim_interval_ms);
+  std::unique_lock<std::mutex> lock(reclaim_mu_);
+  while (!stop_reclaim_) {
+    auto &r = reclaimers_[index];
+    reclaim_cv_.wait_for(lock, interval, [&] {
+      return stop_reclaim_ || r.requested != r.completed;
+    });
+    if (stop_reclaim_)
+      break;
+    uint64_t serving = r.requested;
+    size_t needed = std::exchange(r.bytes_needed, 0);
+    r.running = true;
+    lock.unlock();
+
+    size_t evicted = ReclaimTier(tier, needed);
+
+    lock.lock();
+    r.running = false;
+    r.completed = serving;
+    r.last_evicted = evicted;
+    reclaim_cv_.notify_all();
+  }
+}
+
+size_t BlockStore::ReclaimTier(TierType tier, size_t bytes_needed) {
+  StorageTier *t = FindTier(tier);
+  size_t capacity = t->GetCapacity();
+  if (capacity == 0)
+    return 0;
+
+  size_t used = t->GetUsedBytes();
+  size_t to_free = 0;
+  if (used > capacity * opts_.auto_evict_high_watermark) {
+    size_t target_used =
+        static_cast<size_t>(capacity * opts_.auto_evict_low_watermark);
+    to_free = used > target_used ? used - target_used : 0;
+  }
+  size_t available = t->GetAvailableBytes();
+  if (bytes_needed > available)
+    to_free = std::max(to_free, bytes_needed - available);
+  if (to_free == 0)
+    return 0;
+
+  // A stalled CreateBlock is waiting: don't throttle its demotions
+  bool throttle = bytes_needed == 0 && opts_.demote_on_evict &&
+                  NextSlowerTier(tier) != nullptr;
+  size_t evicted = EvictFromTier(tier, to_free, throttle, nullptr);
+  Metrics::Instance().IncrCounter("block_store.evictions", evicted);
+  return evicted;
+}
+
+StorageTier *BlockStore::FindTierWithSpace(size_t size) {
+  for (auto &tier : tiers_) {
+    if (tier->GetAvailableBytes() >= size)
+      return tier.get();
+  }
+  return nullptr;
+}
+
+Status BlockStore::WaitForSpace(size_t size, StorageTier **target) {
+  // Only reached when the reclaimers fell behind; this is the stall they
+  // exist to avoid, so it is measured
+  ScopedLatency lat("block_store.create_stall_ms");
+  Metrics::Instance().IncrCounter("block_store.create_stalls");
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(opts_.create_stall_timeout_ms);
+  std::unique_lock<std::mutex> lock(reclaim_mu_);
+  auto &r = reclaimers_.front(); // free space in the fastest tier
+  while (!(*target = FindTierWithSpace(size))) {
+    uint64_t ticket = ++r.requested;
+    r.bytes_needed = std::max(r.bytes_needed, size);
+    reclaim_cv_.notify_all();
+    bool served = reclaim_cv_.wait_until(lock, deadline, [&] {
+      return stop_reclaim_ || r.completed >= ticket;
+    });
+    if (!served || stop_reclaim_)
+      return Status::ResourceExhausted("timed out waiting for free space");
+    if (r.last_evicted == 0 && !(*target = FindTierWithSpace(size)))
+      return Status::ResourceExhausted("no tier has enough space");
+  }
+  return Status::OK();
+}
+
+void BlockStore::WaitForReclaim() {
+  std::unique_lock<std::mutex> lock(reclaim_mu_);
+  reclaim_cv_.wait(lock, [this] {
+    if (stop_reclaim_)
+      return true;
+    for (auto &r : reclaimers_) {
+      if (r.running || r.requested != r.completed)
+        return false;
+    }
+    return true;
+  });
+}
+
+void BlockStore::ThrottleDemotion(size_t bytes) {
+  uint64_t rate = opts_.demote_bandwidth_bytes_per_sec;
+  if (rate == 0)
+    return;
+  // Each demotion reserves the next slot of the shared budget; idle time is
+  // not banked beyond the current instant
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point start;
+  {
+    std::lock_guard<std::mutex> lock(throttle_mu_);
+    start = std::max(now, demote_next_slot_);
+    demote_next_slot_ =
+        start +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) /
+                                          static_cast<double>(rate)));
+  }
+  if (start > now) {
+    Metrics::Instance().IncrCounter("block_store.demote_throttled");
+    std::this_thread::sleep_until(start);
+  }
+}
+
+// ─── Access statistics persistence ──────────────────────────
+
+BlockMeta BlockStore::BlockState::ToMeta(TierType current_tier) const {
+  BlockMeta meta;
+  meta.block_id = block_id;
+  meta.length = length;
+  meta.tier = current_tier;
+  meta.create_time_ms = create_time_ms;
+  meta.last_access_time_ms =
+      last_access_time_ms.load(std::memory_order_relaxed);
+  meta.access_count = access_count.load(std::memory_order_relaxed);
+  meta.cached_bytes = cached_bytes.load(std::memory_order_relaxed);
+  meta.fetch_cost_us = fetch_cost_us.load(std::memory_order_relaxed);
+  return meta;
+}
+
+void BlockStore::PersistBlockMeta(BlockId id) {
+  std::lock_guard<std::mutex> meta_lock(meta_mu_);
   BlockMeta meta;
-  if (meta_store_->GetBlockMeta(id, &meta).ok()) {
-    meta.tier = target_type;
-    meta_store_->PutBlockMeta(id, meta);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = blocks_.find(id);
+    if (it == blocks_.end())
+      return;
+    meta = it->second->ToMeta(it->second->tier);
   }
+  auto s = meta_store_->PutBlockMeta(id, meta);
+  if (!s.ok())
+    LOG_WARN("Failed to persist meta of block {}: {}", id, s.ToString());
+}
 
+void BlockStore::DeletePersistedMeta(BlockId id) {
+  std::lock_guard<std::mutex> meta_lock(meta_mu_);
   {
+    // Re-created meanwhile: its CreateBlock already wrote the new record
     std::lock_guard<std::mutex> lock(mu_);
-    block_tier_map_[id] = target_type;
+    if (blocks_.count(id) > 0)
+      return;
   }
+  meta_store_->DeleteBlockMeta(id);
+}
 
-  Metrics::Instance().IncrCounter("block_store.promotions");
-  LOG_DEBUG("Promoted block {} to {}", id, TierTypeName(target_type));
+Status BlockStore::FlushAccessStats() {
+  std::vector<BlockId> ids;
+  {
+    std::lock_guard<std::mutex> lock(dirty_mu_);
+    ids.swap(dirty_ids_);
+  }
+  if (ids.empty())
+    return Status::OK();
+
+  std::lock_guard<std::mutex> meta_lock(meta_mu_);
+  std::vector<BlockMeta> metas;
+  metas.reserve(ids.size());
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (BlockId id : ids) {
+      auto it = blocks_.find(id);
+      if (it == blocks_.end())
+        continue; // removed since it was read
+      auto &state = *it->second;
+      // Cleared before the snapshot: a concurrent read re-queues the block
+      state.dirty.store(false, std::memory_order_release);
+      metas.push_back(state.ToMeta(state.tier));
+    }
+  }
+  if (metas.empty())
+    return Status::OK();
+
+  auto s = meta_store_->PutBlockMetaBatch(metas);
+  if (!s.ok()) {
+    LOG_WARN("Access stats flush of {} blocks failed: {}", metas.size(),
+             s.ToString());
+    // Re-queue so the next flush retries them, even if they go cold
+    std::lock_guard<std::mutex> lock(mu_);
+    for (const auto &meta : metas) {
+      auto it = blocks_.find(meta.block_id);
+      if (it != blocks_.end())
+        MarkDirty(*it->second);
+    }
+    return s;
+  }
+  Metrics::Instance().IncrCounter("block_store.meta_flushes");
+  Metrics::Instance().IncrCounter("block_store.meta_flushed_blocks",
+                                  metas.size());
   return Status::OK();
 }
 
-Status BlockStore::EvictBlocks(TierType tier, size_t bytes_needed,
-                               std::vector<BlockId> *evicted) {
-  auto candidates = cache_mgr_->GetEvictionCandidates(bytes_needed);
-  for (BlockId bid : candidates) {
-    StorageTier *t = FindBlockTier(bid);
-    if (t && t->GetType() == tier) {
-      t->RemoveBlock(bid);
-      meta_store_->DeleteBlockMeta(bid);
-      {
-        std::lock_guard<std::mutex> lock(mu_);
-        block_tier_map_.erase(bid);
+void BlockStore::FlushLoop() {
+  auto interval = std::chrono::milliseconds(opts_.meta_flush_interval_ms);
+  std::unique_lock<std::mutex> lock(flush_mu_);
+  while (!flush_cv_.wait_for(lock, interval, [this] { return stop_flush_; })) {
+    lock.unlock();
+    FlushAccessStats();
+    PublishMissRatioCurves();
+    if (recovered_.load() && opts_.snapshot_interval_ms > 0) {
+      if (NowMs() - last_snapshot_ms_.load() >=
+          static_cast<int64_t>(opts_.snapshot_interval_ms)) {
+        auto s = WriteIndexSnapshot();
+        if (!s.ok())
+          LOG_WARN("Index snapshot failed: {}", s.ToString());
+      }
+      if (last_snapshot_ms_.load() > 0) {
+        Metrics::Instance().SetGauge(
+            "block_store.snapshot_age_ms",
+            static_cast<double>(NowMs() - last_snapshot_ms_.load()));
+      }
+    }
+    lock.lock();
+  }
+}
+
+std::string BlockStore::SnapshotPath() const {
+  return opts_.snapshot_path.empty() ? opts_.meta_db_path + ".snapshot"
+                                     : opts_.snapshot_path;
+}
+
+Status BlockStore::WriteIndexSnapshot() {
+  if (!recovered_.load() || opts_.snapshot_interval_ms == 0)
+    return Status::OK();
+  std::lock_guard<std::mutex> snapshot_lock(snapshot_mu_);
+
+  std::vector<IndexSnapshot::Record> records;
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    TierType type = tiers_[i]->GetType();
+    // Memory-tier blocks do not survive a restart; they are listed only so
+    // Recover deletes their MetaStore records
+    bool memory = type == TierType::kMemory;
+    auto order = cache_mgrs_[i]->ExportPolicy();
+    for (size_t begin = 0; begin < order.size(); begin += kSnapshotChunk) {
+      size_t end = std::min(order.size(), begin + kSnapshotChunk);
+      std::lock_guard<std::mutex> lock(mu_);
+      for (size_t j = begin; j < end; ++j) {
+        auto it = blocks_.find(order[j].first);
+        if (it == blocks_.end())
+          continue;
+        auto &state = *it->second;
+        // Moved meanwhile, or partial (valid pages are not persisted)
+        if (state.tier != type ||
+            (!memory && state.cached_bytes.load(std::memory_order_relaxed) <
+                            state.length))
+          continue;
+        IndexSnapshot::Record r;
+        r.block_id = state.block_id;
+        r.length = state.length;
+        r.create_time_ms = state.create_time_ms;
+        r.last_access_time_ms =
+            state.last_access_time_ms.load(std::memory_order_relaxed);
+        r.access_count = state.access_count.load(std::memory_order_relaxed);
+        r.policy_weight = order[j].second;
+        r.tier = static_cast<uint8_t>(type);
+        r.fetch_cost_us = SaturateCost(
+            state.fetch_cost_us.load(std::memory_order_relaxed));
+        records.push_back(r);
       }
-      if (evicted)
-        evicted->push_back(bid);
     }
   }
-  Metrics::Instance().IncrCounter("block_store.evictions",
-                                  evicted ? evicted->size() : 0);
+
+  std::string path = SnapshotPath();
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+  int64_t now = NowMs();
+  RETURN_IF_ERROR(IndexSnapshot::Write(path, records, now));
+  last_snapshot_ms_ = now;
+  Metrics::Instance().IncrCounter("block_store.snapshots");
+  Metrics::Instance().SetGauge("block_store.snapshot_blocks",
+                               static_cast<double>(records.size()));
+  Metrics::Instance().SetGauge("block_store.snapshot_age_ms", 0);
   return Status::OK();
 }
 
 Status BlockStore::Recover() {
-  std::vector<BlockMeta> all_meta;
-  RETURN_IF_ERROR(meta_store_->ScanAll(&all_meta));
+  ScopedLatency latency("block_store.recover_ms");
+  auto started = std::chrono::steady_clock::now();
+
+  // Stored blocks, listed per tier in parallel. A block found in more than
+  // one tier was mid-move when the worker stopped.
+  struct Stored {
+    BlockId id = kInvalidBlockId;
+    uint32_t tiers = 0; // bitmask of tiers_ indices holding the block
+    int kept = -1;      // tiers_ index the block is indexed in
+    const IndexSnapshot::Record *record = nullptr; // metadata source, or
+    BlockMeta meta;                                // a MetaStore lookup
+  };
+  std::vector<Stored> stored;
+  std::unordered_map<BlockId, size_t> stored_index;
+  {
+    std::vector<std::vector<BlockId>> listed(tiers_.size());
+    std::vector<std::thread> listers;
+    for (size_t i = 0; i < tiers_.size(); ++i)
+      listers.emplace_back(
+          [&, i] { listed[i] = tiers_[i]->ListStoredBlocks(); });
+    for (auto &t : listers)
+      t.join();
+    for (size_t i = 0; i < listed.size(); ++i) {
+      for (BlockId id : listed[i]) {
+        auto [it, inserted] = stored_index.emplace(id, stored.size());
+        if (inserted)
+          stored.push_back(Stored{id});
+        stored[it->second].tiers |= 1u << i;
+      }
+    }
+  }
+
+  // Block metadata: the snapshot when there is a valid one, else a full
+  // MetaStore scan. Scanned records are ordered oldest access first, which
+  // is the best eviction order available without a snapshot.
+  IndexSnapshot snapshot;
+  std::vector<IndexSnapshot::Record> scanned;
+  std::vector<BlockId> stale; // MetaStore records to delete
+  std::span<const IndexSnapshot::Record> records;
+  bool from_snapshot = false;
+  if (opts_.snapshot_interval_ms > 0) {
+    auto s = snapshot.Open(SnapshotPath());
+    if (s.ok()) {
+      records = snapshot.records();
+      from_snapshot = true;
+      last_snapshot_ms_ = snapshot.created_ms();
+    } else if (s.code() != StatusCode::kNotFound) {
+      LOG_WARN("Index snapshot unusable ({}), scanning MetaStore",
+               s.ToString());
+    }
+  } else {
+    std::error_code ec;
+    std::filesystem::remove(SnapshotPath(), ec); // would only go stale
+  }
+  if (!from_snapshot) {
+    std::vector<BlockMeta> all_meta;
+    RETURN_IF_ERROR(meta_store_->ScanAll(&all_meta));
+    std::sort(all_meta.begin(), all_meta.end(),
+              [](const BlockMeta &a, const BlockMeta &b) {
+                return a.last_access_time_ms < b.last_access_time_ms;
+              });
+    for (auto &meta : all_meta) {
+      // Valid-page bitmaps are not persisted: a partial block can't be
+      // trusted after a restart
+      if (meta.cached_bytes < meta.length) {
+        stale.push_back(meta.block_id);
+        continue;
+      }
+      IndexSnapshot::Record r;
+      r.block_id = meta.block_id;
+      r.length = meta.length;
+      r.create_time_ms = meta.create_time_ms;
+      r.last_access_time_ms = meta.last_access_time_ms;
+      r.access_count = meta.access_count;
+      r.tier = static_cast<uint8_t>(meta.tier);
+      r.fetch_cost_us = SaturateCost(meta.fetch_cost_us);
+      scanned.push_back(r);
+    }
+    records = scanned;
+  }
+  std::unordered_map<BlockId, const IndexSnapshot::Record *> record_of;
+  record_of.reserve(records.size());
+  for (auto &r : records)
+    record_of[r.block_id] = &r;
 
+  auto tier_index = [this](TierType type) {
+    for (size_t i = 0; i < tiers_.size(); ++i) {
+      if (tiers_[i]->GetType() == type)
+        return static_cast<int>(i);
+    }
+    return -1;
+  };
+
+  // Reconcile in parallel. A block is kept in the tier its metadata names,
+  // if stored there at the recorded length; every other stored copy is an
+  // orphan and deleted. The snapshot decides for blocks it holds in the one
+  // tier they are stored in; anything else (created, moved or re-created
+  // since the snapshot) is looked up in the MetaStore. A full scan already
+  // holds every record, so it needs no lookups.
+  std::atomic<size_t> orphans{0};
+  auto reconcile = [&](Stored &b) {
+    auto rit = record_of.find(b.id);
+    if (rit != record_of.end() && std::popcount(b.tiers) == 1) {
+      int i = tier_index(static_cast<TierType>(rit->second->tier));
+      if (i >= 0 && (b.tiers >> i & 1) &&
+          tiers_[i]->AdoptBlock(b.id, rit->second->length).ok()) {
+        b.kept = i;
+        b.record = rit->second;
+      }
+    }
+    if (b.kept < 0 && from_snapshot &&
+        meta_store_->GetBlockMeta(b.id, &b.meta).ok() &&
+        b.meta.cached_bytes >= b.meta.length) {
+      int i = tier_index(b.meta.tier);
+      if (i >= 0 && (b.tiers >> i & 1) &&
+          tiers_[i]->AdoptBlock(b.id, b.meta.length).ok())
+        b.kept = i;
+    }
+    for (size_t i = 0; i < tiers_.size(); ++i) {
+      if ((b.tiers >> i & 1) && static_cast<int>(i) != b.kept) {
+        tiers_[i]->DropStoredBlock(b.id);
+        orphans.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  };
+  {
+    size_t chunks = (stored.size() + kRecoverChunk - 1) / kRecoverChunk;
+    size_t nthreads = opts_.recover_threads
+                          ? opts_.recover_threads
+                          : std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, chunks);
+    std::atomic<size_t> next_chunk{0};
+    auto work = [&] {
+      for (size_t c; (c = next_chunk.fetch_add(1)) < chunks;) {
+        size_t end = std::min(stored.size(), (c + 1) * kRecoverChunk);
+        for (size_t j = c * kRecoverChunk; j < end; ++j)
+          reconcile(stored[j]);
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < nthreads; ++t)
+      workers.emplace_back(work);
+    work();
+    for (auto &t : workers)
+      t.join();
+  }
+
+  // Index the kept blocks: first those the records vouched for, in record
+  // order so each tier's eviction policy comes back as it was, then those
+  // found by lookup
   size_t recovered = 0;
-  for (auto &meta : all_meta) {
-    StorageTier *tier = FindTier(meta.tier);
-    if (tier && tier->HasBlock(meta.block_id)) {
+  auto index_block = [&](const BlockMeta &meta, int i,
+                         const IndexSnapshot::Record *r) {
+    auto state = std::make_shared<BlockState>();
+    state->block_id = meta.block_id;
+    state->length = meta.length;
+    state->tier = tiers_[i]->GetType();
+    state->create_time_ms = meta.create_time_ms;
+    state->last_access_time_ms = meta.last_access_time_ms;
+    state->access_count = meta.access_count;
+    state->cached_bytes = meta.length;
+    state->fetch_cost_us = meta.fetch_cost_us;
+    {
       std::lock_guard<std::mutex> lock(mu_);
-      block_tier_map_[meta.block_id] = meta.tier;
-      cache_mgr_->OnBlockInsert(meta.block_id, meta.length);
-      recovered++;
-    } else {
-      // Block data is gone (e.g., memory tier after restart), clean up meta
-      meta_store_->DeleteBlockMeta(meta.block_id);
+      blocks_[meta.block_id] = std::move(state);
     }
+    if (r)
+      cache_mgrs_[i]->RestoreBlock(meta.block_id, meta.length,
+                                   r->policy_weight, meta.fetch_cost_us);
+    else
+      cache_mgrs_[i]->OnBlockInsert(meta.block_id, meta.length,
+                                    meta.fetch_cost_us);
+    recovered++;
+  };
+  for (auto &r : records) {
+    auto sit = stored_index.find(r.block_id);
+    Stored *b = sit == stored_index.end() ? nullptr : &stored[sit->second];
+    if (b && b->record == &r) {
+      BlockMeta meta;
+      meta.block_id = r.block_id;
+      meta.length = r.length;
+      meta.create_time_ms = r.create_time_ms;
+      meta.last_access_time_ms = r.last_access_time_ms;
+      meta.access_count = r.access_count;
+      meta.fetch_cost_us = r.fetch_cost_us;
+      index_block(meta, b->kept, &r);
+    } else if (!b || b->kept < 0) {
+      // Block data is gone (e.g., memory tier after restart)
+      stale.push_back(r.block_id);
+    }
+  }
+  for (auto &b : stored) {
+    if (b.kept >= 0 && !b.record)
+      index_block(b.meta, b.kept, nullptr);
+    else if (b.kept < 0 && !record_of.count(b.id))
+      stale.push_back(b.id); // e.g. partial, or in the wrong tier
   }
-  LOG_INFO("BlockStore recovery: {} blocks recovered from MetaStore",
-           recovered);
+  for (BlockId id : stale)
+    meta_store_->DeleteBlockMeta(id);
+
+  ImportMemorySpill();
+
+  recovered_ = true;
+  Metrics::Instance().IncrCounter("block_store.recover_orphans",
+                                  orphans.load());
+  auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - started)
+                        .count();
+  LOG_INFO("BlockStore recovery: {} blocks recovered from {}, {} orphaned "
+           "copies deleted, {} ms",
+           recovered, from_snapshot ? "index snapshot" : "MetaStore",
+           orphans.load(), elapsed_ms);
+  return Status::OK();
+}
+
+// ─── Memory tier spill ──────────────────────────────────────
+
+std::unique_ptr<StorageTier> BlockStore::OpenSpillTier() const {
+  // Holds at most one memory tier's worth of blocks
+  const StorageTier *mem = FindTier(TierType::kMemory);
+  TierConfig tc;
+  tc.type = TierType::kSSD;
+  tc.path = opts_.memory_spill_dir;
+  tc.capacity_bytes = mem ? mem->GetCapacity() : 0;
+  return std::make_unique<StorageTier>(tc);
+}
+
+Status BlockStore::SpillMemoryTier() {
+  StorageTier *mem = FindTier(TierType::kMemory);
+  if (opts_.memory_spill_dir.empty() || !mem)
+    return Status::OK();
+  ScopedLatency latency("block_store.spill_ms");
+  std::error_code ec;
+  std::filesystem::remove_all(opts_.memory_spill_dir, ec);
+  auto spill = OpenSpillTier();
+
+  // Hottest first, so a timeout drops the coldest blocks
+  auto order = CacheFor(TierType::kMemory)->ExportPolicy();
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(opts_.memory_spill_timeout_ms);
+  std::vector<IndexSnapshot::Record> spilled;
+  std::vector<char> buf;
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      LOG_WARN("Memory tier spill timed out after {} of {} blocks",
+               spilled.size(), order.size());
+      break;
+    }
+    Lease lease;
+    if (!AcquireLease(it->first, &lease).ok() ||
+        lease.tier() != TierType::kMemory)
+      continue;
+    auto &state = *lease.state_;
+    if (state.cached_bytes.load(std::memory_order_relaxed) < state.length)
+      continue; // partial: valid pages are not persisted
+    BlockHandle handle;
+    buf.resize(state.length);
+    auto s = lease.Read(buf.data(), state.length, 0);
+    if (s.ok())
+      s = spill->AllocateBlock(state.block_id, state.length, &handle);
+    if (s.ok()) {
+      s = spill->WriteBlock(state.block_id, buf.data(), state.length, 0);
+      if (!s.ok())
+        spill->RemoveBlock(state.block_id);
+    }
+    if (!s.ok()) {
+      LOG_WARN("Spill of block {} failed: {}", state.block_id, s.ToString());
+      continue;
+    }
+    IndexSnapshot::Record r;
+    r.block_id = state.block_id;
+    r.length = state.length;
+    r.create_time_ms = state.create_time_ms;
+    r.last_access_time_ms =
+        state.last_access_time_ms.load(std::memory_order_relaxed);
+    r.access_count = state.access_count.load(std::memory_order_relaxed);
+    r.policy_weight = it->second;
+    r.tier = static_cast<uint8_t>(TierType::kMemory);
+    r.fetch_cost_us =
+        SaturateCost(state.fetch_cost_us.load(std::memory_order_relaxed));
+    spilled.push_back(r);
+  }
+
+  // The manifest goes last: without it the next Recover ignores the spill
+  RETURN_IF_ERROR(IndexSnapshot::Write(opts_.memory_spill_dir + "/manifest",
+                                       spilled, NowMs()));
+  Metrics::Instance().IncrCounter("block_store.spilled_blocks",
+                                  spilled.size());
+  LOG_INFO("Spilled {} memory-tier blocks to {}", spilled.size(),
+           opts_.memory_spill_dir);
   return Status::OK();
 }
 
+void BlockStore::ImportMemorySpill() {
+  StorageTier *mem = FindTier(TierType::kMemory);
+  if (opts_.memory_spill_dir.empty() ||
+      !std::filesystem::exists(opts_.memory_spill_dir))
+    return;
+
+  IndexSnapshot manifest;
+  auto s = manifest.Open(opts_.memory_spill_dir + "/manifest");
+  size_t imported = 0;
+  if (!s.ok()) {
+    LOG_WARN("Memory tier spill unusable: {}", s.ToString());
+  } else if (mem) {
+    auto spill = OpenSpillTier();
+    size_t limit = static_cast<size_t>(mem->GetCapacity() *
+                                       opts_.auto_evict_high_watermark);
+    std::vector<const IndexSnapshot::Record *> restored;
+    std::vector<BlockMeta> metas;
+    std::vector<char> buf;
+    // Records are hottest first: import until the tier is at its watermark
+    for (auto &r : manifest.records()) {
+      if (mem->GetUsedBytes() + r.length > limit)
+        break;
+      if (HasBlock(r.block_id) ||
+          !spill->AdoptBlock(r.block_id, r.length).ok())
+        continue;
+      BlockHandle handle;
+      buf.resize(r.length);
+      s = spill->ReadBlock(r.block_id, buf.data(), r.length, 0);
+      if (s.ok())
+        s = mem->AllocateBlock(r.block_id, r.length, &handle);
+      if (s.ok()) {
+        s = mem->WriteBlock(r.block_id, buf.data(), r.length, 0);
+        if (!s.ok())
+          mem->RemoveBlock(r.block_id);
+      }
+      if (!s.ok()) {
+        LOG_WARN("Import of spilled block {} failed: {}", r.block_id,
+                 s.ToString());
+        continue;
+      }
+      auto state = std::make_shared<BlockState>();
+      state->block_id = r.block_id;
+      state->length = r.length;
+      state->tier = TierType::kMemory;
+      state->create_time_ms = r.create_time_ms;
+      state->last_access_time_ms = r.last_access_time_ms;
+      state->access_count = r.access_count;
+      state->cached_bytes = r.length;
+      state->fetch_cost_us = r.fetch_cost_us;
+      metas.push_back(state->ToMeta(TierType::kMemory));
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        blocks_[r.block_id] = std::move(state);
+      }
+      restored.push_back(&r);
+    }
+    // The policy is rebuilt victim first
+    for (auto it = restored.rbegin(); it != restored.rend(); ++it) {
+      CacheFor(TierType::kMemory)
+          ->RestoreBlock((*it)->block_id, (*it)->length, (*it)->policy_weight,
+                         (*it)->fetch_cost_us);
+    }
+    if (!metas.empty()) {
+      std::lock_guard<std::mutex> meta_lock(meta_mu_);
+      s = meta_store_->PutBlockMetaBatch(metas);
+      if (!s.ok())
+        LOG_WARN("Persisting imported block metadata failed: {}",
+                 s.ToString());
+    }
+    imported = restored.size();
+    Metrics::Instance().IncrCounter("block_store.spill_imported_blocks",
+                                    imported);
+  }
+
+  // One-shot: a later crash must not re-import stale copies
+  std::error_code ec;
+  std::filesystem::remove_all(opts_.memory_spill_dir, ec);
+  LOG_INFO("Imported {} spilled blocks into the memory tier", imported);
+}
+
 bool BlockStore::HasBlock(BlockId id) const {
   std::lock_guard<std::mutex> lock(mu_);
-  return block_tier_map_.count(id) > 0;
+  return blocks_.count(id) > 0;
 }
 
 Status BlockStore::GetBlockMeta(BlockId id, BlockMeta *meta) const {
-  return meta_store_->GetBlockMeta(id, meta);
+  // The in-memory state is newer than the MetaStore between flushes
+  TierType tier;
+  auto state = LookupBlock(id, &tier);
+  if (!state)
+    return Status::NotFound("block not found");
+  *meta = state->ToMeta(tier);
+  return Status::OK();
 }
 
 size_t BlockStore::GetTierUsedBytes(TierType tier) const {
@@ -233,13 +1413,25 @@ size_t BlockStore::GetTierUsedBytes(TierType tier) const {
   return t ? t->GetUsedBytes() : 0;
 }
 
+std::vector<MissRatioCurve::Point>
+BlockStore::GetMissRatioCurve(TierType tier) const {
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    if (tiers_[i]->GetType() == tier)
+      return cache_mgrs_[i]->GetMissRatioCurve();
+  }
+  return {};
+}
+
 size_t BlockStore::GetTierCapacity(TierType tier) const {
   auto *t = FindTier(tier);
   return t ? t->GetCapacity() : 0;
 }
 
 size_t BlockStore::GetTotalCachedBytes() const {
-  return cache_mgr_->GetCachedBytes();
+  size_t total = 0;
+  for (auto &cache : cache_mgrs_)
+    total += cache->GetCachedBytes();
+  return total;
 }
 
 StorageTier *BlockStore::FindTier(TierType type) {
@@ -258,22 +1450,13 @@ const StorageTier *BlockStore::FindTier(TierType type) const {
   return nullptr;
 }
 
-void BlockStore::MaybeAutoPromote(BlockId id, const BlockMeta &meta) {
+void BlockStore::MaybeAutoPromote(BlockId id, TierType current_tier,
+                                  uint64_t access_count, uint64_t length) {
   if (opts_.auto_promote_access_threshold == 0)
     return;
-  if (meta.access_count < opts_.auto_promote_access_threshold)
+  if (access_count < opts_.auto_promote_access_threshold)
     return;
 
-  // Find current tier
-  TierType current_tier;
-  {
-    std::lock_guard<std::mutex> lock(mu_);
-    auto it = block_tier_map_.find(id);
-    if (it == block_tier_map_.end())
-      return;
-    current_tier = it->second;
-  }
-
   // Find next faster tier (lower enum value = faster)
   TierType target = current_tier;
   if (current_tier == TierType::kHDD)
@@ -285,14 +1468,13 @@ void BlockStore::MaybeAutoPromote(BlockId id, const BlockMeta &meta) {
 
   // Only promote if target tier exists and has space
   StorageTier *dst = FindTier(target);
-  if (!dst || dst->GetAvailableBytes() < meta.length)
+  if (!dst || dst->GetAvailableBytes() < length)
     return;
 
   auto s = PromoteBlock(id, target);
   if (s.ok()) {
     LOG_DEBUG("Auto-promoted block {} from {} to {} (access_count={})", id,
-              TierTypeName(current_tier), TierTypeName(target),
-              meta.access_count);
+              TierTypeName(current_tier), TierTypeName(target), access_count);
   }
 }
 
@@ -305,28 +1487,56 @@ void BlockStore::MaybeAutoEvict(TierType tier) {
   if (usage <= opts_.auto_evict_high_watermark)
     return;
 
-  // Evict down to low watermark
-  size_t target_used =
-      static_cast<size_t>(t->GetCapacity() * opts_.auto_evict_low_watermark);
-  size_t to_free =
-      t->GetUsedBytes() > target_used ? t->GetUsedBytes() - target_used : 0;
-  if (to_free == 0)
-    return;
-
-  std::vector<BlockId> evicted;
-  EvictBlocks(tier, to_free, &evicted);
-  if (!evicted.empty()) {
-    LOG_DEBUG("Auto-evicted {} blocks from {} (freed ~{} bytes, usage {:.1f}%)",
-              evicted.size(), TierTypeName(tier), to_free, usage * 100);
+  // Reclaim off the caller's path
+  std::lock_guard<std::mutex> lock(reclaim_mu_);
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    auto &r = reclaimers_[i];
+    if (tiers_[i]->GetType() == tier && r.requested == r.completed) {
+      r.requested++;
+      reclaim_cv_.notify_all();
+    }
   }
 }
 
 StorageTier *BlockStore::FindBlockTier(BlockId id) {
   std::lock_guard<std::mutex> lock(mu_);
-  auto it = block_tier_map_.find(id);
-  if (it == block_tier_map_.end())
+  auto it = blocks_.find(id);
+  if (it == blocks_.end())
     return nullptr;
-  return FindTier(it->second);
+  return FindTier(it->second->tier);
+}
+
+std::shared_ptr<BlockStore::BlockState>
+BlockStore::LookupBlock(BlockId id, TierType *tier) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = blocks_.find(id);
+  if (it == blocks_.end())
+    return nullptr;
+  *tier = it->second->tier;
+  return it->second;
+}
+
+size_t BlockStore::BlockLength(BlockId id) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = blocks_.find(id);
+  return it == blocks_.end() ? 0 : it->second->length;
+}
+
+CacheManager *BlockStore::CacheFor(TierType type) {
+  for (size_t i = 0; i < tiers_.size(); ++i) {
+    if (tiers_[i]->GetType() == type)
+      return cache_mgrs_[i].get();
+  }
+  return nullptr;
+}
+
+StorageTier *BlockStore::NextSlowerTier(TierType type) {
+  // tiers_ is sorted fastest first
+  for (size_t i = 0; i + 1 < tiers_.size(); ++i) {
+    if (tiers_[i]->GetType() == type)
+      return tiers_[i + 1].get();
+  }
+  return nullptr;
 }
 
 } // namespace anycache
@@ -7,34 +7,138 @@
 #include "worker/meta_store.h"
 #include "worker/storage_tier.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <span>
+#include <thread>
 #include <vector>
 
 namespace anycache {
 
 // BlockStore manages all storage tiers and coordinates reads/writes
 // with the CacheManager for eviction and the MetaStore for persistence.
+// Each tier has its own CacheManager, so eviction only ever picks victims
+// that live in the tier being freed, and its own background reclaimer thread
+// that keeps usage between the low and high watermarks. CreateBlock only
+// waits for the reclaimer when every tier is full.
+// Access statistics live in the in-memory block index and reach the MetaStore
+// in periodic batches, so cache-hit reads never touch it; a crash loses at
+// most meta_flush_interval_ms worth of access counts.
+// Reads and writes go through leases: a leased (pinned) block is never evicted
+// or moved to another tier, so a resolved tier stays valid for the whole I/O.
+// Partial blocks track which page_size ranges hold data in a bitmap; missing
+// pages are fetched on demand by ReadBlockThrough.
+// The disk-tier part of the index, with each tier's eviction order, is
+// snapshotted periodically (see IndexSnapshot); Recover loads the snapshot and
+// reconciles it against the blocks actually on disk instead of scanning the
+// whole MetaStore. The snapshot also lists memory-tier blocks, whose
+// MetaStore records Recover deletes. Memory-tier blocks can be carried across
+// a graceful restart the same way: SpillMemoryTier copies them to a staging
+// directory and Recover re-imports them.
 class BlockStore {
+  struct BlockState;
+
 public:
   struct Options {
     std::vector<TierConfig> tiers;
     std::string meta_db_path = "/tmp/anycache/meta";
     CacheManager::PolicyType cache_policy = CacheManager::PolicyType::kLRU;
+    // W-TinyLFU admission in front of each tier's policy (see CacheManager);
+    // the window gets this share of the tier's high watermark
+    bool cache_admission = false;
+    double admission_window_ratio = 0.01;
+    // Lock shards of each tier's CacheManager (rounded up to a power of two)
+    size_t cache_shards = 16;
+    // Per-tier miss-ratio curve (estimated hit ratio at 0.5x, 1x, 2x and 4x
+    // the tier's capacity) over this share of blocks; 0 = off
+    double mrc_sample_rate = 0.01;
 
     // Auto-promotion: promote a block to faster tier after this many accesses.
     // 0 = disabled.
     uint32_t auto_promote_access_threshold = 3;
 
-    // Auto-eviction: when a tier is above this usage ratio (0.0–1.0), trigger
-    // eviction to free space proactively.
+    // Auto-eviction: when a tier is above this usage ratio (0.0–1.0), its
+    // background reclaimer frees space proactively.
     double auto_evict_high_watermark = 0.95;
     // Evict down to this ratio.
     double auto_evict_low_watermark = 0.80;
+    // Reclaimers also re-check their tier's watermark this often
+    uint32_t reclaim_interval_ms = 1000;
+    // CreateBlock gives up if no tier has room after stalling this long
+    uint32_t create_stall_timeout_ms = 10000;
+
+    // Demotion: evicted blocks move to the next slower tier (memory -> SSD
+    // -> HDD) instead of being dropped; only last-tier victims are dropped.
+    // Watermark reclaim is throttled to demote_bandwidth_bytes_per_sec
+    // (0 = unthrottled); reclaim for a stalled CreateBlock is not.
+    bool demote_on_evict = false;
+    uint64_t demote_bandwidth_bytes_per_sec = 0;
+
+    // Dirty access statistics are written to the MetaStore this often
+    uint32_t meta_flush_interval_ms = 1000;
+
+    // Valid-range granularity of partial blocks
+    size_t page_size = kDefaultPageSize;
+
+    // Index snapshot file; empty = meta_db_path + ".snapshot"
+    std::string snapshot_path;
+    // Write a snapshot this often and on shutdown (0 = never; Recover then
+    // scans the MetaStore)
+    uint32_t snapshot_interval_ms = 60000;
+    // Threads reconciling stored blocks in Recover (0 = one per core)
+    uint32_t recover_threads = 0;
+
+    // Staging directory for SpillMemoryTier (empty = memory-tier blocks are
+    // dropped on restart). Should be on a disk tier's filesystem.
+    std::string memory_spill_dir;
+    // SpillMemoryTier stops after this long; unspilled blocks are dropped
+    uint32_t memory_spill_timeout_ms = 30000;
+  };
+
+  // Called after a block moves to another tier (promotion or demotion)
+  using TierChangeListener = std::function<void(BlockId, TierType)>;
+
+  // Fills a partial block: reads `size` bytes at block offset `offset` from
+  // the backing store into `buf`, zero-filling past its end
+  using RangeFetcher =
+      std::function<Status(uint64_t offset, size_t size, void *buf)>;
+
+  // RAII pin on a cached block. While any lease is held the block stays in
+  // its tier: eviction skips it (it is retried later) and promotion or
+  // demotion gives up. RemoveBlock still unlinks it; I/O through the lease
+  // then fails with NotFound.
+  class Lease {
+  public:
+    Lease() = default;
+    Lease(Lease &&other) noexcept;
+    Lease &operator=(Lease &&other) noexcept;
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+    ~Lease() { Release(); }
+
+    bool valid() const { return state_ != nullptr; }
+    BlockId block_id() const;
+    uint64_t length() const;
+    TierType tier() const;
+
+    Status Read(void *buf, size_t size, off_t offset) const;
+    Status Write(const void *buf, size_t size, off_t offset) const;
+
+    // Unpin early; the lease becomes invalid
+    void Release();
+
+  private:
+    friend class BlockStore;
+    std::shared_ptr<BlockState> state_;
+    StorageTier *tier_ = nullptr;
   };
 
   explicit BlockStore(const Options &opts);
-  ~BlockStore() = default;
+  ~BlockStore();
 
   // Create a block with a deterministic BlockId (composite: inode_id + index)
   Status CreateBlock(BlockId block_id, size_t size);
@@ -42,25 +146,78 @@ public:
   // Ensure a block exists; create it if absent, no-op if already present
   Status EnsureBlock(BlockId block_id, size_t size);
 
+  // Create a block whose pages start out invalid. Writes validate the pages
+  // they fully cover (the last page up to the block's end); ReadBlock fails
+  // with NotFound on a range that is not entirely valid.
+  Status CreatePartialBlock(BlockId block_id, size_t size);
+  Status EnsurePartialBlock(BlockId block_id, size_t size);
+
+  // Read from a block, first fetching the missing pages of the range
+  // through `fetch`. Only those pages are fetched.
+  Status ReadBlockThrough(BlockId id, void *buf, size_t size, off_t offset,
+                          const RangeFetcher &fetch);
+
+  // Feed a measured UFS fetch of `bytes` of the block, taking `elapsed_us`,
+  // into its refetch cost estimate (scaled to the whole block and smoothed
+  // with earlier fetches), which cost-aware eviction (GDSF) weighs.
+  // ReadBlockThrough records its own fetches.
+  void RecordFetch(BlockId id, uint64_t bytes, uint64_t elapsed_us);
+
+  // Pin a cached block; NotFound if it is not cached
+  Status AcquireLease(BlockId id, Lease *lease);
+
   // Read from a cached block
   Status ReadBlock(BlockId id, void *buf, size_t size, off_t offset);
 
   // Write to a block
   Status WriteBlock(BlockId id, const void *buf, size_t size, off_t offset);
 
+  // Batched read/write: requests are grouped by tier and each group is
+  // submitted as one batch. Per-element results are in BlockIo::status; the
+  // return value is the first failure, or OK.
+  Status ReadBlocks(std::span<BlockIo> ios);
+  Status WriteBlocks(std::span<BlockIo> ios);
+
   // Remove a block from all tiers
   Status RemoveBlock(BlockId id);
 
   // Promote a block to a faster tier
   Status PromoteBlock(BlockId id, TierType target_tier);
 
-  // Evict blocks to free space in a tier; returns evicted block ids
+  // Evict blocks to free space in a tier; returns evicted block ids. With
+  // demote_on_evict the victims are demoted synchronously (cascading if the
+  // next tier is full).
   Status EvictBlocks(TierType tier, size_t bytes_needed,
                      std::vector<BlockId> *evicted);
 
-  // Recovery: reload block index from MetaStore (RocksDB)
+  // Set before serving; invoked from the thread that moved the block
+  void SetTierChangeListener(TierChangeListener listener) {
+    tier_listener_ = std::move(listener);
+  }
+
+  // Block until no reclaimer has work pending (for tests)
+  void WaitForReclaim();
+
+  // Persist access statistics changed since the last flush in one batch.
+  // Runs periodically in the background and once more on destruction.
+  Status FlushAccessStats();
+
+  // Recovery: rebuild the block index from the blocks stored on disk, taking
+  // their metadata and eviction order from the index snapshot when there is
+  // one and from the MetaStore otherwise. Stored blocks the metadata does not
+  // vouch for are deleted.
   Status Recover();
 
+  // Write the index snapshot now. A no-op until Recover has run, so a fresh
+  // index never replaces the snapshot of blocks it has not loaded yet.
+  Status WriteIndexSnapshot();
+
+  // Graceful shutdown: copy memory-tier blocks, hottest first, to
+  // memory_spill_dir so the next Recover re-imports them into memory (as
+  // many as fit below the high watermark, in their old eviction order).
+  // Call once I/O has stopped.
+  Status SpillMemoryTier();
+
   // Query
   bool HasBlock(BlockId id) const;
   Status GetBlockMeta(BlockId id, BlockMeta *meta) const;
@@ -69,26 +226,167 @@ public:
   size_t GetTierUsedBytes(TierType tier) const;
   size_t GetTierCapacity(TierType tier) const;
   size_t GetTotalCachedBytes() const;
+  // Empty if the tier does not exist or Options::mrc_sample_rate is 0
+  std::vector<MissRatioCurve::Point> GetMissRatioCurve(TierType tier) const;
 
 private:
   StorageTier *FindTier(TierType type);
   const StorageTier *FindTier(TierType type) const;
   StorageTier *FindBlockTier(BlockId id);
+  CacheManager *CacheFor(TierType type);
+  // Next slower tier than `type`, or nullptr for the last tier
+  StorageTier *NextSlowerTier(TierType type);
+
+  // In-memory state of a cached block. `tier` is guarded by mu_; access
+  // statistics are bumped lock-free by readers. Leases are taken under mu_
+  // and released lock-free, so a zero `pins` seen under mu_ stays zero
+  // until mu_ is dropped.
+  struct BlockState {
+    BlockId block_id = 0;
+    uint64_t length = 0;
+    int64_t create_time_ms = 0;
+    TierType tier = TierType::kMemory;
+    std::atomic<int64_t> last_access_time_ms{0};
+    std::atomic<uint64_t> access_count{0};
+    std::atomic<bool> dirty{false}; // stats changed since the last flush
+    std::atomic<uint32_t> pins{0};  // outstanding leases
+    // Bumped by every write; a tier move that saw it change while copying
+    // would lose the write, so it aborts
+    std::atomic<uint64_t> write_seq{0};
+    // Bytes of valid data; always `length` for a complete block
+    std::atomic<uint64_t> cached_bytes{0};
+    // Estimated UFS refetch time in microseconds, 0 = unknown
+    std::atomic<uint64_t> fetch_cost_us{0};
+    // Partial blocks only: one bit per page, set once the page is valid
+    std::unique_ptr<std::atomic<uint64_t>[]> valid_pages;
+
+    BlockMeta ToMeta(TierType current_tier) const;
+  };
+
+  // State of `id` and its tier at lookup time, or nullptr
+  std::shared_ptr<BlockState> LookupBlock(BlockId id, TierType *tier) const;
+  // Length of a cached block, 0 if unknown
+  size_t BlockLength(BlockId id) const;
+
+  Status CreateBlockImpl(BlockId block_id, size_t size, bool partial);
+
+  // Partial blocks: set the bits of the pages [offset, offset + size) fully
+  // covers and queue the new fill level for the next flush. The last page
+  // clears the block's partial mark in its tier.
+  void MarkValid(const Lease &lease, uint64_t offset, size_t size);
+  bool RangeValid(const BlockState &state, uint64_t offset, size_t size) const;
+  // Pages of [offset, offset + size) as [first, last) page indices
+  std::pair<uint64_t, uint64_t> PageSpan(const BlockState &state,
+                                         uint64_t offset, size_t size) const;
+
+  // Pin `state` under mu_ into `lease`
+  void PinLocked(const std::shared_ptr<BlockState> &state, Lease *lease);
+  bool IsPinned(BlockId id) const;
+
+  // Access bookkeeping after a successful read (policy, stats, promotion).
+  // Releases the read's lease first so promotion is not blocked by it.
+  void RecordRead(Lease lease);
+  // Feed a read request, hit or miss (`size` 0 = unknown), to every tier's
+  // miss-ratio curve
+  void RecordReference(BlockId id, size_t size);
+  // Export the miss-ratio curves as gauges
+  void PublishMissRatioCurves();
+  // Queue `state` for the next flush unless it already is.
+  void MarkDirty(BlockState &state);
+  // Write the current metadata of `id` to the MetaStore, if still cached.
+  void PersistBlockMeta(BlockId id);
+  // Delete `id` from the MetaStore.
+  void DeletePersistedMeta(BlockId id);
+  void FlushLoop();
+  std::string SnapshotPath() const;
+  // Recover: re-import the blocks spilled by SpillMemoryTier
+  void ImportMemorySpill();
+  // Disk-tier view of memory_spill_dir
+  std::unique_ptr<StorageTier> OpenSpillTier() const;
+
+  // Group `ios` by owning tier and submit one batch per tier. Each block is
+  // pinned for the duration; the leases are handed back in `leases`.
+  Status DispatchBatch(std::span<BlockIo> ios, bool is_write,
+                       std::vector<Lease> *leases);
 
   // Try to auto-promote a block to a faster tier based on access count.
-  void MaybeAutoPromote(BlockId id, const BlockMeta &meta);
+  void MaybeAutoPromote(BlockId id, TierType current_tier,
+                        uint64_t access_count, uint64_t length);
 
-  // Check tier usage and trigger eviction if above high watermark.
+  // Wake the tier's reclaimer if its usage is above the high watermark.
   void MaybeAutoEvict(TierType tier);
 
+  // Fastest tier with `size` bytes available, or nullptr
+  StorageTier *FindTierWithSpace(size_t size);
+  // Every tier is full: have the fastest tier's reclaimer free `size` bytes
+  // and wait for it.
+  Status WaitForSpace(size_t size, StorageTier **target);
+
+  // Copy a block to another tier, switch readers over, then free the source.
+  Status MoveBlock(BlockId id, TierType target_type);
+  // An eviction victim of `tier`: demote it if enabled and possible, else
+  // drop it. A pinned victim is put back into the tier's cache manager to be
+  // retried later; returns false in that case.
+  bool DemoteOrDrop(BlockId id, TierType tier);
+  // False if the block is pinned or no longer in `tier`
+  bool DropBlock(BlockId id, TierType tier);
+  void RequeueVictim(BlockId id, TierType tier);
+
+  // Evict (demote or drop) victims of `tier` until `bytes` are freed,
+  // skipping pinned blocks. Returns the number of blocks evicted.
+  size_t EvictFromTier(TierType tier, size_t bytes, bool throttle,
+                       std::vector<BlockId> *evicted);
+
+  // Background reclaim, one thread per tier
+  void ReclaimLoop(size_t index);
+  // One pass: evict down to the low watermark if above the high one, and at
+  // least `bytes_needed` more. Returns the number of blocks evicted.
+  size_t ReclaimTier(TierType tier, size_t bytes_needed);
+  // Sleep as needed to keep demotion within its bandwidth budget.
+  void ThrottleDemotion(size_t bytes);
+
   Options opts_;
   std::vector<std::unique_ptr<StorageTier>> tiers_;
-  std::unique_ptr<CacheManager> cache_mgr_;
+  std::vector<std::unique_ptr<CacheManager>> cache_mgrs_; // parallel to tiers_
   std::unique_ptr<MetaStore> meta_store_;
+  TierChangeListener tier_listener_;
 
   mutable std::mutex mu_;
-  // block_id -> which tier it's in
-  std::unordered_map<BlockId, TierType> block_tier_map_;
+  // block_id -> in-memory state (tier, length, access statistics)
+  std::unordered_map<BlockId, std::shared_ptr<BlockState>> blocks_;
+
+  // Serializes MetaStore writes so a flush never resurrects a removed block
+  // or overwrites a newer tier with a stale one
+  std::mutex meta_mu_;
+  std::mutex dirty_mu_;
+  std::vector<BlockId> dirty_ids_; // guarded by dirty_mu_
+
+  std::mutex flush_mu_;
+  std::condition_variable flush_cv_;
+  bool stop_flush_ = false;
+  std::thread flusher_;
+
+  std::mutex snapshot_mu_; // one snapshot writer at a time
+  std::atomic<bool> recovered_{false};
+  std::atomic<int64_t> last_snapshot_ms_{0}; // 0 = none yet
+
+  // Per-tier background reclaimer, parallel to tiers_. Guarded by
+  // reclaim_mu_ except the thread handle.
+  struct Reclaimer {
+    uint64_t requested = 0;  // bumped to request a pass
+    uint64_t completed = 0;  // `requested` value served by the last pass
+    size_t bytes_needed = 0; // stalled CreateBlock demand for the next pass
+    size_t last_evicted = 0; // blocks evicted by the last pass
+    bool running = false;
+    std::thread thread;
+  };
+  std::mutex reclaim_mu_;
+  std::condition_variable reclaim_cv_;
+  std::vector<Reclaimer> reclaimers_;
+  bool stop_reclaim_ = false;
+
+  std::mutex throttle_mu_;
+  std::chrono::steady_clock::time_point demote_next_slot_;
 };
 
 } // namespace anycache
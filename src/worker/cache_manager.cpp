@@ -1,5 +1,14 @@
 #include "worker/cache_manager.h"
 #include "common/logging.h"
+#include "common/metrics.h"
+#include "worker/frequency_sketch.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <chrono>
 
 namespace anycache {
 
@@ -42,146 +51,1028 @@ BlockId LRUPolicy::Evict() {
   return victim;
 }
 
+BlockId LRUPolicy::Peek() {
+  return order_.empty() ? kInvalidBlockId : order_.front();
+}
+
 size_t LRUPolicy::Size() const { return map_.size(); }
 
+std::vector<std::pair<BlockId, uint64_t>> LRUPolicy::Export() const {
+  std::vector<std::pair<BlockId, uint64_t>> out;
+  out.reserve(order_.size());
+  for (BlockId id : order_)
+    out.emplace_back(id, 0);
+  return out;
+}
+
+void LRUPolicy::Restore(BlockId id, uint64_t /*weight*/) { OnInsert(id); }
+
 // ═══════════════════════════════════════════════════════════════
 // LFU Policy
 // ═══════════════════════════════════════════════════════════════
+void LFUPolicy::Place(BlockId id, Entry &e, uint64_t freq, BucketIter next) {
+  if (next == buckets_.end() || next->freq != freq)
+    next = buckets_.insert(next, Bucket{freq, {}});
+  e.bucket = next;
+  e.pos = next->blocks.insert(next->blocks.end(), id);
+}
+
+void LFUPolicy::Unlink(Entry &e) {
+  e.bucket->blocks.erase(e.pos);
+  if (e.bucket->blocks.empty())
+    buckets_.erase(e.bucket);
+}
+
 void LFUPolicy::OnAccess(BlockId id) {
-  auto fit = freq_map_.find(id);
-  if (fit == freq_map_.end())
+  auto it = entries_.find(id);
+  if (it == entries_.end())
     return;
+  auto &e = it->second;
+  uint64_t freq = e.bucket->freq + 1;
+  BucketIter next = std::next(e.bucket);
+  Unlink(e);
+  Place(id, e, freq, next);
+}
 
-  uint64_t old_freq = fit->second;
-  uint64_t new_freq = old_freq + 1;
-  fit->second = new_freq;
+void LFUPolicy::OnInsert(BlockId id) {
+  if (entries_.count(id)) {
+    OnAccess(id);
+    return;
+  }
+  // New entry starts at freq 1
+  Place(id, entries_[id], 1, buckets_.begin());
+}
+
+void LFUPolicy::OnRemove(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
+    return;
+  Unlink(it->second);
+  entries_.erase(it);
+}
+
+BlockId LFUPolicy::Evict() {
+  BlockId victim = Peek();
+  if (victim != kInvalidBlockId)
+    OnRemove(victim);
+  return victim;
+}
 
-  // Remove from old freq list
-  auto &old_list = freq_lists_[old_freq];
-  old_list.remove(id);
-  if (old_list.empty()) {
-    freq_lists_.erase(old_freq);
-    if (min_freq_ == old_freq)
-      min_freq_ = new_freq;
+BlockId LFUPolicy::Peek() {
+  return buckets_.empty() ? kInvalidBlockId
+                          : buckets_.front().blocks.front();
+}
+
+size_t LFUPolicy::Size() const { return entries_.size(); }
+
+std::vector<std::pair<BlockId, uint64_t>> LFUPolicy::Export() const {
+  std::vector<std::pair<BlockId, uint64_t>> out;
+  out.reserve(entries_.size());
+  for (auto &bucket : buckets_) {
+    for (BlockId id : bucket.blocks)
+      out.emplace_back(id, bucket.freq);
   }
+  return out;
+}
 
-  // Add to new freq list
-  freq_lists_[new_freq].push_back(id);
+void LFUPolicy::Restore(BlockId id, uint64_t weight) {
+  OnRemove(id);
+  uint64_t freq = std::max<uint64_t>(weight, 1);
+  // Exports come in increasing frequency, so the bucket is normally last
+  BucketIter next = buckets_.end();
+  if (!buckets_.empty() && buckets_.back().freq >= freq) {
+    next = buckets_.begin();
+    while (next->freq < freq)
+      ++next;
+  }
+  Place(id, entries_[id], freq, next);
 }
 
-void LFUPolicy::OnInsert(BlockId id) {
-  // New entry starts at freq 1
-  auto fit = freq_map_.find(id);
-  if (fit != freq_map_.end()) {
-    OnAccess(id);
+// ═══════════════════════════════════════════════════════════════
+// ARC Policy
+// ═══════════════════════════════════════════════════════════════
+std::list<BlockId> &ARCPolicy::ListOf(Where where) {
+  switch (where) {
+  case Where::kT1:
+    return t1_;
+  case Where::kT2:
+    return t2_;
+  case Where::kB1:
+    return b1_;
+  case Where::kB2:
+    break;
+  }
+  return b2_;
+}
+
+void ARCPolicy::MoveTo(Entry &e, Where to) {
+  auto &dst = ListOf(to);
+  dst.splice(dst.end(), ListOf(e.where), e.pos);
+  e.where = to;
+}
+
+void ARCPolicy::TrimGhosts() {
+  // |T1| + |B1| <= c and the whole directory <= 2c
+  while (!b1_.empty() && t1_.size() + b1_.size() > capacity_) {
+    entries_.erase(b1_.front());
+    b1_.pop_front();
+  }
+  while (!b2_.empty() && Size() + b1_.size() + b2_.size() > 2 * capacity_) {
+    entries_.erase(b2_.front());
+    b2_.pop_front();
+  }
+}
+
+void ARCPolicy::OnAccess(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
     return;
+  auto &e = it->second;
+  if (e.where == Where::kT1 || e.where == Where::kT2)
+    MoveTo(e, Where::kT2);
+}
+
+void ARCPolicy::OnInsert(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    t1_.push_back(id);
+    entries_[id] = Entry{Where::kT1, std::prev(t1_.end())};
+  } else {
+    auto &e = it->second;
+    // A ghost hit: the list that lost the block should have been larger
+    if (e.where == Where::kB1) {
+      size_t delta = std::max<size_t>(b2_.size() / b1_.size(), 1);
+      p_ = std::min(capacity_, p_ + delta);
+    } else if (e.where == Where::kB2) {
+      size_t delta = std::max<size_t>(b1_.size() / b2_.size(), 1);
+      p_ = p_ > delta ? p_ - delta : 0;
+    }
+    MoveTo(e, Where::kT2);
   }
+  capacity_ = std::max(capacity_, Size());
+  TrimGhosts();
+}
 
-  freq_map_[id] = 1;
-  freq_lists_[1].push_back(id);
-  min_freq_ = 1;
+void ARCPolicy::OnRemove(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end() || it->second.where == Where::kB1 ||
+      it->second.where == Where::kB2)
+    return; // ghosts stay remembered
+  ListOf(it->second.where).erase(it->second.pos);
+  entries_.erase(it);
 }
 
-void LFUPolicy::OnRemove(BlockId id) {
-  auto fit = freq_map_.find(id);
-  if (fit == freq_map_.end())
+void ARCPolicy::Erase(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
+    return;
+  ListOf(it->second.where).erase(it->second.pos);
+  entries_.erase(it);
+}
+
+BlockId ARCPolicy::Peek() {
+  if (!t1_.empty() && (t1_.size() > p_ || t2_.empty()))
+    return t1_.front();
+  return t2_.empty() ? kInvalidBlockId : t2_.front();
+}
+
+BlockId ARCPolicy::Evict() {
+  BlockId victim = Peek();
+  if (victim == kInvalidBlockId)
+    return victim;
+  auto &e = entries_[victim];
+  MoveTo(e, e.where == Where::kT1 ? Where::kB1 : Where::kB2);
+  TrimGhosts();
+  return victim;
+}
+
+std::vector<std::pair<BlockId, uint64_t>> ARCPolicy::Export() const {
+  std::vector<std::pair<BlockId, uint64_t>> out;
+  out.reserve(Size());
+  for (BlockId id : t1_)
+    out.emplace_back(id, 1);
+  for (BlockId id : t2_)
+    out.emplace_back(id, 2);
+  return out;
+}
+
+void ARCPolicy::Restore(BlockId id, uint64_t weight) {
+  Erase(id);
+  auto &list = weight >= 2 ? t2_ : t1_;
+  list.push_back(id);
+  entries_[id] =
+      Entry{weight >= 2 ? Where::kT2 : Where::kT1, std::prev(list.end())};
+  capacity_ = std::max(capacity_, Size());
+}
+
+// ═══════════════════════════════════════════════════════════════
+// 2Q Policy
+// ═══════════════════════════════════════════════════════════════
+std::list<BlockId> &TwoQPolicy::ListOf(Where where) {
+  switch (where) {
+  case Where::kA1in:
+    return a1in_;
+  case Where::kA1out:
+    return a1out_;
+  case Where::kAm:
+    break;
+  }
+  return am_;
+}
+
+void TwoQPolicy::MoveTo(Entry &e, Where to) {
+  auto &dst = ListOf(to);
+  dst.splice(dst.end(), ListOf(e.where), e.pos);
+  e.where = to;
+}
+
+void TwoQPolicy::OnAccess(BlockId id) {
+  auto it = entries_.find(id);
+  if (it != entries_.end() && it->second.where == Where::kAm)
+    MoveTo(it->second, Where::kAm);
+}
+
+void TwoQPolicy::OnInsert(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    a1in_.push_back(id);
+    entries_[id] = Entry{Where::kA1in, std::prev(a1in_.end())};
+  } else if (it->second.where == Where::kA1out) {
+    MoveTo(it->second, Where::kAm);
+  } else {
+    OnAccess(id);
+  }
+  capacity_ = std::max(capacity_, Size());
+}
+
+void TwoQPolicy::OnRemove(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end() || it->second.where == Where::kA1out)
+    return; // ghosts stay remembered
+  ListOf(it->second.where).erase(it->second.pos);
+  entries_.erase(it);
+}
+
+void TwoQPolicy::Erase(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
     return;
+  ListOf(it->second.where).erase(it->second.pos);
+  entries_.erase(it);
+}
 
-  uint64_t freq = fit->second;
-  auto &lst = freq_lists_[freq];
-  lst.remove(id);
-  if (lst.empty()) {
-    freq_lists_.erase(freq);
+BlockId TwoQPolicy::Peek() {
+  size_t kin = std::max<size_t>(capacity_ / 4, 1);
+  if (!a1in_.empty() && (a1in_.size() > kin || am_.empty()))
+    return a1in_.front();
+  return am_.empty() ? kInvalidBlockId : am_.front();
+}
+
+BlockId TwoQPolicy::Evict() {
+  BlockId victim = Peek();
+  if (victim == kInvalidBlockId)
+    return victim;
+  auto it = entries_.find(victim);
+  if (it->second.where == Where::kAm) {
+    am_.erase(it->second.pos);
+    entries_.erase(it);
+    return victim;
   }
-  freq_map_.erase(fit);
+  MoveTo(it->second, Where::kA1out);
+  size_t kout = std::max<size_t>(capacity_ / 2, 1);
+  while (a1out_.size() > kout) {
+    entries_.erase(a1out_.front());
+    a1out_.pop_front();
+  }
+  return victim;
 }
 
-BlockId LFUPolicy::Evict() {
-  if (freq_map_.empty())
-    return kInvalidBlockId;
+std::vector<std::pair<BlockId, uint64_t>> TwoQPolicy::Export() const {
+  std::vector<std::pair<BlockId, uint64_t>> out;
+  out.reserve(Size());
+  for (BlockId id : a1in_)
+    out.emplace_back(id, 1);
+  for (BlockId id : am_)
+    out.emplace_back(id, 2);
+  return out;
+}
 
-  // Find the min_freq list
-  while (freq_lists_.find(min_freq_) == freq_lists_.end() ||
-         freq_lists_[min_freq_].empty()) {
-    if (freq_map_.empty())
+void TwoQPolicy::Restore(BlockId id, uint64_t weight) {
+  Erase(id);
+  auto &list = weight >= 2 ? am_ : a1in_;
+  list.push_back(id);
+  entries_[id] =
+      Entry{weight >= 2 ? Where::kAm : Where::kA1in, std::prev(list.end())};
+  capacity_ = std::max(capacity_, Size());
+}
+
+// ═══════════════════════════════════════════════════════════════
+// S3-FIFO Policy
+// ═══════════════════════════════════════════════════════════════
+namespace {
+constexpr uint8_t kS3MaxFreq = 3;
+constexpr uint64_t kS3MainWeight = 4; // export weight offset of main blocks
+} // namespace
+
+std::list<BlockId> &S3FIFOPolicy::ListOf(Where where) {
+  switch (where) {
+  case Where::kSmall:
+    return small_;
+  case Where::kMain:
+    return main_;
+  case Where::kGhost:
+    break;
+  }
+  return ghost_;
+}
+
+void S3FIFOPolicy::MoveTo(Entry &e, Where to) {
+  auto &dst = ListOf(to);
+  dst.splice(dst.end(), ListOf(e.where), e.pos);
+  e.where = to;
+}
+
+void S3FIFOPolicy::OnAccess(BlockId id) {
+  auto it = entries_.find(id);
+  if (it != entries_.end() && it->second.where != Where::kGhost)
+    it->second.freq = std::min<uint8_t>(it->second.freq + 1, kS3MaxFreq);
+}
+
+void S3FIFOPolicy::OnInsert(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    small_.push_back(id);
+    entries_[id] = Entry{Where::kSmall, 0, std::prev(small_.end())};
+  } else if (it->second.where == Where::kGhost) {
+    it->second.freq = 0;
+    MoveTo(it->second, Where::kMain);
+  } else {
+    OnAccess(id);
+  }
+  capacity_ = std::max(capacity_, Size());
+}
+
+void S3FIFOPolicy::OnRemove(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end() || it->second.where == Where::kGhost)
+    return; // ghosts stay remembered
+  ListOf(it->second.where).erase(it->second.pos);
+  entries_.erase(it);
+}
+
+void S3FIFOPolicy::Erase(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
+    return;
+  ListOf(it->second.where).erase(it->second.pos);
+  entries_.erase(it);
+}
+
+BlockId S3FIFOPolicy::Peek() {
+  size_t small_target = std::max<size_t>(capacity_ / 10, 1);
+  // Each step either returns or moves a block; main counts only go down,
+  // so this ends within a few passes
+  for (;;) {
+    if (!small_.empty() && (small_.size() >= small_target || main_.empty())) {
+      BlockId id = small_.front();
+      auto &e = entries_[id];
+      if (e.freq <= 1)
+        return id;
+      e.freq = 0;
+      MoveTo(e, Where::kMain);
+      continue;
+    }
+    if (main_.empty())
       return kInvalidBlockId;
-    min_freq_++;
+    BlockId id = main_.front();
+    auto &e = entries_[id];
+    if (e.freq == 0)
+      return id;
+    e.freq--;
+    MoveTo(e, Where::kMain);
   }
+}
 
-  auto &lst = freq_lists_[min_freq_];
-  BlockId victim = lst.front();
-  lst.pop_front();
-  if (lst.empty())
-    freq_lists_.erase(min_freq_);
-  freq_map_.erase(victim);
+BlockId S3FIFOPolicy::Evict() {
+  BlockId victim = Peek();
+  if (victim == kInvalidBlockId)
+    return victim;
+  auto it = entries_.find(victim);
+  if (it->second.where == Where::kMain) {
+    main_.erase(it->second.pos);
+    entries_.erase(it);
+    return victim;
+  }
+  MoveTo(it->second, Where::kGhost);
+  while (ghost_.size() > capacity_) {
+    entries_.erase(ghost_.front());
+    ghost_.pop_front();
+  }
   return victim;
 }
 
-size_t LFUPolicy::Size() const { return freq_map_.size(); }
+std::vector<std::pair<BlockId, uint64_t>> S3FIFOPolicy::Export() const {
+  std::vector<std::pair<BlockId, uint64_t>> out;
+  out.reserve(Size());
+  for (BlockId id : small_)
+    out.emplace_back(id, entries_.at(id).freq);
+  for (BlockId id : main_)
+    out.emplace_back(id, kS3MainWeight + entries_.at(id).freq);
+  return out;
+}
+
+void S3FIFOPolicy::Restore(BlockId id, uint64_t weight) {
+  Erase(id);
+  bool main = weight >= kS3MainWeight;
+  auto &list = main ? main_ : small_;
+  list.push_back(id);
+  uint8_t freq = static_cast<uint8_t>(std::min<uint64_t>(
+      main ? weight - kS3MainWeight : weight, kS3MaxFreq));
+  entries_[id] =
+      Entry{main ? Where::kMain : Where::kSmall, freq, std::prev(list.end())};
+  capacity_ = std::max(capacity_, Size());
+}
+
+// ═══════════════════════════════════════════════════════════════
+// GDSF Policy
+// ═══════════════════════════════════════════════════════════════
+namespace {
+// Export packs a block's base into the top 48 bits of the weight, so bases
+// are kept at that precision throughout and an export restores exactly
+constexpr uint64_t kGDSFFreqBits = 16;
+constexpr uint64_t kGDSFFreqMask = (1ULL << kGDSFFreqBits) - 1;
+
+double TruncateBase(double base) {
+  return std::bit_cast<double>(std::bit_cast<uint64_t>(base) &
+                               ~kGDSFFreqMask);
+}
+} // namespace
+
+double GDSFPolicy::CostPerByte(const Entry &e) const {
+  if (e.cost > 0 && e.size > 0)
+    return static_cast<double>(e.cost) / e.size;
+  return known_ > 0 ? known_cost_per_byte_ / known_ : 1.0;
+}
+
+void GDSFPolicy::Requeue(BlockId id, Entry &e) {
+  if (e.queued)
+    queue_.erase(e.pos);
+  double priority = e.base + e.freq * CostPerByte(e);
+  e.pos = queue_.emplace(std::make_pair(priority, seq_++), id).first;
+  e.queued = true;
+}
+
+void GDSFPolicy::Forget(Entry &e) {
+  if (e.cost > 0 && e.size > 0) {
+    known_cost_per_byte_ -= static_cast<double>(e.cost) / e.size;
+    if (--known_ == 0)
+      known_cost_per_byte_ = 0; // drop accumulated rounding
+  }
+  queue_.erase(e.pos);
+  e.queued = false;
+}
+
+void GDSFPolicy::OnAccess(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
+    return;
+  it->second.freq++;
+  it->second.base = TruncateBase(inflation_);
+  Requeue(id, it->second);
+}
+
+void GDSFPolicy::OnInsert(BlockId id) {
+  auto [it, inserted] = entries_.try_emplace(id);
+  it->second.freq = 1;
+  it->second.base = TruncateBase(inflation_);
+  Requeue(id, it->second);
+}
+
+void GDSFPolicy::OnRemove(BlockId id) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
+    return;
+  Forget(it->second);
+  entries_.erase(it);
+}
+
+BlockId GDSFPolicy::Evict() {
+  if (queue_.empty())
+    return kInvalidBlockId;
+  auto first = queue_.begin();
+  BlockId victim = first->second;
+  inflation_ = first->first.first;
+  OnRemove(victim);
+  return victim;
+}
+
+double GDSFPolicy::Rank(BlockId id) const {
+  auto it = entries_.find(id);
+  return it == entries_.end() ? 0 : it->second.pos->first.first;
+}
+
+BlockId GDSFPolicy::Peek() {
+  return queue_.empty() ? kInvalidBlockId : queue_.begin()->second;
+}
+
+void GDSFPolicy::SetCost(BlockId id, size_t size, uint64_t cost) {
+  auto it = entries_.find(id);
+  if (it == entries_.end())
+    return;
+  Entry &e = it->second;
+  if (e.size == size && e.cost == cost)
+    return;
+  if (e.cost > 0 && e.size > 0) {
+    known_cost_per_byte_ -= static_cast<double>(e.cost) / e.size;
+    --known_;
+  }
+  e.size = size;
+  e.cost = cost;
+  if (e.cost > 0 && e.size > 0) {
+    known_cost_per_byte_ += static_cast<double>(e.cost) / e.size;
+    ++known_;
+  }
+  Requeue(id, e);
+}
+
+std::vector<std::pair<BlockId, uint64_t>> GDSFPolicy::Export() const {
+  std::vector<std::pair<BlockId, uint64_t>> order;
+  order.reserve(queue_.size());
+  for (auto &[key, id] : queue_) {
+    const Entry &e = entries_.at(id);
+    order.emplace_back(id, std::bit_cast<uint64_t>(e.base) |
+                               std::min(e.freq, kGDSFFreqMask));
+  }
+  return order;
+}
+
+void GDSFPolicy::Restore(BlockId id, uint64_t weight) {
+  OnRemove(id);
+  Entry &e = entries_[id];
+  e.base = std::bit_cast<double>(weight & ~kGDSFFreqMask);
+  e.freq = std::max<uint64_t>(weight & kGDSFFreqMask, 1);
+  // New blocks must not start below the restored ones
+  inflation_ = std::max(inflation_, e.base);
+  Requeue(id, e);
+}
 
 // ═══════════════════════════════════════════════════════════════
 // CacheManager
 // ═══════════════════════════════════════════════════════════════
-CacheManager::CacheManager(PolicyType type) {
+namespace {
+// Accesses a shard queues while it is locked; more are dropped
+constexpr size_t kReadBufferSize = 64;
+
+std::unique_ptr<CachePolicy> MakePolicy(CacheManager::PolicyType type) {
   switch (type) {
-  case PolicyType::kLRU:
-    policy_ = std::make_unique<LRUPolicy>();
-    break;
-  case PolicyType::kLFU:
-    policy_ = std::make_unique<LFUPolicy>();
+  case CacheManager::PolicyType::kLFU:
+    return std::make_unique<LFUPolicy>();
+  case CacheManager::PolicyType::kARC:
+    return std::make_unique<ARCPolicy>();
+  case CacheManager::PolicyType::kTwoQ:
+    return std::make_unique<TwoQPolicy>();
+  case CacheManager::PolicyType::kS3FIFO:
+    return std::make_unique<S3FIFOPolicy>();
+  case CacheManager::PolicyType::kGDSF:
+    return std::make_unique<GDSFPolicy>();
+  case CacheManager::PolicyType::kLRU:
     break;
   }
+  return std::make_unique<LRUPolicy>();
+}
+
+// Orders victims across shards: the block touched longest ago goes first
+uint64_t NowTick() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+struct alignas(64) CacheManager::Shard {
+  struct Block {
+    size_t size;
+    uint64_t tick;     // last insert or access
+    uint64_t cost = 0; // refetch time in microseconds, 0 = unknown
+  };
+
+  std::mutex mu;
+  std::unique_ptr<CachePolicy> policy;
+  std::unordered_map<BlockId, Block> blocks;
+  size_t cached_bytes = 0;
+
+  AdmissionOptions admission; // capacity_bytes is this shard's share
+  FrequencySketch sketch;
+  std::list<BlockId> window; // front = oldest
+  std::unordered_map<BlockId, std::list<BlockId>::iterator> window_pos;
+  size_t window_bytes = 0;
+
+  // Lossy ring of queued accesses: writers claim [read_head, read_tail)
+  // slots with a CAS on read_tail, the lock holder consumes from read_head.
+  // An empty (kInvalidBlockId) slot is claimed but not yet written.
+  std::array<std::atomic<BlockId>, kReadBufferSize> reads;
+  std::atomic<uint64_t> read_head{0};
+  std::atomic<uint64_t> read_tail{0};
+
+  size_t WindowTarget() const {
+    return static_cast<size_t>(admission.capacity_bytes *
+                               admission.window_ratio);
+  }
+};
+
+CacheManager::CacheManager(PolicyType type, const AdmissionOptions &admission,
+                           size_t shards) {
+  size_t count = std::bit_ceil(std::max<size_t>(shards, 1));
+  shard_bits_ = std::countr_zero(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto shard = std::make_unique<Shard>();
+    shard->policy = MakePolicy(type);
+    shard->admission = admission;
+    shard->admission.capacity_bytes = admission.capacity_bytes / count;
+    for (auto &slot : shard->reads)
+      slot.store(kInvalidBlockId, std::memory_order_relaxed);
+    shards_.push_back(std::move(shard));
+  }
+}
+
+CacheManager::~CacheManager() = default;
+
+bool CacheManager::ParsePolicyType(const std::string &name, PolicyType *type) {
+  std::string upper(name);
+  std::transform(upper.begin(), upper.end(), upper.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+  if (upper == "LRU")
+    *type = PolicyType::kLRU;
+  else if (upper == "LFU")
+    *type = PolicyType::kLFU;
+  else if (upper == "ARC")
+    *type = PolicyType::kARC;
+  else if (upper == "2Q")
+    *type = PolicyType::kTwoQ;
+  else if (upper == "S3FIFO" || upper == "S3-FIFO")
+    *type = PolicyType::kS3FIFO;
+  else if (upper == "GDSF")
+    *type = PolicyType::kGDSF;
+  else
+    return false;
+  return true;
+}
+
+CacheManager::Shard &CacheManager::ShardFor(BlockId id) const {
+  if (shard_bits_ == 0)
+    return *shards_[0];
+  // Fibonacci hashing: block ids of one file differ only in the low bits
+  uint64_t h = id * 0x9e3779b97f4a7c15ULL;
+  return *shards_[h >> (64 - shard_bits_)];
 }
 
 void CacheManager::OnBlockAccess(BlockId id) {
-  std::lock_guard<std::mutex> lock(mu_);
-  policy_->OnAccess(id);
+  Shard &shard = ShardFor(id);
+  std::unique_lock<std::mutex> lock(shard.mu, std::try_to_lock);
+  if (lock.owns_lock()) {
+    DrainReadsLocked(shard);
+    AccessLocked(shard, id);
+    return;
+  }
+  // Busy: queue the access for the lock holder instead of waiting
+  uint64_t tail = shard.read_tail.load(std::memory_order_relaxed);
+  do {
+    if (tail - shard.read_head.load(std::memory_order_acquire) >=
+        kReadBufferSize) {
+      Metrics::Instance().IncrCounter("cache_manager.reads_dropped");
+      return;
+    }
+  } while (!shard.read_tail.compare_exchange_weak(
+      tail, tail + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+  shard.reads[tail % kReadBufferSize].store(id, std::memory_order_release);
+  // The holder may have drained just before the store; take the lock if it
+  // is free now so the access is not left waiting for the next operation
+  if (lock.try_lock())
+    DrainReadsLocked(shard);
+}
+
+void CacheManager::DrainReadsLocked(Shard &shard) {
+  uint64_t head = shard.read_head.load(std::memory_order_relaxed);
+  uint64_t tail = shard.read_tail.load(std::memory_order_acquire);
+  for (; head < tail; ++head) {
+    BlockId id = shard.reads[head % kReadBufferSize].exchange(
+        kInvalidBlockId, std::memory_order_acquire);
+    if (id == kInvalidBlockId)
+      break; // claimed, not yet written; picked up by a later drain
+    AccessLocked(shard, id);
+  }
+  shard.read_head.store(head, std::memory_order_release);
 }
 
-void CacheManager::OnBlockInsert(BlockId id, size_t size) {
-  std::lock_guard<std::mutex> lock(mu_);
-  policy_->OnInsert(id);
-  block_sizes_[id] = size;
-  total_cached_bytes_ += size;
+void CacheManager::AccessLocked(Shard &shard, BlockId id) {
+  auto it = shard.blocks.find(id);
+  if (it != shard.blocks.end())
+    it->second.tick = NowTick();
+  if (shard.admission.enabled) {
+    shard.sketch.Increment(id);
+    auto pos = shard.window_pos.find(id);
+    if (pos != shard.window_pos.end()) {
+      shard.window.splice(shard.window.end(), shard.window, pos->second);
+      return;
+    }
+  }
+  shard.policy->OnAccess(id);
+}
+
+void CacheManager::InsertIntoPolicyLocked(Shard &shard, BlockId id) {
+  shard.policy->OnInsert(id);
+  auto it = shard.blocks.find(id);
+  if (it != shard.blocks.end())
+    shard.policy->SetCost(id, it->second.size, it->second.cost);
+}
+
+void CacheManager::OnBlockInsert(BlockId id, size_t size, uint64_t cost_us) {
+  Shard &shard = ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mu);
+  DrainReadsLocked(shard);
+  if (!shard.admission.enabled) {
+    auto [it, inserted] = shard.blocks.emplace(id, Shard::Block{size, 0});
+    if (!inserted) {
+      shard.cached_bytes -= it->second.size;
+      it->second.size = size;
+    }
+    it->second.tick = NowTick();
+    if (cost_us > 0)
+      it->second.cost = cost_us;
+    shard.cached_bytes += size;
+    InsertIntoPolicyLocked(shard, id);
+    return;
+  }
+
+  shard.sketch.Increment(id);
+  uint64_t cost = cost_us;
+  auto it = shard.blocks.find(id);
+  if (it != shard.blocks.end()) {
+    // Re-inserted: restart it at the window's young end
+    if (shard.window_pos.count(id))
+      EraseFromWindowLocked(shard, id);
+    else
+      shard.policy->OnRemove(id);
+    if (cost == 0)
+      cost = it->second.cost;
+    shard.cached_bytes -= it->second.size;
+    shard.blocks.erase(it);
+  }
+  shard.blocks[id] = Shard::Block{size, NowTick(), cost};
+  shard.cached_bytes += size;
+  shard.window_pos[id] = shard.window.insert(shard.window.end(), id);
+  shard.window_bytes += size;
+  shard.sketch.EnsureCapacity(shard.blocks.size());
+  DrainWindowLocked(shard);
 }
 
 void CacheManager::OnBlockRemove(BlockId id) {
-  std::lock_guard<std::mutex> lock(mu_);
-  policy_->OnRemove(id);
-  auto it = block_sizes_.find(id);
-  if (it != block_sizes_.end()) {
-    total_cached_bytes_ -= it->second;
-    block_sizes_.erase(it);
+  Shard &shard = ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mu);
+  DrainReadsLocked(shard);
+  if (shard.window_pos.count(id))
+    EraseFromWindowLocked(shard, id);
+  else
+    shard.policy->OnRemove(id);
+  auto it = shard.blocks.find(id);
+  if (it != shard.blocks.end()) {
+    shard.cached_bytes -= it->second.size;
+    shard.blocks.erase(it);
   }
 }
 
 std::vector<BlockId> CacheManager::GetEvictionCandidates(size_t bytes_needed) {
-  std::lock_guard<std::mutex> lock(mu_);
   std::vector<BlockId> victims;
   size_t freed = 0;
-  while (freed < bytes_needed && policy_->Size() > 0) {
-    BlockId victim = policy_->Evict();
-    if (victim == kInvalidBlockId)
+  // Each shard's next victim and when it was last touched; a shard is only
+  // re-peeked after it gave up a victim
+  struct Head {
+    BlockId id = kInvalidBlockId;
+    double rank = 0;
+    uint64_t tick = 0;
+    bool operator<(const Head &o) const {
+      return rank != o.rank ? rank < o.rank : tick < o.tick;
+    }
+  };
+  std::vector<Head> heads(shards_.size());
+  auto peek = [&](size_t i) {
+    Shard &shard = *shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mu);
+    DrainReadsLocked(shard);
+    Head head;
+    head.id = PeekVictimLocked(shard);
+    if (head.id != kInvalidBlockId) {
+      auto it = shard.blocks.find(head.id);
+      head.rank = shard.policy->Rank(head.id);
+      head.tick = it != shard.blocks.end() ? it->second.tick : 0;
+    }
+    heads[i] = head;
+  };
+  for (size_t i = 0; i < shards_.size(); ++i)
+    peek(i);
+
+  while (freed < bytes_needed) {
+    size_t best = shards_.size();
+    for (size_t i = 0; i < heads.size(); ++i) {
+      if (heads[i].id != kInvalidBlockId &&
+          (best == shards_.size() || heads[i] < heads[best]))
+        best = i;
+    }
+    if (best == shards_.size())
       break;
-    auto it = block_sizes_.find(victim);
-    if (it != block_sizes_.end()) {
-      freed += it->second;
-      total_cached_bytes_ -= it->second;
-      block_sizes_.erase(it);
+
+    Shard &shard = *shards_[best];
+    {
+      std::lock_guard<std::mutex> lock(shard.mu);
+      // Accesses since the peek may have changed the victim; take the
+      // current one
+      BlockId victim = NextVictimLocked(shard);
+      if (victim != kInvalidBlockId) {
+        auto it = shard.blocks.find(victim);
+        if (it != shard.blocks.end()) {
+          freed += it->second.size;
+          shard.cached_bytes -= it->second.size;
+          shard.blocks.erase(it);
+        }
+        victims.push_back(victim);
+      }
     }
-    victims.push_back(victim);
+    peek(best);
   }
   return victims;
 }
 
+std::vector<std::pair<BlockId, uint64_t>> CacheManager::ExportPolicy() const {
+  // Per shard: eviction order, window blocks last (a restore admits them
+  // into the policy), each with its rank and last-touched tick
+  struct Entry {
+    BlockId id;
+    uint64_t weight;
+    double rank;
+    uint64_t tick;
+    bool operator<(const Entry &o) const {
+      return rank != o.rank ? rank < o.rank : tick < o.tick;
+    }
+  };
+  std::vector<std::vector<Entry>> orders(shards_.size());
+  size_t total = 0;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    Shard &shard = *shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto tick_of = [&](BlockId id) {
+      auto it = shard.blocks.find(id);
+      return it != shard.blocks.end() ? it->second.tick : 0;
+    };
+    for (auto &[id, weight] : shard.policy->Export())
+      orders[i].push_back(
+          Entry{id, weight, shard.policy->Rank(id), tick_of(id)});
+    for (BlockId id : shard.window)
+      orders[i].push_back(Entry{id, 0, 0, tick_of(id)});
+    total += orders[i].size();
+  }
+  if (orders.size() == 1) {
+    std::vector<std::pair<BlockId, uint64_t>> order;
+    order.reserve(total);
+    for (auto &e : orders[0])
+      order.emplace_back(e.id, e.weight);
+    return order;
+  }
+
+  // Merge the shards the way GetEvictionCandidates interleaves them
+  std::vector<std::pair<BlockId, uint64_t>> order;
+  order.reserve(total);
+  std::vector<size_t> next(orders.size(), 0);
+  while (order.size() < total) {
+    size_t best = orders.size();
+    for (size_t i = 0; i < orders.size(); ++i) {
+      if (next[i] < orders[i].size() &&
+          (best == orders.size() ||
+           orders[i][next[i]] < orders[best][next[best]]))
+        best = i;
+    }
+    const Entry &e = orders[best][next[best]++];
+    order.emplace_back(e.id, e.weight);
+  }
+  return order;
+}
+
+void CacheManager::RestoreBlock(BlockId id, size_t size, uint64_t weight,
+                                uint64_t cost_us) {
+  Shard &shard = ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mu);
+  DrainReadsLocked(shard);
+  if (shard.admission.enabled) {
+    // A restored block must not lose its first contest to a one-hit block
+    shard.sketch.EnsureCapacity(shard.blocks.size() + 1);
+    shard.sketch.Increment(id);
+    shard.sketch.Increment(id);
+  }
+  shard.policy->Restore(id, weight);
+  auto [it, inserted] = shard.blocks.emplace(id, Shard::Block{size, 0});
+  if (!inserted) {
+    shard.cached_bytes -= it->second.size;
+    it->second.size = size;
+  }
+  it->second.tick = NowTick();
+  if (cost_us > 0)
+    it->second.cost = cost_us;
+  shard.cached_bytes += size;
+  shard.policy->SetCost(id, size, it->second.cost);
+}
+
+void CacheManager::SetBlockCost(BlockId id, uint64_t cost_us) {
+  Shard &shard = ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mu);
+  auto it = shard.blocks.find(id);
+  if (it == shard.blocks.end())
+    return;
+  it->second.cost = cost_us;
+  // Window blocks get their cost when they enter the policy
+  if (!shard.window_pos.count(id))
+    shard.policy->SetCost(id, it->second.size, cost_us);
+}
+
+// ─── Admission ──────────────────────────────────────────────
+
+void CacheManager::EraseFromWindowLocked(Shard &shard, BlockId id) {
+  auto it = shard.window_pos.find(id);
+  shard.window.erase(it->second);
+  shard.window_pos.erase(it);
+  shard.window_bytes -= shard.blocks[id].size;
+}
+
+void CacheManager::DrainWindowLocked(Shard &shard) {
+  size_t target = shard.WindowTarget();
+  while (shard.window.size() > 1 && shard.window_bytes > target &&
+         shard.cached_bytes <= shard.admission.capacity_bytes) {
+    BlockId id = shard.window.front();
+    EraseFromWindowLocked(shard, id);
+    InsertIntoPolicyLocked(shard, id);
+  }
+}
+
+BlockId CacheManager::PeekVictimLocked(Shard &shard) {
+  if (!shard.admission.enabled || shard.window.empty() ||
+      (shard.window_bytes <= shard.WindowTarget() &&
+       shard.policy->Size() > 0))
+    return shard.policy->Peek();
+  BlockId candidate = shard.window.front();
+  BlockId victim = shard.policy->Peek();
+  if (victim == kInvalidBlockId)
+    return candidate;
+  return shard.sketch.Frequency(candidate) > shard.sketch.Frequency(victim)
+             ? victim
+             : candidate;
+}
+
+BlockId CacheManager::NextVictimLocked(Shard &shard) {
+  if (!shard.admission.enabled || shard.window.empty() ||
+      (shard.window_bytes <= shard.WindowTarget() &&
+       shard.policy->Size() > 0))
+    return shard.policy->Evict();
+
+  // The window is over its share: its oldest block is the candidate for
+  // admission and competes with the policy's victim
+  BlockId candidate = shard.window.front();
+  EraseFromWindowLocked(shard, candidate);
+  BlockId victim = shard.policy->Peek();
+  if (victim == kInvalidBlockId)
+    return candidate;
+  if (shard.sketch.Frequency(candidate) > shard.sketch.Frequency(victim)) {
+    shard.policy->Evict();
+    InsertIntoPolicyLocked(shard, candidate);
+    Metrics::Instance().IncrCounter("cache_manager.admission.admitted");
+    return victim;
+  }
+  Metrics::Instance().IncrCounter("cache_manager.admission.rejected");
+  return candidate;
+}
+
+void CacheManager::EnableMissRatioCurve(size_t capacity_bytes,
+                                        double sample_rate) {
+  mrc_ = std::make_unique<MissRatioCurve>(capacity_bytes, sample_rate);
+}
+
+std::vector<MissRatioCurve::Point> CacheManager::GetMissRatioCurve() const {
+  return mrc_ ? mrc_->Curve() : std::vector<MissRatioCurve::Point>{};
+}
+
 size_t CacheManager::GetCachedBlockCount() const {
-  std::lock_guard<std::mutex> lock(mu_);
-  return block_sizes_.size();
+  size_t count = 0;
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mu);
+    count += shard->blocks.size();
+  }
+  return count;
 }
 
 size_t CacheManager::GetCachedBytes() const {
-  std::lock_guard<std::mutex> lock(mu_);
-  return total_cached_bytes_;
+  size_t bytes = 0;
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mu);
+    bytes += shard->cached_bytes;
+  }
+  return bytes;
 }
 
 } // namespace anycache
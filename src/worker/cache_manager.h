@@ -2,24 +2,54 @@
 
 #include "common/status.h"
 #include "common/types.h"
+#include "worker/miss_ratio_curve.h"
 
 #include <list>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace anycache {
 
 // ─── Cache eviction policy interface ─────────────────────────
+// Policies track block ids only; all operations are O(1) (amortized for
+// Evict/Peek of the policies that recycle blocks before picking a victim),
+// except GDSF's O(log n) priority queue.
 class CachePolicy {
 public:
   virtual ~CachePolicy() = default;
   virtual void OnAccess(BlockId id) = 0;
   virtual void OnInsert(BlockId id) = 0;
+  // A resident block left the cache. Also called for blocks Evict() just
+  // returned, so it must not drop their ghost entries.
   virtual void OnRemove(BlockId id) = 0;
   virtual BlockId
   Evict() = 0; // Returns block to evict, kInvalidBlockId if empty
+  // The block Evict() would return, without removing it. May settle
+  // internal queues (S3-FIFO moves recycled blocks on the way).
+  virtual BlockId Peek() = 0;
   virtual size_t Size() const = 0;
+
+  // Size of a block and what a miss on it costs (refetch time in
+  // microseconds, 0 = unknown). Given after every OnInsert/Restore and
+  // whenever the cost estimate changes; only cost-aware policies use it.
+  virtual void SetCost(BlockId /*id*/, size_t /*size*/, uint64_t /*cost*/) {}
+
+  // Orders the next victims of independent shards: the lowest rank goes
+  // first, ties to the block touched longest ago. Policies without a global
+  // priority leave it at 0, which makes the choice recency-based.
+  virtual double Rank(BlockId /*id*/) const { return 0; }
+
+  // Snapshot support: blocks in eviction order (next victim first) with a
+  // policy-specific weight, and re-insertion of one exported block. Restoring
+  // an export in order rebuilds the same policy state (history that is not
+  // resident, like ghost entries, is lost).
+  virtual std::vector<std::pair<BlockId, uint64_t>> Export() const = 0;
+  virtual void Restore(BlockId id, uint64_t weight) = 0;
 };
 
 // ─── LRU policy ──────────────────────────────────────────────
@@ -29,7 +59,10 @@ public:
   void OnInsert(BlockId id) override;
   void OnRemove(BlockId id) override;
   BlockId Evict() override;
+  BlockId Peek() override;
   size_t Size() const override;
+  std::vector<std::pair<BlockId, uint64_t>> Export() const override;
+  void Restore(BlockId id, uint64_t weight) override;
 
 private:
   std::list<BlockId> order_; // front = LRU (victim)
@@ -37,49 +70,287 @@ private:
 };
 
 // ─── LFU policy ──────────────────────────────────────────────
+// Frequency buckets form a list in increasing frequency order, each holding
+// its blocks oldest first, so an access moves a block to the adjacent bucket
+// and the victim is the front of the first bucket.
 class LFUPolicy : public CachePolicy {
 public:
   void OnAccess(BlockId id) override;
   void OnInsert(BlockId id) override;
   void OnRemove(BlockId id) override;
   BlockId Evict() override;
+  BlockId Peek() override;
   size_t Size() const override;
+  // Weight = access frequency
+  std::vector<std::pair<BlockId, uint64_t>> Export() const override;
+  void Restore(BlockId id, uint64_t weight) override;
 
 private:
-  struct Entry {
-    BlockId id;
+  struct Bucket {
     uint64_t freq;
+    std::list<BlockId> blocks; // front = oldest at this freq
+  };
+  using BucketIter = std::list<Bucket>::iterator;
+  struct Entry {
+    BucketIter bucket;
+    std::list<BlockId>::iterator pos;
+  };
+  // Move `id` into the bucket of frequency `freq`, which must be `next` or
+  // belong right before it; creates the bucket if needed
+  void Place(BlockId id, Entry &e, uint64_t freq, BucketIter next);
+  void Unlink(Entry &e);
+
+  std::list<Bucket> buckets_; // increasing freq
+  std::unordered_map<BlockId, Entry> entries_;
+};
+
+// ─── ARC policy ──────────────────────────────────────────────
+// Adaptive Replacement Cache (Megiddo & Modha): blocks seen once live in
+// T1, blocks seen again in T2; ghost lists B1/B2 remember recent victims of
+// each, and a ghost hit shifts the target size of T1 towards the list that
+// would have kept the block. Capacity is the largest resident count seen.
+class ARCPolicy : public CachePolicy {
+public:
+  void OnAccess(BlockId id) override;
+  void OnInsert(BlockId id) override;
+  void OnRemove(BlockId id) override;
+  BlockId Evict() override;
+  BlockId Peek() override;
+  size_t Size() const override { return t1_.size() + t2_.size(); }
+  // Weight = 1 for T1, 2 for T2
+  std::vector<std::pair<BlockId, uint64_t>> Export() const override;
+  void Restore(BlockId id, uint64_t weight) override;
+
+private:
+  enum class Where : uint8_t { kT1, kT2, kB1, kB2 };
+  struct Entry {
+    Where where;
+    std::list<BlockId>::iterator pos;
+  };
+  std::list<BlockId> &ListOf(Where where);
+  // Append the entry's block to `to` (MRU end), unlinking it from its
+  // current list
+  void MoveTo(Entry &e, Where to);
+  void TrimGhosts();
+  // Forget `id`, ghost or resident
+  void Erase(BlockId id);
+
+  std::list<BlockId> t1_, t2_, b1_, b2_; // front = LRU
+  std::unordered_map<BlockId, Entry> entries_;
+  size_t p_ = 0; // target size of T1
+  size_t capacity_ = 0;
+};
+
+// ─── 2Q policy ───────────────────────────────────────────────
+// Full 2Q (Johnson & Shasha): new blocks enter the FIFO A1in (a quarter of
+// capacity) and are evicted from it into the ghost FIFO A1out (half of
+// capacity); a block re-inserted while remembered in A1out goes to the LRU
+// Am. Accesses inside A1in are treated as correlated and ignored.
+class TwoQPolicy : public CachePolicy {
+public:
+  void OnAccess(BlockId id) override;
+  void OnInsert(BlockId id) override;
+  void OnRemove(BlockId id) override;
+  BlockId Evict() override;
+  BlockId Peek() override;
+  size_t Size() const override { return a1in_.size() + am_.size(); }
+  // Weight = 1 for A1in, 2 for Am
+  std::vector<std::pair<BlockId, uint64_t>> Export() const override;
+  void Restore(BlockId id, uint64_t weight) override;
+
+private:
+  enum class Where : uint8_t { kA1in, kA1out, kAm };
+  struct Entry {
+    Where where;
+    std::list<BlockId>::iterator pos;
+  };
+  std::list<BlockId> &ListOf(Where where);
+  void MoveTo(Entry &e, Where to);
+  void Erase(BlockId id);
+
+  std::list<BlockId> a1in_, a1out_, am_; // front = oldest
+  std::unordered_map<BlockId, Entry> entries_;
+  size_t capacity_ = 0;
+};
+
+// ─── S3-FIFO policy ──────────────────────────────────────────
+// S3-FIFO (Yang et al., SOSP '23): three FIFO queues. New blocks enter the
+// small queue (a tenth of capacity); when it is evicted, a block accessed
+// more than once moves to the main queue and the rest go to a ghost queue,
+// from which a re-insert goes straight to main. Main is a CLOCK: a block
+// with a non-zero access count (capped at 3) is re-queued with one count
+// less instead of being evicted.
+class S3FIFOPolicy : public CachePolicy {
+public:
+  void OnAccess(BlockId id) override;
+  void OnInsert(BlockId id) override;
+  void OnRemove(BlockId id) override;
+  BlockId Evict() override;
+  BlockId Peek() override;
+  size_t Size() const override { return small_.size() + main_.size(); }
+  // Weight = access count, plus 4 for blocks in main
+  std::vector<std::pair<BlockId, uint64_t>> Export() const override;
+  void Restore(BlockId id, uint64_t weight) override;
+
+private:
+  enum class Where : uint8_t { kSmall, kMain, kGhost };
+  struct Entry {
+    Where where;
+    uint8_t freq = 0;
+    std::list<BlockId>::iterator pos;
   };
-  std::unordered_map<BlockId, uint64_t> freq_map_;
-  // freq -> list of block ids (front = oldest at this freq)
-  std::unordered_map<uint64_t, std::list<BlockId>> freq_lists_;
-  uint64_t min_freq_ = 0;
+  std::list<BlockId> &ListOf(Where where);
+  void MoveTo(Entry &e, Where to);
+  void Erase(BlockId id);
+
+  std::list<BlockId> small_, main_, ghost_; // front = oldest
+  std::unordered_map<BlockId, Entry> entries_;
+  size_t capacity_ = 0;
+};
+
+// ─── GDSF policy ─────────────────────────────────────────────
+// GreedyDual-Size-Frequency (Cherkasova): a block's priority is
+// L + frequency * cost / size and the lowest priority is evicted, after
+// which L rises to the victim's priority. Blocks that are cheap to refetch
+// per byte go first, so the cache minimizes total refetch time rather than
+// miss count, and the rising L ages out blocks that stopped being used.
+// A block of unknown cost is charged the mean cost per byte of the blocks
+// whose cost is known (1 if none is), i.e. refetch time proportional to size.
+class GDSFPolicy : public CachePolicy {
+public:
+  void OnAccess(BlockId id) override;
+  void OnInsert(BlockId id) override;
+  void OnRemove(BlockId id) override;
+  BlockId Evict() override;
+  BlockId Peek() override;
+  size_t Size() const override { return entries_.size(); }
+  void SetCost(BlockId id, size_t size, uint64_t cost) override;
+  double Rank(BlockId id) const override; // priority
+  // Weight = L at the block's last access (top 48 bits of the double) and
+  // its frequency (low 16 bits)
+  std::vector<std::pair<BlockId, uint64_t>> Export() const override;
+  void Restore(BlockId id, uint64_t weight) override;
+
+private:
+  // (priority, insertion order) -> block; ties evict the older entry
+  using Queue = std::map<std::pair<double, uint64_t>, BlockId>;
+  struct Entry {
+    double base = 0; // L when the block was last touched
+    uint64_t freq = 1;
+    size_t size = 0;
+    uint64_t cost = 0;
+    bool queued = false; // `pos` is valid
+    Queue::iterator pos;
+  };
+  double CostPerByte(const Entry &e) const;
+  // Re-key `e` in the queue after its base, frequency or cost changed
+  void Requeue(BlockId id, Entry &e);
+  void Forget(Entry &e);
+
+  Queue queue_;
+  std::unordered_map<BlockId, Entry> entries_;
+  double inflation_ = 0; // L
+  uint64_t seq_ = 0;
+  double known_cost_per_byte_ = 0; // sum over blocks with a known cost
+  size_t known_ = 0;
+};
+
+// ─── Admission (W-TinyLFU) ───────────────────────────────────
+struct AdmissionOptions {
+  bool enabled = false;
+  // Bytes the cache holds before it starts evicting (the tier's high
+  // watermark); below it every block is admitted
+  size_t capacity_bytes = 0;
+  // Share of capacity_bytes reserved for the admission window
+  double window_ratio = 0.01;
 };
 
 // ─── CacheManager ────────────────────────────────────────────
 // Coordinates eviction across tiers using a pluggable CachePolicy.
+//
+// With admission enabled, new blocks first enter a small LRU window in front
+// of the policy (W-TinyLFU). While the cache is below capacity, blocks that
+// overflow the window move into the policy freely. Once it is full they wait
+// in the window, and each eviction makes the window's oldest block compete
+// with the policy's victim: the one with the lower estimated access
+// frequency (FrequencySketch) is evicted. A scan of one-hit blocks then
+// drains through the window instead of flushing the hot working set.
+//
+// Blocks are hashed onto independent shards, each with its own lock, policy
+// and admission state (sized by its share of the capacity), so reads of
+// different blocks rarely contend. An access that finds its shard locked is
+// queued in the shard's read buffer and replayed by the next lock holder; a
+// full buffer drops it, as the policies only need a sample of the accesses.
+// Eviction takes, among the shards' next victims, the one of lowest
+// CachePolicy::Rank touched longest ago, which is exact for LRU and keeps
+// the other policies' shards evenly trimmed.
 class CacheManager {
 public:
-  enum class PolicyType { kLRU, kLFU };
+  enum class PolicyType { kLRU, kLFU, kARC, kTwoQ, kS3FIFO, kGDSF };
+  // "LRU", "LFU", "ARC", "2Q", "S3FIFO" or "GDSF" (case-insensitive)
+  static bool ParsePolicyType(const std::string &name, PolicyType *type);
 
-  explicit CacheManager(PolicyType type = PolicyType::kLRU);
+  // `shards` is rounded up to a power of two
+  explicit CacheManager(PolicyType type = PolicyType::kLRU,
+                        const AdmissionOptions &admission = {},
+                        size_t shards = 1);
+  ~CacheManager();
 
   // Notify the manager of block access / insertion / removal
   void OnBlockAccess(BlockId id);
-  void OnBlockInsert(BlockId id, size_t size);
+  // `cost_us`: refetch cost if known (see SetBlockCost); 0 keeps the cost
+  // of a block that is already cached
+  void OnBlockInsert(BlockId id, size_t size, uint64_t cost_us = 0);
   void OnBlockRemove(BlockId id);
 
+  // Refetch cost of a cached block in microseconds (see CachePolicy::SetCost)
+  void SetBlockCost(BlockId id, uint64_t cost_us);
+
   // Get blocks to evict to free at least `bytes_needed`
   std::vector<BlockId> GetEvictionCandidates(size_t bytes_needed);
 
+  // Policy state for index snapshots (see CachePolicy::Export)
+  std::vector<std::pair<BlockId, uint64_t>> ExportPolicy() const;
+  void RestoreBlock(BlockId id, size_t size, uint64_t weight,
+                    uint64_t cost_us = 0);
+
   size_t GetCachedBlockCount() const;
   size_t GetCachedBytes() const;
+  size_t ShardCount() const { return shards_.size(); }
+
+  // Miss-ratio curve: a sampled ghost cache estimating the hit ratio at
+  // multiples of `capacity_bytes` (see MissRatioCurve). Call before use.
+  void EnableMissRatioCurve(size_t capacity_bytes, double sample_rate);
+  // A request for the block at the worker, whichever tier served it or
+  // none; unlike OnBlockAccess it includes this tier's misses. No-op unless
+  // the curve is enabled.
+  void OnBlockReference(BlockId id, size_t size) {
+    if (mrc_)
+      mrc_->Reference(id, size);
+  }
+  // Empty unless enabled
+  std::vector<MissRatioCurve::Point> GetMissRatioCurve() const;
 
 private:
-  mutable std::mutex mu_;
-  std::unique_ptr<CachePolicy> policy_;
-  std::unordered_map<BlockId, size_t> block_sizes_;
-  size_t total_cached_bytes_ = 0;
+  struct Shard;
+
+  Shard &ShardFor(BlockId id) const;
+  // Replay the accesses other threads queued while the shard was locked
+  void DrainReadsLocked(Shard &shard);
+  void AccessLocked(Shard &shard, BlockId id);
+  // Hand a block to the policy (leaving the window or freshly inserted)
+  void InsertIntoPolicyLocked(Shard &shard, BlockId id);
+  // The block NextVictimLocked would return, without changing anything
+  BlockId PeekVictimLocked(Shard &shard);
+  // Removes the next victim from the policy (and admission window)
+  BlockId NextVictimLocked(Shard &shard);
+  // Admission: move window overflow into the policy while there is room
+  void DrainWindowLocked(Shard &shard);
+  void EraseFromWindowLocked(Shard &shard, BlockId id);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  int shard_bits_ = 0;
+  std::unique_ptr<MissRatioCurve> mrc_;
 };
 
 } // namespace anycache
@@ -2,6 +2,7 @@
 #include "common/logging.h"
 #include "common/metrics.h"
 
+#include <chrono>
 #include <fcntl.h>
 
 namespace anycache {
@@ -126,6 +127,7 @@ Status DataMover::ExecuteTask(const Task &task) {
     // Read from UFS and write into block store
     ScopedLatency lat("data_mover.preload_latency_ms");
 
+    auto fetch_start = std::chrono::steady_clock::now();
     UfsFileHandle handle;
     RETURN_IF_ERROR(ufs->Open(task.ufs_path, O_RDONLY, &handle));
 
@@ -136,11 +138,15 @@ Status DataMover::ExecuteTask(const Task &task) {
     ufs->Close(handle);
     if (!s.ok())
       return s;
+    auto fetch_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - fetch_start)
+                        .count();
 
     // Block ID is pre-computed (composite: inode_id + block_index)
     RETURN_IF_ERROR(block_store_->EnsureBlock(task.block_id, bytes_read));
     RETURN_IF_ERROR(
         block_store_->WriteBlock(task.block_id, buf.data(), bytes_read, 0));
+    block_store_->RecordFetch(task.block_id, bytes_read, fetch_us);
 
     Metrics::Instance().IncrCounter("data_mover.preloads");
     LOG_DEBUG("Preloaded {} bytes from {} into block {}", bytes_read,
@@ -0,0 +1,116 @@
+#include "worker/fd_cache.h"
+#include "common/metrics.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace anycache {
+
+CachedFd::CachedFd(int fd, IoEngine *engine) : fd_(fd), engine_(engine) {
+  if (engine_)
+    slot_ = engine_->RegisterFile(fd_);
+}
+
+CachedFd::~CachedFd() {
+  if (slot_ >= 0)
+    engine_->UnregisterFile(slot_);
+  if (fd_ >= 0) {
+    ::close(fd_);
+    Metrics::Instance().IncrCounter("storage_tier.fd_cache.closes");
+  }
+}
+
+FdCache::FdCache(size_t capacity, int open_flags, IoEngine *engine)
+    : capacity_(capacity), open_flags_(open_flags), engine_(engine) {}
+
+Status FdCache::Acquire(BlockId id, const std::string &path, FdRef *out,
+                       uint64_t generation) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = map_.find(id);
+    if (it != map_.end() && it->second->generation == generation) {
+      lru_.splice(lru_.end(), lru_, it->second);
+      *out = it->second->fd;
+      Metrics::Instance().IncrCounter("storage_tier.fd_cache.hits");
+      return Status::OK();
+    }
+  }
+
+  // Miss: open outside the lock so a slow path lookup does not stall hits
+  int fd = ::open(path.c_str(), open_flags_);
+  if (fd < 0)
+    return Status::IOError("open block file failed: " + path);
+  Metrics::Instance().IncrCounter("storage_tier.fd_cache.opens");
+
+  if (capacity_ == 0) {
+    *out = std::make_shared<CachedFd>(fd);
+    return Status::OK();
+  }
+  auto ref = std::make_shared<CachedFd>(fd, engine_);
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = map_.find(id);
+  if (it != map_.end()) {
+    if (it->second->generation == generation) {
+      // Lost an open race; use the cached fd and let ours close
+      *out = it->second->fd;
+      return Status::OK();
+    }
+    if (it->second->generation > generation) {
+      // We are a straggler for an older incarnation: don't cache our fd
+      *out = std::move(ref);
+      return Status::OK();
+    }
+    lru_.erase(it->second);
+    map_.erase(it);
+  }
+  InsertLocked(id, generation, ref);
+  *out = std::move(ref);
+  return Status::OK();
+}
+
+void FdCache::Insert(BlockId id, int fd, uint64_t generation) {
+  Metrics::Instance().IncrCounter("storage_tier.fd_cache.opens");
+  if (capacity_ == 0) {
+    CachedFd closer(fd);
+    return;
+  }
+  auto ref = std::make_shared<CachedFd>(fd, engine_);
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = map_.find(id);
+  if (it != map_.end()) {
+    lru_.erase(it->second);
+    map_.erase(it);
+  }
+  InsertLocked(id, generation, std::move(ref));
+}
+
+void FdCache::Erase(BlockId id) {
+  FdRef victim; // closed after the lock is released
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = map_.find(id);
+  if (it == map_.end())
+    return;
+  victim = std::move(it->second->fd);
+  lru_.erase(it->second);
+  map_.erase(it);
+}
+
+size_t FdCache::Size() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return map_.size();
+}
+
+void FdCache::InsertLocked(BlockId id, uint64_t generation, FdRef ref) {
+  lru_.push_back(Entry{id, generation, std::move(ref)});
+  map_[id] = std::prev(lru_.end());
+  while (map_.size() > capacity_) {
+    auto &front = lru_.front();
+    map_.erase(front.id);
+    lru_.pop_front();
+    Metrics::Instance().IncrCounter("storage_tier.fd_cache.evictions");
+  }
+}
+
+} // namespace anycache
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "common/status.h"
+#include "common/types.h"
+#include "worker/io_engine.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace anycache {
+
+// An open block file descriptor; closed when the last reference goes away.
+// When an IoEngine is given, the fd is also registered as a fixed file for
+// the lifetime of this object.
+class CachedFd {
+public:
+  explicit CachedFd(int fd, IoEngine *engine = nullptr);
+  ~CachedFd();
+
+  CachedFd(const CachedFd &) = delete;
+  CachedFd &operator=(const CachedFd &) = delete;
+
+  int fd() const { return fd_; }
+  int fixed_slot() const { return slot_; } // -1 if not registered
+
+private:
+  int fd_;
+  IoEngine *engine_;
+  int slot_ = -1;
+};
+
+using FdRef = std::shared_ptr<CachedFd>;
+
+// FdCache keeps block file descriptors open across reads and writes so a disk
+// tier I/O costs one pread/pwrite instead of open + pread + close. Entries are
+// keyed by BlockId and bounded by an LRU. Descriptors are reference counted:
+// evicting or erasing an entry only drops the cache's reference, so an I/O
+// already in flight keeps using a valid fd.
+//
+// Each entry carries the generation of the block file it was opened from. A
+// block that is removed and re-created under the same id gets a new
+// generation, so a descriptor opened against the old (unlinked) file by a
+// racing reader is never handed out for the new one.
+class FdCache {
+public:
+  // capacity = max cached descriptors; 0 disables caching (every Acquire
+  // opens a private fd that is closed once the caller releases it).
+  // Cached descriptors are registered with `engine` when one is given.
+  FdCache(size_t capacity, int open_flags, IoEngine *engine = nullptr);
+
+  // Get the descriptor for block `id`, opening `path` lazily on a miss.
+  Status Acquire(BlockId id, const std::string &path, FdRef *out,
+                 uint64_t generation = 0);
+
+  // Cache a descriptor that the caller just opened (takes ownership).
+  void Insert(BlockId id, int fd, uint64_t generation = 0);
+
+  // Drop the cached descriptor for `id` (e.g. the block file is removed).
+  void Erase(BlockId id);
+
+  size_t Size() const;
+  size_t GetCapacity() const { return capacity_; }
+
+private:
+  struct Entry {
+    BlockId id;
+    uint64_t generation;
+    FdRef fd;
+  };
+
+  // Insert `ref` as most recently used and trim the LRU. Caller holds mu_.
+  void InsertLocked(BlockId id, uint64_t generation, FdRef ref);
+
+  size_t capacity_;
+  int open_flags_;
+  IoEngine *engine_;
+
+  mutable std::mutex mu_;
+  std::list<Entry> lru_; // front = least recently used
+  std::unordered_map<BlockId, std::list<Entry>::iterator> map_;
+};
+
+} // namespace anycache
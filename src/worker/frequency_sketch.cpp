@@ -0,0 +1,97 @@
+#include "worker/frequency_sketch.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace anycache {
+
+namespace {
+// Per-row hash seeds
+constexpr uint64_t kSeeds[] = {0x97cb3127a3f1c5b1ULL, 0xc2b2ae3d27d4eb4fULL,
+                               0x165667b19e3779f9ULL, 0x27d4eb2f165667c5ULL};
+
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+} // namespace
+
+FrequencySketch::FrequencySketch(size_t expected_keys) {
+  EnsureCapacity(expected_keys);
+}
+
+void FrequencySketch::EnsureCapacity(size_t expected_keys) {
+  size_t width = std::bit_ceil(std::max<size_t>(expected_keys, 64));
+  if (width <= width_)
+    return;
+  width_ = width;
+  counters_.assign(kDepth * width_, 0);
+  doorkeeper_.assign(width_ / 8, 0);
+  additions_ = 0;
+  sample_size_ = 10 * width_;
+}
+
+size_t FrequencySketch::CounterIndex(uint64_t key, int row) const {
+  return row * width_ + (Mix(key ^ kSeeds[row]) & (width_ - 1));
+}
+
+bool FrequencySketch::DoorkeeperInsert(uint64_t key) {
+  uint64_t h = Mix(key);
+  size_t bits = doorkeeper_.size() * 64;
+  size_t a = h % bits, b = (h >> 32) % bits;
+  uint64_t mask_a = 1ULL << (a % 64), mask_b = 1ULL << (b % 64);
+  bool present =
+      (doorkeeper_[a / 64] & mask_a) && (doorkeeper_[b / 64] & mask_b);
+  doorkeeper_[a / 64] |= mask_a;
+  doorkeeper_[b / 64] |= mask_b;
+  return present;
+}
+
+bool FrequencySketch::DoorkeeperContains(uint64_t key) const {
+  uint64_t h = Mix(key);
+  size_t bits = doorkeeper_.size() * 64;
+  size_t a = h % bits, b = (h >> 32) % bits;
+  return (doorkeeper_[a / 64] >> (a % 64) & 1) &&
+         (doorkeeper_[b / 64] >> (b % 64) & 1);
+}
+
+void FrequencySketch::Increment(uint64_t key) {
+  if (DoorkeeperInsert(key)) {
+    // Conservative update: only the smallest counters grow, which keeps
+    // collisions from inflating the estimate
+    size_t index[kDepth];
+    uint8_t min = kMaxCount;
+    for (int row = 0; row < kDepth; ++row) {
+      index[row] = CounterIndex(key, row);
+      min = std::min(min, counters_[index[row]]);
+    }
+    if (min < kMaxCount) {
+      for (int row = 0; row < kDepth; ++row) {
+        if (counters_[index[row]] == min)
+          counters_[index[row]]++;
+      }
+    }
+  }
+  if (++additions_ >= sample_size_)
+    Reset();
+}
+
+uint32_t FrequencySketch::Frequency(uint64_t key) const {
+  uint8_t min = kMaxCount;
+  for (int row = 0; row < kDepth; ++row)
+    min = std::min(min, counters_[CounterIndex(key, row)]);
+  return min + (DoorkeeperContains(key) ? 1 : 0);
+}
+
+void FrequencySketch::Reset() {
+  for (auto &c : counters_)
+    c >>= 1;
+  std::fill(doorkeeper_.begin(), doorkeeper_.end(), 0);
+  additions_ /= 2;
+}
+
+} // namespace anycache
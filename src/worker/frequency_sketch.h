@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace anycache {
+
+// FrequencySketch estimates how often keys were seen recently (TinyLFU).
+// It is a count-min sketch of 4-bit saturating counters (kDepth rows) with a
+// doorkeeper Bloom filter in front: a key's first sighting only sets its
+// doorkeeper bits, so the many one-hit keys of a scan never reach the
+// counters. Once the number of additions reaches ten times the width, all
+// counters are halved and the doorkeeper is cleared (aging), so the estimate
+// tracks recent popularity rather than all-time counts.
+//
+// Not thread-safe; the owner serializes access.
+class FrequencySketch {
+public:
+  explicit FrequencySketch(size_t expected_keys = 1024);
+
+  // Grow the sketch to track `expected_keys` keys well; growing discards
+  // the current counts. No-op if it is already large enough.
+  void EnsureCapacity(size_t expected_keys);
+
+  void Increment(uint64_t key);
+  // Estimated recent frequency, 0..kMaxCount + 1
+  uint32_t Frequency(uint64_t key) const;
+
+  size_t Width() const { return width_; }
+
+  static constexpr uint8_t kMaxCount = 15;
+
+private:
+  static constexpr int kDepth = 4;
+
+  size_t CounterIndex(uint64_t key, int row) const;
+  // Sets the key's doorkeeper bits; true if they were all set already
+  bool DoorkeeperInsert(uint64_t key);
+  bool DoorkeeperContains(uint64_t key) const;
+  // Aging: halve every counter and clear the doorkeeper
+  void Reset();
+
+  size_t width_ = 0; // counters per row, a power of two
+  std::vector<uint8_t> counters_; // kDepth rows of width_ counters
+  std::vector<uint64_t> doorkeeper_; // 8 * width_ bits
+  size_t additions_ = 0;
+  size_t sample_size_ = 0;
+};
+
+} // namespace anycache
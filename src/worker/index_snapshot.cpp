@@ -0,0 +1,133 @@
+#include "worker/index_snapshot.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace anycache {
+
+// ─── Helpers ─────────────────────────────────────────────────
+
+static std::array<uint32_t, 256> MakeCrc32cTable() {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+    table[i] = crc;
+  }
+  return table;
+}
+
+uint32_t IndexSnapshot::Crc32c(const void *data, size_t size) {
+  static const auto table = MakeCrc32cTable();
+  auto *p = static_cast<const uint8_t *>(data);
+  uint32_t crc = ~0u;
+  for (size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static Status WriteAll(int fd, const void *data, size_t size) {
+  auto *p = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return Status::IOError("snapshot write failed: " +
+                             std::string(std::strerror(errno)));
+    }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return Status::OK();
+}
+
+// ═══════════════════════════════════════════════════════════════
+// Writer
+// ═══════════════════════════════════════════════════════════════
+
+Status IndexSnapshot::Write(const std::string &path,
+                            std::span<const Record> records,
+                            int64_t created_ms) {
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.record_size = sizeof(Record);
+  header.count = records.size();
+  header.created_ms = created_ms;
+  header.crc = Crc32c(records.data(), records.size_bytes());
+
+  // A crash mid-write leaves the previous snapshot in place
+  std::string tmp = path + ".tmp";
+  int fd = ::open(tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0)
+    return Status::IOError("cannot create snapshot " + tmp);
+  auto s = WriteAll(fd, &header, sizeof(header));
+  if (s.ok())
+    s = WriteAll(fd, records.data(), records.size_bytes());
+  if (s.ok() && ::fsync(fd) < 0)
+    s = Status::IOError("snapshot fsync failed");
+  ::close(fd);
+  if (s.ok() && ::rename(tmp.c_str(), path.c_str()) < 0)
+    s = Status::IOError("snapshot rename failed");
+  if (!s.ok())
+    ::unlink(tmp.c_str());
+  return s;
+}
+
+// ═══════════════════════════════════════════════════════════════
+// Reader
+// ═══════════════════════════════════════════════════════════════
+
+IndexSnapshot::~IndexSnapshot() {
+  if (map_)
+    ::munmap(map_, map_size_);
+}
+
+Status IndexSnapshot::Open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return errno == ENOENT ? Status::NotFound("no index snapshot")
+                           : Status::IOError("cannot open snapshot " + path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) < 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    ::close(fd);
+    return Status::IOError("snapshot truncated");
+  }
+  map_size_ = static_cast<size_t>(st.st_size);
+  map_ = ::mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map_ == MAP_FAILED) {
+    map_ = nullptr;
+    return Status::IOError("snapshot mmap failed");
+  }
+  // Records are walked front to back exactly once
+  ::madvise(map_, map_size_, MADV_SEQUENTIAL);
+
+  Header header;
+  std::memcpy(&header, map_, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.record_size != sizeof(Record))
+    return Status::IOError("snapshot format mismatch");
+  if (header.count > (map_size_ - sizeof(Header)) / sizeof(Record))
+    return Status::IOError("snapshot truncated");
+
+  auto *first = reinterpret_cast<const Record *>(
+      static_cast<const char *>(map_) + sizeof(Header));
+  std::span<const Record> records(first, header.count);
+  if (Crc32c(records.data(), records.size_bytes()) != header.crc)
+    return Status::IOError("snapshot checksum mismatch");
+  records_ = records;
+  created_ms_ = header.created_ms;
+  return Status::OK();
+}
+
+} // namespace anycache
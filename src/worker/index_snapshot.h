@@ -0,0 +1,75 @@
+#pragma once
+
+#include "common/status.h"
+#include "common/types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace anycache {
+
+// IndexSnapshot is a point-in-time copy of BlockStore's block index and
+// eviction-policy order, written periodically so a restart does not have to
+// scan the whole MetaStore. The file is a fixed header followed by fixed-size
+// records:
+//
+//   | Header | Record 0 | Record 1 | ... | Record count-1 |
+//
+// The header carries a CRC-32C of the records. Readers mmap the file and walk
+// the records in place. Records are grouped by tier, each group in eviction
+// order (next victim first), so replaying them rebuilds the policy state.
+class IndexSnapshot {
+public:
+  struct Record {
+    BlockId block_id = kInvalidBlockId;
+    uint64_t length = 0;
+    int64_t create_time_ms = 0;
+    int64_t last_access_time_ms = 0;
+    uint64_t access_count = 0;
+    uint64_t policy_weight = 0; // policy-specific state (LFU frequency)
+    uint8_t tier = 0;           // TierType
+    uint8_t reserved[3] = {};
+    uint32_t fetch_cost_us = 0; // BlockMeta::fetch_cost_us, saturated
+  };
+  static_assert(sizeof(Record) == 56, "snapshot record layout changed");
+
+  // Write a snapshot atomically: temp file, fsync, rename.
+  static Status Write(const std::string &path, std::span<const Record> records,
+                      int64_t created_ms);
+
+  IndexSnapshot() = default;
+  ~IndexSnapshot();
+  IndexSnapshot(const IndexSnapshot &) = delete;
+  IndexSnapshot &operator=(const IndexSnapshot &) = delete;
+
+  // Map a snapshot and verify its header and checksum. NotFound if there is
+  // no snapshot; IOError if it is truncated or corrupt.
+  Status Open(const std::string &path);
+
+  std::span<const Record> records() const { return records_; }
+  int64_t created_ms() const { return created_ms_; }
+
+private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count;
+    int64_t created_ms;
+    uint32_t crc;
+    uint32_t reserved;
+  };
+  static constexpr char kMagic[8] = {'A', 'C', 'I', 'D', 'X', 'S', 'N', 'P'};
+  static constexpr uint32_t kVersion = 1;
+
+  static uint32_t Crc32c(const void *data, size_t size);
+
+  void *map_ = nullptr;
+  size_t map_size_ = 0;
+  std::span<const Record> records_;
+  int64_t created_ms_ = 0;
+};
+
+} // namespace anycache
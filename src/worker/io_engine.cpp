@@ -0,0 +1,409 @@
+#include "worker/io_engine.h"
+#include "common/logging.h"
+#include "common/metrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#ifdef ANYCACHE_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace anycache {
+
+// ─── Factory ─────────────────────────────────────────────────
+std::unique_ptr<IoEngine> IoEngine::Create(IoEngineType type,
+                                           uint32_t queue_depth,
+                                           size_t file_slots) {
+  if (type == IoEngineType::kIoUring) {
+#ifdef ANYCACHE_HAS_IO_URING
+    auto engine = std::make_unique<UringIoEngine>();
+    auto s = engine->Init(queue_depth, file_slots);
+    if (s.ok()) {
+      LOG_INFO("IoEngine: io_uring with queue depth {}",
+               engine->GetQueueDepth());
+      return engine;
+    }
+    LOG_WARN("IoEngine: io_uring unavailable ({}), falling back to sync",
+             s.ToString());
+#else
+    (void)queue_depth;
+    (void)file_slots;
+    LOG_WARN("IoEngine: built without io_uring, falling back to sync");
+#endif
+  }
+  return std::make_unique<SyncIoEngine>();
+}
+
+// ═══════════════════════════════════════════════════════════════
+// Synchronous engine
+// ═══════════════════════════════════════════════════════════════
+Status SyncIoEngine::Submit(std::span<IoRequest> reqs) {
+  for (auto &r : reqs) {
+    auto *p = static_cast<char *>(r.buf);
+    size_t done = 0;
+    r.result = 0;
+    while (done < r.size) {
+      off_t off = r.offset + static_cast<off_t>(done);
+      ssize_t n = r.op == IoRequest::Op::kRead
+                      ? ::pread(r.fd, p + done, r.size - done, off)
+                      : ::pwrite(r.fd, p + done, r.size - done, off);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        r.result = -errno;
+        break;
+      }
+      if (n == 0)
+        break; // EOF
+      done += static_cast<size_t>(n);
+      r.result = static_cast<ssize_t>(done);
+    }
+  }
+  return Status::OK();
+}
+
+// ═══════════════════════════════════════════════════════════════
+// io_uring engine
+// ═══════════════════════════════════════════════════════════════
+#ifdef ANYCACHE_HAS_IO_URING
+
+namespace {
+
+template <typename T> T *RingField(void *base, uint32_t offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+
+unsigned LoadAcquire(unsigned *p) {
+  return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+}
+
+void StoreRelease(unsigned *p, unsigned v) {
+  std::atomic_ref<unsigned>(*p).store(v, std::memory_order_release);
+}
+
+Status ErrnoStatus(const char *what) {
+  return Status::Unavailable(std::string(what) + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+UringIoEngine::~UringIoEngine() {
+  if (sqes_)
+    ::munmap(sqes_, sqes_size_);
+  if (cq_ring_ && cq_ring_ != sq_ring_)
+    ::munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_)
+    ::munmap(sq_ring_, sq_ring_size_);
+  if (ring_fd_ >= 0)
+    ::close(ring_fd_);
+}
+
+Status UringIoEngine::Init(uint32_t queue_depth, size_t file_slots) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  ring_fd_ = static_cast<int>(
+      ::syscall(__NR_io_uring_setup, std::max<uint32_t>(queue_depth, 1),
+                &params));
+  if (ring_fd_ < 0)
+    return ErrnoStatus("io_uring_setup");
+  entries_ = params.sq_entries;
+
+  // Map the submission/completion rings and the SQE array
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+  void *sq = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED)
+    return ErrnoStatus("mmap sq ring");
+  sq_ring_ = sq;
+
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    void *cq = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED)
+      return ErrnoStatus("mmap cq ring");
+    cq_ring_ = cq;
+  }
+
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return ErrnoStatus("mmap sqes");
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+  sq_head_ = RingField<unsigned>(sq_ring_, params.sq_off.head);
+  sq_tail_ = RingField<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_mask_ = RingField<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = RingField<unsigned>(sq_ring_, params.sq_off.array);
+  cq_head_ = RingField<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = RingField<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = RingField<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = RingField<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+  // IORING_OP_READ/WRITE need 5.6+; probe instead of trusting the version
+  constexpr unsigned kProbeOps = 256;
+  std::vector<char> probe_buf(sizeof(io_uring_probe) +
+                              kProbeOps * sizeof(io_uring_probe_op));
+  auto *probe = reinterpret_cast<io_uring_probe *>(probe_buf.data());
+  if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE,
+                probe, kProbeOps) < 0)
+    return ErrnoStatus("io_uring probe");
+  for (int op : {IORING_OP_READ, IORING_OP_WRITE}) {
+    if (op > probe->last_op ||
+        !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+      return Status::Unavailable("io_uring read/write ops not supported");
+  }
+
+  // Sparse registered file table; slots are filled by RegisterFile()
+  if (file_slots > 0) {
+    std::vector<int> fds(file_slots, -1);
+    if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES,
+                  fds.data(), static_cast<unsigned>(fds.size())) == 0) {
+      for (size_t i = file_slots; i > 0; --i)
+        free_file_slots_.push_back(static_cast<int>(i - 1));
+    } else {
+      LOG_WARN("io_uring: file registration unavailable: {}",
+               std::strerror(errno));
+    }
+  }
+  return Status::OK();
+}
+
+int UringIoEngine::Enter(unsigned to_submit, unsigned min_complete,
+                         unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+void UringIoEngine::PrepareSqe(io_uring_sqe *sqe, IoRequest &req,
+                               Completion *comp) {
+  std::memset(sqe, 0, sizeof(*sqe));
+  bool is_read = req.op == IoRequest::Op::kRead;
+  sqe->opcode = is_read ? IORING_OP_READ : IORING_OP_WRITE;
+
+  // Use the fixed-buffer opcode when the buffer lies in a registered region
+  auto *p = static_cast<char *>(req.buf);
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    auto *base = static_cast<char *>(buffers_[i].iov_base);
+    if (p >= base && p + req.size <= base + buffers_[i].iov_len) {
+      sqe->opcode = is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+      sqe->buf_index = static_cast<uint16_t>(i);
+      break;
+    }
+  }
+
+  if (req.fixed_file >= 0) {
+    sqe->fd = req.fixed_file;
+    sqe->flags |= IOSQE_FIXED_FILE;
+  } else {
+    sqe->fd = req.fd;
+  }
+  sqe->addr = reinterpret_cast<uint64_t>(req.buf);
+  sqe->len = static_cast<uint32_t>(req.size);
+  sqe->off = static_cast<uint64_t>(req.offset);
+  sqe->user_data = reinterpret_cast<uint64_t>(comp);
+}
+
+Status UringIoEngine::Submit(std::span<IoRequest> reqs) {
+  if (reqs.empty())
+    return Status::OK();
+
+  std::vector<Completion> comps(reqs.size());
+  size_t pending = reqs.size();
+  for (size_t i = 0; i < reqs.size(); ++i) {
+    comps[i].req = &reqs[i];
+    comps[i].pending = &pending;
+  }
+
+  size_t next = 0;
+  while (next < reqs.size()) {
+    size_t queued = 0;
+    {
+      std::lock_guard<std::mutex> lock(sq_mu_);
+      unsigned head = LoadAcquire(sq_head_);
+      unsigned tail = *sq_tail_;
+      size_t room = std::min<size_t>(entries_ - (tail - head),
+                                     entries_ - inflight_.load());
+      queued = std::min(room, reqs.size() - next);
+      for (size_t i = 0; i < queued; ++i) {
+        unsigned idx = tail & *sq_mask_;
+        PrepareSqe(&sqes_[idx], reqs[next + i], &comps[next + i]);
+        sq_array_[idx] = idx;
+        tail++;
+      }
+
+      if (queued > 0) {
+        StoreRelease(sq_tail_, tail);
+        inflight_ += static_cast<uint32_t>(queued);
+        // The kernel may consume fewer SQEs than asked for: enter again
+        // until it takes all of ours or stops making progress
+        int err = 0;
+        size_t consumed = 0;
+        while (consumed < queued) {
+          int ret = Enter(static_cast<unsigned>(queued - consumed), 0, 0);
+          int enter_errno = errno;
+          if (ret < 0 && enter_errno == EINTR)
+            continue;
+          size_t now =
+              std::min<size_t>(LoadAcquire(sq_head_) - head, queued);
+          if (now == consumed) {
+            err = ret < 0 ? enter_errno : EAGAIN;
+            break;
+          }
+          consumed = now;
+        }
+
+        if (consumed < queued) {
+          // Withdraw our unconsumed SQEs and fail those requests
+          size_t withdrawn = queued - consumed;
+          StoreRelease(sq_tail_, tail - static_cast<unsigned>(withdrawn));
+          inflight_ -= static_cast<uint32_t>(withdrawn);
+          std::lock_guard<std::mutex> cq_lock(cq_mu_);
+          for (size_t i = queued - withdrawn; i < queued; ++i) {
+            reqs[next + i].result = -err;
+            pending--;
+          }
+          Metrics::Instance().IncrCounter("io_engine.uring.submit_errors");
+        }
+      }
+    }
+
+    if (queued == 0) {
+      // Ring is full of in-flight requests: make room by reaping
+      ReapOrWait();
+      continue;
+    }
+    next += queued;
+    Metrics::Instance().IncrCounter("io_engine.uring.submitted", queued);
+  }
+
+  {
+    // Wait for our completions; whoever holds cq_mu_ reaps for everyone
+    std::lock_guard<std::mutex> lock(cq_mu_);
+    while (pending > 0) {
+      if (ReapLocked() == 0 && pending > 0) {
+        int ret = Enter(0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+          LOG_ERROR("io_uring_enter wait failed: {}", std::strerror(errno));
+        }
+      }
+    }
+  }
+
+  // Like pread/pwrite, a request may transfer less than asked for; carry
+  // on from where it stopped, as SyncIoEngine does
+  std::vector<IoRequest> rest;
+  std::vector<size_t> rest_of;
+  for (size_t i = 0; i < reqs.size(); ++i) {
+    auto &r = reqs[i];
+    if (r.result <= 0 || static_cast<size_t>(r.result) >= r.size)
+      continue;
+    IoRequest more = r;
+    more.buf = static_cast<char *>(r.buf) + r.result;
+    more.size = r.size - static_cast<size_t>(r.result);
+    more.offset = r.offset + static_cast<off_t>(r.result);
+    more.result = 0;
+    rest.push_back(more);
+    rest_of.push_back(i);
+  }
+  if (rest.empty())
+    return Status::OK();
+  Metrics::Instance().IncrCounter("io_engine.uring.short_transfers",
+                                  rest.size());
+  RETURN_IF_ERROR(Submit(rest));
+  for (size_t k = 0; k < rest.size(); ++k) {
+    auto &r = reqs[rest_of[k]];
+    r.result = rest[k].result < 0 ? rest[k].result : r.result + rest[k].result;
+  }
+  return Status::OK();
+}
+
+size_t UringIoEngine::ReapLocked() {
+  unsigned head = *cq_head_;
+  unsigned tail = LoadAcquire(cq_tail_);
+  size_t reaped = 0;
+  while (head != tail) {
+    io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+    auto *comp = reinterpret_cast<Completion *>(cqe->user_data);
+    comp->req->result = cqe->res;
+    (*comp->pending)--;
+    head++;
+    reaped++;
+  }
+  if (reaped > 0) {
+    StoreRelease(cq_head_, head);
+    inflight_ -= static_cast<uint32_t>(reaped);
+  }
+  return reaped;
+}
+
+void UringIoEngine::ReapOrWait() {
+  std::lock_guard<std::mutex> lock(cq_mu_);
+  if (ReapLocked() > 0)
+    return;
+  if (inflight_.load() == 0)
+    return;
+  Enter(0, 1, IORING_ENTER_GETEVENTS);
+  ReapLocked();
+}
+
+int UringIoEngine::RegisterFile(int fd) {
+  std::lock_guard<std::mutex> lock(files_mu_);
+  if (free_file_slots_.empty())
+    return -1;
+  int slot = free_file_slots_.back();
+
+  io_uring_files_update update;
+  std::memset(&update, 0, sizeof(update));
+  update.offset = static_cast<uint32_t>(slot);
+  update.fds = reinterpret_cast<uint64_t>(&fd);
+  if (::syscall(__NR_io_uring_register, ring_fd_,
+                IORING_REGISTER_FILES_UPDATE, &update, 1) != 1)
+    return -1;
+  free_file_slots_.pop_back();
+  return slot;
+}
+
+void UringIoEngine::UnregisterFile(int slot) {
+  if (slot < 0)
+    return;
+  std::lock_guard<std::mutex> lock(files_mu_);
+  int fd = -1;
+  io_uring_files_update update;
+  std::memset(&update, 0, sizeof(update));
+  update.offset = static_cast<uint32_t>(slot);
+  update.fds = reinterpret_cast<uint64_t>(&fd);
+  ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES_UPDATE,
+            &update, 1);
+  free_file_slots_.push_back(slot);
+}
+
+Status UringIoEngine::RegisterBuffers(std::span<const iovec> bufs) {
+  std::lock_guard<std::mutex> lock(sq_mu_); // PrepareSqe reads buffers_
+  if (!buffers_.empty())
+    return Status::AlreadyExists("io_uring buffers already registered");
+  if (bufs.empty())
+    return Status::OK();
+  if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                bufs.data(), static_cast<unsigned>(bufs.size())) < 0)
+    return ErrnoStatus("io_uring register buffers");
+  buffers_.assign(bufs.begin(), bufs.end());
+  return Status::OK();
+}
+
+#endif // ANYCACHE_HAS_IO_URING
+
+} // namespace anycache
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "common/config.h"
+#include "common/status.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace anycache {
+
+// One positional read or write against an open descriptor.
+struct IoRequest {
+  enum class Op : uint8_t { kRead, kWrite };
+
+  Op op = Op::kRead;
+  int fd = -1;
+  int fixed_file = -1; // slot from IoEngine::RegisterFile, -1 = use fd
+  void *buf = nullptr; // read destination / write source
+  size_t size = 0;
+  off_t offset = 0;
+  ssize_t result = 0; // bytes transferred, or -errno
+};
+
+// ─── IoEngine interface ──────────────────────────────────────
+// Disk tiers issue block I/O through an IoEngine. Submit() executes a batch
+// and returns once every request has completed; engines that support it keep
+// the whole batch in flight at once instead of issuing it one I/O at a time.
+class IoEngine {
+public:
+  virtual ~IoEngine() = default;
+
+  virtual const char *Name() const = 0;
+
+  // Execute all requests; per-request outcome is stored in IoRequest::result.
+  virtual Status Submit(std::span<IoRequest> reqs) = 0;
+
+  // Register a long-lived descriptor; returns a fixed-file slot or -1 when
+  // the engine has no registered file table (or it is full).
+  virtual int RegisterFile(int /*fd*/) { return -1; }
+  virtual void UnregisterFile(int /*slot*/) {}
+
+  // Register long-lived buffers (e.g. a bounce-buffer pool). Requests whose
+  // buffer lies inside one of them use the engine's fixed-buffer path.
+  virtual Status RegisterBuffers(std::span<const iovec> /*bufs*/) {
+    return Status::OK();
+  }
+
+  // Factory: creates the requested engine, falling back to SyncIoEngine when
+  // io_uring is not compiled in or not available on this kernel.
+  static std::unique_ptr<IoEngine> Create(IoEngineType type,
+                                          uint32_t queue_depth,
+                                          size_t file_slots);
+};
+
+// ─── Synchronous engine (pread/pwrite) ───────────────────────
+class SyncIoEngine : public IoEngine {
+public:
+  const char *Name() const override { return "sync"; }
+  Status Submit(std::span<IoRequest> reqs) override;
+};
+
+// ─── io_uring engine ─────────────────────────────────────────
+#ifdef ANYCACHE_HAS_IO_URING
+// A per-tier io_uring driven through the raw syscall interface. Any number of
+// threads may submit concurrently: submission and completion reaping take
+// separate locks, so requests from different threads share the ring's queue
+// depth, and whichever thread is waiting reaps completions for all of them.
+class UringIoEngine : public IoEngine {
+public:
+  UringIoEngine() = default;
+  ~UringIoEngine() override;
+
+  // Set up the ring with `queue_depth` entries and a sparse registered file
+  // table of `file_slots` entries (0 = no registered files).
+  Status Init(uint32_t queue_depth, size_t file_slots);
+
+  const char *Name() const override { return "io_uring"; }
+  Status Submit(std::span<IoRequest> reqs) override;
+  int RegisterFile(int fd) override;
+  void UnregisterFile(int slot) override;
+  Status RegisterBuffers(std::span<const iovec> bufs) override;
+
+  uint32_t GetQueueDepth() const { return entries_; }
+
+private:
+  struct Completion {
+    IoRequest *req = nullptr;
+    size_t *pending = nullptr; // guarded by cq_mu_
+  };
+
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+  void PrepareSqe(io_uring_sqe *sqe, IoRequest &req, Completion *comp);
+  // Reap all available completions. Caller holds cq_mu_.
+  size_t ReapLocked();
+  // Reap, blocking for at least one completion if none is ready.
+  void ReapOrWait();
+
+  int ring_fd_ = -1;
+  uint32_t entries_ = 0;
+
+  void *sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void *cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe *sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned *sq_head_ = nullptr;
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_mask_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned *cq_mask_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+
+  std::mutex sq_mu_;
+  std::mutex cq_mu_;
+  // Requests submitted but not yet reaped; capped at entries_ so the
+  // completion ring (2x entries) can never overflow.
+  std::atomic<uint32_t> inflight_{0};
+
+  std::mutex files_mu_;
+  std::vector<int> free_file_slots_;
+
+  std::vector<iovec> buffers_;
+};
+#endif // ANYCACHE_HAS_IO_URING
+
+} // namespace anycache
@@ -0,0 +1,247 @@
+#include "worker/mem_arena.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace anycache {
+
+namespace {
+
+// A larger recycled slab is reused for a smaller class only if it wastes at
+// most this factor; otherwise the request is carved fresh from the region.
+constexpr size_t kMaxSlabReuseFactor = 2;
+
+size_t RoundUp(size_t value, size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+} // namespace
+
+// ─── Stats ───────────────────────────────────────────────────
+double MemArena::Stats::InternalFragmentation() const {
+  if (allocated_bytes == 0)
+    return 0.0;
+  return static_cast<double>(allocated_bytes - requested_bytes) /
+         allocated_bytes;
+}
+
+double MemArena::Stats::ExternalFragmentation() const {
+  if (carved_bytes == 0)
+    return 0.0;
+  return static_cast<double>(free_slab_bytes) / carved_bytes;
+}
+
+MemArena::Stats &MemArena::Stats::operator+=(const Stats &other) {
+  region_bytes += other.region_bytes;
+  carved_bytes += other.carved_bytes;
+  allocated_bytes += other.allocated_bytes;
+  requested_bytes += other.requested_bytes;
+  free_slab_bytes += other.free_slab_bytes;
+  heap_fallback_bytes += other.heap_fallback_bytes;
+  recycled_allocs += other.recycled_allocs;
+  return *this;
+}
+
+// ─── MemArena ────────────────────────────────────────────────
+MemArena::MemArena(size_t capacity) : MemArena(capacity, Options{}) {}
+
+MemArena::MemArena(size_t capacity, const Options &opts) {
+  // Size classes round up by at most 25%, so reserve that much headroom.
+  region_bytes_ = RoundUp(capacity + capacity / 4, kMinSlabSize);
+  if (region_bytes_ == 0)
+    return;
+
+  if (opts.huge_pages) {
+    region_bytes_ = RoundUp(region_bytes_, kHugePageSize);
+    if (!MapHugeRegion()) {
+      LOG_WARN("MemArena: huge pages unavailable, using base pages");
+    }
+  }
+
+  if (!base_) {
+    void *p = ::mmap(nullptr, region_bytes_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+      LOG_WARN("MemArena: failed to reserve {} bytes, using heap allocation",
+               region_bytes_);
+      region_bytes_ = 0;
+      return;
+    }
+    base_ = static_cast<char *>(p);
+  }
+  stats_.region_bytes = region_bytes_;
+
+  // Bind before first touch so pages are faulted in on the preferred node
+  if (opts.numa_node >= 0)
+    BindToNode(opts.numa_node);
+}
+
+bool MemArena::MapHugeRegion() {
+  // 1. Explicit huge pages. No MAP_NORESERVE: the mapping must fail now if
+  //    the hugetlb pool is short, rather than SIGBUS on first touch later.
+  void *p = ::mmap(nullptr, region_bytes_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    base_ = static_cast<char *>(p);
+    page_mode_ = PageMode::kHugeTlb;
+    return true;
+  }
+
+  // 2. Transparent huge pages: over-reserve, trim to a 2 MB aligned window
+  //    and ask khugepaged / the fault path for huge pages
+  size_t span = region_bytes_ + kHugePageSize;
+  p = ::mmap(nullptr, span, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    return false;
+  auto *raw = static_cast<char *>(p);
+  auto *aligned = reinterpret_cast<char *>(
+      RoundUp(reinterpret_cast<uintptr_t>(raw), kHugePageSize));
+  if (aligned > raw)
+    ::munmap(raw, aligned - raw);
+  char *end = aligned + region_bytes_;
+  if (raw + span > end)
+    ::munmap(end, raw + span - end);
+  base_ = aligned;
+
+  // Without THP support the aligned region is still usable with base pages
+  if (::madvise(base_, region_bytes_, MADV_HUGEPAGE) != 0)
+    return false;
+  page_mode_ = PageMode::kTransparentHuge;
+  return true;
+}
+
+void MemArena::BindToNode(int node) {
+  constexpr int kMaxNodes = sizeof(unsigned long) * 8;
+  if (node >= kMaxNodes)
+    return;
+  // Preferred, not strict: a full node spills to others instead of failing
+  unsigned long mask = 1UL << node;
+  if (::syscall(SYS_mbind, base_, region_bytes_, MPOL_PREFERRED, &mask,
+                kMaxNodes, 0) != 0) {
+    LOG_WARN("MemArena: mbind to node {} failed", node);
+    return;
+  }
+  numa_node_ = node;
+}
+
+int MemArena::NumaNodeCount() {
+  // e.g. "0-1" or "0,2-3"; the count is the highest node id + 1
+  std::ifstream in("/sys/devices/system/node/online");
+  std::string list;
+  if (!(in >> list))
+    return 1;
+  int max_node = 0;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    auto dash = range.find('-');
+    max_node = std::max(
+        max_node,
+        std::atoi(range.c_str() + (dash == std::string::npos ? 0 : dash + 1)));
+  }
+  return max_node + 1;
+}
+
+int MemArena::CurrentNumaNode() {
+  unsigned cpu = 0, node = 0;
+  if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+    return 0;
+  return static_cast<int>(node);
+}
+
+MemArena::~MemArena() {
+  if (base_) {
+    ::munmap(base_, region_bytes_);
+  }
+}
+
+size_t MemArena::SizeClass(size_t size) {
+  if (size <= kMinSlabSize)
+    return kMinSlabSize;
+  // Four classes per power of two: step is a quarter of the power below.
+  size_t step = std::max(kMinSlabSize, std::bit_floor(size) / 4);
+  return RoundUp(size, step);
+}
+
+void *MemArena::Allocate(size_t size, size_t *slab_size, bool allow_heap) {
+  size_t cls = SizeClass(size);
+
+  std::lock_guard<std::mutex> lock(mu_);
+
+  // 1. Recycle a free slab of this class (or a slightly larger one)
+  auto it = free_lists_.lower_bound(cls);
+  if (it != free_lists_.end() && it->first <= cls * kMaxSlabReuseFactor) {
+    char *ptr = it->second.back();
+    size_t actual = it->first;
+    it->second.pop_back();
+    if (it->second.empty())
+      free_lists_.erase(it);
+
+    stats_.free_slab_bytes -= actual;
+    stats_.allocated_bytes += actual;
+    stats_.requested_bytes += size;
+    stats_.recycled_allocs++;
+    *slab_size = actual;
+    return ptr;
+  }
+
+  // 2. Carve a fresh slab from the region
+  if (base_ && region_bytes_ - bump_ >= cls) {
+    char *ptr = base_ + bump_;
+    bump_ += cls;
+    stats_.carved_bytes += cls;
+    stats_.allocated_bytes += cls;
+    stats_.requested_bytes += size;
+    *slab_size = cls;
+    return ptr;
+  }
+
+  // 3. Region exhausted (or fragmented): fall back to the heap
+  if (!allow_heap)
+    return nullptr;
+  void *ptr = std::malloc(size);
+  if (!ptr)
+    return nullptr;
+  stats_.heap_fallback_bytes += size;
+  *slab_size = size;
+  return ptr;
+}
+
+void MemArena::Free(void *ptr, size_t size, size_t slab_size) {
+  if (!ptr)
+    return;
+
+  std::lock_guard<std::mutex> lock(mu_);
+  if (!InRegion(ptr)) {
+    stats_.heap_fallback_bytes -= size;
+    std::free(ptr);
+    return;
+  }
+
+  free_lists_[slab_size].push_back(static_cast<char *>(ptr));
+  stats_.allocated_bytes -= slab_size;
+  stats_.requested_bytes -= size;
+  stats_.free_slab_bytes += slab_size;
+}
+
+MemArena::Stats MemArena::GetStats() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return stats_;
+}
+
+bool MemArena::InRegion(const void *ptr) const {
+  auto *p = static_cast<const char *>(ptr);
+  return base_ && p >= base_ && p < base_ + region_bytes_;
+}
+
+} // namespace anycache
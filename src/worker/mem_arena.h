@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace anycache {
+
+// MemArena backs the memory tier with one pre-reserved virtual region that is
+// carved into size-classed slabs (page-sized up to kMaxBlockSize). Freed slabs
+// are kept on per-class free lists and recycled by later allocations instead
+// of going back to the system allocator.
+//
+// The region is reserved with MAP_NORESERVE, so physical pages are only
+// committed (and zero-filled by the kernel) on first touch. Slab contents are
+// otherwise unspecified; callers that need zeroed memory zero lazily.
+//
+// Optionally the region is backed by 2 MB pages (explicit hugetlbfs pages,
+// else transparent huge pages) and bound to a preferred NUMA node.
+class MemArena {
+public:
+  enum class PageMode : uint8_t {
+    kDefault,         // base pages
+    kHugeTlb,         // MAP_HUGETLB, reserved up front from the hugetlb pool
+    kTransparentHuge, // 2 MB aligned region with MADV_HUGEPAGE
+  };
+
+  struct Options {
+    bool huge_pages = false;
+    int numa_node = -1; // preferred node for the region; -1 = no binding
+  };
+
+  struct Stats {
+    size_t region_bytes = 0;        // reserved virtual region
+    size_t carved_bytes = 0;        // region bytes handed out as slabs so far
+    size_t allocated_bytes = 0;     // slab bytes backing live allocations
+    size_t requested_bytes = 0;     // bytes requested by live allocations
+    size_t free_slab_bytes = 0;     // recycled slabs waiting for reuse
+    size_t heap_fallback_bytes = 0; // live allocations served by malloc
+    uint64_t recycled_allocs = 0;   // allocations served from a free list
+
+    // Share of in-use slab bytes wasted by size-class rounding.
+    double InternalFragmentation() const;
+    // Share of carved region bytes sitting idle on free lists.
+    double ExternalFragmentation() const;
+
+    Stats &operator+=(const Stats &other);
+  };
+
+  // Reserve a region large enough to hold `capacity` bytes of blocks plus
+  // headroom for size-class rounding.
+  explicit MemArena(size_t capacity);
+  MemArena(size_t capacity, const Options &opts);
+  ~MemArena();
+
+  MemArena(const MemArena &) = delete;
+  MemArena &operator=(const MemArena &) = delete;
+
+  // Allocate at least `size` bytes. On success returns the slab pointer and
+  // stores the actual slab size in `*slab_size`; returns nullptr on failure.
+  // With `allow_heap` false, fails instead of falling back to malloc when
+  // the region has no room (lets callers try another node's arena first).
+  void *Allocate(size_t size, size_t *slab_size, bool allow_heap = true);
+
+  // Return a slab obtained from Allocate().
+  void Free(void *ptr, size_t size, size_t slab_size);
+
+  Stats GetStats() const;
+  PageMode GetPageMode() const { return page_mode_; }
+  int GetNumaNode() const { return numa_node_; }
+
+  // Round `size` up to its slab size class.
+  static size_t SizeClass(size_t size);
+
+  // Number of NUMA nodes on this host (1 if unknown or not NUMA).
+  static int NumaNodeCount();
+  // NUMA node of the CPU the calling thread is running on (0 if unknown).
+  static int CurrentNumaNode();
+
+  static constexpr size_t kMinSlabSize = 4096;
+  static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+private:
+  bool InRegion(const void *ptr) const;
+  // Map region_bytes_ with huge pages; false if neither mode is available
+  // (base_ may still be set to a usable base-page region).
+  bool MapHugeRegion();
+  void BindToNode(int node);
+
+  char *base_ = nullptr;
+  size_t region_bytes_ = 0;
+  PageMode page_mode_ = PageMode::kDefault;
+  int numa_node_ = -1;
+
+  mutable std::mutex mu_;
+  size_t bump_ = 0; // next uncarved offset in the region
+  // slab size -> recycled slabs of exactly that size
+  std::map<size_t, std::vector<char *>> free_lists_;
+  Stats stats_;
+};
+
+} // namespace anycache
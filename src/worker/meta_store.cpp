@@ -2,6 +2,7 @@
 #include "common/logging.h"
 
 #include <chrono>
+#include <cstddef>
 #include <cstring>
 #include <filesystem>
 
@@ -19,6 +20,15 @@ BlockMeta BlockMeta::Deserialize(const std::string &data) {
   BlockMeta meta;
   if (data.size() >= sizeof(BlockMeta)) {
     std::memcpy(&meta, data.data(), sizeof(BlockMeta));
+  } else if (data.size() >= offsetof(BlockMeta, fetch_cost_us)) {
+    // Written before fetch_cost_us existed: the cost is unknown
+    std::memcpy(static_cast<void *>(&meta), data.data(),
+                offsetof(BlockMeta, fetch_cost_us));
+  } else if (data.size() >= offsetof(BlockMeta, cached_bytes)) {
+    // Written before cached_bytes existed: blocks were always complete
+    std::memcpy(static_cast<void *>(&meta), data.data(),
+                offsetof(BlockMeta, cached_bytes));
+    meta.cached_bytes = meta.length;
   }
   return meta;
 }
@@ -112,6 +122,16 @@ Status RocksMetaStore::DeleteBlockMeta(BlockId id) {
   return Status::OK();
 }
 
+Status RocksMetaStore::PutBlockMetaBatch(const std::vector<BlockMeta> &metas) {
+  rocksdb::WriteBatch batch;
+  for (auto &meta : metas)
+    batch.Put(MakeKey(meta.block_id), meta.Serialize());
+  auto s = db_->Write(rocksdb::WriteOptions(), &batch);
+  if (!s.ok())
+    return Status::IOError("RocksDB batch write: " + s.ToString());
+  return Status::OK();
+}
+
 Status RocksMetaStore::ScanAll(std::vector<BlockMeta> *out) {
   std::unique_ptr<rocksdb::Iterator> it(
       db_->NewIterator(rocksdb::ReadOptions()));
@@ -161,6 +181,14 @@ Status InMemoryMetaStore::DeleteBlockMeta(BlockId id) {
   return Status::OK();
 }
 
+Status
+InMemoryMetaStore::PutBlockMetaBatch(const std::vector<BlockMeta> &metas) {
+  std::lock_guard<std::mutex> lock(mu_);
+  for (auto &meta : metas)
+    store_[meta.block_id] = meta;
+  return Status::OK();
+}
+
 Status InMemoryMetaStore::ScanAll(std::vector<BlockMeta> *out) {
   std::lock_guard<std::mutex> lock(mu_);
   out->reserve(store_.size());
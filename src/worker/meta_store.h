@@ -10,6 +10,7 @@
 
 #ifdef ANYCACHE_HAS_ROCKSDB
 #include <rocksdb/db.h>
+#include <rocksdb/write_batch.h>
 #endif
 
 namespace anycache {
@@ -24,6 +25,11 @@ struct BlockMeta {
   int64_t create_time_ms = 0;
   int64_t last_access_time_ms = 0;
   uint64_t access_count = 0;
+  // Bytes holding valid data; below `length` for a partially filled block
+  uint64_t cached_bytes = 0;
+  // Estimated time to refetch the block from the UFS in microseconds
+  // (0 = unknown); cost-aware eviction keeps expensive blocks longer
+  uint64_t fetch_cost_us = 0;
 
   // Serialize/Deserialize to binary
   std::string Serialize() const;
@@ -45,6 +51,8 @@ public:
   virtual Status PutBlockMeta(BlockId id, const BlockMeta &meta) = 0;
   virtual Status GetBlockMeta(BlockId id, BlockMeta *meta) = 0;
   virtual Status DeleteBlockMeta(BlockId id) = 0;
+  // Write many records at once (a single WriteBatch on RocksDB)
+  virtual Status PutBlockMetaBatch(const std::vector<BlockMeta> &metas) = 0;
 
   // Scan all block metadata (for recovery)
   virtual Status ScanAll(std::vector<BlockMeta> *out) = 0;
@@ -66,6 +74,7 @@ public:
   Status PutBlockMeta(BlockId id, const BlockMeta &meta) override;
   Status GetBlockMeta(BlockId id, BlockMeta *meta) override;
   Status DeleteBlockMeta(BlockId id) override;
+  Status PutBlockMetaBatch(const std::vector<BlockMeta> &metas) override;
   Status ScanAll(std::vector<BlockMeta> *out) override;
 
 private:
@@ -84,6 +93,7 @@ public:
   Status PutBlockMeta(BlockId id, const BlockMeta &meta) override;
   Status GetBlockMeta(BlockId id, BlockMeta *meta) override;
   Status DeleteBlockMeta(BlockId id) override;
+  Status PutBlockMetaBatch(const std::vector<BlockMeta> &metas) override;
   Status ScanAll(std::vector<BlockMeta> *out) override;
 
 private:
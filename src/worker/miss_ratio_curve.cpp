@@ -0,0 +1,92 @@
+#include "worker/miss_ratio_curve.h"
+
+#include <algorithm>
+
+namespace anycache {
+
+namespace {
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+} // namespace
+
+MissRatioCurve::MissRatioCurve(size_t capacity_bytes, double sample_rate,
+                               std::vector<double> multiples)
+    : capacity_bytes_(capacity_bytes), multiples_(std::move(multiples)) {
+  double smallest = *std::min_element(multiples_.begin(), multiples_.end());
+  double needed = static_cast<double>(kMinSampledBlocks * kDefaultBlockSize) /
+                  std::max(1.0, smallest * capacity_bytes);
+  rate_ = std::clamp(std::max(sample_rate, needed), 0.0, 1.0);
+  threshold_ = static_cast<uint64_t>(rate_ * (1ULL << 32));
+  caches_.resize(multiples_.size());
+  for (size_t i = 0; i < caches_.size(); ++i)
+    caches_[i].capacity =
+        static_cast<size_t>(multiples_[i] * capacity_bytes_ * rate_);
+}
+
+bool MissRatioCurve::Sampled(BlockId id) const {
+  // Seeded so that small ids (0 hashes to 0) are not always sampled
+  return (Mix(id ^ 0x5851f42d4c957f2dULL) >> 32) < threshold_;
+}
+
+void MissRatioCurve::Reference(BlockId id, size_t size) {
+  if (!Sampled(id))
+    return;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (size > 0) {
+    sized_refs_++;
+    sized_bytes_ += size;
+  }
+  size_t fallback = sized_refs_ > 0 ? sized_bytes_ / sized_refs_
+                                    : kDefaultBlockSize;
+  for (auto &c : caches_) {
+    auto it = c.index.find(id);
+    size_t block_size = size;
+    if (it != c.index.end()) {
+      c.hits++;
+      if (block_size == 0)
+        block_size = it->second->second;
+      c.bytes -= it->second->second;
+      c.lru.erase(it->second);
+    } else if (block_size == 0) {
+      block_size = fallback;
+    }
+    c.lru.emplace_front(id, block_size);
+    c.index[id] = c.lru.begin();
+    c.bytes += block_size;
+    while (c.bytes > c.capacity && !c.lru.empty()) {
+      auto &[victim, victim_size] = c.lru.back();
+      c.bytes -= victim_size;
+      c.index.erase(victim);
+      c.lru.pop_back();
+    }
+  }
+  if (++references_ >= kDecayReferences) {
+    references_ /= 2;
+    for (auto &c : caches_)
+      c.hits /= 2;
+  }
+}
+
+std::vector<MissRatioCurve::Point> MissRatioCurve::Curve() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  std::vector<Point> curve;
+  for (size_t i = 0; i < caches_.size(); ++i) {
+    Point p;
+    p.multiple = multiples_[i];
+    p.capacity_bytes = static_cast<size_t>(multiples_[i] * capacity_bytes_);
+    p.references = references_;
+    p.hit_ratio = references_ > 0 ? static_cast<double>(caches_[i].hits) /
+                                        references_
+                                  : 0;
+    curve.push_back(p);
+  }
+  return curve;
+}
+
+} // namespace anycache
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common/types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace anycache {
+
+// MissRatioCurve estimates the hit ratio an LRU cache would reach on the
+// observed reference stream at several multiples of a capacity, using
+// SHARDS (Waldspurger et al., FAST '15): a block is sampled iff its id hashes
+// below sample_rate, so a sampled block is seen on every reference, and each
+// capacity is simulated by a miniature LRU cache scaled down by the rate.
+// An unsampled reference costs one hash and no lock.
+//
+// Counts are halved every kDecayReferences sampled references, so the curve
+// follows the recent workload.
+class MissRatioCurve {
+public:
+  struct Point {
+    double multiple = 0;     // of the configured capacity
+    size_t capacity_bytes = 0;
+    double hit_ratio = 0;
+    uint64_t references = 0; // sampled references behind the estimate
+  };
+
+  // The rate is raised, up to 1, until the smallest miniature cache holds
+  // kMinSampledBlocks blocks of default size, so small tiers stay meaningful
+  MissRatioCurve(size_t capacity_bytes, double sample_rate,
+                 std::vector<double> multiples = {0.5, 1, 2, 4});
+
+  // A request for a block; `size` 0 = unknown (a miss of an uncached block
+  // takes its previous size, or the mean sampled block size)
+  void Reference(BlockId id, size_t size);
+
+  std::vector<Point> Curve() const;
+  double sample_rate() const { return rate_; }
+
+  static constexpr size_t kMinSampledBlocks = 64;
+  static constexpr uint64_t kDecayReferences = 1 << 20;
+
+private:
+  struct MiniCache {
+    size_t capacity = 0; // scaled by the sampling rate
+    size_t bytes = 0;
+    std::list<std::pair<BlockId, size_t>> lru; // front = most recent
+    std::unordered_map<BlockId,
+                       std::list<std::pair<BlockId, size_t>>::iterator>
+        index;
+    uint64_t hits = 0;
+  };
+
+  bool Sampled(BlockId id) const;
+
+  size_t capacity_bytes_;
+  double rate_;
+  uint64_t threshold_; // sampled iff hash < threshold_ (out of 2^32)
+  std::vector<double> multiples_;
+
+  mutable std::mutex mu_;
+  std::vector<MiniCache> caches_; // parallel to multiples_
+  uint64_t references_ = 0;
+  uint64_t sized_refs_ = 0; // references with a known size, for the mean
+  uint64_t sized_bytes_ = 0;
+};
+
+} // namespace anycache
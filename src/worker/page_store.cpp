@@ -2,21 +2,161 @@
 #include "common/logging.h"
 #include "common/metrics.h"
 
+#include <bit>
+#include <sys/mman.h>
+
 namespace anycache {
 
-PageStore::PageStore(size_t page_size, size_t max_pages)
-    : page_size_(page_size), cache_(max_pages) {}
+// ═══════════════════════════════════════════════════════════════
+//  PageFramePool
+// ═══════════════════════════════════════════════════════════════
+
+PageFramePool::Frame &PageFramePool::Frame::operator=(Frame &&other) noexcept {
+  if (this != &other) {
+    Release();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    pooled_ = other.pooled_;
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.pooled_ = false;
+  }
+  return *this;
+}
+
+void PageFramePool::Frame::Release() {
+  if (!data_)
+    return;
+  if (pooled_)
+    pool_->Return(data_);
+  else
+    delete[] data_;
+  data_ = nullptr;
+}
+
+PageFramePool::PageFramePool(size_t frame_size, size_t count)
+    : frame_size_(frame_size) {
+  if (count == 0 || frame_size_ == 0)
+    return;
+
+  size_t bytes = frame_size_ * count;
+  void *p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    LOG_WARN("PageFramePool: mmap of {} bytes failed, using heap only",
+             bytes);
+    return;
+  }
+  region_ = static_cast<char *>(p);
+  region_bytes_ = bytes;
+  free_.reserve(count);
+  // Low addresses first, so a cache that never fills touches a prefix
+  for (size_t i = count; i > 0; --i)
+    free_.push_back(region_ + (i - 1) * frame_size_);
+  stats_.frames = count;
+}
+
+PageFramePool::~PageFramePool() {
+  if (region_)
+    ::munmap(region_, region_bytes_);
+}
+
+PageFramePool::Frame PageFramePool::Acquire(size_t size) {
+  Frame frame;
+  frame.pool_ = this;
+  if (size <= frame_size_) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!free_.empty()) {
+      frame.data_ = free_.back();
+      frame.pooled_ = true;
+      free_.pop_back();
+      stats_.in_use++;
+      return frame;
+    }
+  }
+
+  // Oversized request or pool exhausted
+  frame.data_ = new (std::nothrow) char[std::max<size_t>(size, 1)];
+  if (!frame.data_)
+    return Frame{};
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stats_.heap_fallbacks++;
+  }
+  Metrics::Instance().IncrCounter("page_store.frames.heap_fallbacks");
+  return frame;
+}
+
+void PageFramePool::Return(char *data) {
+  std::lock_guard<std::mutex> lock(mu_);
+  free_.push_back(data);
+  stats_.in_use--;
+}
+
+PageFramePool::Stats PageFramePool::GetStats() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return stats_;
+}
+
+// ═══════════════════════════════════════════════════════════════
+//  PageStore
+// ═══════════════════════════════════════════════════════════════
+
+namespace {
+// The cache's capacity plus spares; the shards round max_pages up by less
+// than one entry each
+size_t FrameCount(const PageStore::Options &opts) {
+  return opts.max_pages + std::bit_ceil(std::max<size_t>(opts.shards, 1)) +
+         PageStore::kSpareFrames;
+}
+} // namespace
+
+PageData::~PageData() {
+  if (prefetched.load(std::memory_order_relaxed))
+    Metrics::Instance().IncrCounter("page_store.prefetch.wasted");
+}
+
+PageStore::PageStore(size_t page_size, size_t max_pages, size_t shards,
+                     PageEvictionMode mode)
+    : PageStore(Options{page_size, max_pages, shards, mode}) {}
+
+PageStore::PageStore(const Options &opts)
+    : page_size_(opts.page_size),
+      frames_(opts.page_size, FrameCount(opts)),
+      cache_(opts.max_pages, opts.shards, opts.mode),
+      readahead_initial_(std::max<size_t>(opts.readahead_initial_pages, 1)),
+      readahead_max_(std::min(opts.readahead_max_pages, opts.max_pages / 4)),
+      prefetch_queue_limit_(opts.prefetch_queue_limit) {
+  if (readahead_max_ < readahead_initial_ || opts.prefetch_threads == 0)
+    readahead_max_ = 0;
+  for (size_t i = 0; i < opts.prefetch_threads; ++i)
+    prefetchers_.emplace_back([this] { PrefetchLoop(); });
+}
+
+PageStore::~PageStore() {
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mu_);
+    stop_prefetch_ = true;
+  }
+  prefetch_cv_.notify_all();
+  for (auto &t : prefetchers_)
+    t.join();
+}
 
 Status PageStore::ReadPage(FileId file_id, uint64_t page_index, void *buf,
                            size_t *bytes_read) {
   PageKey key{file_id, page_index};
+  // Before the lookup, so read-ahead overlaps this read's own miss
+  if (readahead_max_ > 0)
+    OnDemandRead(file_id, page_index);
 
   // Try cache hit
   std::shared_ptr<PageData> page;
   if (cache_.Get(key, &page)) {
     Metrics::Instance().IncrCounter("page_store.cache_hits");
-    size_t copy_size = page->data.size();
-    std::memcpy(buf, page->data.data(), copy_size);
+    CountPrefetchHit(*page);
+    size_t copy_size = page->size;
+    std::memcpy(buf, page->frame.data(), copy_size);
     if (bytes_read)
       *bytes_read = copy_size;
     return Status::OK();
@@ -29,65 +169,310 @@ Status PageStore::ReadPage(FileId file_id, uint64_t page_index, void *buf,
     return Status::Internal("no page fetcher configured");
   }
 
-  page = std::make_shared<PageData>();
-  page->data.resize(page_size_);
-  size_t fetched = 0;
-  RETURN_IF_ERROR(fetcher_(file_id, page_index, page->data.data(), &fetched));
-  page->data.resize(fetched);
-
-  cache_.Put(key, page);
-  TrackPage(file_id, page_index);
-
-  std::memcpy(buf, page->data.data(), fetched);
+  RETURN_IF_ERROR(
+      LoadPage(key, &page, /*prefetch=*/false, FileEpoch(file_id)));
+  CountPrefetchHit(*page);
+  std::memcpy(buf, page->frame.data(), page->size);
   if (bytes_read)
-    *bytes_read = fetched;
+    *bytes_read = page->size;
   return Status::OK();
 }
 
+Status PageStore::LoadPage(const PageKey &key, std::shared_ptr<PageData> *page,
+                           bool prefetch, uint64_t epoch) {
+  std::shared_ptr<PendingFetch> fetch;
+  for (;;) {
+    std::unique_lock<std::mutex> lock(inflight_mu_);
+    auto it = inflight_.find(key);
+    if (it == inflight_.end()) {
+      fetch = std::make_shared<PendingFetch>();
+      fetch->prefetch = prefetch;
+      inflight_.emplace(key, fetch);
+      break;
+    }
+    // Another thread is fetching this page: share its result
+    auto shared = it->second;
+    Metrics::Instance().IncrCounter("page_store.coalesced_misses");
+    shared->cv.wait(lock, [&] { return shared->done; });
+    if (!shared->status.ok() || shared->page) {
+      *page = shared->page;
+      bool promote = !prefetch && shared->prefetch && shared->status.ok();
+      lock.unlock();
+      // A demand read of a page being prefetched: it was cached at low
+      // priority, so use it once to keep it from being evicted first
+      std::shared_ptr<PageData> cached;
+      if (promote)
+        cache_.Get(key, &cached);
+      return shared->status;
+    }
+    // Defensive: a leader always publishes its page, but should it come
+    // back empty, read the cache or fetch again rather than return null
+    lock.unlock();
+    if (cache_.Get(key, page))
+      return Status::OK();
+  }
+
+  // A fetch may have finished between the caller's cache miss and the
+  // registration above; it is cached before it is unregistered. Waiters
+  // need the page itself, so a prefetch peeks rather than checking
+  // presence, which also leaves the page's eviction order alone.
+  Status status;
+  std::shared_ptr<PageData> loaded;
+  bool resident =
+      prefetch ? cache_.Peek(key, &loaded) : cache_.Get(key, &loaded);
+  bool fetched_here = !resident;
+  if (fetched_here) {
+    loaded = NewPage(page_size_);
+    if (!loaded) {
+      status = Status::Internal("page frame allocation failed");
+    } else {
+      size_t fetched = 0;
+      status = fetcher_(key.file_id, key.page_index, loaded->frame.data(),
+                        &fetched);
+      loaded->size = fetched;
+      loaded->prefetched.store(prefetch, std::memory_order_relaxed);
+    }
+    if (!status.ok())
+      loaded.reset();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(inflight_mu_);
+    // Under inflight_mu_, so InvalidateFile either sees the page tracked
+    // or has moved the file's epoch on; waiters get the data either way
+    if (fetched_here && status.ok() &&
+        FileEpochLocked(key.file_id) == epoch) {
+      cache_.Put(key, loaded, /*low_priority=*/prefetch);
+      TrackPage(key.file_id, key.page_index);
+    }
+    fetch->done = true;
+    fetch->status = status;
+    fetch->page = loaded;
+    inflight_.erase(key);
+  }
+  fetch->cv.notify_all();
+  if (fetched_here)
+    PublishStats();
+  *page = std::move(loaded);
+  return status;
+}
+
 Status PageStore::WritePage(FileId file_id, uint64_t page_index,
                             const void *buf, size_t size) {
   PageKey key{file_id, page_index};
 
-  auto page = std::make_shared<PageData>();
-  page->data.assign(static_cast<const char *>(buf),
-                    static_cast<const char *>(buf) + size);
+  auto page = NewPage(size);
+  if (!page)
+    return Status::Internal("page frame allocation failed");
+  std::memcpy(page->frame.data(), buf, size);
+  page->size = size;
   page->dirty = true;
 
   cache_.Put(key, page);
   TrackPage(file_id, page_index);
   Metrics::Instance().IncrCounter("page_store.writes");
+  PublishStats();
   return Status::OK();
 }
 
 void PageStore::PrefetchPages(FileId file_id, uint64_t start_page,
                               uint32_t count) {
-  // Simple sync prefetch; a real implementation would use async I/O
+  Metrics::Instance().IncrCounter("page_store.prefetches", count);
+  if (!fetcher_)
+    return;
+  uint64_t queued = 0, skipped = 0, dropped = 0;
   for (uint32_t i = 0; i < count; ++i) {
     PageKey key{file_id, start_page + i};
-    if (cache_.Contains(key))
+    if (cache_.Contains(key) || IsFetching(key)) {
+      skipped++;
       continue;
+    }
+    if (prefetchers_.empty()) {
+      // No executor: prefetch on the caller's thread, best effort
+      std::shared_ptr<PageData> page;
+      LoadPage(key, &page, /*prefetch=*/true, FileEpoch(file_id));
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(prefetch_mu_);
+    if (prefetch_queued_.count(key)) {
+      skipped++;
+    } else if (prefetch_queue_.size() >= prefetch_queue_limit_) {
+      dropped++;
+    } else {
+      prefetch_queue_.push_back(key);
+      prefetch_queued_.insert(key);
+      queued++;
+    }
+  }
+  if (queued > 0)
+    prefetch_cv_.notify_all();
 
-    if (fetcher_) {
-      auto page = std::make_shared<PageData>();
-      page->data.resize(page_size_);
-      size_t fetched = 0;
-      auto s = fetcher_(file_id, start_page + i, page->data.data(), &fetched);
-      if (s.ok()) {
-        page->data.resize(fetched);
-        cache_.Put(key, page);
-        TrackPage(file_id, start_page + i);
+  auto &m = Metrics::Instance();
+  if (queued > 0)
+    m.IncrCounter("page_store.prefetch.queued", queued);
+  if (skipped > 0)
+    m.IncrCounter("page_store.prefetch.skipped", skipped);
+  if (dropped > 0)
+    m.IncrCounter("page_store.prefetch.dropped", dropped);
+}
+
+void PageStore::WaitForPrefetches() {
+  std::unique_lock<std::mutex> lock(prefetch_mu_);
+  prefetch_idle_cv_.wait(lock, [this] {
+    return prefetch_queue_.empty() && prefetch_active_ == 0;
+  });
+}
+
+void PageStore::PrefetchLoop() {
+  std::unique_lock<std::mutex> lock(prefetch_mu_);
+  for (;;) {
+    prefetch_cv_.wait(lock, [this] {
+      return stop_prefetch_ || !prefetch_queue_.empty();
+    });
+    if (stop_prefetch_)
+      return;
+    PageKey key = prefetch_queue_.front();
+    prefetch_queue_.pop_front();
+    prefetch_queued_.erase(key);
+    prefetch_active_++;
+    // Before prefetch_mu_ is released: an InvalidateFile that no longer
+    // finds the key queued moves the epoch on after this
+    uint64_t epoch = FileEpoch(key.file_id);
+    lock.unlock();
+
+    if (!cache_.Contains(key) && !IsFetching(key)) {
+      std::shared_ptr<PageData> page;
+      auto s = LoadPage(key, &page, /*prefetch=*/true, epoch);
+      if (!s.ok())
+        LOG_DEBUG("Prefetch of file {} page {} failed: {}", key.file_id,
+                  key.page_index, s.ToString());
+    }
+
+    lock.lock();
+    prefetch_active_--;
+    if (prefetch_queue_.empty() && prefetch_active_ == 0)
+      prefetch_idle_cv_.notify_all();
+  }
+}
+
+void PageStore::OnDemandRead(FileId file_id, uint64_t page_index) {
+  uint64_t start = 0, end = 0;
+  {
+    auto &shard = StreamShardFor(file_id);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    auto it = shard.streams.find(file_id);
+    if (it == shard.streams.end()) {
+      if (shard.streams.size() >= kMaxStreamsPerShard) {
+        auto stalest = std::min_element(
+            shard.streams.begin(), shard.streams.end(),
+            [](const auto &a, const auto &b) {
+              return a.second.last_use < b.second.last_use;
+            });
+        shard.streams.erase(stalest);
       }
+      it = shard.streams.emplace(file_id, Stream{}).first;
+      it->second.next_page = page_index + 1;
+      it->second.readahead_end = page_index + 1;
+    }
+    Stream &st = it->second;
+    st.last_use = ++shard.clock;
+
+    if (page_index + 1 == st.next_page)
+      return; // the file's first read, or the same page again
+    if (page_index != st.next_page) {
+      // Random access: shrink the window and start a new run here
+      st.window /= 2;
+      if (st.window < readahead_initial_)
+        st.window = 0;
+      st.run = 0;
+      st.next_page = page_index + 1;
+      st.readahead_end = page_index + 1;
+      return;
     }
+
+    st.run++;
+    st.next_page = page_index + 1;
+    if (st.window == 0)
+      st.window = readahead_initial_;
+    st.readahead_end = std::max(st.readahead_end, page_index + 1);
+    // Issue the next window once the reader is halfway through this one
+    if (st.readahead_end - page_index > st.window / 2)
+      return;
+    if (st.readahead_end > page_index + 1) // the last window is being used
+      st.window = std::min(st.window * 2, readahead_max_);
+    start = st.readahead_end;
+    end = page_index + 1 + st.window;
+    st.readahead_end = end;
   }
-  Metrics::Instance().IncrCounter("page_store.prefetches", count);
+  if (end <= start)
+    return;
+  Metrics::Instance().IncrCounter("page_store.readahead.triggers");
+  Metrics::Instance().IncrCounter("page_store.readahead.pages", end - start);
+  PrefetchPages(file_id, start, static_cast<uint32_t>(end - start));
+}
+
+uint64_t PageStore::FileEpoch(FileId file_id) {
+  std::lock_guard<std::mutex> lock(inflight_mu_);
+  return FileEpochLocked(file_id);
+}
+
+uint64_t PageStore::FileEpochLocked(FileId file_id) const {
+  auto it = file_epochs_.find(file_id);
+  return it == file_epochs_.end() ? epoch_floor_ : it->second;
+}
+
+bool PageStore::IsFetching(const PageKey &key) {
+  std::lock_guard<std::mutex> lock(inflight_mu_);
+  return inflight_.count(key) > 0;
+}
+
+void PageStore::CountPrefetchHit(PageData &page) {
+  // First demand read of a prefetched page
+  if (page.prefetched.load(std::memory_order_relaxed) &&
+      page.prefetched.exchange(false, std::memory_order_relaxed))
+    Metrics::Instance().IncrCounter("page_store.prefetch.useful");
 }
 
 void PageStore::Evict(size_t pages_to_free) {
   cache_.EvictN(pages_to_free);
   Metrics::Instance().IncrCounter("page_store.evictions", pages_to_free);
+  PublishStats();
 }
 
 void PageStore::InvalidateFile(FileId file_id) {
+  // Queued prefetches of the file are dropped and fetches that started
+  // before this are not cached, so no stale page comes back after it
+  size_t cancelled = 0;
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mu_);
+    auto removed = std::remove_if(
+        prefetch_queue_.begin(), prefetch_queue_.end(),
+        [&](const PageKey &key) { return key.file_id == file_id; });
+    for (auto it = removed; it != prefetch_queue_.end(); ++it)
+      prefetch_queued_.erase(*it);
+    cancelled = prefetch_queue_.end() - removed;
+    prefetch_queue_.erase(removed, prefetch_queue_.end());
+    if (prefetch_queue_.empty() && prefetch_active_ == 0)
+      prefetch_idle_cv_.notify_all();
+  }
+  if (cancelled > 0)
+    Metrics::Instance().IncrCounter("page_store.prefetch.cancelled",
+                                    cancelled);
+  {
+    std::lock_guard<std::mutex> lock(inflight_mu_);
+    if (file_epochs_.size() >= kMaxFileEpochs) {
+      file_epochs_.clear();
+      epoch_floor_ = epoch_clock_;
+    }
+    file_epochs_[file_id] = ++epoch_clock_;
+  }
+
+  {
+    auto &shard = StreamShardFor(file_id);
+    std::lock_guard<std::mutex> lock(shard.mu);
+    shard.streams.erase(file_id);
+  }
+
   std::unordered_set<uint64_t> pages;
   {
     std::lock_guard<std::mutex> lock(file_index_mu_);
@@ -103,9 +488,32 @@ void PageStore::InvalidateFile(FileId file_id) {
   }
 
   Metrics::Instance().IncrCounter("page_store.file_invalidations");
+  PublishStats();
   LOG_DEBUG("Invalidated {} pages for file {}", pages.size(), file_id);
 }
 
+std::shared_ptr<PageData> PageStore::NewPage(size_t size) {
+  auto frame = frames_.Acquire(size);
+  if (!frame)
+    return nullptr;
+  auto page = std::make_shared<PageData>();
+  page->frame = std::move(frame);
+  return page;
+}
+
+void PageStore::PublishStats() {
+  auto stats = frames_.GetStats();
+  auto &m = Metrics::Instance();
+  m.SetGauge("page_store.frames.total", static_cast<double>(stats.frames));
+  m.SetGauge("page_store.frames.in_use", static_cast<double>(stats.in_use));
+  // Share of prefetched pages read before they left the cache
+  auto useful = m.GetCounter("page_store.prefetch.useful");
+  auto wasted = m.GetCounter("page_store.prefetch.wasted");
+  if (useful + wasted > 0)
+    m.SetGauge("page_store.prefetch.useful_ratio",
+               static_cast<double>(useful) / (useful + wasted));
+}
+
 void PageStore::TrackPage(FileId file_id, uint64_t page_index) {
   std::lock_guard<std::mutex> lock(file_index_mu_);
   file_page_index_[file_id].insert(page_index);
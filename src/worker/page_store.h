@@ -4,99 +4,408 @@
 #include "common/types.h"
 #include "ufs/ufs.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 namespace anycache {
 
-// Thread-safe concurrent LRU cache for pages
+// How ConcurrentLRUCache picks victims within a shard
+enum class PageEvictionMode {
+  kLRU,   // exact LRU; a hit relinks the entry under the shard's write lock
+  kClock, // CLOCK / second chance; a hit only sets a reference bit under
+          // the shard's read lock, so concurrent hits never serialize
+};
+
+// Thread-safe concurrent cache for pages, split into a power-of-two number
+// of shards by key hash. Each shard has its own lock and an equal share of
+// max_entries, so eviction order is per shard: the victim is the shard's
+// least recently used (or CLOCK) entry, not the cache-wide one. The shard
+// count is reduced until every shard holds kMinShardEntries, so small caches
+// keep exact capacity.
+//
+// Entries put with low_priority (prefetched pages) wait in a per-shard FIFO
+// and are evicted before any other entry unless they are read first, which
+// turns them into ordinary entries.
 template <typename K, typename V> class ConcurrentLRUCache {
 public:
-  explicit ConcurrentLRUCache(size_t max_entries) : max_entries_(max_entries) {}
+  static constexpr size_t kMinShardEntries = 16;
+
+  explicit ConcurrentLRUCache(size_t max_entries, size_t shards = 1,
+                              PageEvictionMode mode = PageEvictionMode::kLRU)
+      : mode_(mode) {
+    size_t count = std::bit_ceil(std::max<size_t>(shards, 1));
+    while (count > 1 && max_entries / count < kMinShardEntries)
+      count /= 2;
+    shard_bits_ = std::countr_zero(count);
+    shards_ = std::make_unique<Shard[]>(count);
+    for (size_t i = 0; i < count; ++i)
+      shards_[i].max_entries =
+          std::max<size_t>(1, (max_entries + count - 1) / count);
+  }
 
   bool Get(const K &key, V *value) {
-    std::lock_guard<std::mutex> lock(mu_);
-    auto it = map_.find(key);
-    if (it == map_.end())
+    Shard &s = ShardFor(key);
+    if (mode_ == PageEvictionMode::kClock) {
+      std::shared_lock<std::shared_mutex> lock(s.mu);
+      auto it = s.clock_index.find(key);
+      if (it == s.clock_index.end())
+        return false;
+      auto &slot = s.ring[it->second];
+      slot.referenced.store(true, std::memory_order_relaxed);
+      *value = slot.value;
+      return true;
+    }
+    std::unique_lock<std::shared_mutex> lock(s.mu);
+    auto it = s.lru_index.find(key);
+    if (it == s.lru_index.end())
       return false;
-    // Move to back (most recently used)
-    order_.splice(order_.end(), order_, it->second);
+    MoveToBackLocked(s, it->second);
     *value = it->second->second;
     return true;
   }
 
-  void Put(const K &key, V value) {
-    std::lock_guard<std::mutex> lock(mu_);
-    auto it = map_.find(key);
-    if (it != map_.end()) {
+  void Put(const K &key, V value, bool low_priority = false) {
+    Shard &s = ShardFor(key);
+    std::unique_lock<std::shared_mutex> lock(s.mu);
+    if (mode_ == PageEvictionMode::kClock) {
+      auto it = s.clock_index.find(key);
+      if (it != s.clock_index.end()) {
+        auto &slot = s.ring[it->second];
+        slot.value = std::move(value);
+        if (!low_priority) {
+          slot.referenced.store(true, std::memory_order_relaxed);
+          slot.cold = false;
+        }
+        return;
+      }
+      if (s.clock_index.size() >= s.max_entries)
+        EvictOneLocked(s);
+      size_t pos;
+      if (!s.free_slots.empty()) {
+        pos = s.free_slots.back();
+        s.free_slots.pop_back();
+      } else {
+        pos = s.ring.size();
+        s.ring.emplace_back();
+      }
+      auto &slot = s.ring[pos];
+      slot.key = key;
+      slot.value = std::move(value);
+      slot.used = true;
+      slot.cold = low_priority;
+      slot.referenced.store(false, std::memory_order_relaxed);
+      s.clock_index[key] = pos;
+      if (low_priority)
+        PushColdSlotLocked(s, pos);
+      return;
+    }
+    auto it = s.lru_index.find(key);
+    if (it != s.lru_index.end()) {
       it->second->second = std::move(value);
-      order_.splice(order_.end(), order_, it->second);
+      if (!low_priority)
+        MoveToBackLocked(s, it->second);
+      return;
+    }
+    if (s.lru_index.size() >= s.max_entries)
+      EvictOneLocked(s);
+    if (low_priority) {
+      // Behind earlier low-priority entries, ahead of everything else
+      s.lru_index[key] = s.order.emplace(s.cold_end, key, std::move(value));
       return;
     }
-    if (map_.size() >= max_entries_) {
-      // Evict LRU
-      auto &front = order_.front();
-      map_.erase(front.first);
-      order_.pop_front();
+    s.order.emplace_back(key, std::move(value));
+    s.lru_index[key] = std::prev(s.order.end());
+    if (s.cold_end == s.order.end())
+      s.cold_end = s.lru_index[key];
+  }
+
+  // Like Get, but the lookup does not count as a use for eviction
+  bool Peek(const K &key, V *value) const {
+    Shard &s = ShardFor(key);
+    std::shared_lock<std::shared_mutex> lock(s.mu);
+    if (mode_ == PageEvictionMode::kClock) {
+      auto it = s.clock_index.find(key);
+      if (it == s.clock_index.end())
+        return false;
+      *value = s.ring[it->second].value;
+      return true;
     }
-    order_.emplace_back(key, std::move(value));
-    map_[key] = std::prev(order_.end());
+    auto it = s.lru_index.find(key);
+    if (it == s.lru_index.end())
+      return false;
+    *value = it->second->second;
+    return true;
   }
 
   bool Contains(const K &key) const {
-    std::lock_guard<std::mutex> lock(mu_);
-    return map_.count(key) > 0;
+    Shard &s = ShardFor(key);
+    std::shared_lock<std::shared_mutex> lock(s.mu);
+    return mode_ == PageEvictionMode::kClock ? s.clock_index.count(key) > 0
+                                             : s.lru_index.count(key) > 0;
   }
 
   void Erase(const K &key) {
-    std::lock_guard<std::mutex> lock(mu_);
-    auto it = map_.find(key);
-    if (it != map_.end()) {
-      order_.erase(it->second);
-      map_.erase(it);
+    Shard &s = ShardFor(key);
+    std::unique_lock<std::shared_mutex> lock(s.mu);
+    if (mode_ == PageEvictionMode::kClock) {
+      auto it = s.clock_index.find(key);
+      if (it != s.clock_index.end()) {
+        FreeSlotLocked(s, it->second);
+        s.clock_index.erase(it);
+      }
+      return;
+    }
+    auto it = s.lru_index.find(key);
+    if (it != s.lru_index.end()) {
+      if (it->second == s.cold_end)
+        ++s.cold_end;
+      s.order.erase(it->second);
+      s.lru_index.erase(it);
     }
   }
 
   size_t Size() const {
-    std::lock_guard<std::mutex> lock(mu_);
-    return map_.size();
+    size_t total = 0;
+    for (size_t i = 0; i < ShardCount(); ++i) {
+      std::shared_lock<std::shared_mutex> lock(shards_[i].mu);
+      total += CountLocked(shards_[i]);
+    }
+    return total;
   }
 
   void Clear() {
-    std::lock_guard<std::mutex> lock(mu_);
-    map_.clear();
-    order_.clear();
+    for (size_t i = 0; i < ShardCount(); ++i) {
+      Shard &s = shards_[i];
+      std::unique_lock<std::shared_mutex> lock(s.mu);
+      s.order.clear();
+      s.lru_index.clear();
+      s.cold_end = s.order.end();
+      s.ring.clear();
+      s.free_slots.clear();
+      s.clock_index.clear();
+      s.cold_slots.clear();
+      s.hand = 0;
+    }
   }
 
-  // Evict `count` LRU entries, returns keys evicted
+  // Evict `count` entries, one per shard in turn, returns keys evicted
   std::vector<K> EvictN(size_t count) {
-    std::lock_guard<std::mutex> lock(mu_);
     std::vector<K> evicted;
-    while (evicted.size() < count && !order_.empty()) {
-      auto &front = order_.front();
-      evicted.push_back(front.first);
-      map_.erase(front.first);
-      order_.pop_front();
+    size_t empty_in_a_row = 0;
+    while (evicted.size() < count && empty_in_a_row < ShardCount()) {
+      Shard &s = shards_[evict_cursor_++ & (ShardCount() - 1)];
+      std::unique_lock<std::shared_mutex> lock(s.mu);
+      if (CountLocked(s) == 0) {
+        empty_in_a_row++;
+        continue;
+      }
+      empty_in_a_row = 0;
+      evicted.push_back(EvictOneLocked(s));
     }
     return evicted;
   }
 
+  size_t ShardCount() const { return size_t{1} << shard_bits_; }
+  // Most entries the shards can hold together (max_entries rounded up)
+  size_t Capacity() const { return ShardCount() * shards_[0].max_entries; }
+  PageEvictionMode Mode() const { return mode_; }
+
 private:
-  size_t max_entries_;
+  struct ClockSlot {
+    K key{};
+    V value{};
+    std::atomic<bool> referenced{false};
+    bool used = false;
+    bool cold = false; // low priority and not yet read
+  };
+
+  using List = std::list<std::pair<K, V>>;
+
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mu;
+    size_t max_entries = 0;
+    // kLRU: front = least recently used. Low-priority entries not yet read
+    // sit at the front, before cold_end (the first ordinary entry, or end).
+    List order;
+    std::unordered_map<K, typename List::iterator> lru_index;
+    typename List::iterator cold_end = order.end();
+    // kClock: slots never move, so readers may hold a slot reference
+    std::deque<ClockSlot> ring;
+    std::vector<size_t> free_slots;
+    std::unordered_map<K, size_t> clock_index;
+    size_t hand = 0;
+    // Low-priority slots in insertion order; stale entries (slot since
+    // evicted, reused or read) are skipped when popped
+    std::deque<std::pair<size_t, K>> cold_slots;
+  };
+
+  Shard &ShardFor(const K &key) const {
+    if (shard_bits_ == 0)
+      return shards_[0];
+    // Fibonacci hashing: pages of one file differ only in the low bits
+    uint64_t h = std::hash<K>{}(key) * 0x9e3779b97f4a7c15ULL;
+    return shards_[h >> (64 - shard_bits_)];
+  }
+
+  size_t CountLocked(const Shard &s) const {
+    return mode_ == PageEvictionMode::kClock ? s.clock_index.size()
+                                             : s.lru_index.size();
+  }
+
+  void MoveToBackLocked(Shard &s, typename List::iterator it) {
+    if (it == s.cold_end)
+      ++s.cold_end;
+    s.order.splice(s.order.end(), s.order, it);
+    if (s.cold_end == s.order.end())
+      s.cold_end = it;
+  }
+
+  void PushColdSlotLocked(Shard &s, size_t pos) {
+    s.cold_slots.emplace_back(pos, s.ring[pos].key);
+    if (s.cold_slots.size() <= 2 * s.max_entries + kMinShardEntries)
+      return;
+    // Mostly stale (cold entries erased without eviction pressure): compact
+    std::erase_if(s.cold_slots, [&](const auto &e) {
+      const auto &slot = s.ring[e.first];
+      return !slot.used || !slot.cold || !(slot.key == e.second);
+    });
+  }
+
+  // Shard must be non-empty
+  K EvictOneLocked(Shard &s) {
+    if (mode_ == PageEvictionMode::kClock) {
+      // Unread low-priority slots first, oldest first
+      while (!s.cold_slots.empty()) {
+        auto [pos, key] = s.cold_slots.front();
+        s.cold_slots.pop_front();
+        auto &slot = s.ring[pos];
+        if (!slot.used || !slot.cold || !(slot.key == key))
+          continue;
+        slot.cold = false;
+        if (slot.referenced.load(std::memory_order_relaxed))
+          continue; // read since it was put: an ordinary entry now
+        s.clock_index.erase(key);
+        FreeSlotLocked(s, pos);
+        return key;
+      }
+      // Sweep the hand, clearing reference bits, until an unreferenced
+      // slot comes up; terminates within two turns
+      for (;;) {
+        size_t pos = s.hand;
+        s.hand = (s.hand + 1) % s.ring.size();
+        auto &slot = s.ring[pos];
+        if (!slot.used ||
+            slot.referenced.exchange(false, std::memory_order_relaxed))
+          continue;
+        K victim = slot.key;
+        s.clock_index.erase(victim);
+        FreeSlotLocked(s, pos);
+        return victim;
+      }
+    }
+    if (s.cold_end == s.order.begin())
+      ++s.cold_end;
+    K victim = s.order.front().first;
+    s.lru_index.erase(victim);
+    s.order.pop_front();
+    return victim;
+  }
+
+  void FreeSlotLocked(Shard &s, size_t pos) {
+    auto &slot = s.ring[pos];
+    slot.used = false;
+    slot.cold = false;
+    slot.value = V{};
+    s.free_slots.push_back(pos);
+  }
+
+  PageEvictionMode mode_;
+  int shard_bits_ = 0;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<size_t> evict_cursor_{0};
+};
+
+// PageFramePool hands out page frames from one mmap'd region of `count`
+// frames of `frame_size` bytes. Frames go back on a free list when their
+// lease is dropped, so a cache that keeps turning over reuses the same
+// memory instead of allocating and freeing a page buffer per miss. The
+// region is reserved up front but the kernel backs a frame only once it is
+// first written. Requests larger than a frame (or arriving while every frame
+// is leased) get a one-off heap buffer instead of blocking.
+class PageFramePool {
+public:
+  // RAII lease on one frame; returned to the pool (or freed) on destruction.
+  class Frame {
+  public:
+    Frame() = default;
+    Frame(Frame &&other) noexcept { *this = std::move(other); }
+    Frame &operator=(Frame &&other) noexcept;
+    ~Frame() { Release(); }
+
+    char *data() const { return data_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+  private:
+    friend class PageFramePool;
+    void Release();
+
+    PageFramePool *pool_ = nullptr;
+    char *data_ = nullptr;
+    bool pooled_ = false;
+  };
+
+  struct Stats {
+    size_t frames = 0;           // pooled frames
+    size_t in_use = 0;           // pooled frames currently leased
+    uint64_t heap_fallbacks = 0; // leases served by a one-off allocation
+  };
+
+  PageFramePool(size_t frame_size, size_t count);
+  ~PageFramePool();
+
+  PageFramePool(const PageFramePool &) = delete;
+  PageFramePool &operator=(const PageFramePool &) = delete;
+
+  // Lease a buffer of at least `size` bytes. Returns an empty Frame only if
+  // a heap fallback fails.
+  Frame Acquire(size_t size);
+
+  size_t GetFrameSize() const { return frame_size_; }
+  Stats GetStats() const;
+
+private:
+  void Return(char *data);
+
+  size_t frame_size_;
+  char *region_ = nullptr;
+  size_t region_bytes_ = 0;
+
   mutable std::mutex mu_;
-  std::list<std::pair<K, V>> order_;
-  std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator> map_;
+  std::vector<char *> free_;
+  Stats stats_;
 };
 
 // Page data container
 struct PageData {
-  std::vector<char> data;
+  ~PageData(); // counts a prefetched page dropped unread
+
+  PageFramePool::Frame frame;
+  size_t size = 0; // valid bytes in the frame
   bool dirty = false;
+  std::atomic<bool> prefetched{false}; // prefetched and not yet read
 };
 
 // PageStore: Page-level cache sitting on top of UFS.
@@ -107,9 +416,38 @@ public:
   using PageFetcher = std::function<Status(FileId file_id, uint64_t page_index,
                                            void *buf, size_t *bytes_read)>;
 
-  PageStore(size_t page_size, size_t max_pages);
+  struct Options {
+    size_t page_size = kDefaultPageSize;
+    size_t max_pages = 1024;
+    // Pages are spread over `shards` locks (see ConcurrentLRUCache); kClock
+    // lets concurrent hits on one shard proceed under a shared lock
+    size_t shards = 16;
+    PageEvictionMode mode = PageEvictionMode::kLRU;
+    // Background threads fetching PrefetchPages hints (0 = fetch them on
+    // the caller's thread) and the most pages waiting for them; hints
+    // beyond the limit are dropped
+    size_t prefetch_threads = 2;
+    size_t prefetch_queue_limit = 256;
+    // Sequential read-ahead: once a file is read page after page, the next
+    // pages are prefetched in a window that starts at readahead_initial_pages
+    // and doubles each time the reader gets halfway through it, up to
+    // readahead_max_pages (and a quarter of max_pages). A read elsewhere in
+    // the file halves it. Off if the cap is below the initial window or
+    // there are no prefetch threads.
+    size_t readahead_initial_pages = 4;
+    size_t readahead_max_pages = 64;
+  };
+
+  explicit PageStore(const Options &opts);
+  PageStore(size_t page_size, size_t max_pages, size_t shards = 16,
+            PageEvictionMode mode = PageEvictionMode::kLRU);
+  ~PageStore();
+
+  PageStore(const PageStore &) = delete;
+  PageStore &operator=(const PageStore &) = delete;
 
-  // Read data through the page cache
+  // Read data through the page cache. Concurrent misses on one page (and
+  // prefetches of it) share a single fetch, and its error if it fails.
   Status ReadPage(FileId file_id, uint64_t page_index, void *buf,
                   size_t *bytes_read);
 
@@ -117,13 +455,18 @@ public:
   Status WritePage(FileId file_id, uint64_t page_index, const void *buf,
                    size_t size);
 
-  // Pre-fetch adjacent pages (async hint)
+  // Pre-fetch adjacent pages (async hint). Pages already cached, queued or
+  // being fetched are skipped. Prefetched pages are cached at low priority:
+  // evicted before any other page unless they are read first.
   void PrefetchPages(FileId file_id, uint64_t start_page, uint32_t count);
 
+  // Block until every queued prefetch has finished
+  void WaitForPrefetches();
+
   // Evict pages to free memory
   void Evict(size_t pages_to_free);
 
-  // Invalidate all pages for a file
+  // Invalidate all pages for a file, cancelling its queued prefetches
   void InvalidateFile(FileId file_id);
 
   // Set the fetcher for loading pages from UFS
@@ -131,9 +474,16 @@ public:
 
   size_t GetPageSize() const { return page_size_; }
   size_t GetCachedPageCount() const { return cache_.Size(); }
+  PageFramePool::Stats GetFrameStats() const { return frames_.GetStats(); }
+
+  // Frames beyond the cache's capacity: a miss leases its frame before the
+  // insert evicts a victim, and readers may still hold evicted pages
+  static constexpr size_t kSpareFrames = 32;
 
 private:
   size_t page_size_;
+  // Declared before cache_ so cached pages return their frames first
+  PageFramePool frames_;
   ConcurrentLRUCache<PageKey, std::shared_ptr<PageData>> cache_;
   PageFetcher fetcher_;
 
@@ -142,6 +492,76 @@ private:
   std::mutex file_index_mu_;
   std::unordered_map<FileId, std::unordered_set<uint64_t>> file_page_index_;
 
+  // Concurrent misses on one page wait for a single fetch and share its
+  // page or error
+  struct PendingFetch {
+    std::condition_variable cv; // waits under inflight_mu_
+    bool done = false;
+    bool prefetch = false; // the result is cached at low priority
+    Status status;
+    std::shared_ptr<PageData> page;
+  };
+  std::mutex inflight_mu_;
+  std::unordered_map<PageKey, std::shared_ptr<PendingFetch>> inflight_;
+
+  // Invalidation epochs, under inflight_mu_: InvalidateFile stamps the file
+  // with the next tick, and a fetch whose file was stamped after it started
+  // is not cached. Files not in the map are at epoch_floor_, which rises to
+  // the clock when the map is cleared to bound it.
+  static constexpr size_t kMaxFileEpochs = 4096;
+  uint64_t epoch_clock_ = 0;
+  uint64_t epoch_floor_ = 0;
+  std::unordered_map<FileId, uint64_t> file_epochs_;
+
+  // Read-ahead state of a file's most recent sequential run
+  struct Stream {
+    uint64_t next_page = 0;      // page that continues the run
+    uint64_t run = 0;            // sequential reads so far
+    uint64_t readahead_end = 0;  // first page not yet read ahead
+    size_t window = 0;           // read-ahead window in pages; 0 = none
+    uint64_t last_use = 0;
+  };
+  static constexpr size_t kStreamShards = 16;
+  static constexpr size_t kMaxStreamsPerShard = 64;
+  struct alignas(64) StreamShard {
+    std::mutex mu;
+    std::unordered_map<FileId, Stream> streams;
+    uint64_t clock = 0; // for last_use
+  };
+  size_t readahead_initial_;
+  size_t readahead_max_; // 0 = read-ahead off
+  std::array<StreamShard, kStreamShards> streams_;
+
+  // Prefetch executor
+  size_t prefetch_queue_limit_;
+  std::mutex prefetch_mu_;
+  std::condition_variable prefetch_cv_;
+  std::condition_variable prefetch_idle_cv_;
+  std::deque<PageKey> prefetch_queue_;
+  std::unordered_set<PageKey> prefetch_queued_; // keys in the queue
+  size_t prefetch_active_ = 0;
+  bool stop_prefetch_ = false;
+  std::vector<std::thread> prefetchers_;
+
+  // Fetches `key` into the cache, or joins the fetch already in flight.
+  // A prefetch skips resident pages (leaving *page empty) and is cached at
+  // low priority. Nothing is cached if the file was invalidated after
+  // `epoch` was taken.
+  Status LoadPage(const PageKey &key, std::shared_ptr<PageData> *page,
+                  bool prefetch, uint64_t epoch);
+  uint64_t FileEpoch(FileId file_id);
+  uint64_t FileEpochLocked(FileId file_id) const; // inflight_mu_ held
+  void PrefetchLoop();
+  // Feeds a demand read to the file's stream detector; may read ahead
+  void OnDemandRead(FileId file_id, uint64_t page_index);
+  StreamShard &StreamShardFor(FileId file_id) {
+    return streams_[std::hash<FileId>{}(file_id) % kStreamShards];
+  }
+  bool IsFetching(const PageKey &key);
+  void CountPrefetchHit(PageData &page);
+  // A page holding `size` bytes in a pooled frame
+  std::shared_ptr<PageData> NewPage(size_t size);
+  void PublishStats();
   void TrackPage(FileId file_id, uint64_t page_index);
   void UntrackFile(FileId file_id);
 };
@@ -0,0 +1,337 @@
+#include "worker/segment_store.h"
+#include "common/logging.h"
+#include "common/metrics.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace anycache {
+
+namespace {
+
+constexpr uint32_t kRecordMagic = 0x41435347; // "ACSG"
+constexpr uint32_t kRecordLive = 1;
+constexpr uint32_t kRecordDead = 2;
+constexpr uint32_t kRecordPending = 3; // data still being copied in
+
+// On-disk record header (first bytes of the header area)
+struct RecordHeader {
+  uint32_t magic;
+  uint32_t state; // kRecordLive / kRecordDead / kRecordPending
+  uint64_t block_id;
+  uint64_t length;       // block bytes
+  uint64_t record_bytes; // header + padded data
+  uint64_t checksum;     // over block_id / length / record_bytes
+};
+static_assert(sizeof(RecordHeader) <= SegmentStore::kHeaderBytes);
+
+uint64_t HeaderChecksum(const RecordHeader &h) {
+  // FNV-1a over the identity fields; the state flips without rehashing
+  uint64_t hash = 1469598103934665603ULL;
+  for (uint64_t v : {h.block_id, h.length, h.record_bytes}) {
+    for (int i = 0; i < 8; ++i) {
+      hash ^= (v >> (i * 8)) & 0xff;
+      hash *= 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+size_t RoundUp(size_t value, size_t align) {
+  return (value + align - 1) / align * align;
+}
+
+// Aligned scratch buffer for header I/O (O_DIRECT needs 4 KB alignment)
+struct AlignedScratch {
+  explicit AlignedScratch(size_t size) : size(size) {
+    if (::posix_memalign(&data, 4096, size) != 0)
+      data = nullptr;
+    else
+      std::memset(data, 0, size);
+  }
+  ~AlignedScratch() { std::free(data); }
+  void *data = nullptr;
+  size_t size;
+};
+
+} // namespace
+
+SegmentStore::SegmentStore(const Options &opts)
+    : opts_(opts), align_(opts.direct_io ? 4096 : kHeaderBytes) {
+  fs::create_directories(opts_.dir);
+}
+
+SegmentStore::~SegmentStore() = default;
+
+std::string SegmentStore::SegmentPath(uint32_t id) const {
+  return opts_.dir + "/segment_" + std::to_string(id) + ".dat";
+}
+
+size_t SegmentStore::RecordBytes(size_t length) const {
+  return HeaderBytes() + RoundUp(length, align_);
+}
+
+// ─── Recovery ────────────────────────────────────────────────
+Status SegmentStore::Open(std::vector<Record> *live) {
+  std::lock_guard<std::mutex> lock(mu_);
+  std::vector<uint32_t> ids;
+  for (auto &ent : fs::directory_iterator(opts_.dir)) {
+    auto name = ent.path().filename().string();
+    if (name.rfind("segment_", 0) != 0 || ent.path().extension() != ".dat")
+      continue;
+    ids.push_back(static_cast<uint32_t>(std::stoul(name.substr(8))));
+  }
+  std::sort(ids.begin(), ids.end());
+  std::vector<Record> scanned;
+  for (uint32_t id : ids) {
+    RETURN_IF_ERROR(ScanSegment(id, &scanned));
+    next_id_ = std::max(next_id_, id + 1);
+  }
+
+  // A crash between committing a relocated copy and retiring the original
+  // leaves both live; compaction always copies into a newer segment, so
+  // keep the last record seen (scan order is segment id, then offset)
+  std::unordered_map<BlockId, size_t> latest;
+  for (size_t i = 0; i < scanned.size(); ++i)
+    latest[scanned[i].block_id] = i;
+  for (size_t i = 0; i < scanned.size(); ++i) {
+    auto &r = scanned[i];
+    if (latest[r.block_id] == i) {
+      live->push_back(r);
+      continue;
+    }
+    auto &seg = segments_.at(r.loc.segment_id);
+    size_t record_bytes = RecordBytes(r.length);
+    WriteHeader(seg.fd->fd(), r.loc.record_offset, r.block_id, r.length,
+                record_bytes, kRecordDead);
+    seg.info.live_bytes -= record_bytes;
+    seg.info.dead_bytes += record_bytes;
+    seg.info.live_blocks--;
+  }
+  for (uint32_t id : ids) {
+    if (segments_.at(id).info.live_blocks == 0)
+      DropSegmentLocked(id);
+  }
+  LOG_INFO("SegmentStore: opened {} segments, {} live blocks", ids.size(),
+           live->size());
+  return Status::OK();
+}
+
+Status SegmentStore::ScanSegment(uint32_t id, std::vector<Record> *live) {
+  std::string path = SegmentPath(id);
+  int fd =
+      ::open(path.c_str(), O_RDWR | (opts_.direct_io ? O_DIRECT : 0), 0644);
+  if (fd < 0)
+    return Status::IOError("open segment failed: " + path);
+  Segment seg;
+  seg.fd = std::make_shared<CachedFd>(fd, opts_.engine);
+  seg.info.id = id;
+  seg.info.size_bytes = static_cast<size_t>(fs::file_size(path));
+
+  // Walk the record chain; the first slot without a valid header is the
+  // end of the appended region (segments are preallocated with zeros)
+  AlignedScratch buf(HeaderBytes());
+  size_t offset = 0;
+  while (offset + HeaderBytes() <= seg.info.size_bytes) {
+    ssize_t n =
+        ::pread(fd, buf.data, HeaderBytes(), static_cast<off_t>(offset));
+    if (n < static_cast<ssize_t>(sizeof(RecordHeader)))
+      break;
+    RecordHeader h;
+    std::memcpy(&h, buf.data, sizeof(h));
+    if (h.magic != kRecordMagic || h.checksum != HeaderChecksum(h) ||
+        h.record_bytes < HeaderBytes() ||
+        offset + h.record_bytes > seg.info.size_bytes)
+      break;
+
+    if (h.state == kRecordLive) {
+      Record r;
+      r.block_id = h.block_id;
+      r.length = h.length;
+      r.loc.segment_id = id;
+      r.loc.record_offset = static_cast<off_t>(offset);
+      r.loc.data_offset = static_cast<off_t>(offset + HeaderBytes());
+      live->push_back(r);
+      seg.live.insert(h.block_id); // a duplicate keeps one set entry
+      seg.info.live_bytes += h.record_bytes;
+      seg.info.live_blocks++;
+    } else {
+      // Dead, or a relocation that never committed
+      seg.info.dead_bytes += h.record_bytes;
+    }
+    offset += h.record_bytes;
+  }
+  seg.info.write_offset = offset;
+  segments_.emplace(id, std::move(seg));
+  return Status::OK();
+}
+
+// ─── Allocation ──────────────────────────────────────────────
+Status SegmentStore::CreateSegmentLocked(size_t min_bytes) {
+  if (active_id_ != kNoSegment) {
+    auto it = segments_.find(active_id_);
+    if (it != segments_.end()) {
+      it->second.info.active = false;
+      if (it->second.info.live_blocks == 0)
+        DropSegmentLocked(active_id_);
+    }
+    active_id_ = kNoSegment;
+  }
+
+  uint32_t id = next_id_++;
+  std::string path = SegmentPath(id);
+  int fd = ::open(path.c_str(),
+                  O_CREAT | O_RDWR | O_TRUNC | (opts_.direct_io ? O_DIRECT : 0),
+                  0644);
+  if (fd < 0)
+    return Status::IOError("create segment failed: " + path);
+
+  size_t size = std::max(opts_.segment_bytes, min_bytes);
+  // Reserve the extent up front; fall back to a sparse file
+  if (::fallocate(fd, 0, 0, static_cast<off_t>(size)) != 0 &&
+      ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    ::close(fd);
+    ::unlink(path.c_str());
+    return Status::IOError("preallocate segment failed: " + path);
+  }
+
+  Segment seg;
+  seg.fd = std::make_shared<CachedFd>(fd, opts_.engine);
+  seg.info.id = id;
+  seg.info.size_bytes = size;
+  seg.info.active = true;
+  segments_.emplace(id, std::move(seg));
+  active_id_ = id;
+  Metrics::Instance().IncrCounter("storage_tier.segment.created");
+  return Status::OK();
+}
+
+Status SegmentStore::Allocate(BlockId id, size_t length, Location *loc,
+                              uint32_t exclude_segment, bool committed) {
+  size_t record_bytes = RecordBytes(length);
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = segments_.find(active_id_);
+  if (it == segments_.end() || active_id_ == exclude_segment ||
+      it->second.info.write_offset + record_bytes >
+          it->second.info.size_bytes) {
+    RETURN_IF_ERROR(CreateSegmentLocked(record_bytes));
+    it = segments_.find(active_id_);
+  }
+  auto &seg = it->second;
+  off_t offset = static_cast<off_t>(seg.info.write_offset);
+  RETURN_IF_ERROR(WriteHeader(seg.fd->fd(), offset, id, length, record_bytes,
+                              committed ? kRecordLive : kRecordPending));
+
+  seg.info.write_offset += record_bytes;
+  seg.info.live_bytes += record_bytes;
+  seg.info.live_blocks++;
+  seg.live.insert(id);
+
+  loc->segment_id = seg.info.id;
+  loc->record_offset = offset;
+  loc->data_offset = offset + static_cast<off_t>(HeaderBytes());
+  return Status::OK();
+}
+
+Status SegmentStore::Free(BlockId id, size_t length, const Location &loc) {
+  size_t record_bytes = RecordBytes(length);
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = segments_.find(loc.segment_id);
+  if (it == segments_.end() || !it->second.live.erase(id))
+    return Status::NotFound("segment record not found");
+  auto &seg = it->second;
+  auto s = WriteHeader(seg.fd->fd(), loc.record_offset, id, length,
+                       record_bytes, kRecordDead);
+  seg.info.live_bytes -= record_bytes;
+  seg.info.dead_bytes += record_bytes;
+  seg.info.live_blocks--;
+  if (seg.info.live_blocks == 0 && !seg.info.active)
+    DropSegmentLocked(loc.segment_id);
+  return s;
+}
+
+Status SegmentStore::Commit(BlockId id, size_t length, const Location &loc) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = segments_.find(loc.segment_id);
+  if (it == segments_.end() || !it->second.live.count(id))
+    return Status::NotFound("segment record not found");
+  return WriteHeader(it->second.fd->fd(), loc.record_offset, id, length,
+                     RecordBytes(length), kRecordLive);
+}
+
+Status SegmentStore::WriteHeader(int fd, off_t offset, BlockId id,
+                                 size_t length, size_t record_bytes,
+                                 uint32_t state) {
+  RecordHeader h;
+  std::memset(&h, 0, sizeof(h));
+  h.magic = kRecordMagic;
+  h.state = state;
+  h.block_id = id;
+  h.length = length;
+  h.record_bytes = record_bytes;
+  h.checksum = HeaderChecksum(h);
+
+  AlignedScratch buf(HeaderBytes());
+  if (!buf.data)
+    return Status::ResourceExhausted("header buffer allocation failed");
+  std::memcpy(buf.data, &h, sizeof(h));
+  if (::pwrite(fd, buf.data, HeaderBytes(), offset) !=
+      static_cast<ssize_t>(HeaderBytes()))
+    return Status::IOError("write segment record header failed");
+  return Status::OK();
+}
+
+void SegmentStore::DropSegmentLocked(uint32_t id) {
+  auto it = segments_.find(id);
+  if (it == segments_.end())
+    return;
+  ::unlink(SegmentPath(id).c_str());
+  segments_.erase(it); // fd closes once in-flight I/O drops its FdRef
+  Metrics::Instance().IncrCounter("storage_tier.segment.dropped");
+}
+
+// ─── Queries ─────────────────────────────────────────────────
+FdRef SegmentStore::GetFd(uint32_t segment_id) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = segments_.find(segment_id);
+  return it == segments_.end() ? nullptr : it->second.fd;
+}
+
+bool SegmentStore::PickCompactionVictim(double min_dead_ratio,
+                                        uint32_t *segment_id,
+                                        std::vector<BlockId> *live_ids) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  const Segment *victim = nullptr;
+  for (auto &[id, seg] : segments_) {
+    if (seg.info.active || seg.info.DeadRatio() < min_dead_ratio)
+      continue;
+    if (!victim || seg.info.dead_bytes > victim->info.dead_bytes)
+      victim = &seg;
+  }
+  if (!victim)
+    return false;
+  *segment_id = victim->info.id;
+  live_ids->assign(victim->live.begin(), victim->live.end());
+  return true;
+}
+
+std::vector<SegmentStore::SegmentInfo> SegmentStore::GetSegmentInfo() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  std::vector<SegmentInfo> out;
+  out.reserve(segments_.size());
+  for (auto &[id, seg] : segments_)
+    out.push_back(seg.info);
+  return out;
+}
+
+} // namespace anycache
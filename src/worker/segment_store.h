@@ -0,0 +1,132 @@
+#pragma once
+
+#include "common/status.h"
+#include "common/types.h"
+#include "worker/fd_cache.h"
+#include "worker/io_engine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace anycache {
+
+// SegmentStore is the log-structured disk layout: blocks are appended as
+// records into large preallocated segment files instead of one file per
+// block. Each record is a fixed-size header followed by the block data:
+//
+//   | header (kHeaderBytes / 4 KB with O_DIRECT) | data, padded |
+//
+// Headers carry the block id, length and a live/dead state, so the offset
+// index is rebuilt on startup by scanning headers; no separate index file is
+// needed. Space freed by removed blocks stays dead until compaction moves the
+// remaining live records out of a segment, after which the segment file is
+// deleted.
+class SegmentStore {
+public:
+  static constexpr uint32_t kNoSegment = UINT32_MAX;
+
+  struct Options {
+    std::string dir;
+    size_t segment_bytes = 1ULL << 30;
+    bool direct_io = false;    // open segments with O_DIRECT, 4 KB records
+    IoEngine *engine = nullptr; // register segment fds as fixed files
+  };
+
+  // Position of one record
+  struct Location {
+    uint32_t segment_id = kNoSegment;
+    off_t record_offset = 0; // header position
+    off_t data_offset = 0;   // first data byte
+  };
+
+  // A live record found by Open()
+  struct Record {
+    BlockId block_id = kInvalidBlockId;
+    size_t length = 0;
+    Location loc;
+  };
+
+  struct SegmentInfo {
+    uint32_t id = 0;
+    size_t size_bytes = 0;   // preallocated file size
+    size_t write_offset = 0; // end of the appended records
+    size_t live_bytes = 0;   // record bytes of live blocks
+    size_t dead_bytes = 0;   // record bytes of removed blocks
+    size_t live_blocks = 0;
+    bool active = false; // currently receiving appends
+
+    double DeadRatio() const {
+      return write_offset ? static_cast<double>(dead_bytes) / write_offset
+                          : 0.0;
+    }
+  };
+
+  explicit SegmentStore(const Options &opts);
+  ~SegmentStore();
+
+  SegmentStore(const SegmentStore &) = delete;
+  SegmentStore &operator=(const SegmentStore &) = delete;
+
+  // Scan existing segment files and rebuild the index; returns live records.
+  Status Open(std::vector<Record> *live);
+
+  // Append a record for block `id` holding `length` bytes. The header is
+  // written immediately; data bytes read as zero until written. Never places
+  // the record in `exclude_segment`. With `committed` false the record is
+  // written as pending and is ignored by recovery until Commit() (used by
+  // compaction so a half-copied block is never resurrected).
+  Status Allocate(BlockId id, size_t length, Location *loc,
+                  uint32_t exclude_segment = kNoSegment,
+                  bool committed = true);
+  Status Commit(BlockId id, size_t length, const Location &loc);
+
+  // Mark a record dead. A sealed segment left without live records is
+  // deleted (in-flight I/O keeps its FdRef and finishes on the unlinked file).
+  Status Free(BlockId id, size_t length, const Location &loc);
+
+  // Descriptor of a segment, or nullptr if it no longer exists.
+  FdRef GetFd(uint32_t segment_id) const;
+
+  // The sealed segment with the most dead bytes whose dead ratio is at
+  // least `min_dead_ratio`, with its live block ids. False if none.
+  bool PickCompactionVictim(double min_dead_ratio, uint32_t *segment_id,
+                            std::vector<BlockId> *live_ids) const;
+
+  std::vector<SegmentInfo> GetSegmentInfo() const;
+  size_t HeaderBytes() const { return align_ == 4096 ? 4096 : kHeaderBytes; }
+  size_t RecordBytes(size_t length) const;
+  std::string SegmentPath(uint32_t id) const;
+
+  static constexpr size_t kHeaderBytes = 64;
+
+private:
+  struct Segment {
+    SegmentInfo info;
+    FdRef fd;
+    std::unordered_set<BlockId> live;
+  };
+
+  // Create a new active segment able to hold at least `min_bytes`. Caller
+  // holds mu_.
+  Status CreateSegmentLocked(size_t min_bytes);
+  Status WriteHeader(int fd, off_t offset, BlockId id, size_t length,
+                     size_t record_bytes, uint32_t state);
+  // Scan one segment file. Caller holds mu_.
+  Status ScanSegment(uint32_t id, std::vector<Record> *live);
+  void DropSegmentLocked(uint32_t id);
+
+  Options opts_;
+  size_t align_; // record alignment: 4 KB for O_DIRECT, else kHeaderBytes
+
+  mutable std::mutex mu_;
+  std::map<uint32_t, Segment> segments_;
+  uint32_t active_id_ = kNoSegment;
+  uint32_t next_id_ = 0;
+};
+
+} // namespace anycache
@@ -1,6 +1,10 @@
 #include "worker/storage_tier.h"
 #include "common/logging.h"
+#include "common/metrics.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
 #include <filesystem>
@@ -11,92 +15,258 @@ namespace fs = std::filesystem;
 
 namespace anycache {
 
+namespace {
+// Bounce buffers for unaligned O_DIRECT requests; larger requests fall back
+// to a one-off aligned allocation
+constexpr size_t kBounceBufferSize = 1024 * 1024;
+constexpr size_t kBounceBuffers = 32;
+// Tier migration chunk; fits a pooled bounce buffer when alignment requires one
+constexpr size_t kMigrateChunk = kBounceBufferSize;
+// Segment layout: how often the background compactor looks for victims
+constexpr auto kCompactionInterval = std::chrono::seconds(10);
+// File-per-block layout: marker next to a block file still being filled
+constexpr char kPartialSuffix[] = ".partial";
+} // namespace
+
 StorageTier::StorageTier(TierType type, const std::string &path,
                          size_t capacity)
-    : type_(type), path_(path), capacity_(capacity) {
-  if (type_ != TierType::kMemory) {
+    : StorageTier(TierConfig{type, path, capacity}) {}
+
+StorageTier::StorageTier(const TierConfig &config)
+    : type_(config.type), path_(config.path), capacity_(config.capacity_bytes) {
+  if (type_ == TierType::kMemory) {
+    int nodes = config.numa_aware ? MemArena::NumaNodeCount() : 1;
+    for (int node = 0; node < nodes; ++node) {
+      MemArena::Options opts;
+      opts.huge_pages = config.huge_pages;
+      opts.numa_node = nodes > 1 ? node : -1;
+      arenas_.push_back(std::make_unique<MemArena>(capacity_ / nodes, opts));
+    }
+  } else {
     fs::create_directories(path_);
+    io_engine_ = IoEngine::Create(config.io_engine, config.io_queue_depth,
+                                  config.max_open_files);
+    int open_flags = O_RDWR;
+    if (config.direct_io) {
+      direct_io_ = ProbeDirectIo();
+      if (direct_io_) {
+        open_flags |= O_DIRECT;
+      } else {
+        LOG_WARN("StorageTier: O_DIRECT not supported on {}, using buffered "
+                 "I/O",
+                 path_);
+      }
+    }
+    bool segment_layout = config.disk_layout == DiskLayout::kSegment;
+    if (direct_io_ || segment_layout) {
+      bounce_pool_ = std::make_unique<AlignedBufferPool>(kBounceBufferSize,
+                                                         kBounceBuffers);
+      iovec region = bounce_pool_->Region();
+      if (region.iov_len > 0) {
+        auto s = io_engine_->RegisterBuffers({&region, 1});
+        if (!s.ok())
+          LOG_WARN("StorageTier: bounce pool not registered: {}",
+                   s.ToString());
+      }
+    }
+    fd_cache_ = std::make_unique<FdCache>(config.max_open_files, open_flags,
+                                          io_engine_.get());
+
+    if (segment_layout) {
+      SegmentStore::Options so;
+      so.dir = path_;
+      so.segment_bytes = config.segment_bytes;
+      so.direct_io = direct_io_;
+      so.engine = io_engine_.get();
+      segments_ = std::make_unique<SegmentStore>(so);
+      compact_dead_ratio_ = config.compact_dead_ratio;
+      auto s = OpenSegments();
+      if (!s.ok())
+        LOG_ERROR("StorageTier: segment recovery failed: {}", s.ToString());
+      compactor_ = std::thread([this] { CompactionLoop(); });
+    }
   }
   LOG_INFO("StorageTier created: type={}, path={}, capacity={}MB",
            TierTypeName(type_), path_, capacity_ / (1024 * 1024));
 }
 
 StorageTier::~StorageTier() {
-  std::lock_guard<std::mutex> lock(mu_);
-  if (type_ == TierType::kMemory) {
-    for (auto &[id, handle] : blocks_) {
-      if (handle.mem_ptr) {
-        free(handle.mem_ptr);
-        handle.mem_ptr = nullptr;
-      }
+  if (compactor_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(compact_mu_);
+      stop_compaction_ = true;
     }
+    compact_cv_.notify_all();
+    compactor_.join();
+  }
+  // Entries free their own slabs; drop the index before the arena goes
+  for (auto &shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard.mu);
+    shard.blocks.clear();
   }
 }
 
+StorageTier::BlockEntry::~BlockEntry() {
+  if (arena && handle.mem_ptr)
+    arena->Free(handle.mem_ptr, handle.capacity, handle.slab_size);
+}
+
+StorageTier::EntryRef StorageTier::Lookup(BlockId id) const {
+  auto &shard = ShardFor(id);
+  std::shared_lock<std::shared_mutex> lock(shard.mu);
+  auto it = shard.blocks.find(id);
+  return it == shard.blocks.end() ? nullptr : it->second;
+}
+
+bool StorageTier::ReserveBytes(size_t size) {
+  size_t used = used_bytes_.load();
+  do {
+    if (used + size > capacity_)
+      return false;
+  } while (!used_bytes_.compare_exchange_weak(used, used + size));
+  return true;
+}
+
 Status StorageTier::AllocateBlock(BlockId id, size_t size,
-                                  BlockHandle *handle) {
-  std::lock_guard<std::mutex> lock(mu_);
-  if (blocks_.count(id)) {
+                                  BlockHandle *handle, bool partial) {
+  // Hold the shard exclusively so two creators of the same id cannot both
+  // allocate (for disk tiers the second would truncate the first's file)
+  auto &shard = ShardFor(id);
+  std::unique_lock<std::shared_mutex> lock(shard.mu);
+  if (shard.blocks.count(id)) {
     return Status::AlreadyExists("block already allocated in tier");
   }
-  if (used_bytes_ + size > capacity_) {
+  if (!ReserveBytes(size)) {
     return Status::ResourceExhausted("tier capacity exceeded");
   }
 
-  if (type_ == TierType::kMemory) {
-    return AllocateMem(id, size, handle);
-  } else {
-    return AllocateDisk(id, size, handle);
+  EntryRef entry;
+  auto s = type_ == TierType::kMemory ? AllocateMem(id, size, &entry)
+                                      : AllocateDisk(id, size, partial,
+                                                     &entry);
+  if (!s.ok()) {
+    ReleaseBytes(size);
+    return s;
   }
+  *handle = entry->handle;
+  shard.blocks.emplace(id, std::move(entry));
+  return Status::OK();
+}
+
+Status StorageTier::CompleteBlock(BlockId id) {
+  auto entry = Lookup(id);
+  if (!entry)
+    return Status::NotFound("block not in tier");
+  if (!entry->partial.exchange(false))
+    return Status::OK();
+  if (segments_) {
+    // Waits out a relocation, which keeps a partial record pending
+    std::shared_lock<std::shared_mutex> pin(entry->relocate_mu);
+    if (entry->removed)
+      return Status::OK();
+    return segments_->Commit(id, entry->handle.capacity, entry->location);
+  }
+  if (::unlink(PartialMarkerPath(id).c_str()) < 0 && errno != ENOENT)
+    return Status::IOError("unlink partial marker failed");
+  return Status::OK();
 }
 
 Status StorageTier::ReadBlock(BlockId id, void *buf, size_t size,
                               off_t offset) {
-  std::lock_guard<std::mutex> lock(mu_);
-  if (type_ == TierType::kMemory)
-    return ReadMem(id, buf, size, offset);
-  return ReadDisk(id, buf, size, offset);
+  if (type_ != TierType::kMemory) {
+    BlockIo io{id, buf, size, offset, Status::OK()};
+    return SubmitDisk(IoRequest::Op::kRead, {&io, 1});
+  }
+  auto entry = Lookup(id);
+  if (!entry)
+    return Status::NotFound("block not found");
+  return ReadMem(*entry, buf, size, offset);
 }
 
 Status StorageTier::WriteBlock(BlockId id, const void *buf, size_t size,
                                off_t offset) {
-  std::lock_guard<std::mutex> lock(mu_);
-  if (type_ == TierType::kMemory)
-    return WriteMem(id, buf, size, offset);
-  return WriteDisk(id, buf, size, offset);
+  if (type_ != TierType::kMemory) {
+    BlockIo io{id, const_cast<void *>(buf), size, offset, Status::OK()};
+    return SubmitDisk(IoRequest::Op::kWrite, {&io, 1});
+  }
+  auto entry = Lookup(id);
+  if (!entry)
+    return Status::NotFound("block not found");
+  return WriteMem(*entry, buf, size, offset);
 }
 
-Status StorageTier::RemoveBlock(BlockId id) {
-  std::lock_guard<std::mutex> lock(mu_);
-  if (type_ == TierType::kMemory)
-    return RemoveMem(id);
-  return RemoveDisk(id);
+Status StorageTier::ReadBlocks(std::span<BlockIo> ios) {
+  if (type_ != TierType::kMemory)
+    return SubmitDisk(IoRequest::Op::kRead, ios);
+  Status first;
+  for (auto &io : ios) {
+    io.status = ReadBlock(io.block_id, io.buf, io.size, io.offset);
+    if (first.ok() && !io.status.ok())
+      first = io.status;
+  }
+  return first;
 }
 
-bool StorageTier::HasBlock(BlockId id) const {
-  std::lock_guard<std::mutex> lock(mu_);
-  return blocks_.count(id) > 0;
+Status StorageTier::WriteBlocks(std::span<BlockIo> ios) {
+  if (type_ != TierType::kMemory)
+    return SubmitDisk(IoRequest::Op::kWrite, ios);
+  Status first;
+  for (auto &io : ios) {
+    io.status = WriteBlock(io.block_id, io.buf, io.size, io.offset);
+    if (first.ok() && !io.status.ok())
+      first = io.status;
+  }
+  return first;
+}
+
+Status StorageTier::RemoveBlock(BlockId id) {
+  EntryRef entry;
+  {
+    auto &shard = ShardFor(id);
+    std::unique_lock<std::shared_mutex> lock(shard.mu);
+    auto it = shard.blocks.find(id);
+    if (it == shard.blocks.end())
+      return Status::NotFound("block not found");
+    entry = std::move(it->second);
+    shard.blocks.erase(it);
+  }
+  ReleaseBytes(entry->handle.capacity);
+
+  if (type_ == TierType::kMemory) {
+    // The slab returns to the arena once in-flight readers release it
+    entry.reset();
+    PublishArenaMetrics();
+  } else if (segments_) {
+    // Waits out in-flight I/O and compaction of this block
+    std::unique_lock<std::shared_mutex> lock(entry->relocate_mu);
+    entry->removed = true;
+    return segments_->Free(id, entry->handle.capacity, entry->location);
+  } else {
+    // In-flight I/O keeps its FdRef; the unlinked file lives until then
+    fd_cache_->Erase(id);
+    ::unlink(entry->handle.path.c_str());
+    if (entry->partial.load())
+      ::unlink(PartialMarkerPath(id).c_str()); // after the data file
+  }
+  return Status::OK();
 }
 
+bool StorageTier::HasBlock(BlockId id) const { return Lookup(id) != nullptr; }
+
 Status StorageTier::ExportBlock(BlockId id, std::vector<char> *data) {
-  std::lock_guard<std::mutex> lock(mu_);
-  auto it = blocks_.find(id);
-  if (it == blocks_.end())
+  auto entry = Lookup(id);
+  if (!entry)
     return Status::NotFound("block not in tier");
 
-  auto &handle = it->second;
-  data->resize(handle.capacity);
+  auto &handle = entry->handle;
   if (type_ == TierType::kMemory) {
-    std::memcpy(data->data(), handle.mem_ptr, handle.capacity);
+    // Bytes past the written high-water mark are logically zero
+    data->assign(handle.capacity, 0);
+    std::memcpy(data->data(), handle.mem_ptr, entry->initialized_bytes.load());
   } else {
-    int fd = ::open(handle.path.c_str(), O_RDONLY);
-    if (fd < 0)
-      return Status::IOError("open failed");
-    ssize_t n = ::pread(fd, data->data(), handle.capacity, 0);
-    ::close(fd);
-    if (n < 0)
-      return Status::IOError("pread failed");
-    data->resize(static_cast<size_t>(n));
+    data->resize(handle.capacity);
+    BlockIo io{id, data->data(), handle.capacity, 0, Status::OK()};
+    RETURN_IF_ERROR(SubmitDisk(IoRequest::Op::kRead, {&io, 1}));
   }
   return Status::OK();
 }
@@ -107,68 +277,313 @@ Status StorageTier::ImportBlock(BlockId id, const std::vector<char> &data) {
   return WriteBlock(id, data.data(), data.size(), 0);
 }
 
+Status StorageTier::MigrateBlockTo(BlockId id, StorageTier *dst) {
+  auto src = Lookup(id);
+  if (!src)
+    return Status::NotFound("block not in tier");
+
+  BlockHandle handle;
+  RETURN_IF_ERROR(dst->AllocateBlock(id, src->handle.capacity, &handle,
+                                     src->partial.load()));
+  auto target = dst->Lookup(id);
+  auto s = target ? CopyBlock(*src, dst, *target)
+                  : Status::NotFound("migration target removed");
+  if (s.ok() && !src->partial.load())
+    s = dst->CompleteBlock(id); // completed while copying
+  if (!s.ok()) {
+    dst->RemoveBlock(id);
+    return s;
+  }
+  Metrics::Instance().IncrCounter("storage_tier.migrate.bytes",
+                                  src->handle.capacity);
+  return Status::OK();
+}
+
+Status StorageTier::CopyBlock(BlockEntry &src, StorageTier *dst,
+                              BlockEntry &target) {
+  BlockId id = src.handle.block_id;
+  size_t capacity = src.handle.capacity;
+
+  if (type_ == TierType::kMemory) {
+    // Hold off writers for a consistent image; readers are not blocked.
+    // Bytes past the high-water mark are zero in a fresh target too.
+    std::lock_guard<std::mutex> lock(src.write_mu);
+    size_t written = src.initialized_bytes.load(std::memory_order_acquire);
+    if (dst->type_ == TierType::kMemory)
+      return dst->WriteMem(target, src.handle.mem_ptr, written, 0);
+    return dst->SubmitChunked(IoRequest::Op::kWrite, id, src.handle.mem_ptr,
+                              written);
+  }
+
+  if (dst->type_ == TierType::kMemory) {
+    // The target is not routed to yet, so nothing else touches its slab
+    RETURN_IF_ERROR(SubmitChunked(IoRequest::Op::kRead, id,
+                                  target.handle.mem_ptr, capacity));
+    target.initialized_bytes.store(capacity, std::memory_order_release);
+    return Status::OK();
+  }
+
+  bool copied = false;
+  RETURN_IF_ERROR(CopyFileRange(src, dst, target, &copied));
+  if (copied)
+    return Status::OK();
+
+  // No in-kernel copy between these files: bounded user-space copy
+  std::vector<char> chunk(std::min(capacity, kMigrateChunk));
+  for (size_t off = 0; off < capacity; off += chunk.size()) {
+    size_t len = std::min(chunk.size(), capacity - off);
+    RETURN_IF_ERROR(
+        ReadBlock(id, chunk.data(), len, static_cast<off_t>(off)));
+    RETURN_IF_ERROR(
+        dst->WriteBlock(id, chunk.data(), len, static_cast<off_t>(off)));
+  }
+  return Status::OK();
+}
+
+Status StorageTier::SubmitChunked(IoRequest::Op op, BlockId id, void *buf,
+                                  size_t size) {
+  std::vector<BlockIo> ios;
+  ios.reserve((size + kMigrateChunk - 1) / kMigrateChunk);
+  for (size_t off = 0; off < size; off += kMigrateChunk) {
+    ios.push_back(BlockIo{id, static_cast<char *>(buf) + off,
+                          std::min(kMigrateChunk, size - off),
+                          static_cast<off_t>(off), Status::OK()});
+  }
+  return ios.empty() ? Status::OK() : SubmitDisk(op, ios);
+}
+
+Status StorageTier::CopyFileRange(BlockEntry &src, StorageTier *dst,
+                                  BlockEntry &target, bool *copied) {
+  *copied = false;
+  // Pin both records against compaction for the duration of the copy
+  std::shared_lock<std::shared_mutex> src_pin(src.relocate_mu,
+                                              std::defer_lock);
+  std::shared_lock<std::shared_mutex> dst_pin(target.relocate_mu,
+                                              std::defer_lock);
+  if (segments_)
+    src_pin.lock();
+  if (dst->segments_)
+    dst_pin.lock();
+  if (src.removed)
+    return Status::NotFound("block not found");
+
+  FdRef in, out;
+  off_t in_base = 0, out_base = 0;
+  RETURN_IF_ERROR(ResolveExtent(src, &in, &in_base));
+  RETURN_IF_ERROR(dst->ResolveExtent(target, &out, &out_base));
+
+  size_t len = src.handle.capacity;
+  for (size_t done = 0; done < len;) {
+    loff_t in_off = in_base + static_cast<off_t>(done);
+    loff_t out_off = out_base + static_cast<off_t>(done);
+    ssize_t n = ::copy_file_range(in->fd(), &in_off, out->fd(), &out_off,
+                                  len - done, 0);
+    if (n < 0) {
+      // Cross-filesystem, O_DIRECT restrictions or an old kernel: the
+      // caller redoes the whole copy in user space
+      if (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+          errno == EOPNOTSUPP)
+        return Status::OK();
+      return Status::IOError(std::string("copy_file_range failed: ") +
+                             std::strerror(errno));
+    }
+    if (n == 0)
+      break; // source never written this far; the target reads as zeros
+    done += static_cast<size_t>(n);
+  }
+  *copied = true;
+  Metrics::Instance().IncrCounter("storage_tier.migrate.copy_file_range");
+  return Status::OK();
+}
+
 std::vector<BlockId> StorageTier::GetBlockIds() const {
-  std::lock_guard<std::mutex> lock(mu_);
   std::vector<BlockId> ids;
-  ids.reserve(blocks_.size());
-  for (auto &[id, _] : blocks_) {
-    ids.push_back(id);
+  for (auto &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mu);
+    for (auto &[id, _] : shard.blocks) {
+      ids.push_back(id);
+    }
   }
   return ids;
 }
 
+std::vector<BlockId> StorageTier::ListStoredBlocks() const {
+  if (type_ == TierType::kMemory)
+    return {};
+  if (segments_)
+    return GetBlockIds(); // already indexed by OpenSegments
+
+  // A marker without its block file is listed too, so it gets dropped
+  std::vector<BlockId> ids;
+  std::error_code ec;
+  for (auto &de : fs::directory_iterator(path_, ec)) {
+    const std::string name = de.path().filename().string();
+    if (name.rfind("block_", 0) != 0)
+      continue;
+    char *end = nullptr;
+    BlockId id = std::strtoull(name.c_str() + 6, &end, 10);
+    if (end != name.c_str() + 6 &&
+        (*end == '\0' || std::strcmp(end, kPartialSuffix) == 0))
+      ids.push_back(id);
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+Status StorageTier::AdoptBlock(BlockId id, size_t length) {
+  if (type_ == TierType::kMemory)
+    return Status::NotFound("memory tier keeps no blocks across restarts");
+  if (segments_) {
+    auto e = Lookup(id);
+    if (!e || e->handle.capacity != length)
+      return Status::NotFound("no stored block of that length");
+    return Status::OK();
+  }
+
+  std::string fpath = BlockFilePath(id);
+  struct stat st;
+  size_t file_size = direct_io_ ? AlignedBufferPool::AlignUp(length) : length;
+  if (::stat(fpath.c_str(), &st) < 0 ||
+      static_cast<size_t>(st.st_size) != file_size)
+    return Status::NotFound("no stored block of that length");
+  // Preallocated to full size, but never completely written
+  if (::stat(PartialMarkerPath(id).c_str(), &st) == 0)
+    return Status::NotFound("stored block is partial");
+
+  auto &shard = ShardFor(id);
+  std::unique_lock<std::shared_mutex> lock(shard.mu);
+  if (shard.blocks.count(id))
+    return Status::AlreadyExists("block already indexed in tier");
+  if (!ReserveBytes(length))
+    return Status::ResourceExhausted("tier capacity exceeded");
+  auto e = std::make_shared<BlockEntry>();
+  e->handle.block_id = id;
+  e->handle.tier = type_;
+  e->handle.capacity = length;
+  e->handle.path = std::move(fpath);
+  e->generation = next_generation_.fetch_add(1);
+  shard.blocks.emplace(id, std::move(e));
+  return Status::OK();
+}
+
+Status StorageTier::DropStoredBlock(BlockId id) {
+  if (HasBlock(id))
+    return RemoveBlock(id);
+  if (type_ == TierType::kMemory || segments_)
+    return Status::OK();
+  if (::unlink(BlockFilePath(id).c_str()) < 0 && errno != ENOENT)
+    return Status::IOError("unlink block file failed");
+  if (::unlink(PartialMarkerPath(id).c_str()) < 0 && errno != ENOENT)
+    return Status::IOError("unlink partial marker failed");
+  return Status::OK();
+}
+
+MemArena::Stats StorageTier::GetArenaStats() const {
+  MemArena::Stats total;
+  for (auto &arena : arenas_)
+    total += arena->GetStats();
+  return total;
+}
+
 // ─── Memory tier impl ────────────────────────────────────────
-Status StorageTier::AllocateMem(BlockId id, size_t size, BlockHandle *handle) {
-  void *ptr = malloc(size);
+Status StorageTier::AllocateMem(BlockId id, size_t size, EntryRef *entry) {
+  // No memset here: recycled slabs are zeroed lazily on write (see WriteMem)
+  // Local node first, then the other nodes' regions, and only then the
+  // local arena's heap fallback
+  size_t local = arenas_.size() > 1
+                     ? static_cast<size_t>(MemArena::CurrentNumaNode()) %
+                           arenas_.size()
+                     : 0;
+  size_t slab_size = 0;
+  void *ptr = nullptr;
+  MemArena *arena = nullptr;
+  for (size_t i = 0; i < arenas_.size() && !ptr; ++i) {
+    arena = arenas_[(local + i) % arenas_.size()].get();
+    ptr = arena->Allocate(size, &slab_size, /*allow_heap=*/false);
+  }
+  if (!ptr) {
+    arena = arenas_[local].get();
+    ptr = arena->Allocate(size, &slab_size);
+  }
   if (!ptr)
-    return Status::ResourceExhausted("malloc failed");
-  std::memset(ptr, 0, size);
+    return Status::ResourceExhausted("memory arena allocation failed");
 
-  BlockHandle bh;
-  bh.block_id = id;
-  bh.tier = TierType::kMemory;
-  bh.mem_ptr = ptr;
-  bh.capacity = size;
+  auto e = std::make_shared<BlockEntry>();
+  e->handle.block_id = id;
+  e->handle.tier = TierType::kMemory;
+  e->handle.mem_ptr = ptr;
+  e->handle.capacity = size;
+  e->handle.slab_size = slab_size;
+  e->generation = next_generation_.fetch_add(1);
+  e->arena = arena;
 
-  blocks_[id] = bh;
-  used_bytes_ += size;
-  *handle = bh;
+  *entry = std::move(e);
+  PublishArenaMetrics();
   return Status::OK();
 }
 
-Status StorageTier::ReadMem(BlockId id, void *buf, size_t size, off_t offset) {
-  auto it = blocks_.find(id);
-  if (it == blocks_.end())
-    return Status::NotFound("block not found");
-  auto &h = it->second;
+Status StorageTier::ReadMem(BlockEntry &e, void *buf, size_t size,
+                            off_t offset) {
+  auto &h = e.handle;
+  if (static_cast<size_t>(offset) >= h.capacity)
+    return Status::OK(); // past the end: reads nothing
   if (static_cast<size_t>(offset) + size > h.capacity) {
     size = h.capacity - offset;
   }
-  std::memcpy(buf, static_cast<char *>(h.mem_ptr) + offset, size);
+  // Serve the unwritten tail as zeros without touching the slab
+  size_t start = static_cast<size_t>(offset);
+  size_t initialized = e.initialized_bytes.load(std::memory_order_acquire);
+  size_t valid =
+      start < initialized ? std::min(size, initialized - start) : 0;
+  std::memcpy(buf, static_cast<char *>(h.mem_ptr) + start, valid);
+  std::memset(static_cast<char *>(buf) + valid, 0, size - valid);
   return Status::OK();
 }
 
-Status StorageTier::WriteMem(BlockId id, const void *buf, size_t size,
+Status StorageTier::WriteMem(BlockEntry &e, const void *buf, size_t size,
                              off_t offset) {
-  auto it = blocks_.find(id);
-  if (it == blocks_.end())
-    return Status::NotFound("block not found");
-  auto &h = it->second;
+  auto &h = e.handle;
   if (static_cast<size_t>(offset) + size > h.capacity) {
     return Status::InvalidArgument("write exceeds block capacity");
   }
-  std::memcpy(static_cast<char *>(h.mem_ptr) + offset, buf, size);
+  size_t start = static_cast<size_t>(offset);
+  auto *base = static_cast<char *>(h.mem_ptr);
+
+  // Writers to one block serialize on the high-water mark; readers don't
+  std::lock_guard<std::mutex> lock(e.write_mu);
+  size_t initialized = e.initialized_bytes.load(std::memory_order_relaxed);
+  // Lazy zeroing: only a gap skipped over by this write needs clearing
+  if (start > initialized) {
+    std::memset(base + initialized, 0, start - initialized);
+  }
+  std::memcpy(base + start, buf, size);
+  if (start + size > initialized) {
+    e.initialized_bytes.store(start + size, std::memory_order_release);
+  }
   return Status::OK();
 }
 
-Status StorageTier::RemoveMem(BlockId id) {
-  auto it = blocks_.find(id);
-  if (it == blocks_.end())
-    return Status::NotFound("block not found");
-  used_bytes_ -= it->second.capacity;
-  free(it->second.mem_ptr);
-  blocks_.erase(it);
-  return Status::OK();
+void StorageTier::PublishArenaMetrics() const {
+  auto stats = GetArenaStats();
+  auto &m = Metrics::Instance();
+  m.SetGauge("storage_tier.mem_arena.allocated_bytes",
+             static_cast<double>(stats.allocated_bytes));
+  m.SetGauge("storage_tier.mem_arena.free_slab_bytes",
+             static_cast<double>(stats.free_slab_bytes));
+  m.SetGauge("storage_tier.mem_arena.heap_fallback_bytes",
+             static_cast<double>(stats.heap_fallback_bytes));
+  m.SetGauge("storage_tier.mem_arena.internal_fragmentation",
+             stats.InternalFragmentation());
+  m.SetGauge("storage_tier.mem_arena.external_fragmentation",
+             stats.ExternalFragmentation());
+  if (arenas_.size() > 1) {
+    for (auto &arena : arenas_) {
+      m.SetGauge("storage_tier.mem_arena.node" +
+                     std::to_string(arena->GetNumaNode()) + ".allocated_bytes",
+                 static_cast<double>(arena->GetStats().allocated_bytes));
+    }
+  }
 }
 
 // ─── Disk tier impl ──────────────────────────────────────────
@@ -176,71 +591,438 @@ std::string StorageTier::BlockFilePath(BlockId id) const {
   return path_ + "/block_" + std::to_string(id);
 }
 
-Status StorageTier::AllocateDisk(BlockId id, size_t size, BlockHandle *handle) {
+std::string StorageTier::PartialMarkerPath(BlockId id) const {
+  return BlockFilePath(id) + kPartialSuffix;
+}
+
+Status StorageTier::AllocateDisk(BlockId id, size_t size, bool partial,
+                                 EntryRef *entry) {
+  auto e = std::make_shared<BlockEntry>();
+  e->handle.block_id = id;
+  e->handle.tier = type_;
+  e->handle.capacity = size;
+  e->generation = next_generation_.fetch_add(1);
+  e->partial = partial;
+
+  if (segments_) {
+    // A pending record is skipped by recovery until CompleteBlock commits it
+    RETURN_IF_ERROR(segments_->Allocate(id, size, &e->location,
+                                        SegmentStore::kNoSegment,
+                                        /*committed=*/!partial));
+    *entry = std::move(e);
+    return Status::OK();
+  }
+
+  // Marked before the block file reaches its full size, so a crash never
+  // leaves a full-size partial block unmarked
   std::string fpath = BlockFilePath(id);
-  int fd = ::open(fpath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (partial) {
+    int marker = ::open(PartialMarkerPath(id).c_str(),
+                        O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (marker < 0)
+      return Status::IOError("create partial marker failed");
+    ::close(marker);
+  }
+  auto fail = [&](const char *what) {
+    if (partial)
+      ::unlink(PartialMarkerPath(id).c_str());
+    return Status::IOError(what);
+  };
+  int flags = O_CREAT | O_RDWR | O_TRUNC | (direct_io_ ? O_DIRECT : 0);
+  int fd = ::open(fpath.c_str(), flags, 0644);
   if (fd < 0)
-    return Status::IOError("create block file failed");
+    return fail("create block file failed");
 
-  // Pre-allocate space
-  if (::ftruncate(fd, static_cast<off_t>(size)) < 0) {
+  // Pre-allocate space. With O_DIRECT the file is padded to the alignment
+  // so sector-aligned I/O on a partial tail never extends it.
+  size_t file_size = direct_io_ ? AlignedBufferPool::AlignUp(size) : size;
+  if (::ftruncate(fd, static_cast<off_t>(file_size)) < 0) {
     ::close(fd);
     ::unlink(fpath.c_str());
-    return Status::IOError("ftruncate failed");
+    return fail("ftruncate failed");
   }
-  ::close(fd);
+  e->handle.path = fpath;
+
+  // Keep the fresh descriptor: the block is about to be written
+  fd_cache_->Insert(id, fd, e->generation);
+  *entry = std::move(e);
+  return Status::OK();
+}
 
-  BlockHandle bh;
-  bh.block_id = id;
-  bh.tier = type_;
-  bh.path = fpath;
-  bh.capacity = size;
+Status StorageTier::ResolveExtent(BlockEntry &e, FdRef *fd, off_t *base) {
+  if (segments_) {
+    *fd = segments_->GetFd(e.location.segment_id);
+    if (!*fd)
+      return Status::IOError("segment file missing");
+    *base = e.location.data_offset;
+    return Status::OK();
+  }
+  *base = 0;
+  return fd_cache_->Acquire(e.handle.block_id, e.handle.path, fd,
+                            e.generation);
+}
 
-  blocks_[id] = bh;
-  used_bytes_ += size;
-  *handle = bh;
+bool StorageTier::ProbeDirectIo() const {
+  std::string probe = path_ + "/.direct_io_probe";
+  int fd = ::open(probe.c_str(), O_CREAT | O_RDWR | O_DIRECT, 0644);
+  if (fd >= 0)
+    ::close(fd);
+  ::unlink(probe.c_str());
+  return fd >= 0;
+}
+
+Status StorageTier::SubmitDisk(IoRequest::Op op, std::span<BlockIo> ios) {
+  using Pool = AlignedBufferPool;
+  bool is_read = op == IoRequest::Op::kRead;
+  std::vector<EntryRef> entries(ios.size());
+  std::vector<FdRef> fds(ios.size());
+  std::vector<off_t> bases(ios.size(), 0); // block start within the file
+  std::vector<Pool::Buffer> bounce(ios.size()); // unaligned direct reads
+  std::vector<IoRequest> reqs;
+  std::vector<size_t> req_index; // reqs[k] serves ios[req_index[k]]
+  std::vector<size_t> unaligned_writes;
+  reqs.reserve(ios.size());
+  req_index.reserve(ios.size());
+  for (size_t i = 0; i < ios.size(); ++i) {
+    entries[i] = Lookup(ios[i].block_id);
+    if (!entries[i])
+      ios[i].status = Status::NotFound("block not found");
+  }
+
+  // Segment layout: pin each record against compaction and removal until
+  // the batch completes. Locks are taken once per entry in address order so
+  // two overlapping batches cannot deadlock behind a waiting writer.
+  std::vector<std::shared_lock<std::shared_mutex>> pins;
+  if (segments_) {
+    std::vector<BlockEntry *> order;
+    order.reserve(ios.size());
+    for (auto &e : entries) {
+      if (e)
+        order.push_back(e.get());
+    }
+    std::sort(order.begin(), order.end());
+    order.erase(std::unique(order.begin(), order.end()), order.end());
+    pins.reserve(order.size());
+    for (auto *e : order)
+      pins.emplace_back(e->relocate_mu);
+  }
+
+  // Direct I/O pads files and segment records share a file: either way the
+  // block must not be read or written past its capacity
+  bool bounded = direct_io_ || segments_;
+  for (size_t i = 0; i < ios.size(); ++i) {
+    auto &io = ios[i];
+    if (!entries[i])
+      continue;
+    auto &handle = entries[i]->handle;
+    if (segments_ && entries[i]->removed) {
+      io.status = Status::NotFound("block not found");
+      continue;
+    }
+    io.status = ResolveExtent(*entries[i], &fds[i], &bases[i]);
+    if (!io.status.ok())
+      continue;
+
+    IoRequest req;
+    req.op = op;
+    req.fd = fds[i]->fd();
+    req.fixed_file = fds[i]->fixed_slot();
+    req.buf = io.buf;
+    req.size = io.size;
+    req.offset = bases[i] + io.offset;
+
+    size_t off = static_cast<size_t>(io.offset);
+    if (bounded) {
+      if (is_read) {
+        if (off >= handle.capacity)
+          continue; // past the end: reads nothing
+        // Don't expose the padding or the next record
+        req.size = std::min(io.size, handle.capacity - off);
+      } else if (off + io.size > handle.capacity) {
+        io.status = Status::InvalidArgument("write exceeds block capacity");
+        continue;
+      }
+    }
+    if (direct_io_) {
+      bool aligned = Pool::IsAligned(reinterpret_cast<uintptr_t>(io.buf)) &&
+                     Pool::IsAligned(off) && Pool::IsAligned(req.size);
+      if (!aligned) {
+        if (!is_read) {
+          unaligned_writes.push_back(i);
+          continue;
+        }
+        size_t start = Pool::AlignDown(off);
+        size_t end = Pool::AlignUp(off + req.size);
+        bounce[i] = bounce_pool_->Acquire(end - start);
+        if (!bounce[i]) {
+          io.status = Status::ResourceExhausted("no bounce buffer");
+          continue;
+        }
+        req.buf = bounce[i].data();
+        req.size = end - start;
+        req.offset = bases[i] + static_cast<off_t>(start);
+        Metrics::Instance().IncrCounter("storage_tier.direct_io.bounced");
+      }
+    }
+    reqs.push_back(req);
+    req_index.push_back(i);
+  }
+
+  if (!reqs.empty())
+    RETURN_IF_ERROR(io_engine_->Submit(reqs));
+
+  for (size_t k = 0; k < reqs.size(); ++k) {
+    auto &io = ios[req_index[k]];
+    if (reqs[k].result < 0) {
+      io.status = Status::IOError(
+          std::string(is_read ? "pread" : "pwrite") +
+          " failed: " + std::strerror(static_cast<int>(-reqs[k].result)));
+    } else if (!is_read &&
+               static_cast<size_t>(reqs[k].result) != reqs[k].size) {
+      // Engines retry short transfers; one that still falls short (e.g. out
+      // of space) must not pass for a complete write
+      io.status = Status::IOError(
+          "short pwrite: " + std::to_string(reqs[k].result) + " of " +
+          std::to_string(reqs[k].size) + " bytes");
+    } else if (auto &b = bounce[req_index[k]]) {
+      // Copy the requested window out of the aligned span
+      size_t skip = static_cast<size_t>(bases[req_index[k]] + io.offset -
+                                        reqs[k].offset);
+      size_t got = static_cast<size_t>(reqs[k].result);
+      size_t capacity = entries[req_index[k]]->handle.capacity;
+      size_t want =
+          std::min(io.size, capacity - static_cast<size_t>(io.offset));
+      if (got > skip)
+        std::memcpy(io.buf, b.data() + skip, std::min(want, got - skip));
+    }
+  }
+
+  for (size_t i : unaligned_writes) {
+    ios[i].status =
+        WriteDirectUnaligned(*entries[i], fds[i], bases[i], ios[i]);
+  }
+
+  for (auto &io : ios) {
+    if (!io.status.ok())
+      return io.status;
+  }
   return Status::OK();
 }
 
-Status StorageTier::ReadDisk(BlockId id, void *buf, size_t size, off_t offset) {
-  auto it = blocks_.find(id);
-  if (it == blocks_.end())
-    return Status::NotFound("block not found");
+Status StorageTier::WriteDirectUnaligned(BlockEntry &e, const FdRef &fd,
+                                         off_t base, const BlockIo &io) {
+  using Pool = AlignedBufferPool;
+  if (io.size == 0)
+    return Status::OK();
+  size_t off = static_cast<size_t>(io.offset);
+  size_t start = Pool::AlignDown(off);
+  size_t end = Pool::AlignUp(off + io.size);
+  auto buf = bounce_pool_->Acquire(end - start);
+  if (!buf)
+    return Status::ResourceExhausted("no bounce buffer");
+  Metrics::Instance().IncrCounter("storage_tier.direct_io.rmw_writes");
 
-  int fd = ::open(it->second.path.c_str(), O_RDONLY);
-  if (fd < 0)
-    return Status::IOError("open block file failed");
-  ssize_t n = ::pread(fd, buf, size, offset);
-  ::close(fd);
-  if (n < 0)
-    return Status::IOError("pread failed");
+  auto make_req = [&](IoRequest::Op op, size_t from, size_t len) {
+    IoRequest req;
+    req.op = op;
+    req.fd = fd->fd();
+    req.fixed_file = fd->fixed_slot();
+    req.buf = buf.data() + (from - start);
+    req.size = len;
+    req.offset = base + static_cast<off_t>(from);
+    return req;
+  };
+
+  // Two unaligned writers sharing an edge sector would lose each other's
+  // bytes; serialize read-modify-write per block
+  std::lock_guard<std::mutex> lock(e.write_mu);
+
+  // Only the partially covered edge sectors need their old contents
+  std::vector<IoRequest> edges;
+  if (!Pool::IsAligned(off))
+    edges.push_back(make_req(IoRequest::Op::kRead, start, Pool::kAlignment));
+  size_t last = end - Pool::kAlignment;
+  if (!Pool::IsAligned(off + io.size) && (edges.empty() || last != start))
+    edges.push_back(make_req(IoRequest::Op::kRead, last, Pool::kAlignment));
+  if (!edges.empty()) {
+    RETURN_IF_ERROR(io_engine_->Submit(edges));
+    for (auto &r : edges) {
+      if (r.result < 0)
+        return Status::IOError(std::string("pread failed: ") +
+                               std::strerror(static_cast<int>(-r.result)));
+    }
+  }
+
+  std::memcpy(buf.data() + (off - start), io.buf, io.size);
+  IoRequest write = make_req(IoRequest::Op::kWrite, start, end - start);
+  RETURN_IF_ERROR(io_engine_->Submit({&write, 1}));
+  if (write.result < 0)
+    return Status::IOError(std::string("pwrite failed: ") +
+                           std::strerror(static_cast<int>(-write.result)));
   return Status::OK();
 }
 
-Status StorageTier::WriteDisk(BlockId id, const void *buf, size_t size,
-                              off_t offset) {
-  auto it = blocks_.find(id);
-  if (it == blocks_.end())
-    return Status::NotFound("block not found");
+// ─── Segment layout ──────────────────────────────────────────
+Status StorageTier::OpenSegments() {
+  std::vector<SegmentStore::Record> live;
+  RETURN_IF_ERROR(segments_->Open(&live));
+  for (auto &r : live) {
+    auto e = std::make_shared<BlockEntry>();
+    e->handle.block_id = r.block_id;
+    e->handle.tier = type_;
+    e->handle.capacity = r.length;
+    e->generation = next_generation_.fetch_add(1);
+    e->location = r.loc;
+    used_bytes_.fetch_add(r.length);
+    auto &shard = ShardFor(r.block_id);
+    std::unique_lock<std::shared_mutex> lock(shard.mu);
+    shard.blocks[r.block_id] = std::move(e);
+  }
+  if (!live.empty())
+    LOG_INFO("StorageTier: recovered {} blocks from segments in {}",
+             live.size(), path_);
+  PublishSegmentMetrics();
+  return Status::OK();
+}
 
-  int fd = ::open(it->second.path.c_str(), O_WRONLY);
-  if (fd < 0)
-    return Status::IOError("open block file failed");
-  ssize_t n = ::pwrite(fd, buf, size, offset);
-  ::close(fd);
-  if (n < 0)
-    return Status::IOError("pwrite failed");
+Status StorageTier::CompactSegments(size_t *relocated) {
+  if (relocated)
+    *relocated = 0;
+  if (!segments_)
+    return Status::OK();
+
+  uint32_t victim;
+  std::vector<BlockId> live_ids;
+  if (!segments_->PickCompactionVictim(compact_dead_ratio_, &victim,
+                                       &live_ids))
+    return Status::OK();
+
+  size_t moved = 0;
+  for (BlockId id : live_ids) {
+    auto s = RelocateBlock(id, victim);
+    if (!s.ok()) {
+      LOG_WARN("StorageTier: compaction of segment {} stopped: {}", victim,
+               s.ToString());
+      PublishSegmentMetrics();
+      return s;
+    }
+    moved++;
+  }
+  if (relocated)
+    *relocated = moved;
+  LOG_DEBUG("StorageTier: compacted segment {}, {} blocks relocated", victim,
+            moved);
+  PublishSegmentMetrics();
   return Status::OK();
 }
 
-Status StorageTier::RemoveDisk(BlockId id) {
-  auto it = blocks_.find(id);
-  if (it == blocks_.end())
-    return Status::NotFound("block not found");
-  used_bytes_ -= it->second.capacity;
-  ::unlink(it->second.path.c_str());
-  blocks_.erase(it);
+Status StorageTier::RelocateBlock(BlockId id, uint32_t from_segment) {
+  auto entry = Lookup(id);
+  if (!entry)
+    return Status::OK(); // removed since the victim was picked
+
+  // Excludes I/O and removal of this block for the duration of the copy
+  std::unique_lock<std::shared_mutex> lock(entry->relocate_mu);
+  if (entry->removed || entry->location.segment_id != from_segment)
+    return Status::OK();
+
+  size_t length = entry->handle.capacity;
+  SegmentStore::Location dst;
+  RETURN_IF_ERROR(segments_->Allocate(id, length, &dst, from_segment,
+                                      /*committed=*/false));
+  FdRef src_fd = segments_->GetFd(from_segment);
+  FdRef dst_fd = segments_->GetFd(dst.segment_id);
+
+  auto copy = [&]() -> Status {
+    if (!src_fd || !dst_fd)
+      return Status::IOError("segment file missing");
+    auto buf = bounce_pool_->Acquire(bounce_pool_->GetBufferSize());
+    if (!buf)
+      return Status::ResourceExhausted("no bounce buffer");
+    for (size_t done = 0; done < length;) {
+      // Records are padded to the alignment, so an O_DIRECT tail stays
+      // inside both records
+      size_t chunk = std::min(buf.size(), length - done);
+      size_t io_size = direct_io_ ? AlignedBufferPool::AlignUp(chunk) : chunk;
+      IoRequest req;
+      req.op = IoRequest::Op::kRead;
+      req.fd = src_fd->fd();
+      req.fixed_file = src_fd->fixed_slot();
+      req.buf = buf.data();
+      req.size = io_size;
+      req.offset = entry->location.data_offset + static_cast<off_t>(done);
+      RETURN_IF_ERROR(io_engine_->Submit({&req, 1}));
+      if (req.result < 0)
+        return Status::IOError(std::string("pread failed: ") +
+                               std::strerror(static_cast<int>(-req.result)));
+      // A short read means the source was never written that far: zeros
+      if (static_cast<size_t>(req.result) < io_size)
+        std::memset(buf.data() + req.result, 0, io_size - req.result);
+
+      req.op = IoRequest::Op::kWrite;
+      req.fd = dst_fd->fd();
+      req.fixed_file = dst_fd->fixed_slot();
+      req.offset = dst.data_offset + static_cast<off_t>(done);
+      RETURN_IF_ERROR(io_engine_->Submit({&req, 1}));
+      if (req.result < 0)
+        return Status::IOError(std::string("pwrite failed: ") +
+                               std::strerror(static_cast<int>(-req.result)));
+      done += chunk;
+    }
+    return Status::OK();
+  };
+
+  auto s = copy();
+  if (s.ok() && !entry->partial.load())
+    s = segments_->Commit(id, length, dst); // else CompleteBlock commits it
+  if (!s.ok()) {
+    segments_->Free(id, length, dst);
+    return s;
+  }
+  SegmentStore::Location old = entry->location;
+  entry->location = dst;
+  RETURN_IF_ERROR(segments_->Free(id, length, old));
+
+  auto &m = Metrics::Instance();
+  m.IncrCounter("storage_tier.segment.compacted_blocks");
+  m.IncrCounter("storage_tier.segment.compacted_bytes", length);
   return Status::OK();
 }
 
+void StorageTier::CompactionLoop() {
+  std::unique_lock<std::mutex> lock(compact_mu_);
+  while (!stop_compaction_) {
+    compact_cv_.wait_for(lock, kCompactionInterval,
+                         [this] { return stop_compaction_; });
+    if (stop_compaction_)
+      break;
+    lock.unlock();
+    // Drain every segment over the threshold, one victim per pass
+    size_t relocated = 0;
+    do {
+      if (!CompactSegments(&relocated).ok())
+        break;
+    } while (relocated > 0 && !stop_compaction_);
+    lock.lock();
+  }
+}
+
+std::vector<SegmentStore::SegmentInfo> StorageTier::GetSegmentInfo() const {
+  return segments_ ? segments_->GetSegmentInfo()
+                   : std::vector<SegmentStore::SegmentInfo>{};
+}
+
+void StorageTier::PublishSegmentMetrics() const {
+  size_t live = 0, dead = 0;
+  auto infos = GetSegmentInfo();
+  for (auto &info : infos) {
+    live += info.live_bytes;
+    dead += info.dead_bytes;
+  }
+  auto &m = Metrics::Instance();
+  m.SetGauge("storage_tier.segment.count", static_cast<double>(infos.size()));
+  m.SetGauge("storage_tier.segment.live_bytes", static_cast<double>(live));
+  m.SetGauge("storage_tier.segment.dead_bytes", static_cast<double>(dead));
+}
+
 } // namespace anycache
@@ -1,11 +1,24 @@
 #pragma once
 
+#include "common/config.h"
 #include "common/status.h"
 #include "common/types.h"
+#include "worker/aligned_buffer_pool.h"
+#include "worker/fd_cache.h"
+#include "worker/io_engine.h"
+#include "worker/mem_arena.h"
+#include "worker/segment_store.h"
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <span>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -15,19 +28,44 @@ namespace anycache {
 struct BlockHandle {
   BlockId block_id = kInvalidBlockId;
   TierType tier = TierType::kMemory;
-  std::string path;        // file path on disk (SSD/HDD) or empty for memory
+  std::string path; // block file (SSD/HDD file-per-block layout), else empty
   void *mem_ptr = nullptr; // memory pointer for memory tier
   size_t capacity = 0;
+  size_t slab_size = 0; // memory tier: size of the arena slab behind mem_ptr
+};
+
+// One element of a batched block read/write
+struct BlockIo {
+  BlockId block_id = kInvalidBlockId;
+  void *buf = nullptr; // read destination; write source
+  size_t size = 0;
+  off_t offset = 0;
+  Status status; // per-element outcome
 };
 
 // A single storage tier (Memory / SSD / HDD)
+//
+// Concurrency: the block index is split into shards, each behind a
+// shared_mutex that is held only for lookups and inserts/erases. Blocks are
+// reference counted (shared_ptr<BlockEntry>), so reads and writes run with no
+// tier lock held and a concurrent RemoveBlock only unlinks the entry; the
+// memory slab is returned to the arena when the last in-flight I/O drops its
+// reference. As with pread/pwrite, overlapping concurrent reads and writes of
+// the same byte range are not atomic with respect to each other.
 class StorageTier {
 public:
   StorageTier(TierType type, const std::string &path, size_t capacity);
+  explicit StorageTier(const TierConfig &config);
   ~StorageTier();
 
-  // Allocate space for a block
-  Status AllocateBlock(BlockId id, size_t size, BlockHandle *handle);
+  // Allocate space for a block. A `partial` block is filled in piecemeal
+  // (see BlockStore::CreatePartialBlock); disk tiers mark it on disk until
+  // CompleteBlock() so a restart never adopts it with holes in it.
+  Status AllocateBlock(BlockId id, size_t size, BlockHandle *handle,
+                       bool partial = false);
+
+  // Clear a partial block's mark once every byte of it has been written
+  Status CompleteBlock(BlockId id);
 
   // Read data from a block
   Status ReadBlock(BlockId id, void *buf, size_t size, off_t offset);
@@ -35,6 +73,12 @@ public:
   // Write data to a block
   Status WriteBlock(BlockId id, const void *buf, size_t size, off_t offset);
 
+  // Batched variants: disk tiers submit the whole batch to the I/O engine at
+  // once. Each element's outcome is stored in BlockIo::status; the return
+  // value is the first failure, or OK.
+  Status ReadBlocks(std::span<BlockIo> ios);
+  Status WriteBlocks(std::span<BlockIo> ios);
+
   // Remove a block, freeing its space
   Status RemoveBlock(BlockId id);
 
@@ -47,38 +91,173 @@ public:
   // Import block data into this tier
   Status ImportBlock(BlockId id, const std::vector<char> &data);
 
+  // Copy a block into `dst` without staging the whole block: memory sources
+  // are written straight from the slab, disk-to-memory reads land directly in
+  // the destination slab, and disk-to-disk uses copy_file_range (which
+  // reflinks where the filesystem supports it). The source block is left in
+  // place and keeps serving reads; the caller switches over and removes it.
+  Status MigrateBlockTo(BlockId id, StorageTier *dst);
+
   // Getters
   TierType GetType() const { return type_; }
-  size_t GetUsedBytes() const { return used_bytes_; }
+  size_t GetUsedBytes() const { return used_bytes_.load(); }
   size_t GetCapacity() const { return capacity_; }
-  size_t GetAvailableBytes() const { return capacity_ - used_bytes_; }
+  size_t GetAvailableBytes() const { return capacity_ - used_bytes_.load(); }
   const std::string &GetPath() const { return path_; }
 
+  // True if block files are accessed with O_DIRECT (requested via
+  // TierConfig::direct_io and supported by the filesystem)
+  bool IsDirectIo() const { return direct_io_; }
+
+  // I/O engine name for disk tiers ("sync" / "io_uring"); "" for memory
+  const char *GetIoEngineName() const {
+    return io_engine_ ? io_engine_->Name() : "";
+  }
+
+  // Memory tier slab allocator statistics, summed over NUMA nodes (all zero
+  // for disk tiers)
+  MemArena::Stats GetArenaStats() const;
+  size_t GetArenaCount() const { return arenas_.size(); }
+  MemArena::PageMode GetPageMode() const {
+    return arenas_.empty() ? MemArena::PageMode::kDefault
+                           : arenas_[0]->GetPageMode();
+  }
+
   // Get all block IDs in this tier
   std::vector<BlockId> GetBlockIds() const;
 
+  // Restart support. Disk tiers keep block data across restarts, but the
+  // file-per-block layout does not rebuild its index on open (the segment
+  // layout does). ListStoredBlocks reports the ids of the blocks on disk
+  // without indexing them; AdoptBlock indexes one such block of
+  // `length` bytes (NotFound if it is missing, still marked partial or its
+  // size does not match), and DropStoredBlock deletes one whether it is
+  // indexed or not. Memory tiers store nothing across restarts.
+  std::vector<BlockId> ListStoredBlocks() const;
+  Status AdoptBlock(BlockId id, size_t length);
+  Status DropStoredBlock(BlockId id);
+
+  // Segment layout: compact the sealed segment with the most dead space if
+  // its dead ratio is at least the configured threshold, relocating its live
+  // blocks. Runs periodically in the background; exposed for tests.
+  Status CompactSegments(size_t *relocated = nullptr);
+  DiskLayout GetDiskLayout() const {
+    return segments_ ? DiskLayout::kSegment : DiskLayout::kFilePerBlock;
+  }
+  std::vector<SegmentStore::SegmentInfo> GetSegmentInfo() const;
+
 private:
-  // Memory tier: allocates from heap
-  Status AllocateMem(BlockId id, size_t size, BlockHandle *handle);
-  Status ReadMem(BlockId id, void *buf, size_t size, off_t offset);
-  Status WriteMem(BlockId id, const void *buf, size_t size, off_t offset);
-  Status RemoveMem(BlockId id);
+  // Per-block state shared by the index and in-flight I/O
+  struct BlockEntry {
+    BlockHandle handle;      // immutable after allocation
+    uint64_t generation = 0; // distinguishes re-created blocks (fd cache)
+    MemArena *arena = nullptr; // memory tier: slab owner, freed in dtor
+
+    // Memory tier: high-water mark of written bytes. Bytes past the mark read
+    // as zero; the slab is only zeroed when a write leaves a gap (lazy
+    // zeroing). Writers update it under write_mu; readers load it lock-free.
+    std::atomic<size_t> initialized_bytes{0};
+    std::mutex write_mu;
+
+    // Segment layout: record position. I/O holds relocate_mu shared;
+    // compaction and removal take it exclusively to move or retire the
+    // record.
+    std::shared_mutex relocate_mu;
+    SegmentStore::Location location;
+    bool removed = false; // guarded by relocate_mu
+
+    // Disk tiers: marked partial on disk (a marker file, or a pending
+    // segment record) until CompleteBlock
+    std::atomic<bool> partial{false};
+
+    ~BlockEntry();
+  };
+  using EntryRef = std::shared_ptr<BlockEntry>;
+
+  static constexpr size_t kIndexShards = 16;
+  struct alignas(64) IndexShard {
+    mutable std::shared_mutex mu;
+    std::unordered_map<BlockId, EntryRef> blocks;
+  };
+
+  IndexShard &ShardFor(BlockId id) const {
+    return shards_[std::hash<BlockId>{}(id) % kIndexShards];
+  }
+  EntryRef Lookup(BlockId id) const;
+
+  // Reserve / release tier capacity without a lock
+  bool ReserveBytes(size_t size);
+  void ReleaseBytes(size_t size) { used_bytes_.fetch_sub(size); }
+
+  // Memory tier: allocates slabs from arenas_, preferring the calling
+  // thread's NUMA node
+  Status AllocateMem(BlockId id, size_t size, EntryRef *entry);
+  Status ReadMem(BlockEntry &e, void *buf, size_t size, off_t offset);
+  Status WriteMem(BlockEntry &e, const void *buf, size_t size, off_t offset);
+  void PublishArenaMetrics() const;
 
   // Disk tier (SSD/HDD): uses files under path_
-  Status AllocateDisk(BlockId id, size_t size, BlockHandle *handle);
-  Status ReadDisk(BlockId id, void *buf, size_t size, off_t offset);
-  Status WriteDisk(BlockId id, const void *buf, size_t size, off_t offset);
-  Status RemoveDisk(BlockId id);
+  Status AllocateDisk(BlockId id, size_t size, bool partial,
+                      EntryRef *entry);
+  // Resolve entries and descriptors, then run the batch through io_engine_
+  // with no tier lock held (the FdRefs keep the files open).
+  Status SubmitDisk(IoRequest::Op op, std::span<BlockIo> ios);
+  // Descriptor and file offset of a block's first byte. Segment layout:
+  // caller holds e.relocate_mu.
+  Status ResolveExtent(BlockEntry &e, FdRef *fd, off_t *base);
+  // O_DIRECT write that is not sector aligned: read-modify-write of the
+  // covering aligned span through a bounce buffer. `base` is the file offset
+  // of the block's first byte.
+  Status WriteDirectUnaligned(BlockEntry &e, const FdRef &fd, off_t base,
+                              const BlockIo &io);
+
+  // Migration helpers (see MigrateBlockTo); `target` belongs to `dst`
+  Status CopyBlock(BlockEntry &src, StorageTier *dst, BlockEntry &target);
+  // Disk tier: run [0, size) of block `id` through SubmitDisk in chunks
+  // small enough for a pooled bounce buffer
+  Status SubmitChunked(IoRequest::Op op, BlockId id, void *buf, size_t size);
+  // Disk to disk in-kernel copy; *copied stays false if unsupported
+  Status CopyFileRange(BlockEntry &src, StorageTier *dst, BlockEntry &target,
+                       bool *copied);
+
+  // Segment layout
+  Status OpenSegments();
+  Status RelocateBlock(BlockId id, uint32_t from_segment);
+  void CompactionLoop();
+  void PublishSegmentMetrics() const;
+  // Probe whether path_ supports O_DIRECT
+  bool ProbeDirectIo() const;
 
   std::string BlockFilePath(BlockId id) const;
+  // File-per-block layout: exists while the block is partial
+  std::string PartialMarkerPath(BlockId id) const;
 
   TierType type_;
   std::string path_;
   size_t capacity_;
-  size_t used_bytes_ = 0;
+  std::atomic<size_t> used_bytes_{0};
+  std::atomic<uint64_t> next_generation_{1};
+  // Declared before the index so entries can free their slabs into it
+  // Memory tier only: one arena per NUMA node when numa_aware (capacity split
+  // evenly), otherwise a single arena
+  std::vector<std::unique_ptr<MemArena>> arenas_;
+  // Disk tiers only. fd_cache_ is declared after io_engine_ so cached
+  // descriptors unregister from the engine before it is destroyed.
+  bool direct_io_ = false;
+  // O_DIRECT bounce buffers; also the copy buffers for segment compaction
+  std::unique_ptr<AlignedBufferPool> bounce_pool_;
+  std::unique_ptr<IoEngine> io_engine_;
+  std::unique_ptr<FdCache> fd_cache_;
+  std::unique_ptr<SegmentStore> segments_; // segment layout only
+
+  mutable std::array<IndexShard, kIndexShards> shards_;
 
-  mutable std::mutex mu_;
-  std::unordered_map<BlockId, BlockHandle> blocks_;
+  // Segment layout: background compaction
+  double compact_dead_ratio_ = 0.5;
+  std::mutex compact_mu_;
+  std::condition_variable compact_cv_;
+  bool stop_compaction_ = false;
+  std::thread compactor_;
 };
 
 } // namespace anycache
@@ -8,7 +8,16 @@ WorkerServer::WorkerServer(const Config &config)
   BlockStore::Options opts;
   opts.tiers = config_.tiers;
   opts.meta_db_path = "/tmp/anycache/worker_meta";
-  opts.cache_policy = CacheManager::PolicyType::kLRU;
+  if (!CacheManager::ParsePolicyType(config_.cache_policy, &opts.cache_policy))
+    LOG_WARN("Unknown cache_policy '{}', using LRU", config_.cache_policy);
+  opts.demote_on_evict = config_.demote_on_evict;
+  opts.demote_bandwidth_bytes_per_sec = config_.demote_bandwidth_bytes_per_sec;
+  opts.page_size = config_.page_size;
+  opts.cache_admission = config_.cache_admission;
+  opts.cache_shards = config_.cache_shards;
+  opts.mrc_sample_rate = config_.mrc_sample_rate;
+  opts.memory_spill_dir = config_.memory_spill_dir;
+  opts.memory_spill_timeout_ms = config_.memory_spill_timeout_ms;
   block_store_ = std::make_unique<BlockStore>(opts);
 
   size_t max_pages = 0;
@@ -17,7 +26,16 @@ WorkerServer::WorkerServer(const Config &config)
   }
   if (max_pages == 0)
     max_pages = 1024;
-  page_store_ = std::make_unique<PageStore>(config_.page_size, max_pages);
+  PageStore::Options page_opts;
+  page_opts.page_size = config_.page_size;
+  page_opts.max_pages = max_pages;
+  page_opts.shards = config_.page_cache_shards;
+  page_opts.mode = config_.page_cache_clock ? PageEvictionMode::kClock
+                                            : PageEvictionMode::kLRU;
+  page_opts.prefetch_threads = config_.page_prefetch_threads;
+  page_opts.prefetch_queue_limit = config_.page_prefetch_queue_limit;
+  page_opts.readahead_max_pages = config_.page_readahead_max_pages;
+  page_store_ = std::make_unique<PageStore>(page_opts);
 }
 
 WorkerServer::WorkerServer(const WorkerConfig &config,
@@ -28,7 +46,16 @@ WorkerServer::WorkerServer(const WorkerConfig &config,
   BlockStore::Options opts;
   opts.tiers = config.tiers;
   opts.meta_db_path = "/tmp/anycache/worker_meta";
-  opts.cache_policy = CacheManager::PolicyType::kLRU;
+  if (!CacheManager::ParsePolicyType(config_.cache_policy, &opts.cache_policy))
+    LOG_WARN("Unknown cache_policy '{}', using LRU", config_.cache_policy);
+  opts.demote_on_evict = config_.demote_on_evict;
+  opts.demote_bandwidth_bytes_per_sec = config_.demote_bandwidth_bytes_per_sec;
+  opts.page_size = config_.page_size;
+  opts.cache_admission = config_.cache_admission;
+  opts.cache_shards = config_.cache_shards;
+  opts.mrc_sample_rate = config_.mrc_sample_rate;
+  opts.memory_spill_dir = config_.memory_spill_dir;
+  opts.memory_spill_timeout_ms = config_.memory_spill_timeout_ms;
   block_store_ = std::make_unique<BlockStore>(opts);
 
   // Build PageStore
@@ -38,7 +65,16 @@ WorkerServer::WorkerServer(const WorkerConfig &config,
   }
   if (max_pages == 0)
     max_pages = 1024;
-  page_store_ = std::make_unique<PageStore>(config.page_size, max_pages);
+  PageStore::Options page_opts;
+  page_opts.page_size = config.page_size;
+  page_opts.max_pages = max_pages;
+  page_opts.shards = config.page_cache_shards;
+  page_opts.mode = config.page_cache_clock ? PageEvictionMode::kClock
+                                           : PageEvictionMode::kLRU;
+  page_opts.prefetch_threads = config.page_prefetch_threads;
+  page_opts.prefetch_queue_limit = config.page_prefetch_queue_limit;
+  page_opts.readahead_max_pages = config.page_readahead_max_pages;
+  page_store_ = std::make_unique<PageStore>(page_opts);
 }
 
 WorkerServer::~WorkerServer() { Stop(); }
@@ -79,6 +115,18 @@ Status WorkerServer::Start() {
       LOG_WARN("Failed to register with Master: {}", reg_status.ToString());
     }
 
+    // Promotions and demotions change the tier the master advertises
+    block_store_->SetTierChangeListener(
+        [reports = tier_reports_](BlockId id, TierType tier) {
+          {
+            std::lock_guard<std::mutex> lock(reports->mu);
+            reports->pending[id] = tier;
+          }
+          reports->cv.notify_one();
+        });
+    tier_report_thread_ =
+        std::thread(&WorkerServer::TierReportLoop, this, self_address);
+
     heartbeat_thread_ = std::thread(&WorkerServer::HeartbeatLoop, this);
   }
 
@@ -141,6 +189,21 @@ void WorkerServer::Stop() {
     heartbeat_thread_.join();
   }
 
+  {
+    std::lock_guard<std::mutex> lock(tier_reports_->mu);
+    tier_reports_->stop = true;
+  }
+  tier_reports_->cv.notify_all();
+  if (tier_report_thread_.joinable()) {
+    tier_report_thread_.join();
+  }
+
+  // No more I/O: carry the memory tier over to the next start
+  auto s = block_store_->SpillMemoryTier();
+  if (!s.ok()) {
+    LOG_WARN("Memory tier spill: {}", s.ToString());
+  }
+
   LOG_INFO("WorkerServer stopped");
 }
 
@@ -178,6 +241,31 @@ void WorkerServer::HeartbeatLoop() {
   }
 }
 
+void WorkerServer::TierReportLoop(std::string self_address) {
+  auto &reports = *tier_reports_;
+  std::unique_lock<std::mutex> lock(reports.mu);
+  for (;;) {
+    reports.cv.wait(lock,
+                    [&] { return reports.stop || !reports.pending.empty(); });
+    if (reports.stop)
+      return; // changes still queued at shutdown are dropped
+    std::unordered_map<BlockId, TierType> batch;
+    batch.swap(reports.pending);
+    lock.unlock();
+
+    for (auto &[id, tier] : batch) {
+      if (worker_id_ == kInvalidWorkerId || !running_)
+        break;
+      auto s = master_client_->ReportBlockLocation(id, worker_id_,
+                                                   self_address, tier);
+      if (!s.ok())
+        LOG_DEBUG("Tier change report for block {} failed: {}", id,
+                  s.ToString());
+    }
+    lock.lock();
+  }
+}
+
 uint64_t WorkerServer::GetTotalCapacity() const {
   uint64_t total = 0;
   for (auto tier_type : {TierType::kMemory, TierType::kSSD, TierType::kHDD}) {
@@ -10,8 +10,12 @@
 #include "worker/worker_service_impl.h"
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <unordered_map>
 
 #include <grpcpp/grpcpp.h>
 
@@ -39,6 +43,9 @@ public:
 
 private:
   void HeartbeatLoop();
+  // Reports queued tier changes to the master, off the threads that move
+  // blocks (a promotion runs inside a read)
+  void TierReportLoop(std::string self_address);
   uint64_t GetTotalCapacity() const;
   uint64_t GetTotalUsed() const;
 
@@ -56,6 +63,18 @@ private:
   WorkerId worker_id_ = kInvalidWorkerId;
   std::atomic<bool> running_{false};
   std::thread heartbeat_thread_;
+
+  // Tier changes not yet reported, latest tier per block. Shared with the
+  // BlockStore listener, which may still fire after the loop has stopped.
+  struct TierReports {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::unordered_map<BlockId, TierType> pending;
+    bool stop = false;
+  };
+  std::shared_ptr<TierReports> tier_reports_ =
+      std::make_shared<TierReports>();
+  std::thread tier_report_thread_;
   std::unique_ptr<MetricsHttpServer> metrics_server_;
 };
 
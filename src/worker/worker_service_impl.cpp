@@ -3,10 +3,34 @@
 #include "common/proto_utils.h"
 #include "ufs/ufs_factory.h"
 
+#include <chrono>
+#include <cstring>
 #include <fcntl.h>
 
 namespace anycache {
 
+// Split ufs_path into base_uri and relative path
+// e.g. "file:///mnt/data/file" -> base="file:///mnt/data", rel="file"
+static void SplitUfsPath(const std::string &ufs_path, std::string *base_uri,
+                         std::string *rel_path) {
+  auto pos = ufs_path.find("://");
+  if (pos == std::string::npos) {
+    *base_uri = "file://";
+    *rel_path = ufs_path;
+    return;
+  }
+  *base_uri = ufs_path.substr(0, pos + 3);
+  std::string path_part = ufs_path.substr(pos + 3);
+  auto slash = path_part.rfind('/');
+  if (slash != std::string::npos) {
+    *base_uri += path_part.substr(0, slash);
+    *rel_path = path_part.substr(slash + 1);
+  } else {
+    *base_uri += path_part;
+    rel_path->clear();
+  }
+}
+
 WorkerServiceImpl::WorkerServiceImpl(BlockStore *block_store,
                                      PageStore *page_store)
     : block_store_(block_store), page_store_(page_store) {}
@@ -26,8 +50,13 @@ grpc::Status WorkerServiceImpl::ReadBlock(grpc::ServerContext * /*ctx*/,
                                           proto::ReadBlockResponse *resp) {
   size_t length = req->length();
   std::string buf(length, '\0');
-  auto s = block_store_->ReadBlock(req->block_id(), buf.data(), length,
-                                   static_cast<off_t>(req->offset()));
+  Status s;
+  if (req->ufs_path().empty() || !config_) {
+    s = block_store_->ReadBlock(req->block_id(), buf.data(), length,
+                                static_cast<off_t>(req->offset()));
+  } else {
+    s = ReadBlockThrough(*req, buf.data());
+  }
   *resp->mutable_status() = ToProtoStatus(s);
   if (s.ok()) {
     resp->set_data(std::move(buf));
@@ -77,26 +106,9 @@ grpc::Status WorkerServiceImpl::CacheBlock(grpc::ServerContext * /*ctx*/,
     return grpc::Status::OK;
   }
 
-  // Split ufs_path into base_uri and relative path
-  // e.g. "file:///mnt/data/file" -> base="file:///mnt/data", rel="file"
-  auto pos = ufs_path.find("://");
   std::string base_uri;
   std::string rel_path;
-  if (pos == std::string::npos) {
-    base_uri = "file://";
-    rel_path = ufs_path;
-  } else {
-    base_uri = ufs_path.substr(0, pos + 3);
-    std::string path_part = ufs_path.substr(pos + 3);
-    auto slash = path_part.rfind('/');
-    if (slash != std::string::npos) {
-      base_uri += path_part.substr(0, slash);
-      rel_path = path_part.substr(slash + 1);
-    } else {
-      base_uri += path_part;
-      rel_path = "";
-    }
-  }
+  SplitUfsPath(ufs_path, &base_uri, &rel_path);
 
   auto ufs = UfsFactory::Create(base_uri, *config_);
   if (!ufs) {
@@ -105,6 +117,7 @@ grpc::Status WorkerServiceImpl::CacheBlock(grpc::ServerContext * /*ctx*/,
     return grpc::Status::OK;
   }
 
+  auto fetch_start = std::chrono::steady_clock::now();
   UfsFileHandle handle;
   auto s = ufs->Open(rel_path, O_RDONLY, &handle);
   if (!s.ok()) {
@@ -121,6 +134,9 @@ grpc::Status WorkerServiceImpl::CacheBlock(grpc::ServerContext * /*ctx*/,
     *resp->mutable_status() = ToProtoStatus(s);
     return grpc::Status::OK;
   }
+  auto fetch_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - fetch_start)
+                      .count();
 
   s = block_store_->EnsureBlock(req->block_id(), bytes_read);
   if (!s.ok()) {
@@ -133,6 +149,7 @@ grpc::Status WorkerServiceImpl::CacheBlock(grpc::ServerContext * /*ctx*/,
     *resp->mutable_status() = ToProtoStatus(s);
     return grpc::Status::OK;
   }
+  block_store_->RecordFetch(req->block_id(), bytes_read, fetch_us);
 
   if (master_client_ && worker_id_ != kInvalidWorkerId && config_) {
     master_client_->ReportBlockLocation(req->block_id(), worker_id_,
@@ -246,6 +263,13 @@ grpc::Status WorkerServiceImpl::GetWorkerStatus(
       ts->set_type(ToProtoTier(tier_type));
       ts->set_capacity_bytes(cap);
       ts->set_used_bytes(used);
+      for (auto &p : block_store_->GetMissRatioCurve(tier_type)) {
+        auto *point = ts->add_miss_ratio_curve();
+        point->set_capacity_multiple(p.multiple);
+        point->set_capacity_bytes(p.capacity_bytes);
+        point->set_hit_ratio(p.hit_ratio);
+        point->set_sampled_references(p.references);
+      }
       total_capacity += cap;
       total_used += used;
     }
@@ -261,6 +285,56 @@ grpc::Status WorkerServiceImpl::GetWorkerStatus(
 
 // ─── Helpers ─────────────────────────────────────────────────────
 
+Status WorkerServiceImpl::ReadBlockThrough(const proto::ReadBlockRequest &req,
+                                           char *buf) {
+  BlockId block_id = req.block_id();
+  bool created = !block_store_->HasBlock(block_id);
+  if (created) {
+    // A zero-length partial block has no pages to fill
+    if (req.block_length() == 0)
+      return Status::InvalidArgument("block_length is required to read "
+                                     "through an uncached block");
+    RETURN_IF_ERROR(
+        block_store_->EnsurePartialBlock(block_id, req.block_length()));
+  }
+
+  // The UFS is opened only if a page is actually missing
+  std::unique_ptr<UnderFileSystem> ufs;
+  UfsFileHandle handle;
+  bool opened = false;
+  auto fetch = [&](uint64_t offset, size_t size, void *out) -> Status {
+    if (!opened) {
+      std::string base_uri, rel_path;
+      SplitUfsPath(req.ufs_path(), &base_uri, &rel_path);
+      ufs = UfsFactory::Create(base_uri, *config_);
+      if (!ufs)
+        return Status::InvalidArgument("failed to create UFS for " + base_uri);
+      RETURN_IF_ERROR(ufs->Open(rel_path, O_RDONLY, &handle));
+      opened = true;
+    }
+    size_t bytes_read = 0;
+    RETURN_IF_ERROR(ufs->Read(handle, out, size,
+                              static_cast<off_t>(req.offset_in_ufs() + offset),
+                              &bytes_read));
+    // Past the end of the file
+    std::memset(static_cast<char *>(out) + bytes_read, 0, size - bytes_read);
+    return Status::OK();
+  };
+  auto s = block_store_->ReadBlockThrough(
+      block_id, buf, req.length(), static_cast<off_t>(req.offset()), fetch);
+  if (opened)
+    ufs->Close(handle);
+
+  BlockMeta meta;
+  if (s.ok() && created && master_client_ && worker_id_ != kInvalidWorkerId &&
+      block_store_->GetBlockMeta(block_id, &meta).ok()) {
+    // The block went to whichever tier had room
+    master_client_->ReportBlockLocation(block_id, worker_id_, GetSelfAddress(),
+                                        meta.tier);
+  }
+  return s;
+}
+
 std::string WorkerServiceImpl::GetSelfAddress() const {
   if (!config_)
     return "";
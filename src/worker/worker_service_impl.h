@@ -60,6 +60,9 @@ public:
                                proto::GetWorkerStatusResponse *resp) override;
 
 private:
+  // ReadBlock with ufs_path set: fetch only the missing pages from the UFS
+  Status ReadBlockThrough(const proto::ReadBlockRequest &req, char *buf);
+
   // Build worker self-address from config (used for ReportBlockLocation)
   std::string GetSelfAddress() const;
 
@@ -0,0 +1,99 @@
+#include "worker/aligned_buffer_pool.h"
+#include "worker/storage_tier.h"
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+
+namespace fs = std::filesystem;
+using namespace anycache;
+
+TEST(AlignedBufferPoolTest, LeasesAlignedBuffersAndRecycles) {
+  AlignedBufferPool pool(8192, 2);
+  char *first = nullptr;
+  {
+    auto a = pool.Acquire(100);
+    ASSERT_TRUE(a);
+    EXPECT_TRUE(AlignedBufferPool::IsAligned(
+        reinterpret_cast<uintptr_t>(a.data())));
+    EXPECT_EQ(a.size(), AlignedBufferPool::kAlignment);
+    EXPECT_EQ(pool.GetStats().in_use, 1u);
+    first = a.data();
+  }
+  EXPECT_EQ(pool.GetStats().in_use, 0u);
+  auto b = pool.Acquire(8192);
+  EXPECT_EQ(b.data(), first); // returned buffer is reused
+}
+
+TEST(AlignedBufferPoolTest, FallsBackWhenExhaustedOrOversized) {
+  AlignedBufferPool pool(4096, 1);
+  auto a = pool.Acquire(4096);
+  auto b = pool.Acquire(4096);   // pool empty
+  auto c = pool.Acquire(100000); // larger than a pooled buffer
+  ASSERT_TRUE(b && c);
+  EXPECT_TRUE(
+      AlignedBufferPool::IsAligned(reinterpret_cast<uintptr_t>(c.data())));
+  EXPECT_GE(c.size(), 100000u);
+  EXPECT_EQ(pool.GetStats().heap_fallbacks, 2u);
+  EXPECT_EQ(pool.GetStats().in_use, 1u);
+}
+
+class DirectIoTierTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    test_dir_ = fs::temp_directory_path() / "anycache_direct_io_test";
+    fs::remove_all(test_dir_);
+    TierConfig tc;
+    tc.type = TierType::kSSD;
+    tc.path = test_dir_.string();
+    tc.capacity_bytes = 4 * 1024 * 1024;
+    tc.direct_io = true;
+    tier_ = std::make_unique<StorageTier>(tc);
+  }
+  void TearDown() override {
+    tier_.reset();
+    fs::remove_all(test_dir_);
+  }
+
+  fs::path test_dir_;
+  std::unique_ptr<StorageTier> tier_;
+};
+
+TEST_F(DirectIoTierTest, UnalignedWritesAndPartialTail) {
+  if (!tier_->IsDirectIo())
+    GTEST_SKIP() << "filesystem does not support O_DIRECT";
+
+  // 10000 bytes: the last sector is only partially inside the block
+  constexpr size_t kSize = 10000;
+  BlockHandle h;
+  ASSERT_TRUE(tier_->AllocateBlock(1, kSize, &h).ok());
+
+  std::vector<char> expected(kSize, '\0');
+  auto write = [&](size_t off, size_t len, char c) {
+    std::vector<char> data(len, c);
+    ASSERT_TRUE(tier_->WriteBlock(1, data.data(), len, off).ok());
+    std::memset(expected.data() + off, c, len);
+  };
+  write(0, 4096, 'a');      // aligned offset, unaligned (heap) buffer
+  write(100, 50, 'b');      // inside one sector
+  write(4000, 200, 'c');    // straddles a sector boundary
+  write(4200, 300, 'd');    // shares an edge sector with the previous write
+  write(9000, 1000, 'e');   // partial tail
+  EXPECT_FALSE(tier_->WriteBlock(1, "x", 1, kSize).ok());
+
+  std::vector<char> back(kSize + 100, 'z');
+  ASSERT_TRUE(tier_->ReadBlock(1, back.data(), back.size(), 0).ok());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), back.begin()));
+  // The read is clamped at the block capacity, not the padded file size
+  EXPECT_EQ(back[kSize], 'z');
+
+  // Unaligned read window
+  char small[7];
+  ASSERT_TRUE(tier_->ReadBlock(1, small, sizeof(small), 4195).ok());
+  EXPECT_EQ(std::string(small, 7), std::string("ccccc") + "dd");
+
+  std::vector<char> exported;
+  ASSERT_TRUE(tier_->ExportBlock(1, &exported).ok());
+  EXPECT_EQ(exported, expected);
+}
@@ -1,8 +1,13 @@
 #include "worker/block_store.h"
+#include "common/metrics.h"
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
 
 namespace fs = std::filesystem;
 using namespace anycache;
@@ -94,3 +99,621 @@ TEST_F(BlockStoreTest, EvictionFreesSpace) {
   // Check total cached bytes
   EXPECT_GT(store_->GetTotalCachedBytes(), 0u);
 }
+
+TEST_F(BlockStoreTest, ReclaimerKeepsHeadroomInBackground) {
+  // 1 MB tier: crossing 95% wakes the reclaimer, which frees down to 80%
+  auto stalls = Metrics::Instance().GetCounter("block_store.create_stalls");
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(store_->CreateBlock(MakeBlockId(40, i), 100 * 1024).ok());
+    store_->WaitForReclaim();
+  }
+  EXPECT_LE(store_->GetTierUsedBytes(TierType::kMemory), 900u * 1024);
+  EXPECT_EQ(Metrics::Instance().GetCounter("block_store.create_stalls"),
+            stalls);
+}
+
+TEST_F(BlockStoreTest, CreateStallsOnlyWhenTierIsFull) {
+  auto stalls = Metrics::Instance().GetCounter("block_store.create_stalls");
+  // 3 x 300 KB stays under the high watermark; the 4th does not fit
+  for (int i = 0; i < 3; ++i)
+    ASSERT_TRUE(store_->CreateBlock(MakeBlockId(41, i), 300 * 1024).ok());
+  store_->WaitForReclaim();
+  EXPECT_EQ(Metrics::Instance().GetCounter("block_store.create_stalls"),
+            stalls);
+  ASSERT_TRUE(store_->CreateBlock(MakeBlockId(41, 3), 300 * 1024).ok());
+  EXPECT_FALSE(store_->HasBlock(MakeBlockId(41, 0))); // LRU victim
+  EXPECT_EQ(Metrics::Instance().GetCounter("block_store.create_stalls"),
+            stalls + 1);
+
+  // Larger than the tier: reclaim cannot help
+  EXPECT_EQ(store_->CreateBlock(MakeBlockId(41, 4), 2 * 1024 * 1024).code(),
+            StatusCode::kResourceExhausted);
+}
+
+TEST_F(BlockStoreTest, AccessStatsFlushInBatches) {
+  BlockStore::Options opts;
+  TierConfig tc;
+  tc.type = TierType::kMemory;
+  tc.capacity_bytes = 1 * 1024 * 1024;
+  opts.tiers.push_back(tc);
+  opts.meta_db_path = (test_dir_ / "meta_flush").string();
+  opts.auto_promote_access_threshold = 0;
+  opts.meta_flush_interval_ms = 3600 * 1000; // only explicit flushes
+  auto store = std::make_unique<BlockStore>(opts);
+
+  auto &metrics = Metrics::Instance();
+  for (int i = 0; i < 3; ++i)
+    ASSERT_TRUE(store->CreateBlock(MakeBlockId(40, i), 4096).ok());
+  char buf[16];
+  for (int round = 0; round < 5; ++round) {
+    for (int i = 0; i < 3; ++i)
+      ASSERT_TRUE(store->ReadBlock(MakeBlockId(40, i), buf, 16, 0).ok());
+  }
+
+  // Reads update the in-memory stats right away
+  BlockMeta meta;
+  ASSERT_TRUE(store->GetBlockMeta(MakeBlockId(40, 1), &meta).ok());
+  EXPECT_EQ(meta.access_count, 5u);
+  EXPECT_GT(meta.last_access_time_ms, 0);
+
+  // ...and reach the MetaStore as one record per block, not per read
+  int64_t flushes = metrics.GetCounter("block_store.meta_flushes");
+  int64_t flushed = metrics.GetCounter("block_store.meta_flushed_blocks");
+  ASSERT_TRUE(store->FlushAccessStats().ok());
+  EXPECT_EQ(metrics.GetCounter("block_store.meta_flushes"), flushes + 1);
+  EXPECT_EQ(metrics.GetCounter("block_store.meta_flushed_blocks"),
+            flushed + 3);
+  ASSERT_TRUE(store->FlushAccessStats().ok()); // nothing dirty
+  EXPECT_EQ(metrics.GetCounter("block_store.meta_flushes"), flushes + 1);
+
+  // Stats of a removed block are not flushed; pending ones are on shutdown
+  ASSERT_TRUE(store->ReadBlock(MakeBlockId(40, 0), buf, 16, 0).ok());
+  ASSERT_TRUE(store->ReadBlock(MakeBlockId(40, 2), buf, 16, 0).ok());
+  ASSERT_TRUE(store->RemoveBlock(MakeBlockId(40, 0)).ok());
+  store.reset();
+  EXPECT_EQ(metrics.GetCounter("block_store.meta_flushed_blocks"),
+            flushed + 4);
+}
+
+TEST_F(BlockStoreTest, PartialBlockFetchesOnlyMissingPages) {
+  constexpr size_t kPage = 4096;
+  constexpr size_t kLength = 10 * kPage + 100; // short last page
+  BlockStore::Options opts;
+  TierConfig tc;
+  tc.type = TierType::kMemory;
+  tc.capacity_bytes = 1 * 1024 * 1024;
+  opts.tiers.push_back(tc);
+  opts.meta_db_path = (test_dir_ / "meta_partial").string();
+  opts.page_size = kPage;
+  BlockStore store(opts);
+
+  auto expected = [](uint64_t offset, size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+      data[i] = static_cast<char>((offset + i) % 251);
+    return data;
+  };
+  std::vector<std::pair<uint64_t, size_t>> fetches;
+  bool fail = false;
+  auto fetch = [&](uint64_t offset, size_t size, void *buf) {
+    if (fail)
+      return Status::IOError("ufs down");
+    fetches.emplace_back(offset, size);
+    std::memcpy(buf, expected(offset, size).data(), size);
+    return Status::OK();
+  };
+
+  BlockId id = MakeBlockId(50, 0);
+  ASSERT_TRUE(store.CreatePartialBlock(id, kLength).ok());
+  BlockMeta meta;
+  ASSERT_TRUE(store.GetBlockMeta(id, &meta).ok());
+  EXPECT_EQ(meta.cached_bytes, 0u);
+  std::string buf(kLength, '\0');
+  EXPECT_TRUE(store.ReadBlock(id, buf.data(), 100, 5000).IsNotFound());
+
+  // A small read costs one page
+  ASSERT_TRUE(store.ReadBlockThrough(id, buf.data(), 100, 5000, fetch).ok());
+  EXPECT_EQ(buf.substr(0, 100), expected(5000, 100));
+  ASSERT_EQ(fetches.size(), 1u);
+  EXPECT_EQ(fetches[0].first, kPage);
+  EXPECT_EQ(fetches[0].second, kPage);
+  ASSERT_TRUE(store.ReadBlock(id, buf.data(), 100, 5000).ok());
+  EXPECT_TRUE(store.ReadBlock(id, buf.data(), kPage, kPage + 10).IsNotFound());
+
+  // A run of missing pages is one fetch; valid pages are not re-fetched
+  fetches.clear();
+  ASSERT_TRUE(
+      store.ReadBlockThrough(id, buf.data(), 3 * kPage, kPage, fetch).ok());
+  EXPECT_EQ(buf.substr(0, 3 * kPage), expected(kPage, 3 * kPage));
+  ASSERT_EQ(fetches.size(), 1u);
+  EXPECT_EQ(fetches[0].first, 2 * kPage);
+  EXPECT_EQ(fetches[0].second, 2 * kPage);
+
+  // Writes validate the pages they fully cover, including the short tail
+  std::string tail = expected(10 * kPage, 100);
+  ASSERT_TRUE(store.WriteBlock(id, tail.data(), 100, 10 * kPage).ok());
+  std::string part = expected(kPage * 5 + 1, 10);
+  ASSERT_TRUE(store.WriteBlock(id, part.data(), 10, kPage * 5 + 1).ok());
+  ASSERT_TRUE(store.GetBlockMeta(id, &meta).ok());
+  EXPECT_EQ(meta.cached_bytes, 3 * kPage + 100);
+
+  // A failed fetch leaves the pages invalid
+  fail = true;
+  EXPECT_FALSE(store.ReadBlockThrough(id, buf.data(), 10, 0, fetch).ok());
+  EXPECT_TRUE(store.ReadBlock(id, buf.data(), 10, 0).IsNotFound());
+  fail = false;
+
+  fetches.clear();
+  ASSERT_TRUE(store.ReadBlockThrough(id, buf.data(), kLength, 0, fetch).ok());
+  EXPECT_EQ(buf, expected(0, kLength));
+  EXPECT_EQ(fetches.size(), 2u); // page 0, then pages 4..9
+  ASSERT_TRUE(store.GetBlockMeta(id, &meta).ok());
+  EXPECT_EQ(meta.cached_bytes, kLength);
+  EXPECT_GT(meta.fetch_cost_us, 0u); // fetches feed the refetch estimate
+  EXPECT_TRUE(store.ReadBlock(id, buf.data(), kLength, 0).ok());
+}
+
+TEST_F(BlockStoreTest, CrashRestartDropsPartialBlocks) {
+  // A partial block is preallocated to full size, so after a crash it
+  // matches the length an older snapshot recorded for a complete block of
+  // the same id; it must not come back with its missing pages as zeros
+  constexpr size_t kPage = 4096;
+  constexpr size_t kLength = 4 * kPage;
+  for (auto layout : {DiskLayout::kFilePerBlock, DiskLayout::kSegment}) {
+    auto dir = test_dir_ / (layout == DiskLayout::kSegment ? "seg" : "file");
+    BlockStore::Options opts;
+    TierConfig tc;
+    tc.type = TierType::kSSD;
+    tc.path = (dir / "ssd").string();
+    tc.capacity_bytes = 1 * 1024 * 1024;
+    tc.disk_layout = layout;
+    opts.tiers.push_back(tc);
+    opts.meta_db_path = (dir / "meta").string();
+    opts.page_size = kPage;
+    auto store = std::make_unique<BlockStore>(opts);
+    ASSERT_TRUE(store->Recover().ok());
+
+    BlockId id = MakeBlockId(60, 0);
+    std::string data(kLength, 'x');
+    ASSERT_TRUE(store->CreateBlock(id, kLength).ok());
+    ASSERT_TRUE(store->WriteBlock(id, data.data(), kLength, 0).ok());
+    ASSERT_TRUE(store->WriteIndexSnapshot().ok());
+
+    ASSERT_TRUE(store->RemoveBlock(id).ok());
+    ASSERT_TRUE(store->CreatePartialBlock(id, kLength).ok());
+    auto fetch = [&](uint64_t, size_t size, void *buf) {
+      std::memset(buf, 'y', size);
+      return Status::OK();
+    };
+    char buf[16];
+    ASSERT_TRUE(store->ReadBlockThrough(id, buf, sizeof(buf), 0, fetch).ok());
+
+    // Crash: the shutdown snapshot never happens
+    auto snapshot = opts.meta_db_path + ".snapshot";
+    fs::copy_file(snapshot, snapshot + ".crash");
+    store.reset();
+    fs::rename(snapshot + ".crash", snapshot);
+
+    store = std::make_unique<BlockStore>(opts);
+    ASSERT_TRUE(store->Recover().ok());
+    EXPECT_FALSE(store->HasBlock(id));
+    EXPECT_EQ(store->GetTierUsedBytes(TierType::kSSD), 0u);
+
+    // Once complete, the block survives a crash like any other
+    ASSERT_TRUE(store->CreatePartialBlock(id, kLength).ok());
+    std::string back(kLength, '\0');
+    ASSERT_TRUE(
+        store->ReadBlockThrough(id, back.data(), kLength, 0, fetch).ok());
+    ASSERT_TRUE(store->WriteIndexSnapshot().ok());
+    fs::copy_file(snapshot, snapshot + ".crash");
+    store.reset();
+    fs::rename(snapshot + ".crash", snapshot);
+
+    store = std::make_unique<BlockStore>(opts);
+    ASSERT_TRUE(store->Recover().ok());
+    ASSERT_TRUE(store->HasBlock(id));
+    ASSERT_TRUE(store->ReadBlock(id, back.data(), kLength, 0).ok());
+    EXPECT_EQ(back, std::string(kLength, 'y'));
+  }
+}
+
+TEST_F(BlockStoreTest, MissRatioCurveSeesHitsAndMisses) {
+  std::string data(4096, 'm');
+  ASSERT_TRUE(store_->CreateBlock(1, data.size()).ok());
+  ASSERT_TRUE(store_->WriteBlock(1, data.data(), data.size(), 0).ok());
+  for (int i = 0; i < 9; ++i)
+    ASSERT_TRUE(store_->ReadBlock(1, data.data(), data.size(), 0).ok());
+  // A read of an uncached block is a reference too
+  EXPECT_TRUE(store_->ReadBlock(2, data.data(), 16, 0).IsNotFound());
+
+  auto curve = store_->GetMissRatioCurve(TierType::kMemory);
+  ASSERT_EQ(curve.size(), 4u);
+  EXPECT_EQ(curve[1].capacity_bytes, 1024u * 1024);
+  EXPECT_EQ(curve[1].references, 10u);
+  EXPECT_DOUBLE_EQ(curve[1].hit_ratio, 0.8); // first read of each missed
+  EXPECT_TRUE(store_->GetMissRatioCurve(TierType::kSSD).empty());
+}
+
+TEST_F(BlockStoreTest, CostAwareEvictionKeepsExpensiveBlocks) {
+  BlockStore::Options opts;
+  TierConfig tc;
+  tc.type = TierType::kMemory;
+  tc.capacity_bytes = 1 * 1024 * 1024;
+  opts.tiers.push_back(tc);
+  opts.meta_db_path = (test_dir_ / "meta_gdsf").string();
+  opts.cache_policy = CacheManager::PolicyType::kGDSF;
+  BlockStore store(opts);
+
+  constexpr size_t kSize = 64 * 1024;
+  std::string data(kSize, 'g');
+  for (BlockId id = 1; id <= 3; ++id) {
+    ASSERT_TRUE(store.CreateBlock(id, kSize).ok());
+    ASSERT_TRUE(store.WriteBlock(id, data.data(), kSize, 0).ok());
+  }
+  // Block 1 came from a slow mount, 2 and 3 from a fast one; 3 is also read
+  store.RecordFetch(1, kSize, 50000);
+  store.RecordFetch(2, kSize, 1000);
+  store.RecordFetch(3, kSize, 1000);
+  ASSERT_TRUE(store.ReadBlock(3, data.data(), kSize, 0).ok());
+
+  std::vector<BlockId> evicted;
+  ASSERT_TRUE(store.EvictBlocks(TierType::kMemory, 1, &evicted).ok());
+  EXPECT_EQ(evicted, std::vector<BlockId>{2});
+  evicted.clear();
+  ASSERT_TRUE(store.EvictBlocks(TierType::kMemory, 1, &evicted).ok());
+  EXPECT_EQ(evicted, std::vector<BlockId>{3});
+
+  // Later fetches are smoothed into the estimate
+  store.RecordFetch(1, kSize / 2, 5000); // 10 ms for the whole block
+  BlockMeta meta;
+  ASSERT_TRUE(store.GetBlockMeta(1, &meta).ok());
+  EXPECT_EQ(meta.fetch_cost_us, (50000u * 3 + 10000) / 4);
+}
+
+TEST_F(BlockStoreTest, BatchReadWrite) {
+  std::vector<BlockId> ids = {MakeBlockId(30, 0), MakeBlockId(30, 1),
+                              MakeBlockId(30, 2)};
+  std::vector<std::string> data = {"alpha", "beta", "gamma"};
+  std::vector<BlockIo> ios;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ASSERT_TRUE(store_->CreateBlock(ids[i], 4096).ok());
+    ios.push_back(
+        BlockIo{ids[i], data[i].data(), data[i].size(), 0, Status::OK()});
+  }
+  ASSERT_TRUE(store_->WriteBlocks(ios).ok());
+
+  std::vector<std::string> back(ids.size(), std::string(5, '\0'));
+  for (size_t i = 0; i < ids.size(); ++i)
+    ios[i].buf = back[i].data();
+  ios.push_back(BlockIo{MakeBlockId(31, 0), back[0].data(), 1, 0,
+                        Status::OK()}); // not cached
+  EXPECT_FALSE(store_->ReadBlocks(ios).ok());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_TRUE(ios[i].status.ok());
+    EXPECT_EQ(back[i].substr(0, data[i].size()), data[i]);
+  }
+  EXPECT_EQ(ios.back().status.code(), StatusCode::kNotFound);
+}
+
+class TieredBlockStoreTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    test_dir_ = fs::temp_directory_path() / "anycache_tiered_bstore_test";
+    fs::remove_all(test_dir_);
+    fs::create_directories(test_dir_);
+  }
+  void TearDown() override {
+    store_.reset();
+    fs::remove_all(test_dir_);
+  }
+
+  void Open(bool demote, uint32_t promote_threshold = 0) {
+    BlockStore::Options opts;
+    auto add_tier = [&](TierType type, const char *name, size_t capacity) {
+      TierConfig tc;
+      tc.type = type;
+      tc.path = type == TierType::kMemory ? "" : (test_dir_ / name).string();
+      tc.capacity_bytes = capacity;
+      opts.tiers.push_back(tc);
+    };
+    add_tier(TierType::kMemory, "", 400 * 1024);
+    add_tier(TierType::kSSD, "ssd", 400 * 1024);
+    add_tier(TierType::kHDD, "hdd", 4 * 1024 * 1024);
+    opts.meta_db_path = (test_dir_ / "meta").string();
+    opts.auto_promote_access_threshold = promote_threshold;
+    opts.demote_on_evict = demote;
+    opts.memory_spill_dir = memory_spill_dir_;
+    store_ = std::make_unique<BlockStore>(opts);
+    store_->SetTierChangeListener([this](BlockId id, TierType tier) {
+      std::lock_guard<std::mutex> lock(moves_mu_);
+      moves_.emplace_back(id, tier);
+    });
+  }
+
+  void Fill(BlockId id) {
+    std::string data(kBlockSize, static_cast<char>('a' + id % 26));
+    ASSERT_TRUE(store_->CreateBlock(id, kBlockSize).ok());
+    ASSERT_TRUE(store_->WriteBlock(id, data.data(), kBlockSize, 0).ok());
+  }
+
+  void ExpectBlock(BlockId id) {
+    std::string back(kBlockSize, '\0');
+    ASSERT_TRUE(store_->ReadBlock(id, back.data(), kBlockSize, 0).ok())
+        << "block " << id;
+    EXPECT_EQ(back, std::string(kBlockSize, static_cast<char>('a' + id % 26)));
+  }
+
+  static constexpr size_t kBlockSize = 100 * 1024;
+  fs::path test_dir_;
+  std::string memory_spill_dir_; // set before Open
+  std::unique_ptr<BlockStore> store_;
+  std::mutex moves_mu_;
+  std::vector<std::pair<BlockId, TierType>> moves_;
+};
+
+TEST_F(TieredBlockStoreTest, EvictionDemotesInsteadOfDropping) {
+  Open(/*demote=*/true);
+  for (BlockId id = 1; id <= 3; ++id)
+    Fill(id);
+
+  std::vector<BlockId> evicted;
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kMemory, 1, &evicted).ok());
+  ASSERT_EQ(evicted.size(), 1u);
+  EXPECT_EQ(evicted[0], 1u); // LRU victim
+  BlockMeta meta;
+  ASSERT_TRUE(store_->GetBlockMeta(1, &meta).ok());
+  EXPECT_EQ(meta.tier, TierType::kSSD);
+  ExpectBlock(1);
+
+  // Last-tier victims are still dropped
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kSSD, 1, nullptr).ok());
+  ASSERT_TRUE(store_->GetBlockMeta(1, &meta).ok());
+  EXPECT_EQ(meta.tier, TierType::kHDD);
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kHDD, 1, nullptr).ok());
+  EXPECT_FALSE(store_->HasBlock(1));
+}
+
+TEST_F(TieredBlockStoreTest, WatermarkEvictionCascadesInBackground) {
+  Open(/*demote=*/true);
+  // 20 blocks need all three tiers; nothing may be dropped
+  constexpr BlockId kBlocks = 20;
+  for (BlockId id = 1; id <= kBlocks; ++id) {
+    Fill(id);
+    store_->WaitForReclaim();
+  }
+  for (BlockId id = 1; id <= kBlocks; ++id)
+    ExpectBlock(id);
+  EXPECT_GT(store_->GetTierUsedBytes(TierType::kHDD), 0u);
+
+  std::lock_guard<std::mutex> lock(moves_mu_);
+  ASSERT_FALSE(moves_.empty());
+  BlockMeta meta;
+  for (auto &[id, tier] : moves_) {
+    EXPECT_NE(tier, TierType::kMemory); // demotions only
+  }
+  // The listener saw every block's final tier
+  auto last = moves_.back();
+  ASSERT_TRUE(store_->GetBlockMeta(last.first, &meta).ok());
+  EXPECT_EQ(meta.tier, last.second);
+}
+
+TEST_F(TieredBlockStoreTest, EvictionDropsWithoutDemotion) {
+  Open(/*demote=*/false);
+  for (BlockId id = 1; id <= 3; ++id)
+    Fill(id);
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kMemory, 1, nullptr).ok());
+  EXPECT_FALSE(store_->HasBlock(1));
+  EXPECT_TRUE(moves_.empty());
+}
+
+TEST_F(TieredBlockStoreTest, LeasedBlocksAreNotEvictedOrMoved) {
+  Open(/*demote=*/true);
+  for (BlockId id = 1; id <= 3; ++id)
+    Fill(id);
+
+  BlockStore::Lease lease;
+  ASSERT_TRUE(store_->AcquireLease(1, &lease).ok());
+  EXPECT_EQ(lease.tier(), TierType::kMemory);
+  EXPECT_EQ(lease.length(), kBlockSize);
+
+  // Block 1 is the LRU victim but pinned: the next one goes instead
+  std::vector<BlockId> evicted;
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kMemory, 1, &evicted).ok());
+  ASSERT_EQ(evicted.size(), 1u);
+  EXPECT_EQ(evicted[0], 2u);
+  std::string back(kBlockSize, '\0');
+  ASSERT_TRUE(lease.Read(back.data(), kBlockSize, 0).ok());
+  EXPECT_EQ(back, std::string(kBlockSize, 'b'));
+
+  BlockStore::Lease ssd_lease;
+  ASSERT_TRUE(store_->AcquireLease(2, &ssd_lease).ok());
+  EXPECT_EQ(ssd_lease.tier(), TierType::kSSD);
+  EXPECT_EQ(store_->PromoteBlock(2, TierType::kMemory).code(),
+            StatusCode::kUnavailable);
+  ssd_lease.Release();
+  EXPECT_FALSE(ssd_lease.valid());
+  ASSERT_TRUE(store_->PromoteBlock(2, TierType::kMemory).ok());
+
+  // Once released, the deferred victim is evictable again
+  lease.Release();
+  evicted.clear();
+  ASSERT_TRUE(
+      store_->EvictBlocks(TierType::kMemory, 3 * kBlockSize, &evicted).ok());
+  EXPECT_NE(std::find(evicted.begin(), evicted.end(), 1u), evicted.end());
+  BlockMeta meta;
+  ASSERT_TRUE(store_->GetBlockMeta(1, &meta).ok());
+  EXPECT_EQ(meta.tier, TierType::kSSD);
+  ExpectBlock(1);
+}
+
+TEST_F(TieredBlockStoreTest, EvictionRacesWithReads) {
+  // Readers hammer blocks that are concurrently demoted, promoted and
+  // dropped; every read must return the block's data or NotFound
+  Open(/*demote=*/true, /*promote_threshold=*/2);
+  constexpr BlockId kBlocks = 60;
+  std::atomic<BlockId> published{0};
+  std::atomic<bool> stop{false};
+  std::atomic<int> corrupt{0}, failed{0}, reads{0};
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; ++t) {
+    readers.emplace_back([&, t] {
+      std::mt19937 rng(t);
+      std::string buf(kBlockSize, '\0');
+      while (!stop.load()) {
+        BlockId max = published.load();
+        if (max == 0) {
+          std::this_thread::yield();
+          continue;
+        }
+        BlockId id = rng() % max + 1;
+        auto s = store_->ReadBlock(id, buf.data(), kBlockSize, 0);
+        if (s.IsNotFound())
+          continue;
+        if (!s.ok()) {
+          failed++;
+          continue;
+        }
+        reads++;
+        if (buf != std::string(kBlockSize, static_cast<char>('a' + id % 26)))
+          corrupt++;
+      }
+    });
+  }
+  std::thread evictor([&] {
+    while (!stop.load()) {
+      store_->EvictBlocks(TierType::kMemory, kBlockSize, nullptr);
+      store_->EvictBlocks(TierType::kHDD, kBlockSize, nullptr);
+      std::this_thread::yield();
+    }
+  });
+
+  std::string data;
+  for (BlockId id = 1; id <= kBlocks; ++id) {
+    // The evictor may take a new block before it is written: write through
+    // a lease and skip blocks that are already gone
+    auto s = store_->CreateBlock(id, kBlockSize);
+    BlockStore::Lease lease;
+    if (s.ok() && store_->AcquireLease(id, &lease).ok()) {
+      data.assign(kBlockSize, static_cast<char>('a' + id % 26));
+      s = lease.Write(data.data(), kBlockSize, 0);
+    }
+    lease.Release();
+    if (!s.ok()) {
+      ADD_FAILURE() << "block " << id << ": " << s.ToString();
+      break;
+    }
+    published = id;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  while (published.load() == kBlocks && reads.load() < 2000)
+    std::this_thread::yield();
+  stop = true;
+  for (auto &th : readers)
+    th.join();
+  evictor.join();
+  store_->WaitForReclaim();
+
+  EXPECT_EQ(corrupt.load(), 0);
+  EXPECT_EQ(failed.load(), 0);
+  // No tier leaked space for a block that is gone
+  size_t used = 0;
+  for (TierType tier : {TierType::kMemory, TierType::kSSD, TierType::kHDD})
+    used += store_->GetTierUsedBytes(tier);
+  size_t cached = 0;
+  for (BlockId id = 1; id <= kBlocks; ++id)
+    cached += store_->HasBlock(id) ? kBlockSize : 0;
+  EXPECT_EQ(used, cached);
+}
+
+TEST_F(TieredBlockStoreTest, RestartRecoversIndexFromSnapshot) {
+  Open(/*demote=*/true);
+  ASSERT_TRUE(store_->Recover().ok()); // empty; enables snapshots
+  for (BlockId id = 1; id <= 3; ++id)
+    Fill(id);
+  ASSERT_TRUE(
+      store_->EvictBlocks(TierType::kMemory, 3 * kBlockSize, nullptr).ok());
+  ExpectBlock(1); // SSD eviction order is now 2, 3, 1
+  Fill(4);        // memory tier: lost on restart
+  {
+    // Left behind by a crash; no metadata vouches for it
+    std::ofstream orphan(test_dir_ / "ssd" / "block_999");
+    orphan << "stale";
+  }
+  store_.reset(); // writes the final snapshot
+
+  auto orphans_before =
+      Metrics::Instance().GetCounter("block_store.recover_orphans");
+  Open(/*demote=*/true);
+  ASSERT_TRUE(store_->Recover().ok());
+  EXPECT_EQ(Metrics::Instance().GetCounter("block_store.recover_orphans"),
+            orphans_before + 1);
+  EXPECT_FALSE(fs::exists(test_dir_ / "ssd" / "block_999"));
+  EXPECT_FALSE(store_->HasBlock(4));
+  EXPECT_EQ(store_->GetTierUsedBytes(TierType::kSSD), 3 * kBlockSize);
+
+  BlockMeta meta1, meta2;
+  ASSERT_TRUE(store_->GetBlockMeta(1, &meta1).ok());
+  ASSERT_TRUE(store_->GetBlockMeta(2, &meta2).ok());
+  EXPECT_EQ(meta1.tier, TierType::kSSD);
+  EXPECT_GT(meta1.access_count, meta2.access_count);
+
+  // The eviction order survived the restart
+  std::vector<BlockId> evicted;
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kSSD, 1, &evicted).ok());
+  ASSERT_EQ(evicted.size(), 1u);
+  EXPECT_EQ(evicted[0], 2u);
+  for (BlockId id = 1; id <= 3; ++id)
+    ExpectBlock(id);
+}
+
+TEST_F(TieredBlockStoreTest, SnapshotRestartDeletesMemoryTierMeta) {
+  Open(/*demote=*/true);
+  ASSERT_TRUE(store_->Recover().ok());
+  for (BlockId id = 1; id <= 3; ++id)
+    Fill(id);
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kMemory, kBlockSize, nullptr).ok());
+  ASSERT_TRUE(store_->FlushAccessStats().ok());
+  store_.reset(); // block 1 on SSD, 2 and 3 in memory
+
+  Open(/*demote=*/true);
+  ASSERT_TRUE(store_->Recover().ok());
+  EXPECT_TRUE(store_->HasBlock(1));
+  EXPECT_FALSE(store_->HasBlock(2));
+  store_.reset();
+
+  // The lost memory-tier blocks left no records behind
+  auto meta_store = MetaStore::Create((test_dir_ / "meta").string());
+  std::vector<BlockMeta> metas;
+  ASSERT_TRUE(meta_store->ScanAll(&metas).ok());
+  ASSERT_EQ(metas.size(), 1u);
+  EXPECT_EQ(metas[0].block_id, 1u);
+}
+
+TEST_F(TieredBlockStoreTest, GracefulRestartKeepsMemoryTier) {
+  memory_spill_dir_ = (test_dir_ / "spill").string();
+  Open(/*demote=*/true);
+  ASSERT_TRUE(store_->Recover().ok());
+  for (BlockId id = 1; id <= 3; ++id)
+    Fill(id);
+  ExpectBlock(1); // memory eviction order is now 2, 3, 1
+  ASSERT_TRUE(store_->SpillMemoryTier().ok());
+  store_.reset();
+
+  Open(/*demote=*/true);
+  ASSERT_TRUE(store_->Recover().ok());
+  EXPECT_FALSE(fs::exists(memory_spill_dir_)); // imported only once
+  for (BlockId id = 1; id <= 3; ++id) {
+    BlockMeta meta;
+    ASSERT_TRUE(store_->GetBlockMeta(id, &meta).ok()) << "block " << id;
+    EXPECT_EQ(meta.tier, TierType::kMemory);
+  }
+  EXPECT_EQ(store_->GetTierUsedBytes(TierType::kMemory), 3 * kBlockSize);
+
+  std::vector<BlockId> evicted;
+  ASSERT_TRUE(store_->EvictBlocks(TierType::kMemory, 1, &evicted).ok());
+  ASSERT_EQ(evicted.size(), 1u);
+  EXPECT_EQ(evicted[0], 2u);
+  for (BlockId id = 1; id <= 3; ++id)
+    ExpectBlock(id);
+}
@@ -1,6 +1,13 @@
 #include "worker/cache_manager.h"
+#include "common/metrics.h"
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <tuple>
+
 using namespace anycache;
 
 TEST(CacheManagerTest, LRU_EvictionOrder) {
@@ -63,3 +70,320 @@ TEST(CacheManagerTest, CachedBytesAccounting) {
   EXPECT_EQ(mgr.GetCachedBytes(), 200u);
   EXPECT_EQ(mgr.GetCachedBlockCount(), 1u);
 }
+
+TEST(CacheManagerTest, AdmissionKeepsHotBlocksThroughScan) {
+  AdmissionOptions admission;
+  admission.enabled = true;
+  admission.capacity_bytes = 1000;
+  admission.window_ratio = 0.1; // one block
+  CacheManager tinylfu(CacheManager::PolicyType::kLRU, admission);
+  CacheManager lru(CacheManager::PolicyType::kLRU);
+
+  for (auto *mgr : {&tinylfu, &lru}) {
+    for (BlockId id = 1; id <= 9; ++id) {
+      mgr->OnBlockInsert(id, 100);
+      for (int i = 0; i < 3; ++i)
+        mgr->OnBlockAccess(id);
+    }
+    mgr->OnBlockInsert(10, 100); // cold; fills the cache
+  }
+
+  auto rejected_before =
+      Metrics::Instance().GetCounter("cache_manager.admission.rejected");
+  // A scan of one-hit blocks, each evicting one block to make room
+  std::vector<BlockId> tinylfu_victims, lru_victims;
+  for (BlockId id = 100; id < 200; ++id) {
+    tinylfu.OnBlockInsert(id, 100);
+    lru.OnBlockInsert(id, 100);
+    for (BlockId v : tinylfu.GetEvictionCandidates(100))
+      tinylfu_victims.push_back(v);
+    for (BlockId v : lru.GetEvictionCandidates(100))
+      lru_victims.push_back(v);
+  }
+
+  auto evicted_hot = [](const std::vector<BlockId> &victims) {
+    return std::count_if(victims.begin(), victims.end(),
+                         [](BlockId id) { return id <= 9; });
+  };
+  EXPECT_EQ(evicted_hot(tinylfu_victims), 0);
+  EXPECT_EQ(evicted_hot(lru_victims), 9);
+  EXPECT_EQ(tinylfu.GetCachedBytes(), 1000u);
+  EXPECT_GE(Metrics::Instance().GetCounter("cache_manager.admission.rejected"),
+            rejected_before + 99);
+}
+
+TEST(CacheManagerTest, AdmissionAdmitsFrequentNewcomer) {
+  AdmissionOptions admission;
+  admission.enabled = true;
+  admission.capacity_bytes = 300;
+  admission.window_ratio = 0.34; // one block
+  CacheManager mgr(CacheManager::PolicyType::kLRU, admission);
+  for (BlockId id = 1; id <= 3; ++id)
+    mgr.OnBlockInsert(id, 100);
+
+  // Over capacity: 4 waits in the window and becomes popular there
+  mgr.OnBlockInsert(4, 100);
+  for (int i = 0; i < 5; ++i)
+    mgr.OnBlockAccess(4);
+  auto victims = mgr.GetEvictionCandidates(100);
+  ASSERT_EQ(victims.size(), 1u);
+  EXPECT_EQ(victims[0], 3u); // the window's oldest loses a tie
+
+  auto admitted_before =
+      Metrics::Instance().GetCounter("cache_manager.admission.admitted");
+  mgr.OnBlockInsert(5, 100);
+  victims = mgr.GetEvictionCandidates(100);
+  ASSERT_EQ(victims.size(), 1u);
+  EXPECT_EQ(victims[0], 1u); // 4 displaced the policy's victim
+  EXPECT_EQ(Metrics::Instance().GetCounter("cache_manager.admission.admitted"),
+            admitted_before + 1);
+}
+
+// ─── Policy-specific behaviour ───────────────────────────────
+
+TEST(CacheManagerTest, LFU_TiesEvictOldestFirst) {
+  LFUPolicy lfu;
+  for (BlockId id = 1; id <= 4; ++id)
+    lfu.OnInsert(id);
+  lfu.OnAccess(1);
+  lfu.OnAccess(3);
+  lfu.OnRemove(2);
+  EXPECT_EQ(lfu.Evict(), 4u); // only one left at freq 1
+  EXPECT_EQ(lfu.Evict(), 1u); // 1 reached freq 2 before 3
+  EXPECT_EQ(lfu.Evict(), 3u);
+  EXPECT_EQ(lfu.Evict(), kInvalidBlockId);
+}
+
+TEST(CacheManagerTest, ARC_GhostHitGrowsRecencySide) {
+  ARCPolicy arc;
+  for (BlockId id = 1; id <= 4; ++id)
+    arc.OnInsert(id);
+  arc.OnAccess(1);
+  arc.OnAccess(2); // T1 = {3, 4}, T2 = {1, 2}
+  EXPECT_EQ(arc.Evict(), 3u);
+  EXPECT_EQ(arc.Evict(), 4u);
+  EXPECT_EQ(arc.Evict(), 1u); // T1 empty
+  // 3 comes back from B1: T1 should have been bigger
+  arc.OnInsert(3);
+  arc.OnInsert(5);
+  EXPECT_EQ(arc.Size(), 3u);
+  EXPECT_EQ(arc.Peek(), 2u); // T1 = {5} is within its grown target
+}
+
+TEST(CacheManagerTest, TwoQ_RememberedBlocksSkipTheFifo) {
+  TwoQPolicy q;
+  for (BlockId id = 1; id <= 8; ++id)
+    q.OnInsert(id);
+  q.OnAccess(2); // correlated reference in A1in: ignored
+  EXPECT_EQ(q.Evict(), 1u);
+  EXPECT_EQ(q.Evict(), 2u);
+  q.OnInsert(1); // remembered in A1out: straight to Am
+  // A1in drains down to its quarter before Am is touched
+  for (BlockId id = 3; id <= 6; ++id)
+    EXPECT_EQ(q.Evict(), id);
+  EXPECT_EQ(q.Evict(), 1u);
+}
+
+TEST(CacheManagerTest, S3FIFO_OneHitBlocksLeaveFirst) {
+  S3FIFOPolicy s3;
+  for (BlockId id = 1; id <= 10; ++id)
+    s3.OnInsert(id);
+  s3.OnAccess(1);
+  s3.OnAccess(1); // accessed twice: moves to main when it reaches the head
+  s3.OnAccess(2); // once: still a one-hit block
+  EXPECT_EQ(s3.Evict(), 2u);
+  EXPECT_EQ(s3.Evict(), 3u);
+  s3.OnInsert(2); // ghost hit: straight to main
+  for (BlockId id = 4; id <= 10; ++id)
+    EXPECT_EQ(s3.Evict(), id);
+  EXPECT_EQ(s3.Evict(), 1u);
+  EXPECT_EQ(s3.Evict(), 2u);
+  EXPECT_EQ(s3.Evict(), kInvalidBlockId);
+}
+
+TEST(CacheManagerTest, GhostsSurviveTheRemoveOfAnEvictedBlock) {
+  // BlockStore reports every evicted block removed once it is gone; the
+  // ghost entry the eviction left must still catch its return
+  struct Case {
+    CacheManager::PolicyType type;
+    uint64_t frequent_weight; // export weight of the frequency side
+  };
+  for (auto [type, frequent_weight] :
+       {Case{CacheManager::PolicyType::kARC, 2},
+        Case{CacheManager::PolicyType::kTwoQ, 2},
+        Case{CacheManager::PolicyType::kS3FIFO, 4}}) {
+    CacheManager mgr(type);
+    for (BlockId id = 1; id <= 10; ++id)
+      mgr.OnBlockInsert(id, 100);
+    auto victims = mgr.GetEvictionCandidates(1);
+    ASSERT_EQ(victims, std::vector<BlockId>{1});
+    mgr.OnBlockRemove(1);
+    EXPECT_EQ(mgr.GetCachedBlockCount(), 9u);
+
+    mgr.OnBlockInsert(1, 100); // ghost hit
+    auto exported = mgr.ExportPolicy();
+    auto it = std::find_if(exported.begin(), exported.end(),
+                           [](const auto &e) { return e.first == 1; });
+    ASSERT_NE(it, exported.end());
+    EXPECT_GE(it->second, frequent_weight);
+  }
+}
+
+// ─── Properties shared by every policy ───────────────────────
+
+TEST(CacheManagerTest, GDSF_WeighsRefetchCostPerByte) {
+  CacheManager mgr(CacheManager::PolicyType::kGDSF);
+  // Same refetch time: the big block is cheaper per byte
+  mgr.OnBlockInsert(1, 100, 1000);
+  mgr.OnBlockInsert(2, 1000, 1000);
+  // Same size: the fast mount's block goes before the slow mount's
+  mgr.OnBlockInsert(3, 100, 50);
+  mgr.OnBlockInsert(4, 100, 2500);
+  // Unknown cost: charged the mean cost per byte of the others (9.125)
+  mgr.OnBlockInsert(5, 100);
+
+  auto victims = mgr.GetEvictionCandidates(1);
+  EXPECT_EQ(victims, std::vector<BlockId>{3}); // 0.5 per byte
+  victims = mgr.GetEvictionCandidates(1);
+  EXPECT_EQ(victims, std::vector<BlockId>{2}); // 1 per byte
+
+  // Frequency multiplies the cost: two more reads put 1 (3 x 10 per byte)
+  // above 4 (25 per byte)
+  mgr.OnBlockAccess(1);
+  mgr.OnBlockAccess(1);
+  victims = mgr.GetEvictionCandidates(1);
+  EXPECT_EQ(victims, std::vector<BlockId>{5});
+  victims = mgr.GetEvictionCandidates(1);
+  EXPECT_EQ(victims, std::vector<BlockId>{4});
+}
+
+TEST(CacheManagerTest, GDSF_InflationAgesOutIdleBlocks) {
+  CacheManager mgr(CacheManager::PolicyType::kGDSF);
+  mgr.OnBlockInsert(1, 100, 1000); // priority 10
+  for (int i = 0; i < 3; ++i)
+    mgr.OnBlockAccess(1); // 40
+  // Each eviction raises L to the victim's priority and new blocks start
+  // from L, so one-hit blocks churning through overtake the idle block 1
+  for (BlockId id = 100; id < 103; ++id) {
+    mgr.OnBlockInsert(id, 100, 1000); // priority L + 10
+    EXPECT_EQ(mgr.GetEvictionCandidates(1), std::vector<BlockId>{id});
+  }
+  mgr.OnBlockInsert(103, 100, 1000); // 40, ties with 1 which is older
+  EXPECT_EQ(mgr.GetEvictionCandidates(1), std::vector<BlockId>{1});
+}
+
+class CachePolicyTest
+    : public ::testing::TestWithParam<
+          std::tuple<CacheManager::PolicyType, size_t>> {};
+
+TEST_P(CachePolicyTest, EvictsEveryBlockOnceAndRestoresExport) {
+  auto [type, shards] = GetParam();
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<BlockId> pick(1, 200);
+  CacheManager mgr(type, {}, shards);
+  for (int i = 0; i < 2000; ++i) {
+    BlockId id = pick(rng);
+    switch (rng() % 4) {
+    case 0:
+      mgr.OnBlockRemove(id);
+      break;
+    case 1:
+      mgr.OnBlockAccess(id);
+      break;
+    default:
+      if (mgr.GetCachedBlockCount() < 100)
+        mgr.OnBlockInsert(id, 1);
+      else
+        mgr.GetEvictionCandidates(1);
+    }
+  }
+  size_t cached = mgr.GetCachedBlockCount();
+  ASSERT_GT(cached, 0u);
+
+  // The export replays into the same eviction order
+  auto exported = mgr.ExportPolicy();
+  ASSERT_EQ(exported.size(), cached);
+  CacheManager restored(type, {}, shards);
+  for (auto &[id, weight] : exported)
+    restored.RestoreBlock(id, 1, weight);
+  EXPECT_EQ(restored.ExportPolicy(), exported);
+
+  auto victims = mgr.GetEvictionCandidates(cached);
+  EXPECT_EQ(victims.size(), cached);
+  std::sort(victims.begin(), victims.end());
+  EXPECT_EQ(std::unique(victims.begin(), victims.end()), victims.end());
+  EXPECT_EQ(mgr.GetCachedBytes(), 0u);
+  EXPECT_TRUE(mgr.GetEvictionCandidates(1).empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllPolicies, CachePolicyTest,
+    ::testing::Combine(::testing::Values(CacheManager::PolicyType::kLRU,
+                                         CacheManager::PolicyType::kLFU,
+                                         CacheManager::PolicyType::kARC,
+                                         CacheManager::PolicyType::kTwoQ,
+                                         CacheManager::PolicyType::kS3FIFO,
+                                         CacheManager::PolicyType::kGDSF),
+                       ::testing::Values(size_t{1}, size_t{8})));
+
+TEST(CacheManagerTest, ShardedLRUEvictsGloballyOldestFirst) {
+  CacheManager mgr(CacheManager::PolicyType::kLRU, {}, 5);
+  EXPECT_EQ(mgr.ShardCount(), 8u);
+  for (BlockId id = 1; id <= 64; ++id)
+    mgr.OnBlockInsert(id, 10);
+  // Touch every odd block again: the even ones are now the oldest
+  for (BlockId id = 1; id <= 64; id += 2)
+    mgr.OnBlockAccess(id);
+
+  std::vector<BlockId> expected;
+  for (BlockId id = 2; id <= 64; id += 2)
+    expected.push_back(id);
+  for (BlockId id = 1; id <= 64; id += 2)
+    expected.push_back(id);
+  EXPECT_EQ(mgr.GetEvictionCandidates(640), expected);
+}
+
+TEST(CacheManagerTest, ShardedConcurrentAccessKeepsAccounting) {
+  CacheManager mgr(CacheManager::PolicyType::kLRU, {}, 4);
+  constexpr BlockId kBlocks = 256;
+  for (BlockId id = 1; id <= kBlocks; ++id)
+    mgr.OnBlockInsert(id, 4);
+
+  // Readers hammer a few hot blocks (forcing the read buffers) while a
+  // writer churns the cold ones
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t] {
+      for (int i = 0; !stop.load(); ++i)
+        mgr.OnBlockAccess(1 + (t + i) % 4);
+    });
+  }
+  for (int round = 0; round < 200; ++round) {
+    BlockId id = 100 + round % 100;
+    mgr.OnBlockRemove(id);
+    mgr.OnBlockInsert(id, 4);
+  }
+  stop = true;
+  for (auto &t : readers)
+    t.join();
+
+  EXPECT_EQ(mgr.GetCachedBlockCount(), kBlocks);
+  EXPECT_EQ(mgr.GetCachedBytes(), kBlocks * 4);
+  auto victims = mgr.GetEvictionCandidates(kBlocks * 4);
+  ASSERT_EQ(victims.size(), kBlocks);
+  std::sort(victims.begin(), victims.end());
+  EXPECT_EQ(std::unique(victims.begin(), victims.end()), victims.end());
+  EXPECT_EQ(mgr.GetCachedBytes(), 0u);
+}
+
+TEST(CacheManagerTest, ParsePolicyType) {
+  CacheManager::PolicyType type;
+  ASSERT_TRUE(CacheManager::ParsePolicyType("s3fifo", &type));
+  EXPECT_EQ(type, CacheManager::PolicyType::kS3FIFO);
+  ASSERT_TRUE(CacheManager::ParsePolicyType("2Q", &type));
+  EXPECT_EQ(type, CacheManager::PolicyType::kTwoQ);
+  ASSERT_TRUE(CacheManager::ParsePolicyType("gdsf", &type));
+  EXPECT_EQ(type, CacheManager::PolicyType::kGDSF);
+  EXPECT_FALSE(CacheManager::ParsePolicyType("mru", &type));
+}
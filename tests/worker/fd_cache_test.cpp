@@ -0,0 +1,93 @@
+#include "common/metrics.h"
+#include "worker/fd_cache.h"
+#include "worker/storage_tier.h"
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+using namespace anycache;
+
+class FdCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    test_dir_ = fs::temp_directory_path() / "anycache_fd_cache_test";
+    fs::remove_all(test_dir_);
+    fs::create_directories(test_dir_);
+  }
+  void TearDown() override { fs::remove_all(test_dir_); }
+
+  std::string MakeFile(const std::string &name) {
+    auto p = (test_dir_ / name).string();
+    std::ofstream(p) << name;
+    return p;
+  }
+
+  int64_t Opens() const {
+    return Metrics::Instance().GetCounter("storage_tier.fd_cache.opens");
+  }
+
+  fs::path test_dir_;
+};
+
+TEST_F(FdCacheTest, ReusesOpenDescriptor) {
+  FdCache cache(4, O_RDONLY);
+  auto path = MakeFile("a");
+
+  int64_t opens = Opens();
+  FdRef first, second;
+  ASSERT_TRUE(cache.Acquire(1, path, &first).ok());
+  ASSERT_TRUE(cache.Acquire(1, path, &second).ok());
+  EXPECT_EQ(first->fd(), second->fd());
+  EXPECT_EQ(Opens() - opens, 1);
+}
+
+TEST_F(FdCacheTest, EvictsLeastRecentlyUsed) {
+  FdCache cache(2, O_RDONLY);
+  FdRef ref;
+  ASSERT_TRUE(cache.Acquire(1, MakeFile("a"), &ref).ok());
+  ASSERT_TRUE(cache.Acquire(2, MakeFile("b"), &ref).ok());
+  ASSERT_TRUE(cache.Acquire(1, MakeFile("a"), &ref).ok()); // 2 becomes LRU
+  ASSERT_TRUE(cache.Acquire(3, MakeFile("c"), &ref).ok());
+  EXPECT_EQ(cache.Size(), 2u);
+
+  int64_t opens = Opens();
+  ASSERT_TRUE(cache.Acquire(1, MakeFile("a"), &ref).ok());
+  EXPECT_EQ(Opens(), opens); // still cached
+  ASSERT_TRUE(cache.Acquire(2, MakeFile("b"), &ref).ok());
+  EXPECT_EQ(Opens() - opens, 1); // was evicted, reopened
+}
+
+TEST_F(FdCacheTest, ErasedDescriptorStaysValidForHolder) {
+  FdCache cache(4, O_RDONLY);
+  FdRef ref;
+  ASSERT_TRUE(cache.Acquire(1, MakeFile("a"), &ref).ok());
+  cache.Erase(1);
+  EXPECT_EQ(cache.Size(), 0u);
+
+  char buf[1] = {};
+  EXPECT_EQ(::pread(ref->fd(), buf, 1, 0), 1);
+  EXPECT_EQ(buf[0], 'a');
+}
+
+TEST_F(FdCacheTest, DiskTierOpensBlockFileOnce) {
+  StorageTier tier(TierType::kSSD, test_dir_.string(), 1024 * 1024);
+  BlockHandle handle;
+  ASSERT_TRUE(tier.AllocateBlock(1, 4096, &handle).ok());
+
+  int64_t opens = Opens();
+  const char *data = "cached fd";
+  char buf[16] = {};
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(tier.WriteBlock(1, data, strlen(data), 0).ok());
+    ASSERT_TRUE(tier.ReadBlock(1, buf, strlen(data), 0).ok());
+  }
+  EXPECT_STREQ(buf, data);
+  EXPECT_EQ(Opens(), opens); // the fd from AllocateBlock is reused
+
+  ASSERT_TRUE(tier.RemoveBlock(1).ok());
+  EXPECT_FALSE(fs::exists(handle.path));
+}
@@ -0,0 +1,47 @@
+#include "worker/frequency_sketch.h"
+#include <gtest/gtest.h>
+
+using namespace anycache;
+
+TEST(FrequencySketchTest, FirstSightingOnlyReachesDoorkeeper) {
+  FrequencySketch sketch;
+  EXPECT_EQ(sketch.Frequency(42), 0u);
+  sketch.Increment(42);
+  EXPECT_EQ(sketch.Frequency(42), 1u);
+  sketch.Increment(42);
+  sketch.Increment(42);
+  EXPECT_EQ(sketch.Frequency(42), 3u);
+  EXPECT_EQ(sketch.Frequency(43), 0u);
+}
+
+TEST(FrequencySketchTest, CountersSaturate) {
+  FrequencySketch sketch;
+  for (int i = 0; i < 100; ++i)
+    sketch.Increment(7);
+  EXPECT_EQ(sketch.Frequency(7), FrequencySketch::kMaxCount + 1u);
+}
+
+TEST(FrequencySketchTest, AgingHalvesCounts) {
+  FrequencySketch sketch(64); // resets after 640 additions
+  for (int i = 0; i < 10; ++i)
+    sketch.Increment(1);
+  EXPECT_EQ(sketch.Frequency(1), 10u);
+  for (int i = 0; i < 629; ++i)
+    sketch.Increment(2);
+  EXPECT_EQ(sketch.Frequency(2), FrequencySketch::kMaxCount + 1u);
+
+  sketch.Increment(2); // 640th addition
+  EXPECT_EQ(sketch.Frequency(1), 4u); // 9 / 2, doorkeeper cleared
+  EXPECT_EQ(sketch.Frequency(2), 7u);
+}
+
+TEST(FrequencySketchTest, EnsureCapacityOnlyGrows) {
+  FrequencySketch sketch(100);
+  EXPECT_EQ(sketch.Width(), 128u);
+  sketch.Increment(5);
+  sketch.EnsureCapacity(50);
+  EXPECT_EQ(sketch.Frequency(5), 1u);
+  sketch.EnsureCapacity(1000);
+  EXPECT_EQ(sketch.Width(), 1024u);
+  EXPECT_EQ(sketch.Frequency(5), 0u);
+}
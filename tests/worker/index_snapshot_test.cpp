@@ -0,0 +1,83 @@
+#include "worker/index_snapshot.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace anycache;
+
+class IndexSnapshotTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    test_dir_ = fs::temp_directory_path() / "anycache_index_snapshot_test";
+    fs::remove_all(test_dir_);
+    fs::create_directories(test_dir_);
+    path_ = (test_dir_ / "index.snapshot").string();
+  }
+  void TearDown() override { fs::remove_all(test_dir_); }
+
+  static std::vector<IndexSnapshot::Record> MakeRecords(size_t n) {
+    std::vector<IndexSnapshot::Record> records(n);
+    for (size_t i = 0; i < n; ++i) {
+      records[i].block_id = MakeBlockId(7, i);
+      records[i].length = 4096 + i;
+      records[i].access_count = i * 3;
+      records[i].policy_weight = i % 5;
+      records[i].tier = static_cast<uint8_t>(TierType::kSSD);
+    }
+    return records;
+  }
+
+  fs::path test_dir_;
+  std::string path_;
+};
+
+TEST_F(IndexSnapshotTest, RoundTrip) {
+  auto records = MakeRecords(1000);
+  ASSERT_TRUE(IndexSnapshot::Write(path_, records, 12345).ok());
+  EXPECT_FALSE(fs::exists(path_ + ".tmp"));
+
+  IndexSnapshot snapshot;
+  ASSERT_TRUE(snapshot.Open(path_).ok());
+  EXPECT_EQ(snapshot.created_ms(), 12345);
+  ASSERT_EQ(snapshot.records().size(), records.size());
+  for (size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(snapshot.records()[i].block_id, records[i].block_id);
+    EXPECT_EQ(snapshot.records()[i].length, records[i].length);
+    EXPECT_EQ(snapshot.records()[i].policy_weight, records[i].policy_weight);
+  }
+}
+
+TEST_F(IndexSnapshotTest, EmptySnapshot) {
+  ASSERT_TRUE(IndexSnapshot::Write(path_, {}, 1).ok());
+  IndexSnapshot snapshot;
+  ASSERT_TRUE(snapshot.Open(path_).ok());
+  EXPECT_TRUE(snapshot.records().empty());
+}
+
+TEST_F(IndexSnapshotTest, MissingSnapshotIsNotFound) {
+  IndexSnapshot snapshot;
+  EXPECT_EQ(snapshot.Open(path_).code(), StatusCode::kNotFound);
+}
+
+TEST_F(IndexSnapshotTest, RejectsCorruptOrTruncatedFiles) {
+  auto records = MakeRecords(100);
+  ASSERT_TRUE(IndexSnapshot::Write(path_, records, 1).ok());
+  auto size = fs::file_size(path_);
+
+  {
+    // Flip one byte inside the last record
+    std::fstream f(path_, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(static_cast<std::streamoff>(size) - 20);
+    f.put('\x5a');
+  }
+  IndexSnapshot corrupt;
+  EXPECT_EQ(corrupt.Open(path_).code(), StatusCode::kIOError);
+
+  ASSERT_TRUE(IndexSnapshot::Write(path_, records, 1).ok());
+  fs::resize_file(path_, size - sizeof(IndexSnapshot::Record));
+  IndexSnapshot truncated;
+  EXPECT_EQ(truncated.Open(path_).code(), StatusCode::kIOError);
+}
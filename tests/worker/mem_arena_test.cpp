@@ -0,0 +1,118 @@
+#include "worker/mem_arena.h"
+#include "worker/storage_tier.h"
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+using namespace anycache;
+
+TEST(MemArenaTest, SizeClassRounding) {
+  EXPECT_EQ(MemArena::SizeClass(1), MemArena::kMinSlabSize);
+  EXPECT_EQ(MemArena::SizeClass(4096), 4096u);
+  EXPECT_EQ(MemArena::SizeClass(4097), 8192u);
+  // Four classes per power of two: 64 MB + 1 rounds to 80 MB
+  size_t mb = 1024 * 1024;
+  EXPECT_EQ(MemArena::SizeClass(64 * mb), 64 * mb);
+  EXPECT_EQ(MemArena::SizeClass(64 * mb + 1), 80 * mb);
+}
+
+TEST(MemArenaTest, RecyclesFreedSlabs) {
+  MemArena arena(1024 * 1024);
+
+  size_t slab = 0;
+  void *a = arena.Allocate(64 * 1024, &slab);
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(slab, 64u * 1024);
+  arena.Free(a, 64 * 1024, slab);
+
+  void *b = arena.Allocate(60 * 1024, &slab);
+  EXPECT_EQ(b, a); // same class -> same slab reused
+  auto stats = arena.GetStats();
+  EXPECT_EQ(stats.recycled_allocs, 1u);
+  EXPECT_EQ(stats.requested_bytes, 60u * 1024);
+  EXPECT_GT(stats.InternalFragmentation(), 0.0);
+  arena.Free(b, 60 * 1024, slab);
+
+  stats = arena.GetStats();
+  EXPECT_EQ(stats.allocated_bytes, 0u);
+  EXPECT_EQ(stats.free_slab_bytes, 64u * 1024);
+}
+
+TEST(MemArenaTest, HeapFallbackWhenRegionExhausted) {
+  MemArena arena(8192); // region: 8 KB + 25% headroom -> three slabs
+
+  std::vector<std::pair<void *, size_t>> slabs(4);
+  for (auto &[ptr, slab] : slabs) {
+    ptr = arena.Allocate(4096, &slab);
+    ASSERT_NE(ptr, nullptr);
+  }
+  EXPECT_EQ(arena.GetStats().heap_fallback_bytes, 4096u);
+
+  for (auto &[ptr, slab] : slabs) {
+    arena.Free(ptr, 4096, slab);
+  }
+  EXPECT_EQ(arena.GetStats().heap_fallback_bytes, 0u);
+  EXPECT_EQ(arena.GetStats().free_slab_bytes, 3u * 4096);
+}
+
+TEST(MemArenaTest, TierReadsRecycledSlabAsZero) {
+  StorageTier tier(TierType::kMemory, "", 1024 * 1024);
+
+  BlockHandle handle;
+  ASSERT_TRUE(tier.AllocateBlock(1, 4096, &handle).ok());
+  std::vector<char> junk(4096, 'x');
+  ASSERT_TRUE(tier.WriteBlock(1, junk.data(), junk.size(), 0).ok());
+  ASSERT_TRUE(tier.RemoveBlock(1).ok());
+
+  // Block 2 reuses block 1's slab but must not expose its stale bytes
+  ASSERT_TRUE(tier.AllocateBlock(2, 4096, &handle).ok());
+  ASSERT_TRUE(tier.WriteBlock(2, "ab", 2, 100).ok());
+
+  std::vector<char> buf(4096, 'y');
+  ASSERT_TRUE(tier.ReadBlock(2, buf.data(), buf.size(), 0).ok());
+  for (size_t i = 0; i < buf.size(); ++i) {
+    char expected = i == 100 ? 'a' : (i == 101 ? 'b' : '\0');
+    ASSERT_EQ(buf[i], expected) << "offset " << i;
+  }
+  EXPECT_EQ(tier.GetArenaStats().recycled_allocs, 1u);
+}
+
+TEST(MemArenaTest, HugePageRegionFallsBackGracefully) {
+  MemArena::Options opts;
+  opts.huge_pages = true;
+  opts.numa_node = 0;
+  MemArena arena(3 * 1024 * 1024, opts);
+
+  // Whatever the host offers, the region is 2 MB granular and usable
+  EXPECT_EQ(arena.GetStats().region_bytes % MemArena::kHugePageSize, 0u);
+  size_t slab = 0;
+  void *p = arena.Allocate(1024 * 1024, &slab);
+  ASSERT_NE(p, nullptr);
+  std::memset(p, 0xab, 1024 * 1024);
+  if (arena.GetPageMode() != MemArena::PageMode::kDefault) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % MemArena::kHugePageSize, 0u);
+  }
+  arena.Free(p, 1024 * 1024, slab);
+  EXPECT_EQ(arena.GetStats().heap_fallback_bytes, 0u);
+}
+
+TEST(MemArenaTest, NumaAwareTierSplitsCapacityPerNode) {
+  EXPECT_GE(MemArena::NumaNodeCount(), 1);
+  EXPECT_LT(MemArena::CurrentNumaNode(), MemArena::NumaNodeCount());
+
+  TierConfig tc;
+  tc.type = TierType::kMemory;
+  tc.capacity_bytes = 1024 * 1024;
+  tc.numa_aware = true;
+  StorageTier tier(tc);
+  EXPECT_EQ(tier.GetArenaCount(),
+            static_cast<size_t>(MemArena::NumaNodeCount()));
+
+  // Allocations are served from the arenas, not the heap
+  BlockHandle handle;
+  for (BlockId id = 1; id <= 4; ++id) {
+    ASSERT_TRUE(tier.AllocateBlock(id, 128 * 1024, &handle).ok());
+  }
+  EXPECT_EQ(tier.GetArenaStats().heap_fallback_bytes, 0u);
+  EXPECT_EQ(tier.GetArenaStats().requested_bytes, 4u * 128 * 1024);
+}
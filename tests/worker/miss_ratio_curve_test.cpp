@@ -0,0 +1,66 @@
+#include "worker/miss_ratio_curve.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+
+using namespace anycache;
+
+TEST(MissRatioCurveTest, LoopLargerThanCacheOnlyHitsBiggerSizes) {
+  // 150 blocks read in a loop: LRU misses every time unless all fit
+  MissRatioCurve mrc(100, 0.01);
+  EXPECT_EQ(mrc.sample_rate(), 1.0); // small capacity: simulated in full
+  for (int pass = 0; pass < 10; ++pass) {
+    for (BlockId id = 1; id <= 150; ++id)
+      mrc.Reference(id, 1);
+  }
+  auto curve = mrc.Curve();
+  ASSERT_EQ(curve.size(), 4u);
+  EXPECT_EQ(curve[0].capacity_bytes, 50u);
+  EXPECT_EQ(curve[3].capacity_bytes, 400u);
+  EXPECT_EQ(curve[0].references, 1500u);
+  EXPECT_EQ(curve[0].hit_ratio, 0.0);
+  EXPECT_EQ(curve[1].hit_ratio, 0.0);
+  EXPECT_DOUBLE_EQ(curve[2].hit_ratio, 0.9); // all but the first pass
+  EXPECT_DOUBLE_EQ(curve[3].hit_ratio, 0.9);
+}
+
+TEST(MissRatioCurveTest, UnknownSizeReusesTheKnownOne) {
+  MissRatioCurve mrc(4, 1.0, {1});
+  mrc.Reference(1, 3);
+  mrc.Reference(2, 1);
+  mrc.Reference(1, 0); // still 3 bytes: both fit, a hit
+  mrc.Reference(3, 0); // mean size 2: pushes out 2 and 1
+  mrc.Reference(2, 1);
+  auto curve = mrc.Curve();
+  ASSERT_EQ(curve.size(), 1u);
+  EXPECT_DOUBLE_EQ(curve[0].hit_ratio, 1.0 / 5);
+}
+
+TEST(MissRatioCurveTest, SampledEstimateTracksFullSimulation) {
+  // Big enough that the 10% sample is not raised
+  const size_t capacity = 12800 * kDefaultBlockSize;
+  MissRatioCurve full(capacity, 1.0);
+  MissRatioCurve sampled(capacity, 0.1);
+  EXPECT_DOUBLE_EQ(sampled.sample_rate(), 0.1);
+
+  std::mt19937_64 rng(3);
+  std::uniform_real_distribution<double> u(0, 1);
+  for (int i = 0; i < 300000; ++i) {
+    // Skewed popularity over 100k blocks
+    auto id = static_cast<BlockId>(1 + 100000 * std::pow(u(rng), 3));
+    full.Reference(id, kDefaultBlockSize);
+    sampled.Reference(id, kDefaultBlockSize);
+  }
+  auto exact = full.Curve();
+  auto estimate = sampled.Curve();
+  ASSERT_EQ(exact.size(), estimate.size());
+  EXPECT_LT(estimate[0].references, exact[0].references / 5);
+  for (size_t i = 0; i < exact.size(); ++i) {
+    EXPECT_NEAR(estimate[i].hit_ratio, exact[i].hit_ratio, 0.05)
+        << exact[i].multiple << "x";
+    if (i > 0) {
+      EXPECT_GE(exact[i].hit_ratio, exact[i - 1].hit_ratio);
+    }
+  }
+}
@@ -1,7 +1,11 @@
 #include "worker/page_store.h"
+#include "common/metrics.h"
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <thread>
 
 using namespace anycache;
 
@@ -75,5 +79,565 @@ TEST(PageStoreTest, Prefetch) {
       });
 
   store.PrefetchPages(1, 10, 5);
+  store.WaitForPrefetches();
   EXPECT_EQ(store.GetCachedPageCount(), 5u);
 }
+
+TEST(ConcurrentLRUCacheTest, ShardCountKeepsShardsUseful) {
+  ConcurrentLRUCache<PageKey, int> small(5, 16);
+  EXPECT_EQ(small.ShardCount(), 1u); // exact capacity for tiny caches
+  ConcurrentLRUCache<PageKey, int> big(1024, 6);
+  EXPECT_EQ(big.ShardCount(), 8u); // rounded up to a power of two
+
+  for (uint64_t i = 0; i < 4096; ++i)
+    big.Put(PageKey{1, i}, static_cast<int>(i));
+  EXPECT_LE(big.Size(), 1024u);
+  EXPECT_GT(big.Size(), 1024u - 8);
+  EXPECT_TRUE(big.Contains(PageKey{1, 4095}));
+  EXPECT_FALSE(big.Contains(PageKey{1, 0}));
+
+  auto evicted = big.EvictN(100);
+  EXPECT_EQ(evicted.size(), 100u);
+  big.Clear();
+  EXPECT_EQ(big.Size(), 0u);
+  EXPECT_TRUE(big.EvictN(1).empty());
+}
+
+TEST(ConcurrentLRUCacheTest, ClockGivesReferencedPagesASecondChance) {
+  ConcurrentLRUCache<PageKey, int> cache(16, 1, PageEvictionMode::kClock);
+  for (uint64_t i = 0; i < 16; ++i)
+    cache.Put(PageKey{1, i}, static_cast<int>(i));
+  int v = 0;
+  for (uint64_t i = 0; i < 8; ++i)
+    ASSERT_TRUE(cache.Get(PageKey{1, i}, &v));
+  for (uint64_t i = 16; i < 24; ++i)
+    cache.Put(PageKey{1, i}, static_cast<int>(i));
+
+  EXPECT_EQ(cache.Size(), 16u);
+  for (uint64_t i = 0; i < 8; ++i)
+    EXPECT_TRUE(cache.Contains(PageKey{1, i})) << i;
+  for (uint64_t i = 8; i < 16; ++i)
+    EXPECT_FALSE(cache.Contains(PageKey{1, i})) << i;
+
+  // Erased slots are reused
+  cache.Erase(PageKey{1, 0});
+  cache.Put(PageKey{2, 0}, 7);
+  ASSERT_TRUE(cache.Get(PageKey{2, 0}, &v));
+  EXPECT_EQ(v, 7);
+  EXPECT_EQ(cache.Size(), 16u);
+}
+
+TEST(ConcurrentLRUCacheTest, PeekDoesNotCountAsAUse) {
+  for (auto mode : {PageEvictionMode::kLRU, PageEvictionMode::kClock}) {
+    ConcurrentLRUCache<PageKey, int> cache(4, 1, mode);
+    for (uint64_t i = 0; i < 4; ++i)
+      cache.Put(PageKey{1, i}, static_cast<int>(i));
+    int v = -1;
+    ASSERT_TRUE(cache.Peek(PageKey{1, 0}, &v));
+    EXPECT_EQ(v, 0);
+    EXPECT_FALSE(cache.Peek(PageKey{1, 9}, &v));
+
+    cache.Put(PageKey{1, 4}, 4); // page 0 is still the oldest
+    EXPECT_FALSE(cache.Contains(PageKey{1, 0}));
+    EXPECT_TRUE(cache.Contains(PageKey{1, 1}));
+  }
+}
+
+TEST(ConcurrentLRUCacheTest, ConcurrentHitsAndMisses) {
+  for (auto mode : {PageEvictionMode::kLRU, PageEvictionMode::kClock}) {
+    ConcurrentLRUCache<PageKey, uint64_t> cache(256, 8, mode);
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&, t] {
+        for (uint64_t i = 0; i < 20000; ++i) {
+          PageKey key{static_cast<FileId>(t), (i * 7919) % 512};
+          uint64_t v;
+          if (cache.Get(key, &v)) {
+            if (v != key.page_index)
+              wrong++;
+          } else {
+            cache.Put(key, key.page_index);
+          }
+        }
+      });
+    }
+    for (auto &th : threads)
+      th.join();
+    EXPECT_EQ(wrong.load(), 0);
+    EXPECT_LE(cache.Size(), 256u);
+  }
+}
+
+TEST(PageFramePoolTest, RecyclesFramesAndFallsBackToHeap) {
+  PageFramePool pool(64, 2);
+  {
+    auto a = pool.Acquire(64);
+    auto b = pool.Acquire(10);
+    ASSERT_TRUE(a && b);
+    EXPECT_EQ(pool.GetStats().in_use, 2u);
+    auto c = pool.Acquire(64); // exhausted
+    auto big = pool.Acquire(128); // oversized
+    ASSERT_TRUE(c && big);
+    std::memset(big.data(), 'x', 128);
+    EXPECT_EQ(pool.GetStats().heap_fallbacks, 2u);
+  }
+  auto stats = pool.GetStats();
+  EXPECT_EQ(stats.frames, 2u);
+  EXPECT_EQ(stats.in_use, 0u);
+
+  // Moving a lease does not return the frame
+  auto a = pool.Acquire(64);
+  PageFramePool::Frame moved = std::move(a);
+  EXPECT_FALSE(a);
+  EXPECT_EQ(pool.GetStats().in_use, 1u);
+}
+
+TEST(PageStoreTest, EvictedPagesReturnTheirFrames) {
+  PageStore store(64, 8);
+  store.SetPageFetcher(
+      [](FileId, uint64_t page_index, void *buf, size_t *bytes_read) -> Status {
+        std::string data = "p" + std::to_string(page_index);
+        std::memcpy(buf, data.data(), data.size());
+        *bytes_read = data.size();
+        return Status::OK();
+      });
+  EXPECT_EQ(store.GetFrameStats().frames, 8u + 16 + PageStore::kSpareFrames);
+
+  char buf[64];
+  size_t n = 0;
+  for (uint64_t i = 0; i < 1000; ++i)
+    ASSERT_TRUE(store.ReadPage(1, i, buf, &n).ok());
+  EXPECT_EQ(std::string(buf, n), "p999");
+  auto stats = store.GetFrameStats();
+  EXPECT_EQ(stats.in_use, 8u); // one per cached page, the rest recycled
+  EXPECT_EQ(stats.heap_fallbacks, 0u);
+
+  store.InvalidateFile(1);
+  EXPECT_EQ(store.GetFrameStats().in_use, 0u);
+
+  // Writes larger than a page still work, from the heap
+  std::string big(100, 'w');
+  ASSERT_TRUE(store.WritePage(2, 0, big.data(), big.size()).ok());
+  char big_buf[100];
+  ASSERT_TRUE(store.ReadPage(2, 0, big_buf, &n).ok());
+  EXPECT_EQ(std::string(big_buf, n), big);
+  EXPECT_EQ(store.GetFrameStats().heap_fallbacks, 1u);
+}
+
+namespace {
+int64_t CoalescedMisses() {
+  return Metrics::Instance().GetCounter("page_store.coalesced_misses");
+}
+
+// Holds the fetch until `waiters` more threads have joined it
+bool WaitForJoiners(int64_t base, int64_t waiters) {
+  for (int i = 0; i < 5000 && CoalescedMisses() - base < waiters; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  return CoalescedMisses() - base >= waiters;
+}
+} // namespace
+
+TEST(PageStoreTest, ConcurrentMissesShareOneFetch) {
+  constexpr int kReaders = 8;
+  PageStore store(64, 100);
+  std::atomic<int> fetches{0};
+  int64_t base = CoalescedMisses();
+  store.SetPageFetcher([&](FileId, uint64_t page_index, void *buf,
+                           size_t *bytes_read) -> Status {
+    fetches++;
+    WaitForJoiners(base, kReaders - 1);
+    std::string data = "p" + std::to_string(page_index);
+    std::memcpy(buf, data.data(), data.size());
+    *bytes_read = data.size();
+    return Status::OK();
+  });
+
+  std::vector<std::thread> threads;
+  std::atomic<int> ok{0};
+  for (int t = 0; t < kReaders; ++t) {
+    threads.emplace_back([&] {
+      char buf[64];
+      size_t n = 0;
+      if (store.ReadPage(3, 7, buf, &n).ok() && std::string(buf, n) == "p7")
+        ok++;
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+  EXPECT_EQ(fetches.load(), 1);
+  EXPECT_EQ(ok.load(), kReaders);
+  EXPECT_EQ(store.GetCachedPageCount(), 1u);
+}
+
+TEST(PageStoreTest, CoalescedMissesAllSeeTheFetchError) {
+  constexpr int kReaders = 4;
+  PageStore store(64, 100);
+  std::atomic<int> fetches{0};
+  std::atomic<bool> fail{true};
+  int64_t base = CoalescedMisses();
+  store.SetPageFetcher(
+      [&](FileId, uint64_t, void *buf, size_t *bytes_read) -> Status {
+        fetches++;
+        if (fail) {
+          WaitForJoiners(base, kReaders - 1);
+          return Status::IOError("ufs down");
+        }
+        std::memcpy(buf, "ok", 2);
+        *bytes_read = 2;
+        return Status::OK();
+      });
+
+  std::vector<std::thread> threads;
+  std::atomic<int> io_errors{0};
+  for (int t = 0; t < kReaders; ++t) {
+    threads.emplace_back([&] {
+      char buf[64];
+      size_t n = 0;
+      if (store.ReadPage(1, 0, buf, &n).code() == StatusCode::kIOError)
+        io_errors++;
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+  EXPECT_EQ(fetches.load(), 1);
+  EXPECT_EQ(io_errors.load(), kReaders);
+  EXPECT_EQ(store.GetCachedPageCount(), 0u);
+
+  // A failed fetch is not remembered
+  fail = false;
+  char buf[64];
+  size_t n = 0;
+  ASSERT_TRUE(store.ReadPage(1, 0, buf, &n).ok());
+  EXPECT_EQ(fetches.load(), 2);
+}
+
+TEST(ConcurrentLRUCacheTest, LowPriorityEntriesAreEvictedFirstUnlessRead) {
+  for (auto mode : {PageEvictionMode::kLRU, PageEvictionMode::kClock}) {
+    ConcurrentLRUCache<PageKey, int> cache(16, 1, mode);
+    for (uint64_t i = 0; i < 12; ++i)
+      cache.Put(PageKey{1, i}, 0);
+    for (uint64_t i = 100; i < 104; ++i)
+      cache.Put(PageKey{1, i}, 0, /*low_priority=*/true);
+    int v;
+    ASSERT_TRUE(cache.Get(PageKey{1, 101}, &v)); // read: now ordinary
+
+    for (uint64_t i = 12; i < 15; ++i)
+      cache.Put(PageKey{1, i}, 0);
+    EXPECT_FALSE(cache.Contains(PageKey{1, 100}));
+    EXPECT_TRUE(cache.Contains(PageKey{1, 101}));
+    EXPECT_FALSE(cache.Contains(PageKey{1, 102}));
+    EXPECT_FALSE(cache.Contains(PageKey{1, 103}));
+    for (uint64_t i = 0; i < 15; ++i)
+      EXPECT_TRUE(cache.Contains(PageKey{1, i})) << i;
+
+    // Then the usual order resumes
+    cache.Put(PageKey{1, 15}, 0);
+    EXPECT_FALSE(cache.Contains(PageKey{1, 0}));
+    EXPECT_EQ(cache.Size(), 16u);
+  }
+}
+
+namespace {
+int64_t Counter(const char *name) {
+  return Metrics::Instance().GetCounter(std::string("page_store.") + name);
+}
+
+// A fetcher that blocks until released
+struct GatedFetcher {
+  std::atomic<bool> open{false};
+  std::atomic<int> started{0};
+
+  PageStore::PageFetcher Fn() {
+    return [this](FileId, uint64_t page_index, void *buf,
+                  size_t *bytes_read) -> Status {
+      started++;
+      while (!open)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      std::string data = "p" + std::to_string(page_index);
+      std::memcpy(buf, data.data(), data.size());
+      *bytes_read = data.size();
+      return Status::OK();
+    };
+  }
+};
+} // namespace
+
+TEST(PageStoreTest, PrefetchRunsInTheBackground) {
+  PageStore::Options opts;
+  opts.page_size = 64;
+  opts.max_pages = 16;
+  opts.prefetch_threads = 1;
+  PageStore store(opts);
+  GatedFetcher gate;
+  store.SetPageFetcher(gate.Fn());
+  int64_t useful = Counter("prefetch.useful");
+  int64_t wasted = Counter("prefetch.wasted");
+
+  store.PrefetchPages(1, 0, 4); // returns while the fetcher is blocked
+  EXPECT_EQ(store.GetCachedPageCount(), 0u);
+  gate.open = true;
+  store.WaitForPrefetches();
+  EXPECT_EQ(store.GetCachedPageCount(), 4u);
+  EXPECT_EQ(gate.started.load(), 4);
+
+  char buf[64];
+  size_t n = 0;
+  ASSERT_TRUE(store.ReadPage(1, 0, buf, &n).ok());
+  ASSERT_TRUE(store.ReadPage(1, 1, buf, &n).ok());
+  ASSERT_TRUE(store.ReadPage(1, 1, buf, &n).ok());
+  EXPECT_EQ(std::string(buf, n), "p1");
+  EXPECT_EQ(gate.started.load(), 4); // all hits
+  EXPECT_EQ(Counter("prefetch.useful") - useful, 2);
+
+  store.InvalidateFile(1); // pages 2 and 3 were never read
+  EXPECT_EQ(Counter("prefetch.wasted") - wasted, 2);
+}
+
+TEST(PageStoreTest, PrefetchQueueDedupsBoundsAndCancels) {
+  PageStore::Options opts;
+  opts.page_size = 64;
+  opts.max_pages = 16;
+  opts.prefetch_threads = 1;
+  opts.prefetch_queue_limit = 2;
+  PageStore store(opts);
+  GatedFetcher gate;
+  store.SetPageFetcher(gate.Fn());
+  int64_t skipped = Counter("prefetch.skipped");
+  int64_t dropped = Counter("prefetch.dropped");
+  int64_t cancelled = Counter("prefetch.cancelled");
+
+  store.PrefetchPages(1, 0, 1);
+  for (int i = 0; i < 5000 && gate.started == 0; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_EQ(gate.started.load(), 1); // page 0 in flight
+
+  store.PrefetchPages(1, 0, 4); // 0 in flight, 1-2 queued, 3 over the limit
+  store.PrefetchPages(1, 1, 1); // already queued
+  EXPECT_EQ(Counter("prefetch.skipped") - skipped, 2);
+  EXPECT_EQ(Counter("prefetch.dropped") - dropped, 1);
+
+  store.InvalidateFile(1);
+  EXPECT_EQ(Counter("prefetch.cancelled") - cancelled, 2);
+  gate.open = true;
+  store.WaitForPrefetches();
+  EXPECT_EQ(gate.started.load(), 1);
+  EXPECT_EQ(store.GetCachedPageCount(), 0u); // the in-flight page is dropped
+}
+
+TEST(PageStoreTest, DemandReadJoiningAPrefetchKeepsThePage) {
+  for (auto mode : {PageEvictionMode::kLRU, PageEvictionMode::kClock}) {
+    PageStore::Options opts;
+    opts.page_size = 64;
+    opts.max_pages = 16;
+    opts.shards = 1;
+    opts.mode = mode;
+    opts.prefetch_threads = 1;
+    opts.readahead_max_pages = 0;
+    PageStore store(opts);
+    GatedFetcher gate;
+    gate.open = true;
+    store.SetPageFetcher(gate.Fn());
+    char buf[64];
+    size_t n = 0;
+    for (uint64_t i = 0; i < 15; ++i)
+      ASSERT_TRUE(store.ReadPage(2, i, buf, &n).ok());
+
+    // A demand read joins the prefetch of page 0 while it is in flight
+    gate.open = false;
+    int started = gate.started.load();
+    store.PrefetchPages(1, 0, 1);
+    for (int i = 0; i < 5000 && gate.started == started; ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ASSERT_EQ(gate.started.load(), started + 1);
+    int64_t base = CoalescedMisses();
+    std::thread reader([&] {
+      char rbuf[64];
+      size_t rn = 0;
+      EXPECT_TRUE(store.ReadPage(1, 0, rbuf, &rn).ok());
+    });
+    EXPECT_TRUE(WaitForJoiners(base, 1));
+    gate.open = true;
+    reader.join();
+    store.WaitForPrefetches();
+
+    // It was read, so eviction pressure takes other pages first
+    for (uint64_t i = 15; i < 17; ++i)
+      ASSERT_TRUE(store.ReadPage(2, i, buf, &n).ok());
+    started = gate.started.load();
+    ASSERT_TRUE(store.ReadPage(1, 0, buf, &n).ok());
+    EXPECT_EQ(std::string(buf, n), "p0");
+    EXPECT_EQ(gate.started.load(), started) << "page was evicted";
+  }
+}
+
+TEST(PageStoreTest, PrefetchPoppedBeforeAnInvalidationIsNotCached) {
+  // The executor pops a key before registering its fetch; an invalidation
+  // in between must still keep the page out of the cache
+  constexpr int kRounds = 2000;
+  PageStore::Options opts;
+  opts.page_size = 64;
+  opts.max_pages = 16;
+  opts.prefetch_threads = 1;
+  PageStore store(opts);
+  std::atomic<int> fetches{0};
+  store.SetPageFetcher(
+      [&](FileId, uint64_t, void *buf, size_t *bytes_read) -> Status {
+        fetches++;
+        std::memcpy(buf, "p0", 2);
+        *bytes_read = 2;
+        return Status::OK();
+      });
+
+  int stale = 0;
+  for (int round = 0; round < kRounds; ++round) {
+    store.PrefetchPages(1, 0, 1);
+    for (int spin = 0; spin < round % 64; ++spin)
+      std::this_thread::yield();
+    store.InvalidateFile(1);
+    store.WaitForPrefetches();
+    if (store.GetCachedPageCount() != 0) {
+      stale++;
+      store.InvalidateFile(1);
+    }
+  }
+  EXPECT_EQ(stale, 0);
+  EXPECT_GT(fetches.load(), 0);
+}
+
+TEST(PageStoreTest, PrefetchLeaderFindingThePageCachedSharesIt) {
+  // A prefetch that checked the cache just before a demand miss cached the
+  // page leads a fetch that finds it resident; readers that joined that
+  // fetch must still get the page
+  constexpr int kRounds = 1000;
+  constexpr int kThreads = 8; // half demand readers, half prefetchers
+  PageStore::Options opts;
+  opts.page_size = 64;
+  opts.max_pages = 16;
+  opts.prefetch_threads = 0; // prefetch on the caller's thread
+  PageStore store(opts);
+  store.SetPageFetcher(
+      [](FileId, uint64_t, void *buf, size_t *bytes_read) -> Status {
+        std::memcpy(buf, "p0", 2);
+        *bytes_read = 2;
+        return Status::OK();
+      });
+
+  std::atomic<int> bad{0};
+  for (int round = 0; round < kRounds; ++round) {
+    store.InvalidateFile(1);
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t] {
+        ready++;
+        while (ready.load() < kThreads)
+          std::this_thread::yield();
+        for (int i = 0; i < 4; ++i) {
+          if (t % 2 == 1) {
+            store.PrefetchPages(1, 0, 1);
+            continue;
+          }
+          char buf[64];
+          size_t n = 0;
+          if (!store.ReadPage(1, 0, buf, &n).ok() ||
+              std::string(buf, n) != "p0")
+            bad++;
+        }
+      });
+    }
+    for (auto &th : threads)
+      th.join();
+  }
+  EXPECT_EQ(bad.load(), 0);
+  EXPECT_EQ(store.GetCachedPageCount(), 1u);
+}
+
+namespace {
+PageStore::Options ReadAheadOptions() {
+  PageStore::Options opts;
+  opts.page_size = 64;
+  opts.max_pages = 1024;
+  opts.prefetch_threads = 1;
+  opts.prefetch_queue_limit = 1024;
+  return opts;
+}
+
+PageStore::PageFetcher CountingFetcher(std::atomic<int> *fetches) {
+  return [fetches](FileId, uint64_t page_index, void *buf,
+                   size_t *bytes_read) -> Status {
+    (*fetches)++;
+    std::string data = "p" + std::to_string(page_index);
+    std::memcpy(buf, data.data(), data.size());
+    *bytes_read = data.size();
+    return Status::OK();
+  };
+}
+} // namespace
+
+TEST(PageStoreTest, SequentialReadsTriggerGrowingReadAhead) {
+  PageStore store(ReadAheadOptions());
+  std::atomic<int> fetches{0};
+  store.SetPageFetcher(CountingFetcher(&fetches));
+  int64_t misses = Counter("cache_misses");
+  int64_t triggers = Counter("readahead.triggers");
+
+  char buf[64];
+  size_t n = 0;
+  for (uint64_t i = 0; i < 200; ++i) {
+    ASSERT_TRUE(store.ReadPage(7, i, buf, &n).ok());
+    ASSERT_EQ(std::string(buf, n), "p" + std::to_string(i));
+    store.WaitForPrefetches();
+  }
+  // Only the two reads that establish the run miss. Windows of 4, 8, 16
+  // and 32 pages, then one of 64 every 32 pages, keep ahead of the reader.
+  EXPECT_EQ(Counter("cache_misses") - misses, 2);
+  EXPECT_EQ(Counter("readahead.triggers") - triggers, 9);
+  EXPECT_LE(fetches.load(), 200 + 64);
+}
+
+TEST(PageStoreTest, RandomReadsShrinkTheReadAheadWindow) {
+  PageStore store(ReadAheadOptions());
+  std::atomic<int> fetches{0};
+  store.SetPageFetcher(CountingFetcher(&fetches));
+  char buf[64];
+  size_t n = 0;
+  auto read = [&](uint64_t page) {
+    ASSERT_TRUE(store.ReadPage(7, page, buf, &n).ok());
+    store.WaitForPrefetches();
+  };
+  for (uint64_t i = 0; i <= 40; ++i)
+    read(i); // the window reaches 64 pages
+
+  int64_t pages = Counter("readahead.pages");
+  read(1000); // random: halved to 32
+  EXPECT_EQ(Counter("readahead.pages"), pages);
+  read(1001);
+  EXPECT_EQ(Counter("readahead.pages") - pages, 32);
+
+  for (uint64_t page : {5000, 9000, 13000, 17000})
+    read(page); // 16, 8, 4, then below the initial window: reset
+  pages = Counter("readahead.pages");
+  read(17001);
+  EXPECT_EQ(Counter("readahead.pages") - pages, 4);
+
+  // Invalidation forgets the stream
+  store.InvalidateFile(7);
+  pages = Counter("readahead.pages");
+  read(17002);
+  EXPECT_EQ(Counter("readahead.pages"), pages);
+}
+
+TEST(PageStoreTest, NoReadAheadForTinyCaches) {
+  PageStore::Options opts = ReadAheadOptions();
+  opts.max_pages = 8; // a quarter is below the initial window
+  PageStore store(opts);
+  std::atomic<int> fetches{0};
+  store.SetPageFetcher(CountingFetcher(&fetches));
+  char buf[64];
+  size_t n = 0;
+  for (uint64_t i = 0; i < 20; ++i)
+    ASSERT_TRUE(store.ReadPage(1, i, buf, &n).ok());
+  store.WaitForPrefetches();
+  EXPECT_EQ(fetches.load(), 20);
+}
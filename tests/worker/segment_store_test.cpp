@@ -0,0 +1,152 @@
+#include "worker/segment_store.h"
+#include "worker/storage_tier.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+using namespace anycache;
+
+class SegmentStoreTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    test_dir_ = fs::temp_directory_path() / "anycache_segment_store_test";
+    fs::remove_all(test_dir_);
+    fs::create_directories(test_dir_);
+  }
+  void TearDown() override { fs::remove_all(test_dir_); }
+
+  SegmentStore::Options MakeOptions() const {
+    SegmentStore::Options opts;
+    opts.dir = test_dir_.string();
+    opts.segment_bytes = 64 * 1024;
+    return opts;
+  }
+
+  fs::path test_dir_;
+};
+
+TEST_F(SegmentStoreTest, RecoversOnlyCommittedLiveRecords) {
+  SegmentStore::Location a, b, c, pending;
+  {
+    SegmentStore store(MakeOptions());
+    std::vector<SegmentStore::Record> live;
+    ASSERT_TRUE(store.Open(&live).ok());
+    EXPECT_TRUE(live.empty());
+
+    ASSERT_TRUE(store.Allocate(1, 1000, &a).ok());
+    ASSERT_TRUE(store.Allocate(2, 30000, &b).ok());
+    ASSERT_TRUE(store.Allocate(3, 50000, &c).ok()); // spills to segment 1
+    EXPECT_NE(c.segment_id, a.segment_id);
+    ASSERT_TRUE(store.Free(2, 30000, b).ok());
+    // A compaction copy that never committed
+    ASSERT_TRUE(store.Allocate(1, 1000, &pending, a.segment_id, false).ok());
+  }
+
+  SegmentStore store(MakeOptions());
+  std::vector<SegmentStore::Record> live;
+  ASSERT_TRUE(store.Open(&live).ok());
+  ASSERT_EQ(live.size(), 2u);
+  std::sort(live.begin(), live.end(),
+            [](auto &x, auto &y) { return x.block_id < y.block_id; });
+  EXPECT_EQ(live[0].block_id, 1u);
+  EXPECT_EQ(live[0].length, 1000u);
+  EXPECT_EQ(live[0].loc.data_offset, a.data_offset);
+  EXPECT_EQ(live[1].block_id, 3u);
+  EXPECT_EQ(live[1].loc.segment_id, c.segment_id);
+}
+
+class SegmentTierTest : public ::testing::TestWithParam<bool> {
+protected:
+  void SetUp() override {
+    test_dir_ = fs::temp_directory_path() / "anycache_segment_tier_test";
+    fs::remove_all(test_dir_);
+    Open();
+  }
+  void TearDown() override {
+    tier_.reset();
+    fs::remove_all(test_dir_);
+  }
+
+  void Open() {
+    tier_.reset();
+    TierConfig tc;
+    tc.type = TierType::kSSD;
+    tc.path = test_dir_.string();
+    tc.capacity_bytes = 16 * 1024 * 1024;
+    tc.disk_layout = DiskLayout::kSegment;
+    tc.segment_bytes = 64 * 1024;
+    tc.compact_dead_ratio = 0.3;
+    tc.direct_io = GetParam();
+    tier_ = std::make_unique<StorageTier>(tc);
+  }
+
+  static std::vector<char> Pattern(BlockId id, size_t size) {
+    std::vector<char> data(size);
+    for (size_t i = 0; i < size; ++i)
+      data[i] = static_cast<char>(id * 31 + i % 251);
+    return data;
+  }
+
+  void ExpectBlock(BlockId id, size_t size) {
+    std::vector<char> back(size);
+    ASSERT_TRUE(tier_->ReadBlock(id, back.data(), size, 0).ok())
+        << "block " << id;
+    EXPECT_EQ(back, Pattern(id, size)) << "block " << id;
+  }
+
+  fs::path test_dir_;
+  std::unique_ptr<StorageTier> tier_;
+};
+
+TEST_P(SegmentTierTest, CompactionRelocatesLiveBlocks) {
+  if (GetParam() && !tier_->IsDirectIo())
+    GTEST_SKIP() << "filesystem does not support O_DIRECT";
+  ASSERT_EQ(tier_->GetDiskLayout(), DiskLayout::kSegment);
+
+  constexpr size_t kBlocks = 24, kSize = 10000;
+  for (BlockId id = 1; id <= kBlocks; ++id) {
+    BlockHandle h;
+    ASSERT_TRUE(tier_->AllocateBlock(id, kSize, &h).ok());
+    auto data = Pattern(id, kSize);
+    ASSERT_TRUE(tier_->WriteBlock(id, data.data(), kSize, 0).ok());
+  }
+  // Unaligned write inside a record must not spill into its neighbour
+  auto patch = Pattern(3, kSize);
+  ASSERT_TRUE(tier_->WriteBlock(3, patch.data() + 123, 77, 123).ok());
+  char dummy[16];
+  EXPECT_FALSE(tier_->WriteBlock(3, dummy, sizeof(dummy), kSize - 8).ok());
+  EXPECT_GT(tier_->GetSegmentInfo().size(), 1u);
+
+  for (BlockId id = 2; id <= kBlocks; id += 2)
+    ASSERT_TRUE(tier_->RemoveBlock(id).ok());
+
+  size_t total = 0, relocated = 0;
+  do {
+    ASSERT_TRUE(tier_->CompactSegments(&relocated).ok());
+    total += relocated;
+  } while (relocated > 0);
+  EXPECT_GT(total, 0u);
+  for (auto &info : tier_->GetSegmentInfo()) {
+    if (!info.active) {
+      EXPECT_LT(info.DeadRatio(), 0.3) << "segment " << info.id;
+    }
+  }
+
+  for (BlockId id = 1; id <= kBlocks; id += 2)
+    ExpectBlock(id, kSize);
+  EXPECT_FALSE(tier_->HasBlock(2));
+
+  // The index is rebuilt from record headers on restart
+  Open();
+  EXPECT_EQ(tier_->GetBlockIds().size(), kBlocks / 2);
+  EXPECT_EQ(tier_->GetUsedBytes(), kBlocks / 2 * kSize);
+  for (BlockId id = 1; id <= kBlocks; id += 2)
+    ExpectBlock(id, kSize);
+  EXPECT_FALSE(tier_->HasBlock(2));
+}
+
+INSTANTIATE_TEST_SUITE_P(Modes, SegmentTierTest, ::testing::Bool(),
+                         [](const auto &info) {
+                           return info.param ? "Direct" : "Buffered";
+                         });
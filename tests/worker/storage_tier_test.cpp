@@ -1,8 +1,10 @@
 #include "worker/storage_tier.h"
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <cstring>
 #include <filesystem>
+#include <thread>
 
 namespace fs = std::filesystem;
 using namespace anycache;
@@ -32,6 +34,21 @@ TEST_F(StorageTierTest, MemoryTierAllocateWriteRead) {
   EXPECT_STREQ(buf, data);
 }
 
+TEST_F(StorageTierTest, MemoryTierReadPastTheEndReadsNothing) {
+  StorageTier tier(TierType::kMemory, "", 1024 * 1024);
+  BlockHandle h;
+  ASSERT_TRUE(tier.AllocateBlock(1, 4000, &h).ok());
+  std::vector<char> data(4000, 'a');
+  ASSERT_TRUE(tier.WriteBlock(1, data.data(), data.size(), 0).ok());
+
+  std::vector<char> back(100, 'z');
+  ASSERT_TRUE(tier.ReadBlock(1, back.data(), back.size(), 5000).ok());
+  EXPECT_EQ(back, std::vector<char>(100, 'z'));
+  ASSERT_TRUE(tier.ReadBlock(1, back.data(), back.size(), 3950).ok());
+  EXPECT_EQ(std::string(back.data(), 50), std::string(50, 'a'));
+  EXPECT_EQ(std::string(back.data() + 50, 50), std::string(50, 'z'));
+}
+
 TEST_F(StorageTierTest, MemoryTierCapacityExhausted) {
   StorageTier tier(TierType::kMemory, "", 1024);
 
@@ -81,3 +98,123 @@ TEST_F(StorageTierTest, ExportImportBlock) {
   ASSERT_TRUE(tier.ExportBlock(1, &exported).ok());
   EXPECT_GE(exported.size(), strlen(data));
 }
+
+TEST_F(StorageTierTest, MigrateAcrossTiersAndLayouts) {
+  // Spans several migration chunks with a partial tail
+  constexpr size_t kSize = 2 * 1024 * 1024 + 5000;
+  auto make_disk = [&](const char *name, DiskLayout layout, bool direct) {
+    TierConfig tc;
+    tc.type = TierType::kSSD;
+    tc.path = (test_dir_ / name).string();
+    tc.capacity_bytes = 16 * 1024 * 1024;
+    tc.disk_layout = layout;
+    tc.segment_bytes = 4 * 1024 * 1024;
+    tc.direct_io = direct;
+    return std::make_unique<StorageTier>(tc);
+  };
+  auto mem = std::make_unique<StorageTier>(TierType::kMemory, "",
+                                           8 * 1024 * 1024);
+  auto files = make_disk("files", DiskLayout::kFilePerBlock, false);
+  auto segments = make_disk("segments", DiskLayout::kSegment, false);
+  auto direct = make_disk("direct", DiskLayout::kFilePerBlock, true);
+  auto mem2 = std::make_unique<StorageTier>(TierType::kMemory, "",
+                                            8 * 1024 * 1024);
+
+  // Only a prefix is written: the rest must migrate as zeros
+  std::vector<char> expected(kSize, 0);
+  for (size_t i = 0; i < kSize - 100000; ++i)
+    expected[i] = static_cast<char>(i % 253);
+  BlockHandle h;
+  ASSERT_TRUE(mem->AllocateBlock(7, kSize, &h).ok());
+  ASSERT_TRUE(mem->WriteBlock(7, expected.data(), kSize - 100000, 0).ok());
+
+  std::vector<StorageTier *> chain{mem.get(), files.get(), segments.get(),
+                                   direct.get(), mem2.get()};
+  for (size_t i = 0; i + 1 < chain.size(); ++i) {
+    ASSERT_TRUE(chain[i]->MigrateBlockTo(7, chain[i + 1]).ok())
+        << "hop " << i;
+    // The source is untouched until the caller removes it
+    EXPECT_TRUE(chain[i]->HasBlock(7));
+    ASSERT_TRUE(chain[i]->RemoveBlock(7).ok());
+
+    std::vector<char> back(kSize, 'z');
+    ASSERT_TRUE(chain[i + 1]->ReadBlock(7, back.data(), kSize, 0).ok());
+    EXPECT_EQ(back, expected) << "hop " << i;
+  }
+
+  // A target without room rejects the block and keeps nothing
+  StorageTier small(TierType::kMemory, "", 1024 * 1024);
+  EXPECT_EQ(mem2->MigrateBlockTo(7, &small).code(),
+            StatusCode::kResourceExhausted);
+  EXPECT_FALSE(small.HasBlock(7));
+  EXPECT_EQ(small.GetUsedBytes(), 0u);
+}
+
+TEST_F(StorageTierTest, DirectReadPastTheEndReadsNothing) {
+  TierConfig tc;
+  tc.type = TierType::kSSD;
+  tc.path = (test_dir_ / "direct").string();
+  tc.capacity_bytes = 1024 * 1024;
+  tc.direct_io = true;
+  StorageTier tier(tc);
+  // The file is padded to 4096 bytes
+  BlockHandle h;
+  ASSERT_TRUE(tier.AllocateBlock(1, 4000, &h).ok());
+  std::vector<char> data(4000, 'a');
+  ASSERT_TRUE(tier.WriteBlock(1, data.data(), data.size(), 0).ok());
+
+  // Unaligned, so served through a bounce buffer
+  std::vector<char> back(100, 'z');
+  ASSERT_TRUE(tier.ReadBlock(1, back.data(), back.size(), 4050).ok());
+  EXPECT_EQ(back, std::vector<char>(100, 'z'));
+  ASSERT_TRUE(tier.ReadBlock(1, back.data(), back.size(), 3950).ok());
+  EXPECT_EQ(std::string(back.data(), 50), std::string(50, 'a'));
+  EXPECT_EQ(std::string(back.data() + 50, 50), std::string(50, 'z'));
+}
+
+TEST_F(StorageTierTest, ConcurrentReadRemoveRecreate) {
+  // Readers run lock-free against blocks that are concurrently removed and
+  // re-created; a read must see either NotFound or a fully valid block
+  for (TierType type : {TierType::kMemory, TierType::kSSD}) {
+    StorageTier tier(type, (test_dir_ / "concurrent").string(),
+                     4 * 1024 * 1024);
+    constexpr BlockId kBlocks = 8;
+    constexpr size_t kSize = 16 * 1024;
+    std::vector<char> fill(kSize, 'z');
+    BlockHandle h;
+    for (BlockId id = 1; id <= kBlocks; ++id) {
+      ASSERT_TRUE(tier.AllocateBlock(id, kSize, &h).ok());
+      ASSERT_TRUE(tier.WriteBlock(id, fill.data(), kSize, 0).ok());
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> corrupt{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+      readers.emplace_back([&, t] {
+        std::vector<char> buf(kSize);
+        for (BlockId id = 1 + t; !stop.load(); id = id % kBlocks + 1) {
+          if (!tier.ReadBlock(id, buf.data(), kSize, 0).ok())
+            continue;
+          for (char c : buf) {
+            if (c != 'z' && c != '\0') {
+              corrupt++;
+              break;
+            }
+          }
+        }
+      });
+    }
+    for (int round = 0; round < 200; ++round) {
+      BlockId id = round % kBlocks + 1;
+      ASSERT_TRUE(tier.RemoveBlock(id).ok());
+      ASSERT_TRUE(tier.AllocateBlock(id, kSize, &h).ok());
+      ASSERT_TRUE(tier.WriteBlock(id, fill.data(), kSize, 0).ok());
+    }
+    stop = true;
+    for (auto &th : readers)
+      th.join();
+    EXPECT_EQ(corrupt.load(), 0) << TierTypeName(type);
+    EXPECT_EQ(tier.GetUsedBytes(), kBlocks * kSize);
+  }
+}
@@ -102,6 +102,21 @@ TEST_F(WorkerServiceImplTest, RemoveBlock) {
   ASSERT_NE(read_resp.status().code(), proto::OK);
 }
 
+TEST_F(WorkerServiceImplTest, ReadThroughRequiresBlockLength) {
+  Config config = Config::Default();
+  WorkerServiceImpl service(block_store_.get(), page_store_.get(), &config,
+                            nullptr, kInvalidWorkerId);
+  proto::ReadBlockRequest req;
+  req.set_block_id(MakeBlockId(5, 0));
+  req.set_length(16);
+  req.set_ufs_path("file://" + (test_dir_ / "data").string());
+  proto::ReadBlockResponse resp;
+
+  ASSERT_TRUE(service.ReadBlock(nullptr, &req, &resp).ok());
+  EXPECT_EQ(resp.status().code(), proto::INVALID_ARGUMENT);
+  EXPECT_FALSE(block_store_->HasBlock(MakeBlockId(5, 0)));
+}
+
 TEST_F(WorkerServiceImplTest, AsyncCacheBlockRequiresConfig) {
   // Without config, AsyncCacheBlock should return error
   proto::AsyncCacheBlockRequest req;
@@ -137,4 +152,9 @@ TEST_F(WorkerServiceImplTest, GetWorkerStatus) {
   ASSERT_TRUE(status.ok());
   ASSERT_EQ(resp.status().code(), proto::OK);
   ASSERT_GT(resp.capacity_bytes(), 0u);
+  ASSERT_GT(resp.tiers_size(), 0);
+  // 0.5x, 1x, 2x and 4x the tier's capacity
+  ASSERT_EQ(resp.tiers(0).miss_ratio_curve_size(), 4);
+  EXPECT_EQ(resp.tiers(0).miss_ratio_curve(1).capacity_bytes(),
+            resp.tiers(0).capacity_bytes());
 }